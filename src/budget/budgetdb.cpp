@@ -8,8 +8,6 @@
 #include "chainparams.h"
 #include "clientversion.h"
 
-static const int BUDGET_DB_VERSION = 1;
-
 //
 // CBudgetDB
 //
@@ -20,38 +18,6 @@ CBudgetDB::CBudgetDB()
     strMagicMessage = "MasternodeBudget";
 }
 
-bool CBudgetDB::Write(const CBudgetManager& objToSave)
-{
-    int64_t nStart = GetTimeMillis();
-
-    // serialize, checksum data up to that point, then append checksum
-    CDataStream ssObj(SER_DISK, CLIENT_VERSION);
-    ssObj << BUDGET_DB_VERSION;
-    ssObj << strMagicMessage;                   // masternode cache file specific magic message
-    ssObj << Params().MessageStart(); // network specific magic number
-    ssObj << objToSave;
-    uint256 hash = Hash(ssObj.begin(), ssObj.end());
-    ssObj << hash;
-
-    // open output file, and associate with CAutoFile
-    FILE* file = fsbridge::fopen(pathDB, "wb");
-    CAutoFile fileout(file, SER_DISK, CLIENT_VERSION);
-    if (fileout.IsNull())
-        return error("%s : Failed to open file %s", __func__, pathDB.string());
-
-    // Write and commit header, data
-    try {
-        fileout << ssObj;
-    } catch (const std::exception& e) {
-        return error("%s : Serialize or I/O error - %s", __func__, e.what());
-    }
-    fileout.fclose();
-
-    LogPrint(BCLog::MNBUDGET,"Written info to budget.dat  %dms\n", GetTimeMillis() - nStart);
-
-    return true;
-}
-
 CBudgetDB::ReadResult CBudgetDB::Read(CBudgetManager& objToLoad, bool fDryRun)
 {
     int64_t nStart = GetTimeMillis();
@@ -134,14 +100,3 @@ CBudgetDB::ReadResult CBudgetDB::Read(CBudgetManager& objToLoad, bool fDryRun)
 
     return Ok;
 }
-
-void DumpBudgets(CBudgetManager& budgetman)
-{
-    int64_t nStart = GetTimeMillis();
-
-    CBudgetDB budgetdb;
-    LogPrint(BCLog::MNBUDGET,"Writing info to budget.dat...\n");
-    budgetdb.Write(budgetman);
-
-    LogPrint(BCLog::MNBUDGET,"Budget dump finished  %dms\n", GetTimeMillis() - nStart);
-}
@@ -9,10 +9,7 @@
 #include "budget/budgetmanager.h"
 #include "fs.h"
 
-void DumpBudgets(CBudgetManager& budgetman);
-
-
-/** Save Budget Manager (budget.dat)
+/** Legacy Budget Manager file (budget.dat), only read to import it in the tier two caches db
  */
 class CBudgetDB
 {
@@ -32,7 +29,6 @@ public:
     };
 
     CBudgetDB();
-    bool Write(const CBudgetManager& objToSave);
     ReadResult Read(CBudgetManager& objToLoad, bool fDryRun = false);
 };
 
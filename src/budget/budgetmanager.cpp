@@ -27,18 +27,20 @@ void CBudgetManager::CheckOrphanVotes()
     {
         LOCK(cs_votes);
         for (auto it = mapOrphanProposalVotes.begin(); it != mapOrphanProposalVotes.end();) {
-            if (UpdateProposal(it->second, nullptr, strError))
+            if (UpdateProposal(it->second, nullptr, strError)) {
+                dbOrphanProposalVotes.SetDirty(it->first);
                 it = mapOrphanProposalVotes.erase(it);
-            else
+            } else
                 ++it;
         }
     }
     {
         LOCK(cs_finalizedvotes);
         for (auto it = mapOrphanFinalizedBudgetVotes.begin(); it != mapOrphanFinalizedBudgetVotes.end();) {
-            if (UpdateFinalizedBudget(it->second, nullptr, strError))
+            if (UpdateFinalizedBudget(it->second, nullptr, strError)) {
+                dbOrphanFinalizedBudgetVotes.SetDirty(it->first);
                 it = mapOrphanFinalizedBudgetVotes.erase(it);
-            else
+            } else
                 ++it;
         }
     }
@@ -122,7 +124,8 @@ uint256 CBudgetManager::SubmitFinalBudget()
         const CWallet::CommitResult& res = vpwallets[0]->CommitTransaction(wtx, keyChange, g_connman.get());
         if (res.status == CWallet::CommitStatus::OK) {
             const uint256& collateraltxid = wtx->GetHash();
-            mapUnconfirmedFeeTx.emplace(budgetHash, collateraltxid);
+            WITH_LOCK(cs_budgets, mapUnconfirmedFeeTx.emplace(budgetHash, collateraltxid);
+                                  dbUnconfirmedFeeTx.SetDirty(budgetHash); );
             LogPrint(BCLog::MNBUDGET,"%s: Collateral sent. txid: %s\n", __func__, collateraltxid.ToString());
             return budgetHash;
         }
@@ -154,43 +157,6 @@ void CBudgetManager::SetBudgetProposalsStr(CFinalizedBudget& finalizedBudget) co
     finalizedBudget.SetProposalsStr(strProposals);
 }
 
-std::string CBudgetManager::GetFinalizedBudgetStatus(const uint256& nHash) const
-{
-    CFinalizedBudget fb;
-    if (!GetFinalizedBudget(nHash, fb))
-        return strprintf("ERROR: cannot find finalized budget %s\n", nHash.ToString());
-
-    std::string retBadHashes = "";
-    std::string retBadPayeeOrAmount = "";
-    int nBlockStart = fb.GetBlockStart();
-    int nBlockEnd = fb.GetBlockEnd();
-
-    for (int nBlockHeight = nBlockStart; nBlockHeight <= nBlockEnd; nBlockHeight++) {
-        CTxBudgetPayment budgetPayment;
-        if (!fb.GetBudgetPaymentByBlock(nBlockHeight, budgetPayment)) {
-            LogPrint(BCLog::MNBUDGET,"%s: Couldn't find budget payment for block %lld\n", __func__, nBlockHeight);
-            continue;
-        }
-
-        CBudgetProposal bp;
-        if (!GetProposal(budgetPayment.nProposalHash, bp)) {
-            retBadHashes += (retBadHashes == "" ? "" : ", ") + budgetPayment.nProposalHash.ToString();
-            continue;
-        }
-
-        if (bp.GetPayee() != budgetPayment.payee || bp.GetAmount() != budgetPayment.nAmount) {
-            retBadPayeeOrAmount += (retBadPayeeOrAmount == "" ? "" : ", ") + budgetPayment.nProposalHash.ToString();
-        }
-    }
-
-    if (retBadHashes == "" && retBadPayeeOrAmount == "") return "OK";
-
-    if (retBadHashes != "") retBadHashes = "Unknown proposal(s) hash! Check this proposal(s) before voting: " + retBadHashes;
-    if (retBadPayeeOrAmount != "") retBadPayeeOrAmount = "Budget payee/nAmount doesn't match our proposal(s)! "+ retBadPayeeOrAmount;
-
-    return retBadHashes + " -- " + retBadPayeeOrAmount;
-}
-
 bool CBudgetManager::AddFinalizedBudget(CFinalizedBudget& finalizedBudget)
 {
     AssertLockNotHeld(cs_budgets);    // need to lock cs_main here (CheckCollateral)
@@ -233,12 +199,15 @@ bool CBudgetManager::AddFinalizedBudget(CFinalizedBudget& finalizedBudget)
 void CBudgetManager::ForceAddFinalizedBudget(const uint256& nHash, const uint256& feeTxId, const CFinalizedBudget& finalizedBudget)
 {
     LOCK(cs_budgets);
-    mapFinalizedBudgets.emplace(nHash, finalizedBudget);
+    const auto& res = mapFinalizedBudgets.emplace(nHash, finalizedBudget);
+    SetFinalizedBudgetChanged(nHash);
+    SetFinalizedBudgetDirty(nHash, res.first->second);
     // Add to feeTx index
     mapFeeTxToBudget.emplace(feeTxId, nHash);
+    dbFeeTxToBudget.SetDirty(feeTxId);
     // Remove the budget from the unconfirmed map, if it was there
-    if (mapUnconfirmedFeeTx.count(nHash))
-        mapUnconfirmedFeeTx.erase(nHash);
+    if (mapUnconfirmedFeeTx.erase(nHash))
+        dbUnconfirmedFeeTx.SetDirty(nHash);
 }
 
 bool CBudgetManager::AddProposal(CBudgetProposal& budgetProposal)
@@ -274,9 +243,13 @@ bool CBudgetManager::AddProposal(CBudgetProposal& budgetProposal)
 
     {
         LOCK(cs_proposals);
-        mapProposals.emplace(nHash, budgetProposal);
+        const auto& res = mapProposals.emplace(nHash, budgetProposal);
+        fRankedProposalsDirty = true;
+        SetProposalChanged(nHash);
+        SetProposalDirty(nHash, res.first->second);
         // Add to feeTx index
         mapFeeTxToProposal.emplace(feeTxId, nHash);
+        dbFeeTxToProposal.SetDirty(feeTxId);
     }
     LogPrint(BCLog::MNBUDGET,"%s: budget proposal %s [%s] added\n", __func__, nHash.ToString(), budgetProposal.GetName());
 
@@ -286,26 +259,30 @@ bool CBudgetManager::AddProposal(CBudgetProposal& budgetProposal)
 void CBudgetManager::CheckAndRemove()
 {
     int nCurrentHeight = GetBestHeight();
-    std::map<uint256, CFinalizedBudget> tmpMapFinalizedBudgets;
-    std::map<uint256, CBudgetProposal> tmpMapProposals;
 
     // Check Proposals first
     {
         LOCK(cs_proposals);
         LogPrint(BCLog::MNBUDGET, "%s: mapProposals cleanup - size before: %d\n", __func__, mapProposals.size());
-        for (auto& it: mapProposals) {
-            CBudgetProposal* pbudgetProposal = &(it.second);
+        for (auto it = mapProposals.begin(); it != mapProposals.end(); ) {
+            CBudgetProposal* pbudgetProposal = &(it->second);
+            const std::string strWasInvalid = pbudgetProposal->IsInvalidReason();
             if (!pbudgetProposal->UpdateValid(nCurrentHeight)) {
-                LogPrint(BCLog::MNBUDGET,"%s: Invalid budget proposal %s %s\n", __func__, (it.first).ToString(), pbudgetProposal->IsInvalidLogStr());
+                LogPrint(BCLog::MNBUDGET,"%s: Invalid budget proposal %s %s\n", __func__, (it->first).ToString(), pbudgetProposal->IsInvalidLogStr());
                 mapFeeTxToProposal.erase(pbudgetProposal->GetFeeTXHash());
+                dbFeeTxToProposal.SetDirty(pbudgetProposal->GetFeeTXHash());
+                // Remove invalid entries in place (the proposals aren't copied with all their votes)
+                SetProposalChanged(it->first);
+                SetProposalDirty(it->first, *pbudgetProposal);
+                it = mapProposals.erase(it);
+                fRankedProposalsDirty = true;
             } else {
                  LogPrint(BCLog::MNBUDGET,"%s: Found valid budget proposal: %s %s\n", __func__,
                           pbudgetProposal->GetName(), pbudgetProposal->GetFeeTXHash().ToString());
-                 tmpMapProposals.emplace(pbudgetProposal->GetHash(), *pbudgetProposal);
+                 if (!strWasInvalid.empty()) SetProposalChanged(it->first);
+                 ++it;
             }
         }
-        // Remove invalid entries by overwriting complete map
-        mapProposals.swap(tmpMapProposals);
         LogPrint(BCLog::MNBUDGET, "%s: mapProposals cleanup - size after: %d\n", __func__, mapProposals.size());
     }
 
@@ -313,19 +290,23 @@ void CBudgetManager::CheckAndRemove()
     {
         LOCK(cs_budgets);
         LogPrint(BCLog::MNBUDGET, "%s: mapFinalizedBudgets cleanup - size before: %d\n", __func__, mapFinalizedBudgets.size());
-        for (auto& it: mapFinalizedBudgets) {
-            CFinalizedBudget* pfinalizedBudget = &(it.second);
+        for (auto it = mapFinalizedBudgets.begin(); it != mapFinalizedBudgets.end(); ) {
+            CFinalizedBudget* pfinalizedBudget = &(it->second);
+            const std::string strWasInvalid = pfinalizedBudget->IsInvalidReason();
             if (!pfinalizedBudget->UpdateValid(nCurrentHeight)) {
-                LogPrint(BCLog::MNBUDGET,"%s: Invalid finalized budget %s %s\n", __func__, (it.first).ToString(), pfinalizedBudget->IsInvalidLogStr());
+                LogPrint(BCLog::MNBUDGET,"%s: Invalid finalized budget %s %s\n", __func__, (it->first).ToString(), pfinalizedBudget->IsInvalidLogStr());
                 mapFeeTxToBudget.erase(pfinalizedBudget->GetFeeTXHash());
+                dbFeeTxToBudget.SetDirty(pfinalizedBudget->GetFeeTXHash());
+                SetFinalizedBudgetChanged(it->first);
+                SetFinalizedBudgetDirty(it->first, *pfinalizedBudget);
+                it = mapFinalizedBudgets.erase(it);
             } else {
                 LogPrint(BCLog::MNBUDGET,"%s: Found valid finalized budget: %s %s\n", __func__,
                           pfinalizedBudget->GetName(), pfinalizedBudget->GetFeeTXHash().ToString());
-                tmpMapFinalizedBudgets.emplace(pfinalizedBudget->GetHash(), *pfinalizedBudget);
+                if (!strWasInvalid.empty()) SetFinalizedBudgetChanged(it->first);
+                ++it;
             }
         }
-        // Remove invalid entries by overwriting complete map
-        mapFinalizedBudgets = tmpMapFinalizedBudgets;
         LogPrint(BCLog::MNBUDGET, "%s: mapFinalizedBudgets cleanup - size after: %d\n", __func__, mapFinalizedBudgets.size());
     }
     // Masternodes vote on valid ones
@@ -348,13 +329,17 @@ void CBudgetManager::RemoveByFeeTxId(const uint256& feeTxId)
                     LOCK(cs_votes);
                     for (const uint256& hash: p->GetVotesHashes()) {
                         mapSeenProposalVotes.erase(hash);
-                        mapOrphanProposalVotes.erase(hash);
+                        if (mapOrphanProposalVotes.erase(hash)) dbOrphanProposalVotes.SetDirty(hash);
                     }
                 }
                 // Erase proposal object
+                SetProposalDirty(it->second, *p);
                 mapProposals.erase(it->second);
+                fRankedProposalsDirty = true;
+                SetProposalChanged(it->second);
             }
             // Remove from collateral index
+            dbFeeTxToProposal.SetDirty(feeTxId);
             mapFeeTxToProposal.erase(it);
             return;
         }
@@ -373,13 +358,16 @@ void CBudgetManager::RemoveByFeeTxId(const uint256& feeTxId)
                     LOCK(cs_finalizedvotes);
                     for (const uint256& hash: b->GetVotesHashes()) {
                         mapSeenFinalizedBudgetVotes.erase(hash);
-                        mapOrphanFinalizedBudgetVotes.erase(hash);
+                        if (mapOrphanFinalizedBudgetVotes.erase(hash)) dbOrphanFinalizedBudgetVotes.SetDirty(hash);
                     }
                 }
                 // Erase finalized budget object
+                SetFinalizedBudgetDirty(it->second, *b);
                 mapFinalizedBudgets.erase(it->second);
+                SetFinalizedBudgetChanged(it->second);
             }
             // Remove from collateral index
+            dbFeeTxToBudget.SetDirty(feeTxId);
             mapFeeTxToBudget.erase(it);
         }
     }
@@ -508,6 +496,7 @@ void CBudgetManager::VoteOnFinalizedBudgets()
             // we only need to check this once
             if (pfb->IsAutoChecked()) continue;
             pfb->SetAutoChecked(true);
+            dbFinalizedBudgets.SetDirty(it.first);
             //only vote for exact matches
             if (strBudgetMode == "auto") {
                 // compare budget payements with winning proposals
@@ -548,25 +537,6 @@ CFinalizedBudget* CBudgetManager::FindFinalizedBudget(const uint256& nHash)
     return NULL;
 }
 
-const CBudgetProposal* CBudgetManager::FindProposalByName(const std::string& strProposalName) const
-{
-    LOCK(cs_proposals);
-
-    int64_t nYesCountMax = std::numeric_limits<int64_t>::min();
-    const CBudgetProposal* pbudgetProposal = nullptr;
-
-    for (const auto& it: mapProposals) {
-        const CBudgetProposal& proposal = it.second;
-        int64_t nYesCount = proposal.GetYeas() - proposal.GetNays();
-        if (proposal.GetName() == strProposalName && nYesCount > nYesCountMax) {
-            pbudgetProposal = &proposal;
-            nYesCountMax = nYesCount;
-        }
-    }
-
-    return pbudgetProposal;
-}
-
 CBudgetProposal* CBudgetManager::FindProposal(const uint256& nHash)
 {
     AssertLockHeld(cs_proposals);
@@ -653,92 +623,154 @@ TrxValidationStatus CBudgetManager::IsTransactionValid(const CTransaction& txNew
     return fThreshold ? TrxValidationStatus::InValid : TrxValidationStatus::VoteThreshold;
 }
 
-std::vector<CBudgetProposal*> CBudgetManager::GetAllProposals()
+std::vector<CBudgetProposal*> CBudgetManager::GetRankedProposals()
 {
-    LOCK(cs_proposals);
+    AssertLockHeld(cs_proposals);
 
-    std::vector<CBudgetProposal*> vBudgetProposalRet;
+    std::vector<CBudgetProposal*> vRet;
+    vRet.reserve(mapProposals.size());
+    if (!fRankedProposalsDirty && vRankedProposals.size() == mapProposals.size()) {
+        for (const uint256& nHash : vRankedProposals) {
+            auto it = mapProposals.find(nHash);
+            if (it == mapProposals.end()) break;
+            vRet.emplace_back(&it->second);
+        }
+        if (vRet.size() == mapProposals.size()) return vRet;
+        // proposals were replaced without going through the dirty flag. Sort them again.
+        vRet.clear();
+    }
 
     for (auto& it: mapProposals) {
-        CBudgetProposal* pbudgetProposal = &(it.second);
-        RemoveStaleVotesOnProposal(pbudgetProposal);
-        vBudgetProposalRet.push_back(pbudgetProposal);
+        vRet.emplace_back(&it.second);
     }
-
-    std::sort(vBudgetProposalRet.begin(), vBudgetProposalRet.end(), CBudgetProposal::PtrHigherYes);
-
-    return vBudgetProposalRet;
+    std::sort(vRet.begin(), vRet.end(), CBudgetProposal::PtrHigherYes);
+    vRankedProposals.clear();
+    vRankedProposals.reserve(vRet.size());
+    for (const CBudgetProposal* pbudgetProposal : vRet) {
+        vRankedProposals.emplace_back(pbudgetProposal->GetHash());
+    }
+    fRankedProposalsDirty = false;
+    return vRet;
 }
 
-std::vector<CBudgetProposal> CBudgetManager::GetBudget()
+// Selects the proposals (from vRanked, sorted by net yes count) paid with the next superblock after nHeight.
+// Returns them in order, with the amount allotted to each.
+template <typename ProposalPtr>
+static std::vector<std::pair<ProposalPtr, CAmount>> SelectBudgetProposals(const std::vector<ProposalPtr>& vRanked, int nHeight, bool fLog)
 {
-    LOCK(cs_proposals);
-
-    int nHeight = GetBestHeight();
-    if (nHeight <= 0)
-        return {};
-
-    // ------- Sort budgets by net Yes Count
-    std::vector<CBudgetProposal*> vBudgetPorposalsSort;
-    for (auto& it: mapProposals) {
-        RemoveStaleVotesOnProposal(&it.second);
-        vBudgetPorposalsSort.push_back(&it.second);
-    }
-    std::sort(vBudgetPorposalsSort.begin(), vBudgetPorposalsSort.end(), CBudgetProposal::PtrHigherYes);
-
-    // ------- Grab The Budgets In Order
-    std::vector<CBudgetProposal> vBudgetProposalsRet;
+    std::vector<std::pair<ProposalPtr, CAmount>> vRet;
     CAmount nBudgetAllocated = 0;
 
     const int nBlocksPerCycle = Params().GetConsensus().nBudgetCycleBlocks;
     int nBlockStart = nHeight - nHeight % nBlocksPerCycle + nBlocksPerCycle;
     int nBlockEnd = nBlockStart + nBlocksPerCycle - 1;
     int mnCount = mnodeman.CountEnabled(ActiveProtocol());
-    CAmount nTotalBudget = GetTotalBudget(nBlockStart);
+    CAmount nTotalBudget = CBudgetManager::GetTotalBudget(nBlockStart);
 
-    for (CBudgetProposal* pbudgetProposal: vBudgetPorposalsSort) {
-        LogPrint(BCLog::MNBUDGET,"%s: Processing Budget %s\n", __func__, pbudgetProposal->GetName());
+    for (const ProposalPtr& pbudgetProposal: vRanked) {
+        if (fLog) LogPrint(BCLog::MNBUDGET,"%s: Processing Budget %s\n", __func__, pbudgetProposal->GetName());
         //prop start/end should be inside this period
         if (pbudgetProposal->IsPassing(nBlockStart, nBlockEnd, mnCount)) {
-            LogPrint(BCLog::MNBUDGET,"%s:  -   Check 1 passed: valid=%d | %ld <= %ld | %ld >= %ld | Yeas=%d Nays=%d Count=%d | established=%d\n",
+            if (fLog) LogPrint(BCLog::MNBUDGET,"%s:  -   Check 1 passed: valid=%d | %ld <= %ld | %ld >= %ld | Yeas=%d Nays=%d Count=%d | established=%d\n",
                     __func__, pbudgetProposal->IsValid(), pbudgetProposal->GetBlockStart(), nBlockStart, pbudgetProposal->GetBlockEnd(),
                     nBlockEnd, pbudgetProposal->GetYeas(), pbudgetProposal->GetNays(), mnCount / 10, pbudgetProposal->IsEstablished());
 
             if (pbudgetProposal->GetAmount() + nBudgetAllocated <= nTotalBudget) {
-                pbudgetProposal->SetAllotted(pbudgetProposal->GetAmount());
                 nBudgetAllocated += pbudgetProposal->GetAmount();
-                vBudgetProposalsRet.emplace_back(*pbudgetProposal);
-                LogPrint(BCLog::MNBUDGET,"%s:  -     Check 2 passed: Budget added\n", __func__);
+                vRet.emplace_back(pbudgetProposal, pbudgetProposal->GetAmount());
+                if (fLog) LogPrint(BCLog::MNBUDGET,"%s:  -     Check 2 passed: Budget added\n", __func__);
             } else {
-                pbudgetProposal->SetAllotted(0);
-                LogPrint(BCLog::MNBUDGET,"%s:  -     Check 2 failed: no amount allotted\n", __func__);
+                if (fLog) LogPrint(BCLog::MNBUDGET,"%s:  -     Check 2 failed: no amount allotted\n", __func__);
             }
 
-        } else {
+        } else if (fLog) {
             LogPrint(BCLog::MNBUDGET,"%s:  -   Check 1 failed: valid=%d | %ld <= %ld | %ld >= %ld | Yeas=%d Nays=%d Count=%d | established=%d\n",
                     __func__, pbudgetProposal->IsValid(), pbudgetProposal->GetBlockStart(), nBlockStart, pbudgetProposal->GetBlockEnd(),
-                    nBlockEnd, pbudgetProposal->GetYeas(), pbudgetProposal->GetNays(), mnodeman.CountEnabled(ActiveProtocol()) / 10,
+                    nBlockEnd, pbudgetProposal->GetYeas(), pbudgetProposal->GetNays(), mnCount / 10,
                     pbudgetProposal->IsEstablished());
         }
 
     }
 
+    return vRet;
+}
+
+std::vector<CBudgetProposal> CBudgetManager::GetBudget()
+{
+    LOCK(cs_proposals);
+
+    int nHeight = GetBestHeight();
+    if (nHeight <= 0)
+        return {};
+
+    // ------- Grab The Budgets In Order (sorted by net Yes Count)
+    std::vector<CBudgetProposal> vBudgetProposalsRet;
+    for (const auto& p : SelectBudgetProposals(GetRankedProposals(), nHeight, true)) {
+        vBudgetProposalsRet.emplace_back(*p.first);
+        vBudgetProposalsRet.back().SetAllotted(p.second);
+    }
     return vBudgetProposalsRet;
 }
 
-std::vector<CFinalizedBudget*> CBudgetManager::GetFinalizedBudgets()
+void CBudgetManager::PublishSnapshot(bool fForce)
 {
-    LOCK(cs_budgets);
+    LOCK(cs_snapshot);
+    if (!fForce && !fSnapshotStale) return;
+    fSnapshotStale = false;
+
+    const std::shared_ptr<const CBudgetSnapshot> pOld = std::atomic_load(&pSnapshot);
+    auto snapshot = std::make_shared<CBudgetSnapshot>();
+    snapshot->nVersion = pOld ? pOld->nVersion + 1 : 1;
+    snapshot->nHeight = GetBestHeight();
 
-    std::vector<CFinalizedBudget*> vFinalizedBudgetsRet;
+    // Copy only the items changed since the last snapshot, and share the others with it
+    {
+        LOCK(cs_proposals);
+        const std::vector<CBudgetProposal*>& vRanked = GetRankedProposals();
+        snapshot->vProposals.reserve(vRanked.size());
+        for (size_t i = 0; i < vRanked.size(); i++) {
+            // vRankedProposals holds the hashes of vRanked, in the same order
+            const uint256& nHash = vRankedProposals[i];
+            std::shared_ptr<const CBudgetProposal> p;
+            if (pOld && !setSnapshotChangedProposals.count(nHash)) {
+                auto it = pOld->mapProposals.find(nHash);
+                if (it != pOld->mapProposals.end()) p = it->second;
+            }
+            if (!p) p = std::make_shared<const CBudgetProposal>(*vRanked[i]);
+            snapshot->vProposals.emplace_back(p);
+            snapshot->mapProposals.emplace(nHash, p);
+        }
+        setSnapshotChangedProposals.clear();
+    }
+    if (snapshot->nHeight > 0) {
+        snapshot->vProjection = SelectBudgetProposals(snapshot->vProposals, snapshot->nHeight, false);
+    }
 
-    // ------- Grab The Budgets In Order
-    for (auto& it: mapFinalizedBudgets) {
-        vFinalizedBudgetsRet.push_back(&(it.second));
+    {
+        LOCK(cs_budgets);
+        for (const auto& it : mapFinalizedBudgets) {
+            std::shared_ptr<const CFinalizedBudget> fb;
+            if (pOld && !setSnapshotChangedBudgets.count(it.first)) {
+                fb = pOld->FindFinalizedBudget(it.first);
+            }
+            if (!fb) fb = std::make_shared<const CFinalizedBudget>(it.second);
+            snapshot->vFinalizedBudgets.emplace_back(fb);
+            snapshot->mapFinalizedBudgets.emplace(it.first, fb);
+        }
+        setSnapshotChangedBudgets.clear();
     }
-    std::sort(vFinalizedBudgetsRet.begin(), vFinalizedBudgetsRet.end(), CFinalizedBudget::PtrGreater);
+    std::sort(snapshot->vFinalizedBudgets.begin(), snapshot->vFinalizedBudgets.end(),
+              [](const std::shared_ptr<const CFinalizedBudget>& a, const std::shared_ptr<const CFinalizedBudget>& b) {
+                  return *a > *b;
+              });
 
-    return vFinalizedBudgetsRet;
+    std::atomic_store(&pSnapshot, std::shared_ptr<const CBudgetSnapshot>(std::move(snapshot)));
+}
+
+std::shared_ptr<const CBudgetSnapshot> CBudgetManager::GetSnapshot() const
+{
+    std::shared_ptr<const CBudgetSnapshot> p = std::atomic_load(&pSnapshot);
+    return p ? p : std::make_shared<const CBudgetSnapshot>();
 }
 
 std::string CBudgetManager::GetRequiredPaymentsString(int nBlockHeight)
@@ -797,19 +829,25 @@ void CBudgetManager::RemoveStaleVotesOnProposal(CBudgetProposal* prop)
     LogPrint(BCLog::MNBUDGET, "Cleaning proposal votes for %s. Before: YES=%d, NO=%d\n",
             prop->GetName(), prop->GetYeas(), prop->GetNays());
 
-    auto it = prop->mapVotes.begin();
-    while (it != prop->mapVotes.end()) {
-        auto mnList = deterministicMNManager->GetListAtChainTip();
-        auto dmn = mnList.GetMNByCollateral(it->first);
+    auto mnList = deterministicMNManager->GetListAtChainTip();
+    bool fChanged = false;
+    for (auto& it : prop->mapVotes) {
+        bool fVoteValid;
+        auto dmn = mnList.GetMNByCollateral(it.first);
         if (dmn) {
-            (*it).second.SetValid(mnList.IsMNValid(dmn));
+            fVoteValid = mnList.IsMNValid(dmn);
         } else {
             // -- Legacy System (!TODO: remove after enforcement) --
-            CMasternode* pmn = mnodeman.Find(it->first);
-            (*it).second.SetValid(pmn && pmn->IsEnabled());
+            CMasternode* pmn = mnodeman.Find(it.first);
+            fVoteValid = pmn && pmn->IsEnabled();
+        }
+        // the tallies (and the ranking) change only if the vote changed validity
+        if (prop->SetVoteValid(it.second, fVoteValid)) {
+            fRankedProposalsDirty = true;
+            fChanged = true;
         }
-        ++it;
     }
+    if (fChanged) SetProposalChanged(prop->GetHash());
 
     LogPrint(BCLog::MNBUDGET, "Cleaned proposal votes for %s. After: YES=%d, NO=%d\n",
             prop->GetName(), prop->GetYeas(), prop->GetNays());
@@ -821,19 +859,22 @@ void CBudgetManager::RemoveStaleVotesOnFinalBudget(CFinalizedBudget* fbud)
     LogPrint(BCLog::MNBUDGET, "Cleaning finalized budget votes for [%s (%s)]. Before: %d\n",
             fbud->GetName(), fbud->GetProposalsStr(), fbud->GetVoteCount());
 
-    auto it = fbud->mapVotes.begin();
-    while (it != fbud->mapVotes.end()) {
-        auto mnList = deterministicMNManager->GetListAtChainTip();
-        auto dmn = mnList.GetMNByCollateral(it->first);
+    auto mnList = deterministicMNManager->GetListAtChainTip();
+    bool fChanged = false;
+    for (auto& it : fbud->mapVotes) {
+        bool fVoteValid;
+        auto dmn = mnList.GetMNByCollateral(it.first);
         if (dmn) {
-            (*it).second.SetValid(mnList.IsMNValid(dmn));
+            fVoteValid = mnList.IsMNValid(dmn);
         } else {
             // -- Legacy System (!TODO: remove after enforcement) --
-            CMasternode* pmn = mnodeman.Find(it->first);
-            (*it).second.SetValid(pmn && pmn->IsEnabled());
+            CMasternode* pmn = mnodeman.Find(it.first);
+            fVoteValid = pmn && pmn->IsEnabled();
         }
-        ++it;
+        fChanged |= (it.second.IsValid() != fVoteValid);
+        it.second.SetValid(fVoteValid);
     }
+    if (fChanged) SetFinalizedBudgetChanged(fbud->GetHash());
     LogPrint(BCLog::MNBUDGET, "Cleaned finalized budget votes for [%s (%s)]. After: %d\n",
             fbud->GetName(), fbud->GetProposalsStr(), fbud->GetVoteCount());
 }
@@ -873,6 +914,8 @@ bool CBudgetManager::AddAndRelayProposalVote(const CBudgetVote& vote, std::strin
     if (UpdateProposal(vote, nullptr, strError)) {
         AddSeenProposalVote(vote);
         vote.Relay();
+        // local votes are visible right away
+        PublishSnapshot();
         return true;
     }
     return false;
@@ -881,7 +924,14 @@ bool CBudgetManager::AddAndRelayProposalVote(const CBudgetVote& vote, std::strin
 void CBudgetManager::NewBlock(int height)
 {
     SetBestHeight(height);
+    CheckBudgetsOnNewBlock();
+    // the projection depends on the height, and the snapshot must not show the
+    // stale votes and the budgets removed above
+    PublishSnapshot(true);
+}
 
+void CBudgetManager::CheckBudgetsOnNewBlock()
+{
     if (masternodeSync.RequestedMasternodeAssets <= MASTERNODE_SYNC_BUDGET) return;
 
     if (strBudgetMode == "suggest") { //suggest the budget we see
@@ -908,10 +958,20 @@ void CBudgetManager::NewBlock(int height)
         MarkSynced();
     }
 
+    //remove invalid (from non-active masternode) votes once in a while.
+    //Done before CheckAndRemove, so that the heavily downvoted check and the budget voted by
+    //the masternodes use fresh tallies (the budget RPCs don't refresh them anymore)
+    {
+        LOCK(cs_proposals);
+        LogPrint(BCLog::MNBUDGET,"%s:  mapProposals cleanup - size: %d\n", __func__, mapProposals.size());
+        for (auto& it: mapProposals) {
+            RemoveStaleVotesOnProposal(&it.second);
+        }
+    }
+
     // remove expired/heavily downvoted budgets
     CheckAndRemove();
 
-    //remove invalid (from non-active masternode) votes once in a while
     LogPrint(BCLog::MNBUDGET,"%s:  askedForSourceProposalOrBudget cleanup - size: %d\n", __func__, askedForSourceProposalOrBudget.size());
     for (auto it = askedForSourceProposalOrBudget.begin(); it !=  askedForSourceProposalOrBudget.end(); ) {
         if (it->second <= GetTime() - (60 * 60 * 24)) {
@@ -920,13 +980,6 @@ void CBudgetManager::NewBlock(int height)
             it++;
         }
     }
-    {
-        LOCK(cs_proposals);
-        LogPrint(BCLog::MNBUDGET,"%s:  mapProposals cleanup - size: %d\n", __func__, mapProposals.size());
-        for (auto& it: mapProposals) {
-            RemoveStaleVotesOnProposal(&it.second);
-        }
-    }
     {
         LOCK(cs_budgets);
         LogPrint(BCLog::MNBUDGET,"%s:  mapFinalizedBudgets cleanup - size: %d\n", __func__, mapFinalizedBudgets.size());
@@ -937,8 +990,13 @@ void CBudgetManager::NewBlock(int height)
     LogPrint(BCLog::MNBUDGET,"%s:  PASSED\n", __func__);
 }
 
-int CBudgetManager::ProcessBudgetVoteSync(const uint256& nProp, CNode* pfrom)
+int CBudgetManager::ProcessBudgetVoteSync(const uint256& nProp, CNode* pfrom, const std::vector<CBudgetVotesDigest>& vPeerDigests)
 {
+    if (vPeerDigests.size() > MAX_BUDGET_VOTES_DIGESTS) {
+        LogPrint(BCLog::MNBUDGET, "mnvs - too many digests (%d) from peer %i\n", vPeerDigests.size(), pfrom->GetId());
+        return 20;
+    }
+
     if (Params().NetworkIDString() == CBaseChainParams::MAIN) {
         if (nProp.IsNull()) {
             if (pfrom->HasFulfilledRequest("budgetvotesync")) {
@@ -949,8 +1007,12 @@ int CBudgetManager::ProcessBudgetVoteSync(const uint256& nProp, CNode* pfrom)
         }
     }
 
-    Sync(pfrom, nProp);
-    LogPrint(BCLog::MNBUDGET, "mnvs - Sent Masternode votes to peer %i\n", pfrom->GetId());
+    std::map<uint256, CBudgetVotesDigest> mapPeerDigests;
+    for (const CBudgetVotesDigest& digest : vPeerDigests) {
+        if (digest.IsValid()) mapPeerDigests.emplace(digest.nHash, digest);
+    }
+    Sync(pfrom, nProp, false, mapPeerDigests);
+    LogPrint(BCLog::MNBUDGET, "mnvs - Sent Masternode votes to peer %i (%d digests)\n", pfrom->GetId(), mapPeerDigests.size());
     return 0;
 }
 
@@ -1162,7 +1224,13 @@ int CBudgetManager::ProcessMessageInner(CNode* pfrom, std::string& strCommand, C
         // Masternode vote sync
         uint256 nProp;
         vRecv >> nProp;
-        return ProcessBudgetVoteSync(nProp, pfrom);
+        // newer peers append the digests of the votes they already have.
+        // (older peers ignore them, and answer with all the votes)
+        std::vector<CBudgetVotesDigest> vPeerDigests;
+        if (!vRecv.empty()) {
+            vRecv >> vPeerDigests;
+        }
+        return ProcessBudgetVoteSync(nProp, pfrom, vPeerDigests);
     }
 
     if (strCommand == NetMsgType::BUDGETPROPOSAL) {
@@ -1241,7 +1309,29 @@ void CBudgetManager::SetSynced(bool synced)
     }
 }
 
-void CBudgetManager::Sync(CNode* pfrom, const uint256& nProp, bool fPartial)
+std::vector<CBudgetVotesDigest> CBudgetManager::GetVotesDigests() const
+{
+    std::vector<CBudgetVotesDigest> vDigests;
+    {
+        LOCK(cs_proposals);
+        for (const auto& it: mapProposals) {
+            vDigests.emplace_back(it.second.GetVotesDigest());
+        }
+    }
+    {
+        LOCK(cs_budgets);
+        for (const auto& it: mapFinalizedBudgets) {
+            vDigests.emplace_back(it.second.GetVotesDigest());
+        }
+    }
+    if (vDigests.size() > MAX_BUDGET_VOTES_DIGESTS) {
+        // let the peer send us everything
+        vDigests.clear();
+    }
+    return vDigests;
+}
+
+void CBudgetManager::Sync(CNode* pfrom, const uint256& nProp, bool fPartial, const std::map<uint256, CBudgetVotesDigest>& mapPeerDigests)
 {
     CNetMsgMaker msgMaker(pfrom->GetSendVersion());
     int nInvCount = 0;
@@ -1252,7 +1342,8 @@ void CBudgetManager::Sync(CNode* pfrom, const uint256& nProp, bool fPartial)
             if (pbudgetProposal && pbudgetProposal->IsValid() && (nProp.IsNull() || it.first == nProp)) {
                 pfrom->PushInventory(CInv(MSG_BUDGET_PROPOSAL, it.second.GetHash()));
                 nInvCount++;
-                pbudgetProposal->SyncVotes(pfrom, fPartial, nInvCount);
+                auto itDigest = mapPeerDigests.find(it.first);
+                pbudgetProposal->SyncVotes(pfrom, fPartial, nInvCount, itDigest != mapPeerDigests.end() ? &itDigest->second : nullptr);
             }
         }
     }
@@ -1267,7 +1358,8 @@ void CBudgetManager::Sync(CNode* pfrom, const uint256& nProp, bool fPartial)
             if (pfinalizedBudget && pfinalizedBudget->IsValid() && (nProp.IsNull() || it.first == nProp)) {
                 pfrom->PushInventory(CInv(MSG_BUDGET_FINALIZED, it.second.GetHash()));
                 nInvCount++;
-                pfinalizedBudget->SyncVotes(pfrom, fPartial, nInvCount);
+                auto itDigest = mapPeerDigests.find(it.first);
+                pfinalizedBudget->SyncVotes(pfrom, fPartial, nInvCount, itDigest != mapPeerDigests.end() ? &itDigest->second : nullptr);
             }
         }
     }
@@ -1287,7 +1379,8 @@ bool CBudgetManager::UpdateProposal(const CBudgetVote& vote, CNode* pfrom, std::
             if (!masternodeSync.IsSynced()) return false;
 
             LogPrint(BCLog::MNBUDGET,"%s: Unknown proposal %d, asking for source proposal\n", __func__, nProposalHash.ToString());
-            WITH_LOCK(cs_votes, mapOrphanProposalVotes[nProposalHash] = vote; );
+            WITH_LOCK(cs_votes, mapOrphanProposalVotes[nProposalHash] = vote;
+                                dbOrphanProposalVotes.SetDirty(nProposalHash); );
 
             if (!askedForSourceProposalOrBudget.count(nProposalHash)) {
                 g_connman->PushMessage(pfrom, CNetMsgMaker(pfrom->GetSendVersion()).Make(NetMsgType::BUDGETVOTESYNC, nProposalHash));
@@ -1300,7 +1393,13 @@ bool CBudgetManager::UpdateProposal(const CBudgetVote& vote, CNode* pfrom, std::
     }
 
 
-    return mapProposals[nProposalHash].AddOrUpdateVote(vote, strError);
+    if (!mapProposals[nProposalHash].AddOrUpdateVote(vote, strError)) {
+        return false;
+    }
+    dbProposalVotes.SetDirty(std::make_pair(nProposalHash, vote.GetVin().prevout));
+    fRankedProposalsDirty = true;
+    SetProposalChanged(nProposalHash);
+    return true;
 }
 
 bool CBudgetManager::UpdateFinalizedBudget(CFinalizedBudgetVote& vote, CNode* pfrom, std::string& strError)
@@ -1315,7 +1414,8 @@ bool CBudgetManager::UpdateFinalizedBudget(CFinalizedBudgetVote& vote, CNode* pf
             if (!masternodeSync.IsSynced()) return false;
 
             LogPrint(BCLog::MNBUDGET,"%s: Unknown Finalized Proposal %s, asking for source budget\n", __func__, nBudgetHash.ToString());
-            WITH_LOCK(cs_finalizedvotes, mapOrphanFinalizedBudgetVotes[nBudgetHash] = vote; );
+            WITH_LOCK(cs_finalizedvotes, mapOrphanFinalizedBudgetVotes[nBudgetHash] = vote;
+                                         dbOrphanFinalizedBudgetVotes.SetDirty(nBudgetHash); );
 
             if (!askedForSourceProposalOrBudget.count(nBudgetHash)) {
                 g_connman->PushMessage(pfrom, CNetMsgMaker(pfrom->GetSendVersion()).Make(NetMsgType::BUDGETVOTESYNC, nBudgetHash));
@@ -1327,7 +1427,141 @@ bool CBudgetManager::UpdateFinalizedBudget(CFinalizedBudgetVote& vote, CNode* pf
         return false;
     }
     LogPrint(BCLog::MNBUDGET,"%s: Finalized Proposal %s added\n", __func__, nBudgetHash.ToString());
-    return mapFinalizedBudgets[nBudgetHash].AddOrUpdateVote(vote, strError);
+    if (!mapFinalizedBudgets[nBudgetHash].AddOrUpdateVote(vote, strError)) {
+        return false;
+    }
+    dbFinalizedBudgetVotes.SetDirty(std::make_pair(nBudgetHash, vote.GetVin().prevout));
+    SetFinalizedBudgetChanged(nBudgetHash);
+    return true;
+}
+
+size_t CBudgetManager::WriteDBChanges(CDBBatch& batch)
+{
+    size_t nChanged = 0;
+    {
+        LOCK(cs_budgets);
+        nChanged += dbFinalizedBudgets.WriteChanges(batch, mapFinalizedBudgets);
+        nChanged += dbFinalizedBudgetVotes.WriteDirty(batch, [this](const std::pair<uint256, COutPoint>& key) -> const CFinalizedBudgetVote* {
+            const auto it = mapFinalizedBudgets.find(key.first);
+            if (it == mapFinalizedBudgets.end()) return nullptr;
+            const auto itVote = it->second.mapVotes.find(key.second);
+            return itVote != it->second.mapVotes.end() ? &itVote->second : nullptr;
+        });
+        nChanged += dbFeeTxToBudget.WriteChanges(batch, mapFeeTxToBudget);
+        nChanged += dbUnconfirmedFeeTx.WriteChanges(batch, mapUnconfirmedFeeTx);
+    }
+    {
+        LOCK(cs_proposals);
+        nChanged += dbProposals.WriteChanges(batch, mapProposals);
+        nChanged += dbProposalVotes.WriteDirty(batch, [this](const std::pair<uint256, COutPoint>& key) -> const CBudgetVote* {
+            const auto it = mapProposals.find(key.first);
+            if (it == mapProposals.end()) return nullptr;
+            const auto itVote = it->second.mapVotes.find(key.second);
+            return itVote != it->second.mapVotes.end() ? &itVote->second : nullptr;
+        });
+        nChanged += dbFeeTxToProposal.WriteChanges(batch, mapFeeTxToProposal);
+    }
+    {
+        LOCK(cs_finalizedvotes);
+        nChanged += dbOrphanFinalizedBudgetVotes.WriteChanges(batch, mapOrphanFinalizedBudgetVotes);
+    }
+    {
+        LOCK(cs_votes);
+        nChanged += dbOrphanProposalVotes.WriteChanges(batch, mapOrphanProposalVotes);
+    }
+    return nChanged;
+}
+
+void CBudgetManager::DBChangesWritten()
+{
+    dbFinalizedBudgets.ChangesWritten();
+    dbFinalizedBudgetVotes.ChangesWritten();
+    dbFeeTxToBudget.ChangesWritten();
+    dbUnconfirmedFeeTx.ChangesWritten();
+    dbProposals.ChangesWritten();
+    dbProposalVotes.ChangesWritten();
+    dbFeeTxToProposal.ChangesWritten();
+    dbOrphanFinalizedBudgetVotes.ChangesWritten();
+    dbOrphanProposalVotes.ChangesWritten();
+}
+
+bool CBudgetManager::LoadFromDB(CDBWrapper& db)
+{
+    std::map<std::pair<uint256, COutPoint>, CBudgetVote> mapProposalVotes;
+    std::map<std::pair<uint256, COutPoint>, CFinalizedBudgetVote> mapFinalizedBudgetVotes;
+    if (!dbFinalizedBudgets.Load(db, mapFinalizedBudgets, cs_budgets) ||
+        !dbFinalizedBudgetVotes.Read(db, mapFinalizedBudgetVotes) ||
+        !dbFeeTxToBudget.Load(db, mapFeeTxToBudget, cs_budgets) ||
+        !dbUnconfirmedFeeTx.Load(db, mapUnconfirmedFeeTx, cs_budgets) ||
+        !dbProposals.Load(db, mapProposals, cs_proposals) ||
+        !dbProposalVotes.Read(db, mapProposalVotes) ||
+        !dbFeeTxToProposal.Load(db, mapFeeTxToProposal, cs_proposals) ||
+        !dbOrphanFinalizedBudgetVotes.Load(db, mapOrphanFinalizedBudgetVotes, cs_finalizedvotes) ||
+        !dbOrphanProposalVotes.Load(db, mapOrphanProposalVotes, cs_votes)) {
+        // discard the cached data, it will be written again with the next flush
+        dbFinalizedBudgets.Wipe(db);
+        dbFinalizedBudgetVotes.Wipe(db);
+        dbFeeTxToBudget.Wipe(db);
+        dbUnconfirmedFeeTx.Wipe(db);
+        dbProposals.Wipe(db);
+        dbProposalVotes.Wipe(db);
+        dbFeeTxToProposal.Wipe(db);
+        dbOrphanFinalizedBudgetVotes.Wipe(db);
+        dbOrphanProposalVotes.Wipe(db);
+        SetDBDirty();
+        return false;
+    }
+
+    // Add the votes to their budget items, keeping the ones received meanwhile (the votes left alone are erased)
+    {
+        LOCK(cs_budgets);
+        for (auto& it : mapFinalizedBudgetVotes) {
+            auto itBudget = mapFinalizedBudgets.find(it.first.first);
+            if (itBudget == mapFinalizedBudgets.end()) {
+                dbFinalizedBudgetVotes.SetDirty(it.first);
+                continue;
+            }
+            if (itBudget->second.mapVotes.emplace(it.first.second, std::move(it.second)).second) {
+                SetFinalizedBudgetChanged(itBudget->first);
+            }
+        }
+    }
+    {
+        LOCK(cs_proposals);
+        for (auto& it : mapProposalVotes) {
+            auto itProp = mapProposals.find(it.first.first);
+            if (itProp == mapProposals.end()) {
+                dbProposalVotes.SetDirty(it.first);
+                continue;
+            }
+            if (itProp->second.mapVotes.emplace(it.first.second, std::move(it.second)).second) {
+                SetProposalChanged(itProp->first);
+            }
+        }
+        for (auto& it : mapProposals) {
+            it.second.RecountVotes();
+        }
+        fRankedProposalsDirty = true;
+    }
+    fSnapshotStale = true;
+    return true;
+}
+
+void CBudgetManager::SetDBDirty()
+{
+    {
+        LOCK(cs_budgets);
+        for (const auto& it : mapFinalizedBudgets) SetFinalizedBudgetDirty(it.first, it.second);
+        dbFeeTxToBudget.SetAllDirty(mapFeeTxToBudget);
+        dbUnconfirmedFeeTx.SetAllDirty(mapUnconfirmedFeeTx);
+    }
+    {
+        LOCK(cs_proposals);
+        for (const auto& it : mapProposals) SetProposalDirty(it.first, it.second);
+        dbFeeTxToProposal.SetAllDirty(mapFeeTxToProposal);
+    }
+    WITH_LOCK(cs_finalizedvotes, dbOrphanFinalizedBudgetVotes.SetAllDirty(mapOrphanFinalizedBudgetVotes); );
+    WITH_LOCK(cs_votes, dbOrphanProposalVotes.SetAllDirty(mapOrphanProposalVotes); );
 }
 
 std::string CBudgetManager::ToString() const
@@ -7,10 +7,15 @@
 #define BUDGET_MANAGER_H
 
 #include "budget/budgetproposal.h"
+#include "budget/budgetsnapshot.h"
 #include "budget/finalizedbudget.h"
+#include "tiertwo_cachedb.h"
 
 class CValidationState;
 
+/** Interval between two publications of the budget snapshot (if anything changed), in seconds */
+static const int64_t BUDGET_SNAPSHOT_INTERVAL = 1;
+
 //
 // Budget Manager : Contains all proposals for the budget
 //
@@ -35,7 +40,49 @@ protected:
     std::map<uint256, CFinalizedBudgetVote> mapOrphanFinalizedBudgetVotes;  // guarded by cs_finalizedvotes
 
     // Memory Only. Updated in NewBlock (blocks arrive in order)
-    std::atomic<int> nBestHeight;
+    std::atomic<int> nBestHeight{0};
+
+    // Memory Only. Proposal hashes sorted by net yes count (see CBudgetProposal::PtrHigherYes).
+    // Kept across blocks, and sorted again only after a proposal, or its vote tallies, changed.
+    std::vector<uint256> vRankedProposals;                                  // guarded by cs_proposals
+    bool fRankedProposalsDirty{true};                                       // guarded by cs_proposals
+    // Returns pointers to the proposals sorted by net yes count. Needs cs_proposals locked.
+    std::vector<CBudgetProposal*> GetRankedProposals();
+
+    // Memory Only. Snapshot read by the RPC (see CBudgetSnapshot). Accessed with std::atomic_load/store.
+    std::shared_ptr<const CBudgetSnapshot> pSnapshot;
+    // Items modified (or removed) since they were copied in the published snapshot
+    std::set<uint256> setSnapshotChangedProposals;                          // guarded by cs_proposals
+    std::set<uint256> setSnapshotChangedBudgets;                            // guarded by cs_budgets
+    // Whether anything changed since the snapshot was published
+    std::atomic<bool> fSnapshotStale{true};
+    // Serializes the snapshot publishers (the readers don't lock)
+    Mutex cs_snapshot;
+    void SetProposalChanged(const uint256& nHash) { setSnapshotChangedProposals.emplace(nHash); fSnapshotStale = true; }
+    void SetFinalizedBudgetChanged(const uint256& nHash) { setSnapshotChangedBudgets.emplace(nHash); fSnapshotStale = true; }
+    // Mark a proposal (or finalized budget) added or removed, with its votes, to write with the next flush
+    void SetProposalDirty(const uint256& nHash, const CBudgetProposal& prop)
+    {
+        dbProposals.SetDirty(nHash);
+        for (const auto& it : prop.mapVotes) dbProposalVotes.SetDirty(std::make_pair(nHash, it.first));
+    }
+    void SetFinalizedBudgetDirty(const uint256& nHash, const CFinalizedBudget& fbud)
+    {
+        dbFinalizedBudgets.SetDirty(nHash);
+        for (const auto& it : fbud.mapVotes) dbFinalizedBudgetVotes.SetDirty(std::make_pair(nHash, it.first));
+    }
+
+    // Incremental persistence of the maps above (the seen votes are not persisted).
+    // The votes of the proposals and finalized budgets have their own tables, keyed by (hash, voter).
+    CTierTwoDBTable<uint256, CBudgetProposal, CBudgetProposal::NoVotes> dbProposals{DB_BUDGET_PROPOSALS};
+    CTierTwoDBTable<std::pair<uint256, COutPoint>, CBudgetVote> dbProposalVotes{DB_BUDGET_PROPOSAL_VOTES};
+    CTierTwoDBTable<uint256, uint256> dbFeeTxToProposal{DB_BUDGET_FEETX_TO_PROPOSAL};
+    CTierTwoDBTable<uint256, CBudgetVote> dbOrphanProposalVotes{DB_BUDGET_ORPHAN_PROPOSAL_VOTES};
+    CTierTwoDBTable<uint256, CFinalizedBudget, CFinalizedBudget::NoVotes> dbFinalizedBudgets{DB_BUDGET_FINALIZED};
+    CTierTwoDBTable<std::pair<uint256, COutPoint>, CFinalizedBudgetVote> dbFinalizedBudgetVotes{DB_BUDGET_FINALIZED_VOTES};
+    CTierTwoDBTable<uint256, uint256> dbFeeTxToBudget{DB_BUDGET_FEETX_TO_FINALIZED};
+    CTierTwoDBTable<uint256, uint256> dbUnconfirmedFeeTx{DB_BUDGET_UNCONFIRMED_FEETX};
+    CTierTwoDBTable<uint256, CFinalizedBudgetVote> dbOrphanFinalizedBudgetVotes{DB_BUDGET_ORPHAN_FINALIZED_VOTES};
 
     // Returns a const pointer to the budget with highest vote count
     const CFinalizedBudget* GetBudgetWithHighestVoteCount(int chainHeight) const;
@@ -44,6 +91,8 @@ protected:
     bool GetPayeeAndAmount(int chainHeight, CScript& payeeRet, CAmount& nAmountRet) const;
     // Marks synced all votes in proposals and finalized budgets
     void SetSynced(bool synced);
+    // Budget submission, incremental sync and cleanup done at each block (see NewBlock)
+    void CheckBudgetsOnNewBlock();
 
 public:
     // critical sections to protect the inner data structures (must be locked in this order)
@@ -82,13 +131,12 @@ public:
     // sets strProposal of a CFinalizedBudget reference
     void SetBudgetProposalsStr(CFinalizedBudget& finalizedBudget) const;
 
-    // checks finalized budget proposals (existence, payee, amount) for the finalized budget
-    // in the map, with given nHash. Returns error string if any, or "OK" otherwise
-    std::string GetFinalizedBudgetStatus(const uint256& nHash) const;
-
     void ResetSync() { SetSynced(false); }
     void MarkSynced() { SetSynced(true); }
-    void Sync(CNode* node, const uint256& nProp, bool fPartial = false);
+    // mapPeerDigests: digests of the votes the peer already has (see CBudgetVotesDigest)
+    void Sync(CNode* node, const uint256& nProp, bool fPartial = false, const std::map<uint256, CBudgetVotesDigest>& mapPeerDigests = {});
+    // Digests of the votes of all the proposals and finalized budgets, appended to the budget sync requests
+    std::vector<CBudgetVotesDigest> GetVotesDigests() const;
     void SetBestHeight(int height) { nBestHeight.store(height, std::memory_order_release); };
     int GetBestHeight() const { return nBestHeight.load(std::memory_order_acquire); }
 
@@ -97,7 +145,7 @@ public:
     int ProcessMessageInner(CNode* pfrom, std::string& strCommand, CDataStream& vRecv);
     void NewBlock(int height);
 
-    int ProcessBudgetVoteSync(const uint256& nProp, CNode* pfrom);
+    int ProcessBudgetVoteSync(const uint256& nProp, CNode* pfrom, const std::vector<CBudgetVotesDigest>& vPeerDigests = {});
     int ProcessProposal(CBudgetProposal& proposal);
     int ProcessFinalizedBudget(CFinalizedBudget& finalbudget);
 
@@ -110,13 +158,16 @@ public:
     // const functions, copying the budget object to a reference and returning true if found
     bool GetProposal(const uint256& nHash, CBudgetProposal& bp) const;
     bool GetFinalizedBudget(const uint256& nHash, CFinalizedBudget& fb) const;
-    // finds the proposal with the given name, with highest net yes count.
-    const CBudgetProposal* FindProposalByName(const std::string& strProposalName) const;
+
+    // Publishes a new snapshot for the readers, if anything changed since the last one (or if fForce).
+    // Called after each block, and periodically for the votes received meanwhile.
+    void PublishSnapshot(bool fForce = false);
+    // Returns the last published snapshot. Lock free, and never blocks the vote processing.
+    std::shared_ptr<const CBudgetSnapshot> GetSnapshot() const;
 
     static CAmount GetTotalBudget(int nHeight);
+    // Proposals paid with the next superblock (copies, with the allotted amount set)
     std::vector<CBudgetProposal> GetBudget();
-    std::vector<CBudgetProposal*> GetAllProposals();
-    std::vector<CFinalizedBudget*> GetFinalizedBudgets();
     bool GetExpectedPayeeAmount(int chainHeight, CAmount& nAmountRet) const;
     bool IsBudgetPaymentBlock(int nBlockHeight) const;
     bool IsBudgetPaymentBlock(int nBlockHeight, int& nCountThreshold) const;
@@ -139,22 +190,37 @@ public:
     {
         {
             LOCK(cs_proposals);
+            for (const auto& it : mapProposals) {
+                SetProposalChanged(it.first);
+                SetProposalDirty(it.first, it.second);
+            }
+            for (const auto& it : mapFeeTxToProposal) dbFeeTxToProposal.SetDirty(it.first);
             mapProposals.clear();
             mapFeeTxToProposal.clear();
+            vRankedProposals.clear();
+            fRankedProposalsDirty = true;
         }
         {
             LOCK(cs_budgets);
+            for (const auto& it : mapFinalizedBudgets) {
+                SetFinalizedBudgetChanged(it.first);
+                SetFinalizedBudgetDirty(it.first, it.second);
+            }
+            for (const auto& it : mapFeeTxToBudget) dbFeeTxToBudget.SetDirty(it.first);
+            for (const auto& it : mapUnconfirmedFeeTx) dbUnconfirmedFeeTx.SetDirty(it.first);
             mapFinalizedBudgets.clear();
             mapFeeTxToBudget.clear();
             mapUnconfirmedFeeTx.clear();
         }
         {
             LOCK(cs_votes);
+            for (const auto& it : mapOrphanProposalVotes) dbOrphanProposalVotes.SetDirty(it.first);
             mapSeenProposalVotes.clear();
             mapOrphanProposalVotes.clear();
         }
         {
             LOCK(cs_finalizedvotes);
+            for (const auto& it : mapOrphanFinalizedBudgetVotes) dbOrphanFinalizedBudgetVotes.SetDirty(it.first);
             mapSeenFinalizedBudgetVotes.clear();
             mapOrphanFinalizedBudgetVotes.clear();
         }
@@ -163,6 +229,15 @@ public:
     void CheckAndRemove();
     std::string ToString() const;
 
+    // Add to batch the changes since the last call (see CTierTwoDBTable). Returns the number of changed entries.
+    size_t WriteDBChanges(CDBBatch& batch);
+    // Record the changes of the last WriteDBChanges as written, after the batch was written to the db
+    void DBChangesWritten();
+    // Load the cached data from db, keeping the entries already in memory
+    bool LoadFromDB(CDBWrapper& db);
+    // Mark all the entries to write with the next flush (e.g. after the import of the legacy flat file)
+    void SetDBDirty();
+
     // Remove proposal/budget by FeeTx (called when a block is disconnected)
     void RemoveByFeeTxId(const uint256& feeTxId);
 
@@ -174,6 +249,8 @@ public:
             LOCK(cs_proposals);
             READWRITE(mapProposals);
             READWRITE(mapFeeTxToProposal);
+            if (ser_action.ForRead())
+                fSnapshotStale = true;
         }
         {
             LOCK(cs_votes);
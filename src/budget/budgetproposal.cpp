@@ -66,10 +66,13 @@ bool CBudgetProposal::ParseBroadcast(CDataStream& broadcast)
     return true;
 }
 
-void CBudgetProposal::SyncVotes(CNode* pfrom, bool fPartial, int& nInvCount) const
+void CBudgetProposal::SyncVotes(CNode* pfrom, bool fPartial, int& nInvCount, const CBudgetVotesDigest* pPeerDigest) const
 {
+    CBudgetVotesDigest digest;
+    if (pPeerDigest) digest = GetVotesDigest();
     for (const auto& it: mapVotes) {
         const CBudgetVote& vote = it.second;
+        if (pPeerDigest && digest.IsBucketSynced(*pPeerDigest, it.first)) continue;
         if (vote.IsValid() && (!fPartial || !vote.IsSynced())) {
             pfrom->PushInventory(CInv(MSG_BUDGET_VOTE, vote.GetHash()));
             nInvCount++;
@@ -240,12 +243,46 @@ bool CBudgetProposal::AddOrUpdateVote(const CBudgetVote& vote, std::string& strE
         return false;
     }
 
-    mapVotes[mnId] = vote;
+    auto res = mapVotes.emplace(mnId, vote);
+    if (!res.second) {
+        CountVote(res.first->second, -1);
+        res.first->second = vote;
+    }
+    CountVote(vote, 1);
     LogPrint(BCLog::MNBUDGET, "%s: %s %s\n", __func__, strAction.c_str(), vote.GetHash().ToString().c_str());
 
     return true;
 }
 
+void CBudgetProposal::CountVote(const CBudgetVote& vote, int nDelta)
+{
+    if (!vote.IsValid()) return;
+    switch (vote.GetDirection()) {
+        case CBudgetVote::VOTE_YES: nYeas += nDelta; break;
+        case CBudgetVote::VOTE_NO: nNays += nDelta; break;
+        case CBudgetVote::VOTE_ABSTAIN: nAbstains += nDelta; break;
+    }
+}
+
+void CBudgetProposal::RecountVotes()
+{
+    nYeas = nNays = nAbstains = 0;
+    for (const auto& it : mapVotes) {
+        CountVote(it.second, 1);
+    }
+}
+
+bool CBudgetProposal::SetVoteValid(CBudgetVote& vote, bool fVoteValid)
+{
+    if (vote.IsValid() == fVoteValid) {
+        return false;
+    }
+    CountVote(vote, -1);
+    vote.SetValid(fVoteValid);
+    CountVote(vote, 1);
+    return true;
+}
+
 UniValue CBudgetProposal::GetVotesArray() const
 {
     UniValue ret(UniValue::VARR);
@@ -279,13 +316,12 @@ double CBudgetProposal::GetRatio() const
 
 int CBudgetProposal::GetVoteCount(CBudgetVote::VoteDirection vd) const
 {
-    int ret = 0;
-    for (const auto& it : mapVotes) {
-        const CBudgetVote& vote = it.second;
-        if (vote.GetDirection() == vd && vote.IsValid())
-            ret++;
+    switch (vd) {
+        case CBudgetVote::VOTE_YES: return nYeas;
+        case CBudgetVote::VOTE_NO: return nNays;
+        case CBudgetVote::VOTE_ABSTAIN: return nAbstains;
     }
-    return ret;
+    return 0;
 }
 
 std::vector<uint256> CBudgetProposal::GetVotesHashes() const
@@ -7,6 +7,7 @@
 #define BUDGET_PROPOSAL_H
 
 #include "budget/budgetvote.h"
+#include "budget/budgetvotesdigest.h"
 #include "net.h"
 #include "streams.h"
 
@@ -29,6 +30,16 @@ private:
     bool fValid;
     std::string strInvalid;
 
+    // Running tallies of the valid votes in mapVotes (memory only)
+    int nYeas{0};
+    int nNays{0};
+    int nAbstains{0};
+    // Adds (nDelta = 1) or removes (nDelta = -1) a vote from the tallies, if it's valid
+    void CountVote(const CBudgetVote& vote, int nDelta);
+    void RecountVotes();
+    // Sets fValid on a vote of mapVotes, updating the tallies. Returns true if it changed
+    bool SetVoteValid(CBudgetVote& vote, bool fVoteValid);
+
     // Functions used inside UpdateValid()/IsWellFormed - setting strInvalid
     bool IsHeavilyDownvoted(bool fNewRules);
     bool IsExpired(int nCurrentHeight);
@@ -58,7 +69,9 @@ public:
     void SetSynced(bool synced);    // sets fSynced on votes (true only if valid)
 
     // sync proposal votes with a node
-    void SyncVotes(CNode* pfrom, bool fPartial, int& nInvCount) const;
+    // pPeerDigest: digest of the votes of the peer, to skip the buckets that it already has
+    void SyncVotes(CNode* pfrom, bool fPartial, int& nInvCount, const CBudgetVotesDigest* pPeerDigest = nullptr) const;
+    CBudgetVotesDigest GetVotesDigest() const { return CBudgetVotesDigest(GetHash(), mapVotes); }
 
     // sets fValid and strInvalid, returns fValid
     bool UpdateValid(int nHeight);
@@ -86,9 +99,10 @@ public:
     double GetRatio() const;
     int GetVoteCount(CBudgetVote::VoteDirection vd) const;
     std::vector<uint256> GetVotesHashes() const;
-    int GetYeas() const { return GetVoteCount(CBudgetVote::VOTE_YES); }
-    int GetNays() const { return GetVoteCount(CBudgetVote::VOTE_NO); }
-    int GetAbstains() const { return GetVoteCount(CBudgetVote::VOTE_ABSTAIN); };
+    int GetYeas() const { return nYeas; }
+    int GetNays() const { return nNays; }
+    int GetAbstains() const { return nAbstains; };
+    int GetNetYeas() const { return nYeas - nNays; }
     CAmount GetAmount() const { return nAmount; }
     void SetAllotted(CAmount nAllottedIn) { nAllotted = nAllottedIn; }
     CAmount GetAllotted() const { return nAllotted; }
@@ -119,8 +133,31 @@ public:
         READWRITE(nFeeTXHash);
         READWRITE(nTime);
         READWRITE(mapVotes);
+        if (ser_action.ForRead())
+            RecountVotes();
     }
 
+    // Serialization for the tier two caches db, without the votes (stored in their own table)
+    struct NoVotes
+    {
+        CBudgetProposal& obj;
+        explicit NoVotes(CBudgetProposal& _obj) : obj(_obj) {}
+
+        ADD_SERIALIZE_METHODS;
+        template <typename Stream, typename Operation>
+        inline void SerializationOp(Stream& s, Operation ser_action)
+        {
+            READWRITE(LIMITED_STRING(obj.strProposalName, 20));
+            READWRITE(LIMITED_STRING(obj.strURL, 64));
+            READWRITE(obj.nBlockStart);
+            READWRITE(obj.nBlockEnd);
+            READWRITE(obj.nAmount);
+            READWRITE(obj.address);
+            READWRITE(obj.nFeeTXHash);
+            READWRITE(obj.nTime);
+        }
+    };
+
     // Serialization for network messages.
     bool ParseBroadcast(CDataStream& broadcast);
     CDataStream GetBroadcast() const;
@@ -135,8 +172,8 @@ public:
     // compare proposals pointers by net yes count (solve tie with feeHash)
     static inline bool PtrHigherYes(CBudgetProposal* a, CBudgetProposal* b)
     {
-        const int netYes_a = a->GetYeas() - a->GetNays();
-        const int netYes_b = b->GetYeas() - b->GetNays();
+        const int netYes_a = a->GetNetYeas();
+        const int netYes_b = b->GetNetYeas();
         if (netYes_a == netYes_b) return UintToArith256(a->GetFeeTXHash()) > UintToArith256(b->GetFeeTXHash());
         return netYes_a > netYes_b;
     }
@@ -0,0 +1,64 @@
+// Copyright (c) 2021 The PIVX developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "budget/budgetsnapshot.h"
+
+std::shared_ptr<const CBudgetProposal> CBudgetSnapshot::FindProposalByName(const std::string& strProposalName) const
+{
+    // the proposals are sorted by net yes count
+    for (const auto& p : vProposals) {
+        if (p->GetName() == strProposalName) return p;
+    }
+    return nullptr;
+}
+
+std::shared_ptr<const CFinalizedBudget> CBudgetSnapshot::FindFinalizedBudget(const uint256& nHash) const
+{
+    auto it = mapFinalizedBudgets.find(nHash);
+    return it != mapFinalizedBudgets.end() ? it->second : nullptr;
+}
+
+CAmount CBudgetSnapshot::GetAllotted(const uint256& nProposalHash) const
+{
+    auto it = mapProposals.find(nProposalHash);
+    if (it == mapProposals.end()) return 0;
+    for (const auto& p : vProjection) {
+        if (p.first == it->second) return p.second;
+    }
+    return 0;
+}
+
+std::string CBudgetSnapshot::GetFinalizedBudgetStatus(const CFinalizedBudget& fb) const
+{
+    std::string retBadHashes = "";
+    std::string retBadPayeeOrAmount = "";
+    int nBlockStart = fb.GetBlockStart();
+    int nBlockEnd = fb.GetBlockEnd();
+
+    for (int nBlockHeight = nBlockStart; nBlockHeight <= nBlockEnd; nBlockHeight++) {
+        CTxBudgetPayment budgetPayment;
+        if (!fb.GetBudgetPaymentByBlock(nBlockHeight, budgetPayment)) {
+            LogPrint(BCLog::MNBUDGET,"%s: Couldn't find budget payment for block %lld\n", __func__, nBlockHeight);
+            continue;
+        }
+
+        auto it = mapProposals.find(budgetPayment.nProposalHash);
+        if (it == mapProposals.end()) {
+            retBadHashes += (retBadHashes == "" ? "" : ", ") + budgetPayment.nProposalHash.ToString();
+            continue;
+        }
+
+        const CBudgetProposal& bp = *it->second;
+        if (bp.GetPayee() != budgetPayment.payee || bp.GetAmount() != budgetPayment.nAmount) {
+            retBadPayeeOrAmount += (retBadPayeeOrAmount == "" ? "" : ", ") + budgetPayment.nProposalHash.ToString();
+        }
+    }
+
+    if (retBadHashes == "" && retBadPayeeOrAmount == "") return "OK";
+
+    if (retBadHashes != "") retBadHashes = "Unknown proposal(s) hash! Check this proposal(s) before voting: " + retBadHashes;
+    if (retBadPayeeOrAmount != "") retBadPayeeOrAmount = "Budget payee/nAmount doesn't match our proposal(s)! "+ retBadPayeeOrAmount;
+
+    return retBadHashes + " -- " + retBadPayeeOrAmount;
+}
@@ -0,0 +1,47 @@
+// Copyright (c) 2021 The PIVX developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BUDGET_SNAPSHOT_H
+#define BUDGET_SNAPSHOT_H
+
+#include "budget/budgetproposal.h"
+#include "budget/finalizedbudget.h"
+
+#include <map>
+#include <memory>
+#include <vector>
+
+/** Immutable view of the proposals and finalized budgets, for the RPC readers.
+ *  Published by the budget manager (see CBudgetManager::PublishSnapshot) after each block
+ *  and vote batch, and read without locking the manager. The objects that didn't change
+ *  are shared between consecutive snapshots, so only the modified ones are copied.
+ */
+class CBudgetSnapshot
+{
+public:
+    // Incremented with each published snapshot
+    uint64_t nVersion{0};
+    // Best height of the budget manager when the snapshot was built
+    int nHeight{0};
+
+    // Proposals sorted by net yes count (see CBudgetProposal::PtrHigherYes)
+    std::vector<std::shared_ptr<const CBudgetProposal>> vProposals;
+    std::map<uint256, std::shared_ptr<const CBudgetProposal>> mapProposals;
+    // Proposals paid with the next superblock, in order, with the amount allotted to each
+    std::vector<std::pair<std::shared_ptr<const CBudgetProposal>, CAmount>> vProjection;
+    // Finalized budgets sorted by vote count (see CFinalizedBudget::PtrGreater)
+    std::vector<std::shared_ptr<const CFinalizedBudget>> vFinalizedBudgets;
+    std::map<uint256, std::shared_ptr<const CFinalizedBudget>> mapFinalizedBudgets;
+
+    // Finds the proposal with the given name, with highest net yes count. Returns nullptr if not found.
+    std::shared_ptr<const CBudgetProposal> FindProposalByName(const std::string& strProposalName) const;
+    std::shared_ptr<const CFinalizedBudget> FindFinalizedBudget(const uint256& nHash) const;
+    // Amount allotted to the proposal in the projection (0 if it's not paid with the next superblock)
+    CAmount GetAllotted(const uint256& nProposalHash) const;
+    // Checks the finalized budget proposals (existence, payee, amount).
+    // Returns error string if any, or "OK" otherwise
+    std::string GetFinalizedBudgetStatus(const CFinalizedBudget& fb) const;
+};
+
+#endif // BUDGET_SNAPSHOT_H
@@ -0,0 +1,70 @@
+// Copyright (c) 2021 The PIVX developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BUDGET_VOTES_DIGEST_H
+#define BUDGET_VOTES_DIGEST_H
+
+#include "hash.h"
+#include "primitives/transaction.h"
+#include "serialize.h"
+#include "uint256.h"
+
+#include <vector>
+
+/** Maximum number of digests accepted along with a budget vote sync request */
+static const unsigned int MAX_BUDGET_VOTES_DIGESTS = 1000;
+
+/** Summary of the valid votes of a proposal, or of a finalized budget.
+ *  The votes are split in buckets by voter, and each bucket is summarized with a 64-bit hash.
+ *  A node asking for the budget votes (BUDGETVOTESYNC) appends the digests of the items it
+ *  knows, so that the peer only announces the votes in the buckets that differ from its own.
+ */
+class CBudgetVotesDigest
+{
+public:
+    static const unsigned int BUCKETS = 16;
+
+    uint256 nHash;                  // proposal / finalized budget hash
+    std::vector<uint64_t> vBuckets;
+
+    CBudgetVotesDigest() {}
+
+    template <typename VoteMap>
+    CBudgetVotesDigest(const uint256& _nHash, const VoteMap& mapVotes) : nHash(_nHash)
+    {
+        // the votes are sorted by voter in the map, so the hashes don't depend on the arrival order
+        std::vector<CHashWriter> vHashers(BUCKETS, CHashWriter(SER_GETHASH, 0));
+        for (const auto& it : mapVotes) {
+            if (it.second.IsValid()) {
+                vHashers[GetBucket(it.first)] << it.second.GetHash();
+            }
+        }
+        vBuckets.reserve(BUCKETS);
+        for (CHashWriter& hasher : vHashers) {
+            vBuckets.emplace_back(hasher.GetHash().GetCheapHash());
+        }
+    }
+
+    static unsigned int GetBucket(const COutPoint& voter) { return (voter.hash.GetCheapHash() + voter.n) % BUCKETS; }
+
+    bool IsValid() const { return vBuckets.size() == BUCKETS; }
+
+    // Whether the voter's bucket has the same votes in both digests
+    bool IsBucketSynced(const CBudgetVotesDigest& other, const COutPoint& voter) const
+    {
+        const unsigned int nBucket = GetBucket(voter);
+        return IsValid() && other.IsValid() && vBuckets[nBucket] == other.vBuckets[nBucket];
+    }
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action)
+    {
+        READWRITE(nHash);
+        READWRITE(vBuckets);
+    }
+};
+
+#endif // BUDGET_VOTES_DIGEST_H
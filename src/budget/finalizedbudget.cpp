@@ -183,10 +183,13 @@ std::vector<uint256> CFinalizedBudget::GetProposalsHashes() const
     return vHashes;
 }
 
-void CFinalizedBudget::SyncVotes(CNode* pfrom, bool fPartial, int& nInvCount) const
+void CFinalizedBudget::SyncVotes(CNode* pfrom, bool fPartial, int& nInvCount, const CBudgetVotesDigest* pPeerDigest) const
 {
+    CBudgetVotesDigest digest;
+    if (pPeerDigest) digest = GetVotesDigest();
     for (const auto& it: mapVotes) {
         const CFinalizedBudgetVote& vote = it.second;
+        if (pPeerDigest && digest.IsBucketSynced(*pPeerDigest, it.first)) continue;
         if (vote.IsValid() && (!fPartial || !vote.IsSynced())) {
             pfrom->PushInventory(CInv(MSG_BUDGET_FINALIZED_VOTE, vote.GetHash()));
             nInvCount++;
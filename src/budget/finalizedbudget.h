@@ -62,7 +62,9 @@ public:
     void SetSynced(bool synced);    // sets fSynced on votes (true only if valid)
 
     // sync budget votes with a node
-    void SyncVotes(CNode* pfrom, bool fPartial, int& nInvCount) const;
+    // pPeerDigest: digest of the votes of the peer, to skip the buckets that it already has
+    void SyncVotes(CNode* pfrom, bool fPartial, int& nInvCount, const CBudgetVotesDigest* pPeerDigest = nullptr) const;
+    CBudgetVotesDigest GetVotesDigest() const { return CBudgetVotesDigest(GetHash(), mapVotes); }
 
     // sets fValid and strInvalid, returns fValid
     bool UpdateValid(int nHeight);
@@ -120,6 +122,26 @@ public:
         READWRITE(strProposals);
     }
 
+    // Serialization for the tier two caches db, without the votes (stored in their own table)
+    struct NoVotes
+    {
+        CFinalizedBudget& obj;
+        explicit NoVotes(CFinalizedBudget& _obj) : obj(_obj) {}
+
+        ADD_SERIALIZE_METHODS;
+        template <typename Stream, typename Operation>
+        inline void SerializationOp(Stream& s, Operation ser_action)
+        {
+            READWRITE(LIMITED_STRING(obj.strBudgetName, 20));
+            READWRITE(obj.nFeeTXHash);
+            READWRITE(obj.nTime);
+            READWRITE(obj.nBlockStart);
+            READWRITE(obj.vecBudgetPayments);
+            READWRITE(obj.fAutoChecked);
+            READWRITE(obj.strProposals);
+        }
+    };
+
     // Serialization for network messages.
     bool ParseBroadcast(CDataStream& broadcast);
     CDataStream GetBroadcast() const;
@@ -89,13 +89,24 @@ typedef u_int SOCKET;
 #define THREAD_PRIORITY_ABOVE_NORMAL (-2)
 #endif
 
+// Socket event backend of the network thread (see CConnman::SocketEvents): epoll, then poll, select otherwise.
+// WIN32 poll is broken https://daniel.haxx.se/blog/2012/10/10/wsapoll-is-broken/
+// __APPLE__ poll is broken https://github.com/bitcoin/bitcoin/pull/14336#issuecomment-437384408
+#if defined(__linux__) && defined(HAVE_EPOLL)
+#define USE_EPOLL
+#include <sys/epoll.h>
+#elif defined(__linux__) && defined(HAVE_POLL)
+#define USE_POLL
+#include <poll.h>
+#endif
+
 #if HAVE_DECL_STRNLEN == 0
 size_t strnlen( const char *start, size_t max_len);
 #endif // HAVE_DECL_STRNLEN
 
 bool static inline IsSelectableSocket(SOCKET s)
 {
-#ifdef WIN32
+#if defined(WIN32) || defined(USE_POLL) || defined(USE_EPOLL)
     return true;
 #else
     return (s < FD_SETSIZE);
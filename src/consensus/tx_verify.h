@@ -13,14 +13,16 @@
 class CBlockIndex;
 class CChainParams;
 class CCoinsViewCache;
+class CSaplingProofCheck;
 class CValidationState;
 
 /** Transaction validation functions */
 
 /** Context-independent validity checks */
 bool CheckTransaction(const CTransaction& tx, CValidationState& state, bool fColdStakingActive);
-/** Context-dependent validity checks */
-bool ContextualCheckTransaction(const CTransactionRef& tx, CValidationState& state, const CChainParams& chainparams, int nHeight, bool isMined, bool fIBD);
+/** Context-dependent validity checks.
+ *  If pvSaplingChecks is not nullptr, the Sapling proofs verification is appended to it instead of being performed */
+bool ContextualCheckTransaction(const CTransactionRef& tx, CValidationState& state, const CChainParams& chainparams, int nHeight, bool isMined, bool fIBD, std::vector<CSaplingProofCheck>* pvSaplingChecks = nullptr);
 
 /**
  * Count ECDSA signature operations the old-fashioned (pre-0.6) way
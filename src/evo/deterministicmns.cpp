@@ -153,14 +153,14 @@ CDeterministicMNCPtr CDeterministicMNList::GetValidMN(const uint256& proTxHash)
     return dmn;
 }
 
-CDeterministicMNCPtr CDeterministicMNList::GetMNByOperatorKey(const CKeyID& keyID)
+CDeterministicMNCPtr CDeterministicMNList::GetMNByOperatorKey(const CKeyID& keyID) const
 {
-    for (const auto& p : mnMap) {
-        if (p.second->pdmnState->keyIDOperator == keyID) {
-            return p.second;
-        }
+    // owner and operator keys share the unique properties map
+    auto dmn = GetUniquePropertyMN(keyID);
+    if (dmn && dmn->pdmnState->keyIDOperator != keyID) {
+        return nullptr;
     }
-    return nullptr;
+    return dmn;
 }
 
 CDeterministicMNCPtr CDeterministicMNList::GetMNByCollateral(const COutPoint& collateralOutpoint) const
@@ -219,38 +219,23 @@ static bool CompareByLastPaid(const CDeterministicMNCPtr& _a, const CDeterminist
 
 CDeterministicMNCPtr CDeterministicMNList::GetMNPayee() const
 {
-    if (mnMap.size() == 0) {
+    if (mnPaymentQueue.empty()) {
         return nullptr;
     }
-
-    CDeterministicMNCPtr best;
-    ForEachMN(true, [&](const CDeterministicMNCPtr& dmn) {
-        if (!best || CompareByLastPaid(dmn, best)) {
-            best = dmn;
-        }
-    });
-
-    return best;
+    return mnPaymentQueue.front();
 }
 
 std::vector<CDeterministicMNCPtr> CDeterministicMNList::GetProjectedMNPayees(unsigned int nCount) const
 {
-    if (nCount > GetValidMNsCount()) {
-        nCount = GetValidMNsCount();
+    if (nCount > mnPaymentQueue.size()) {
+        nCount = mnPaymentQueue.size();
     }
 
     std::vector<CDeterministicMNCPtr> result;
     result.reserve(nCount);
-
-    ForEachMN(true, [&](const CDeterministicMNCPtr& dmn) {
+    for (const auto& dmn : mnPaymentQueue.take(nCount)) {
         result.emplace_back(dmn);
-    });
-    std::sort(result.begin(), result.end(), [&](const CDeterministicMNCPtr& a, const CDeterministicMNCPtr& b) {
-        return CompareByLastPaid(a, b);
-    });
-
-    result.resize(nCount);
-
+    }
     return result;
 }
 
@@ -433,6 +418,7 @@ void CDeterministicMNList::AddMN(const CDeterministicMNCPtr& dmn, bool fBumpTota
 
     mnMap = mnMap.set(dmn->proTxHash, dmn);
     mnInternalIdMap = mnInternalIdMap.set(dmn->GetInternalId(), dmn->proTxHash);
+    AddToPaymentQueue(dmn);
     AddUniqueProperty(dmn, dmn->collateralOutpoint);
     if (dmn->pdmnState->addr != CService()) {
         AddUniqueProperty(dmn, dmn->pdmnState->addr);
@@ -454,10 +440,17 @@ void CDeterministicMNList::UpdateMN(const CDeterministicMNCPtr& oldDmn, const CD
         throw(std::runtime_error(strprintf("%s: can't update a masternode with a duplicate address %s", __func__, oldDmn->pdmnState->addr.ToStringIPPort())));
     }
 
+    // the queue position is keyed by the state of the entry currently in the list
+    auto curDmn = mnMap.find(oldDmn->proTxHash);
+    if (curDmn) {
+        RemoveFromPaymentQueue(*curDmn);
+    }
+
     auto dmn = std::make_shared<CDeterministicMN>(*oldDmn);
     auto oldState = dmn->pdmnState;
     dmn->pdmnState = pdmnState;
     mnMap = mnMap.set(oldDmn->proTxHash, dmn);
+    AddToPaymentQueue(dmn);
 
     UpdateUniqueProperty(dmn, oldState->addr, pdmnState->addr);
     UpdateUniqueProperty(dmn, oldState->keyIDOwner, pdmnState->keyIDOwner);
@@ -497,10 +490,48 @@ void CDeterministicMNList::RemoveMN(const uint256& proTxHash)
 
     mnMap = mnMap.erase(proTxHash);
     mnInternalIdMap = mnInternalIdMap.erase(dmn->GetInternalId());
+    RemoveFromPaymentQueue(dmn);
 }
 
-CDeterministicMNManager::CDeterministicMNManager(CEvoDB& _evoDb) :
-    evoDb(_evoDb)
+void CDeterministicMNList::AddToPaymentQueue(const CDeterministicMNCPtr& dmn)
+{
+    if (!IsMNValid(dmn)) {
+        return;
+    }
+    auto it = std::lower_bound(mnPaymentQueue.begin(), mnPaymentQueue.end(), dmn, [](const CDeterministicMNCPtr& a, const CDeterministicMNCPtr& b) {
+        return CompareByLastPaid(a, b);
+    });
+    mnPaymentQueue = mnPaymentQueue.insert(it - mnPaymentQueue.begin(), dmn);
+}
+
+void CDeterministicMNList::RemoveFromPaymentQueue(const CDeterministicMNCPtr& dmn)
+{
+    if (!IsMNValid(dmn)) {
+        return;
+    }
+    auto it = std::lower_bound(mnPaymentQueue.begin(), mnPaymentQueue.end(), dmn, [](const CDeterministicMNCPtr& a, const CDeterministicMNCPtr& b) {
+        return CompareByLastPaid(a, b);
+    });
+    if (it == mnPaymentQueue.end() || (*it)->proTxHash != dmn->proTxHash) {
+        throw(std::runtime_error(strprintf("%s: masternode proTxHash=%s missing from the payment queue", __func__, dmn->proTxHash.ToString())));
+    }
+    const size_t pos = it - mnPaymentQueue.begin();
+    mnPaymentQueue = mnPaymentQueue.take(pos) + mnPaymentQueue.drop(pos + 1);
+}
+
+// Rough upper bound of the memory used by each masternode of a cached list, when it shares no
+// node with the other cached lists (the CDeterministicMN objects are always shared).
+static const size_t LIST_ENTRY_MEMORY_USAGE = 512;
+
+static size_t EstimateListMemoryUsage(const CDeterministicMNList& mnList)
+{
+    return sizeof(CDeterministicMNList) + mnList.GetAllMNsCount() * LIST_ENTRY_MEMORY_USAGE;
+}
+
+CDeterministicMNManager::CDeterministicMNManager(CEvoDB& _evoDb, int _nCheckpointInterval, size_t nMaxCacheSize) :
+    evoDb(_evoDb),
+    mnListsCache(nMaxCacheSize),
+    nCheckpointInterval(std::max(1, _nCheckpointInterval))
 {
 }
 
@@ -539,13 +570,14 @@ bool CDeterministicMNManager::ProcessBlock(const CBlock& block, const CBlockInde
         evoDb.Write(std::make_pair(DB_LIST_DIFF, newList.GetBlockHash()), diff);
         if ((nHeight % DISK_SNAPSHOT_PERIOD) == 0 || oldList.GetHeight() == -1) {
             evoDb.Write(std::make_pair(DB_LIST_SNAPSHOT, newList.GetBlockHash()), newList);
-            mnListsCache.emplace(newList.GetBlockHash(), newList);
             LogPrintf("CDeterministicMNManager::%s -- Wrote snapshot. nHeight=%d, mapCurMNs.allMNsCount=%d\n",
                 __func__, nHeight, newList.GetAllMNsCount());
         }
 
         diff.nHeight = pindex->nHeight;
-        mnListDiffsCache.emplace(pindex->GetBlockHash(), diff);
+        WITH_LOCK(cs_cache, mnListDiffsCache.emplace(pindex->GetBlockHash(), diff); );
+        // the new tip is the next list requested
+        AddListToCache(newList);
     } catch (const std::exception& e) {
         LogPrintf("CDeterministicMNManager::%s -- internal error: %s\n", __func__, e.what());
         return _state.DoS(100, false, REJECT_INVALID, "failed-dmn-block");
@@ -585,6 +617,7 @@ bool CDeterministicMNManager::UndoBlock(const CBlock& block, const CBlockIndex*
             prevList = GetListForBlock(pindex->pprev);
         }
 
+        LOCK(cs_cache);
         mnListsCache.erase(blockHash);
         mnListDiffsCache.erase(blockHash);
     }
@@ -800,76 +833,127 @@ void CDeterministicMNManager::DecreasePoSePenalties(CDeterministicMNList& mnList
     }
 }
 
-CDeterministicMNList CDeterministicMNManager::GetListForBlock(const CBlockIndex* pindex)
+void CDeterministicMNManager::AddListToCache(const CDeterministicMNList& mnList)
 {
-    LOCK(cs);
+    LOCK(cs_cache);
+    mnListsCache.insert(mnList.GetBlockHash(), mnList, EstimateListMemoryUsage(mnList));
+}
 
-    // Return early before enforcement
-    if (!IsDIP3Enforced(pindex->nHeight)) {
-        return {};
+bool CDeterministicMNManager::ReadListDataFromDisk(const CBlockIndex*& pindex, CDeterministicMNList& snapshot,
+                                                   std::vector<std::pair<const CBlockIndex*, CDeterministicMNListDiff>>& listDiffs)
+{
+    // collect the blocks not yet in the cache
+    std::vector<const CBlockIndex*> toRead;
+    {
+        LOCK(cs_cache);
+        for (const CBlockIndex* p = pindex; p && (int)toRead.size() < LIST_DIFFS_READ_BATCH; p = p->pprev) {
+            if (mnListsCache.exists(p->GetBlockHash()) || mnListDiffsCache.count(p->GetBlockHash())) {
+                break;
+            }
+            toRead.emplace_back(p);
+        }
     }
 
-    CDeterministicMNList snapshot;
-    std::list<const CBlockIndex*> listDiffIndexes;
+    bool fSnapshot = false;
+    std::vector<std::pair<const CBlockIndex*, CDeterministicMNListDiff>> readDiffs;
+    {
+        LOCK(evoDb.cs);
+        auto& dbTx = evoDb.GetCurTransaction();
+        for (const CBlockIndex* p : toRead) {
+            if (dbTx.Read(std::make_pair(DB_LIST_SNAPSHOT, p->GetBlockHash()), snapshot)) {
+                fSnapshot = true;
+                break;
+            }
 
-    while (true) {
-        // try using cache before reading from disk
-        auto itLists = mnListsCache.find(pindex->GetBlockHash());
-        if (itLists != mnListsCache.end()) {
-            snapshot = itLists->second;
-            break;
+            CDeterministicMNListDiff diff;
+            if (!dbTx.Read(std::make_pair(DB_LIST_DIFF, p->GetBlockHash()), diff)) {
+                // no snapshot and no diff on disk means that it's initial snapshot (empty list)
+                // If we get here, then this must be the block before the enforcement of DIP3.
+                if (!IsActivationHeight(p->nHeight + 1, Params().GetConsensus(), Consensus::UPGRADE_V6_0)) {
+                    std::string err = strprintf("No masternode list data found for block %s at height %d. "
+                                                "Possible corrupt database.", p->GetBlockHash().ToString(), p->nHeight);
+                    throw std::runtime_error(err);
+                }
+                snapshot = CDeterministicMNList(p->GetBlockHash(), -1, 0);
+                fSnapshot = true;
+                break;
+            }
+            diff.nHeight = p->nHeight;
+            readDiffs.emplace_back(p, std::move(diff));
         }
+    }
 
-        if (evoDb.Read(std::make_pair(DB_LIST_SNAPSHOT, pindex->GetBlockHash()), snapshot)) {
-            mnListsCache.emplace(pindex->GetBlockHash(), snapshot);
-            break;
+    {
+        LOCK(cs_cache);
+        for (const auto& p : readDiffs) {
+            mnListDiffsCache.emplace(p.first->GetBlockHash(), p.second);
         }
-
-        // no snapshot found yet, check diffs
-        auto itDiffs = mnListDiffsCache.find(pindex->GetBlockHash());
-        if (itDiffs != mnListDiffsCache.end()) {
-            listDiffIndexes.emplace_front(pindex);
-            pindex = pindex->pprev;
-            continue;
+        if (fSnapshot) {
+            mnListsCache.insert(snapshot.GetBlockHash(), snapshot, EstimateListMemoryUsage(snapshot));
         }
+    }
 
-        CDeterministicMNListDiff diff;
-        if (!evoDb.Read(std::make_pair(DB_LIST_DIFF, pindex->GetBlockHash()), diff)) {
-            // no snapshot and no diff on disk means that it's initial snapshot (empty list)
-            // If we get here, then this must be the block before the enforcement of DIP3.
-            if (!IsActivationHeight(pindex->nHeight + 1, Params().GetConsensus(), Consensus::UPGRADE_V6_0)) {
-                std::string err = strprintf("No masternode list data found for block %s at height %d. "
-                                            "Possible corrupt database.", pindex->GetBlockHash().ToString(), pindex->nHeight);
-                throw std::runtime_error(err);
+    listDiffs.insert(listDiffs.end(), std::make_move_iterator(readDiffs.begin()), std::make_move_iterator(readDiffs.end()));
+    if (!readDiffs.empty()) {
+        pindex = listDiffs.back().first->pprev;
+    }
+    return fSnapshot;
+}
+
+CDeterministicMNList CDeterministicMNManager::GetListForBlock(const CBlockIndex* pindex)
+{
+    // Return early before enforcement
+    if (!IsDIP3Enforced(pindex->nHeight)) {
+        return {};
+    }
+
+    const uint256 blockHash = pindex->GetBlockHash();
+    CDeterministicMNList snapshot;
+    // diffs to apply to the snapshot, from the newest to the oldest
+    std::vector<std::pair<const CBlockIndex*, CDeterministicMNListDiff>> listDiffs;
+
+    while (true) {
+        bool fSnapshot = false;
+        {
+            // try using cache before reading from disk
+            LOCK(cs_cache);
+            while (!(fSnapshot = mnListsCache.get(pindex->GetBlockHash(), snapshot))) {
+                auto itDiffs = mnListDiffsCache.find(pindex->GetBlockHash());
+                if (itDiffs == mnListDiffsCache.end()) {
+                    break;
+                }
+                listDiffs.emplace_back(pindex, itDiffs->second);
+                pindex = pindex->pprev;
             }
-            snapshot = CDeterministicMNList(pindex->GetBlockHash(), -1, 0);
-            mnListsCache.emplace(pindex->GetBlockHash(), snapshot);
+        }
+        if (fSnapshot || ReadListDataFromDisk(pindex, snapshot, listDiffs)) {
             break;
         }
-
-        diff.nHeight = pindex->nHeight;
-        mnListDiffsCache.emplace(pindex->GetBlockHash(), std::move(diff));
-        listDiffIndexes.emplace_front(pindex);
-        pindex = pindex->pprev;
     }
 
-    for (const auto& diffIndex : listDiffIndexes) {
-        const auto& diff = mnListDiffsCache.at(diffIndex->GetBlockHash());
+    // Replay the diffs outside of the locks, keeping a checkpoint every nCheckpointInterval
+    // blocks, so that the next requests for the blocks around here replay only a few diffs.
+    std::vector<CDeterministicMNList> checkpoints;
+    for (auto it = listDiffs.rbegin(); it != listDiffs.rend(); ++it) {
+        const CBlockIndex* diffIndex = it->first;
+        const auto& diff = it->second;
         if (diff.HasChanges()) {
             snapshot = snapshot.ApplyDiff(diffIndex, diff);
         } else {
             snapshot.SetBlockHash(diffIndex->GetBlockHash());
             snapshot.SetHeight(diffIndex->nHeight);
         }
+        if (diffIndex->nHeight % nCheckpointInterval == 0 && diffIndex->GetBlockHash() != blockHash) {
+            checkpoints.emplace_back(snapshot);
+        }
     }
 
-    if (tipIndex) {
-        // always keep a snapshot for the tip
-        if (snapshot.GetBlockHash() == tipIndex->GetBlockHash()) {
-            mnListsCache.emplace(snapshot.GetBlockHash(), snapshot);
-        } else {
-            // !TODO: keep snapshots for yet alive quorums
+    if (!listDiffs.empty()) {
+        LOCK(cs_cache);
+        for (const auto& checkpoint : checkpoints) {
+            mnListsCache.insert(checkpoint.GetBlockHash(), checkpoint, EstimateListMemoryUsage(checkpoint));
         }
+        mnListsCache.insert(snapshot.GetBlockHash(), snapshot, EstimateListMemoryUsage(snapshot));
     }
 
     return snapshot;
@@ -877,11 +961,11 @@ CDeterministicMNList CDeterministicMNManager::GetListForBlock(const CBlockIndex*
 
 CDeterministicMNList CDeterministicMNManager::GetListAtChainTip()
 {
-    LOCK(cs);
-    if (!tipIndex) {
+    const CBlockIndex* tip = WITH_LOCK(cs, return tipIndex; );
+    if (!tip) {
         return {};
     }
-    return GetListForBlock(tipIndex);
+    return GetListForBlock(tip);
 }
 
 bool CDeterministicMNManager::IsDIP3Enforced(int nHeight) const
@@ -910,24 +994,13 @@ void CDeterministicMNManager::CleanupCache(int nHeight)
 {
     AssertLockHeld(cs);
 
-    std::vector<uint256> toDeleteLists;
-    std::vector<uint256> toDeleteDiffs;
-    for (const auto& p : mnListsCache) {
-        if (p.second.GetHeight() + LIST_DIFFS_CACHE_SIZE < nHeight) {
-            toDeleteLists.emplace_back(p.first);
-            continue;
-        }
-        // !TODO: llmq cache cleanup
-    }
-    for (const auto& h : toDeleteLists) {
-        mnListsCache.erase(h);
-    }
-    for (const auto& p : mnListDiffsCache) {
-        if (p.second.nHeight + LIST_DIFFS_CACHE_SIZE < nHeight) {
-            toDeleteDiffs.emplace_back(p.first);
+    // the lists are evicted by the LRU cache, the diffs only by height
+    LOCK(cs_cache);
+    for (auto it = mnListDiffsCache.begin(); it != mnListDiffsCache.end();) {
+        if (it->second.nHeight + LIST_DIFFS_CACHE_SIZE < nHeight) {
+            it = mnListDiffsCache.erase(it);
+        } else {
+            ++it;
         }
     }
-    for (const auto& h : toDeleteDiffs) {
-        mnListDiffsCache.erase(h);
-    }
 }
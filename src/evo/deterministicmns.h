@@ -12,7 +12,9 @@
 #include "evo/providertx.h"
 #include "saltedhasher.h"
 #include "sync.h"
+#include "unordered_lru_cache.h"
 
+#include <immer/flex_vector.hpp>
 #include <immer/map.hpp>
 #include <immer/map_transient.hpp>
 
@@ -265,6 +267,7 @@ public:
     typedef immer::map<uint256, CDeterministicMNCPtr> MnMap;
     typedef immer::map<uint64_t, uint256> MnInternalIdMap;
     typedef immer::map<uint256, std::pair<uint256, uint32_t> > MnUniquePropertyMap;
+    typedef immer::flex_vector<CDeterministicMNCPtr> MnPaymentQueue;
 
 private:
     uint256 blockHash;
@@ -277,6 +280,10 @@ private:
     // we keep track of this as checking for duplicates would otherwise be painfully slow
     MnUniquePropertyMap mnUniquePropertyMap;
 
+    // valid masternodes, ordered by (last paid height, proTxHash): the front is the next payee.
+    // Not serialized, it is rebuilt by AddMN when the list is loaded.
+    MnPaymentQueue mnPaymentQueue;
+
 public:
     CDeterministicMNList() {}
     explicit CDeterministicMNList(const uint256& _blockHash, int _height, uint32_t _totalRegisteredCount) :
@@ -310,6 +317,7 @@ public:
         mnMap = MnMap();
         mnUniquePropertyMap = MnUniquePropertyMap();
         mnInternalIdMap = MnInternalIdMap();
+        mnPaymentQueue = MnPaymentQueue();
 
         SerializationOpBase(s, CSerActionUnserialize());
 
@@ -327,13 +335,7 @@ public:
 
     size_t GetValidMNsCount() const
     {
-        size_t count = 0;
-        for (const auto& p : mnMap) {
-            if (IsMNValid(p.second)) {
-                count++;
-            }
-        }
-        return count;
+        return mnPaymentQueue.size();
     }
 
     template <typename Callback>
@@ -372,7 +374,7 @@ public:
     }
     CDeterministicMNCPtr GetMN(const uint256& proTxHash) const;
     CDeterministicMNCPtr GetValidMN(const uint256& proTxHash) const;
-    CDeterministicMNCPtr GetMNByOperatorKey(const CKeyID& keyID);
+    CDeterministicMNCPtr GetMNByOperatorKey(const CKeyID& keyID) const;
     CDeterministicMNCPtr GetMNByCollateral(const COutPoint& collateralOutpoint) const;
     CDeterministicMNCPtr GetValidMNByCollateral(const COutPoint& collateralOutpoint) const;
     CDeterministicMNCPtr GetMNByService(const CService& service) const;
@@ -500,6 +502,9 @@ private:
             AddUniqueProperty(dmn, newValue);
         }
     }
+
+    void AddToPaymentQueue(const CDeterministicMNCPtr& dmn);
+    void RemoveFromPaymentQueue(const CDeterministicMNCPtr& dmn);
 };
 
 class CDeterministicMNListDiff
@@ -558,11 +563,17 @@ public:
     }
 };
 
+//! Default for -mnlistcheckpointinterval, blocks between the lists kept in memory while replaying diffs
+static const int DEFAULT_MNLIST_CHECKPOINT_INTERVAL = 24;
+//! Default for -mnlistcachesize, max memory of the masternode lists cache (MiB)
+static const int64_t DEFAULT_MNLIST_CACHE_SIZE = 64;
+
 class CDeterministicMNManager
 {
     static const int DISK_SNAPSHOT_PERIOD = 1440; // once per day
     static const int DISK_SNAPSHOTS = 3; // keep cache for 3 disk snapshots to have 2 full days covered
     static const int LIST_DIFFS_CACHE_SIZE = DISK_SNAPSHOT_PERIOD * DISK_SNAPSHOTS;
+    static const int LIST_DIFFS_READ_BATCH = 64; // diffs read from disk under a single evoDb lock
 
 public:
     mutable RecursiveMutex cs;
@@ -570,12 +581,21 @@ public:
 private:
     CEvoDB& evoDb;
 
-    std::unordered_map<uint256, CDeterministicMNList, StaticSaltedHasher> mnListsCache;
-    std::unordered_map<uint256, CDeterministicMNListDiff, StaticSaltedHasher> mnListDiffsCache;
+    // Lists and diffs already built/read. Guarded by their own lock (always taken after cs)
+    // so that concurrent readers of GetListForBlock don't serialize on cs.
+    mutable Mutex cs_cache;
+    // every list returned by GetListForBlock, the disk snapshots and a list each nCheckpointInterval
+    // blocks of the replayed diffs. The lists share most of their memory, evicted by estimated size.
+    unordered_lru_cache<uint256, CDeterministicMNList, StaticSaltedHasher> mnListsCache GUARDED_BY(cs_cache);
+    std::unordered_map<uint256, CDeterministicMNListDiff, StaticSaltedHasher> mnListDiffsCache GUARDED_BY(cs_cache);
+    const int nCheckpointInterval;
+
     const CBlockIndex* tipIndex{nullptr};
 
 public:
-    explicit CDeterministicMNManager(CEvoDB& _evoDb);
+    explicit CDeterministicMNManager(CEvoDB& _evoDb,
+                                     int _nCheckpointInterval = DEFAULT_MNLIST_CHECKPOINT_INTERVAL,
+                                     size_t nMaxCacheSize = DEFAULT_MNLIST_CACHE_SIZE << 20);
 
     bool ProcessBlock(const CBlock& block, const CBlockIndex* pindex, CValidationState& state, bool fJustCheck);
     bool UndoBlock(const CBlock& block, const CBlockIndex* pindex);
@@ -600,6 +620,11 @@ public:
 
 private:
     void CleanupCache(int nHeight);
+    void AddListToCache(const CDeterministicMNList& mnList);
+    // Reads the lists data of (up to LIST_DIFFS_READ_BATCH) blocks missing from the cache, walking back from pindex.
+    // Returns true if a snapshot was found, false if the walk must continue from the updated pindex.
+    bool ReadListDataFromDisk(const CBlockIndex*& pindex, CDeterministicMNList& snapshot,
+                              std::vector<std::pair<const CBlockIndex*, CDeterministicMNListDiff>>& listDiffs);
 };
 
 extern std::unique_ptr<CDeterministicMNManager> deterministicMNManager;
@@ -0,0 +1,231 @@
+// Copyright (c) 2017-2018 The Bitcoin Core developers
+// Copyright (c) 2021 The PIVX developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "index/txindex.h"
+
+#include "guiinterface.h"
+#include "init.h"
+#include "sync.h"
+#include "util/system.h"
+#include "validation.h"
+#include "validationinterface.h"
+
+constexpr char DB_TXINDEX = 't';
+
+//! Size of the batches moved from the block tree database by the txindex migration
+static const size_t TXINDEX_MIGRATION_BATCH_SIZE = 16 << 20;
+
+static Mutex cs_txindex;
+static std::shared_ptr<TxIndex> g_txindex GUARDED_BY(cs_txindex);
+
+/**
+ * Access to the txindex database (indexes/txindex/)
+ *
+ * The database stores a block locator of the chain the database is synced to
+ * so that the TxIndex can efficiently determine the point it last stopped at.
+ * A locator is used instead of a simple hash of the chain tip because blocks
+ * and block index entries may not be flushed to disk until after this database
+ * is updated.
+ */
+class TxIndex::DB : public BaseIndex::DB
+{
+public:
+    explicit DB(size_t n_cache_size, bool f_memory = false, bool f_wipe = false);
+
+    /// Read the disk location of the transaction data with the given hash. Returns false if the
+    /// transaction hash is not indexed.
+    bool ReadTxPos(const uint256& txid, CDiskTxPos& pos) const;
+
+    /// Write a batch of transaction positions to the DB.
+    bool WriteTxs(const std::vector<std::pair<uint256, CDiskTxPos>>& v_pos);
+
+    /// Move the transaction positions of the legacy txindex, kept in the block
+    /// tree database, to this database.
+    bool MigrateData(CBlockTreeDB& block_tree_db);
+};
+
+TxIndex::DB::DB(size_t n_cache_size, bool f_memory, bool f_wipe) :
+    BaseIndex::DB(GetDataDir() / "indexes" / "txindex", n_cache_size, f_memory, f_wipe)
+{}
+
+bool TxIndex::DB::ReadTxPos(const uint256& txid, CDiskTxPos& pos) const
+{
+    return Read(std::make_pair(DB_TXINDEX, txid), pos);
+}
+
+bool TxIndex::DB::WriteTxs(const std::vector<std::pair<uint256, CDiskTxPos>>& v_pos)
+{
+    CDBBatch batch;
+    for (const auto& tuple : v_pos) {
+        batch.Write(std::make_pair(DB_TXINDEX, tuple.first), tuple.second);
+    }
+    return WriteBatch(batch);
+}
+
+bool TxIndex::DB::MigrateData(CBlockTreeDB& block_tree_db)
+{
+    LogPrintf("Upgrading txindex database... [0%%]\n");
+    uiInterface.InitMessage(_("Upgrading txindex database"));
+
+    CDBBatch batch_newdb;
+    CDBBatch batch_olddb;
+    std::pair<char, uint256> key;
+    std::pair<char, uint256> begin_key{DB_TXINDEX, UINT256_ZERO};
+    int report_done = 0;
+
+    std::unique_ptr<CDBIterator> cursor(block_tree_db.NewIterator());
+    for (cursor->Seek(begin_key); cursor->Valid(); cursor->Next()) {
+        if (ShutdownRequested()) {
+            // Entries already moved are erased from the block tree database,
+            // the migration resumes from there at the next start.
+            return false;
+        }
+
+        if (!cursor->GetKey(key) || key.first != DB_TXINDEX) {
+            break;
+        }
+
+        // Log progress every 10%, the keys are uniformly distributed txids
+        int percentage_done = (int)(key.second.GetUint64(3) >> 32) * 100 / 0xffffffff;
+        if (report_done < percentage_done / 10) {
+            LogPrintf("Upgrading txindex database... [%d%%]\n", percentage_done);
+            report_done++;
+        }
+
+        CDiskTxPos value;
+        if (!cursor->GetValue(value)) {
+            return error("%s: cannot parse txindex record", __func__);
+        }
+        batch_newdb.Write(key, value);
+        batch_olddb.Erase(key);
+
+        if (batch_newdb.SizeEstimate() > TXINDEX_MIGRATION_BATCH_SIZE ||
+            batch_olddb.SizeEstimate() > TXINDEX_MIGRATION_BATCH_SIZE) {
+            // NOTE: it's OK to write to the new database first, an interruption
+            // only leaves entries present in both databases.
+            if (!WriteBatch(batch_newdb, true) || !block_tree_db.WriteBatch(batch_olddb, true)) {
+                return false;
+            }
+            batch_newdb.Clear();
+            batch_olddb.Clear();
+        }
+    }
+    if (!WriteBatch(batch_newdb, true) || !block_tree_db.WriteBatch(batch_olddb, true)) {
+        return false;
+    }
+
+    // The legacy txindex was written while connecting each block, so it is
+    // in sync with the active chain.
+    CDBBatch batch;
+    WriteBestBlock(batch, WITH_LOCK(cs_main, return chainActive.GetLocator(); ));
+    if (!WriteBatch(batch, true) || !block_tree_db.WriteFlag("txindex", false)) {
+        return false;
+    }
+
+    LogPrintf("Upgrading txindex database... [DONE]\n");
+    return true;
+}
+
+TxIndex::TxIndex(size_t n_cache_size, bool f_memory, bool f_wipe)
+    : m_db(std::make_unique<TxIndex::DB>(n_cache_size, f_memory, f_wipe))
+{}
+
+TxIndex::~TxIndex() {}
+
+bool TxIndex::Init()
+{
+    // Migrate the txindex written by older versions in the block tree database,
+    // unless this index has already been started once.
+    bool fLegacyTxIndex = false;
+    CBlockLocator locator;
+    if (pblocktree && pblocktree->ReadFlag("txindex", fLegacyTxIndex) && fLegacyTxIndex &&
+            !m_db->ReadBestBlock(locator) && !m_db->MigrateData(*pblocktree)) {
+        return false;
+    }
+
+    return BaseIndex::Init();
+}
+
+bool TxIndex::WriteBlock(const CBlock& block, const CBlockIndex* pindex)
+{
+    CDiskTxPos pos(pindex->GetBlockPos(), GetSizeOfCompactSize(block.vtx.size()));
+    std::vector<std::pair<uint256, CDiskTxPos>> vPos;
+    vPos.reserve(block.vtx.size());
+    for (const auto& tx : block.vtx) {
+        vPos.emplace_back(tx->GetHash(), pos);
+        pos.nTxOffset += ::GetSerializeSize(*tx, SER_DISK, CLIENT_VERSION);
+    }
+    return m_db->WriteTxs(vPos);
+}
+
+BaseIndex::DB& TxIndex::GetDB() const { return *m_db; }
+
+bool TxIndex::FindTx(const uint256& tx_hash, uint256& block_hash, CTransactionRef& tx) const
+{
+    CDiskTxPos postx;
+    if (!m_db->ReadTxPos(tx_hash, postx)) {
+        return false;
+    }
+
+    CAutoFile file(OpenBlockFile(postx, true), SER_DISK, CLIENT_VERSION);
+    if (file.IsNull()) {
+        return error("%s: OpenBlockFile failed", __func__);
+    }
+    CBlockHeader header;
+    try {
+        file >> header;
+        if (fseek(file.Get(), postx.nTxOffset, SEEK_CUR)) {
+            return error("%s: fseek(...) failed", __func__);
+        }
+        file >> tx;
+    } catch (const std::exception& e) {
+        return error("%s: Deserialize or I/O error - %s", __func__, e.what());
+    }
+    if (tx->GetHash() != tx_hash) {
+        return error("%s: txid mismatch", __func__);
+    }
+    block_hash = header.GetHash();
+    return true;
+}
+
+std::shared_ptr<TxIndex> GetTxIndex()
+{
+    LOCK(cs_txindex);
+    return g_txindex;
+}
+
+bool StartTxIndex(size_t n_cache_size, bool f_wipe)
+{
+    std::shared_ptr<TxIndex> txindex;
+    {
+        LOCK(cs_txindex);
+        if (g_txindex) return false;
+        g_txindex = std::make_shared<TxIndex>(n_cache_size, false, f_wipe);
+        txindex = g_txindex;
+    }
+    txindex->Start();
+    return true;
+}
+
+void InterruptTxIndex()
+{
+    std::shared_ptr<TxIndex> txindex = GetTxIndex();
+    if (txindex) txindex->Interrupt();
+}
+
+bool StopTxIndex()
+{
+    std::shared_ptr<TxIndex> txindex;
+    {
+        LOCK(cs_txindex);
+        txindex = std::move(g_txindex);
+    }
+    if (!txindex) return false;
+    txindex->Interrupt();
+    txindex->Stop();
+    // Let the callbacks already queued for the index run, before releasing it
+    SyncWithValidationInterfaceQueue();
+    return true;
+}
@@ -17,16 +17,18 @@
 #include "activemasternode.h"
 #include "addrman.h"
 #include "amount.h"
-#include "budget/budgetdb.h"
 #include "budget/budgetmanager.h"
 #include "checkpoints.h"
 #include "compat/sanity.h"
 #include "consensus/upgrades.h"
+#include "crypto/sha256.h"
 #include "evo/deterministicmns.h"
 #include "evo/evonotificationinterface.h"
 #include "fs.h"
 #include "httpserver.h"
 #include "httprpc.h"
+#include "index/blockfilterindex.h"
+#include "index/txindex.h"
 #include "invalid.h"
 #include "key.h"
 #include "mapport.h"
@@ -41,11 +43,13 @@
 #include "policy/policy.h"
 #include "rpc/register.h"
 #include "rpc/server.h"
+#include "sapling/sapling_validation.h"
 #include "script/sigcache.h"
 #include "script/standard.h"
 #include "scheduler.h"
 #include "spork.h"
 #include "sporkdb.h"
+#include "tiertwo_cachedb.h"
 #include "evo/deterministicmns.h"
 #include "evo/evodb.h"
 #include "txdb.h"
@@ -189,6 +193,8 @@ static std::unique_ptr<ECCVerifyHandle> globalVerifyHandle;
 
 static boost::thread_group threadGroup;
 static CScheduler scheduler;
+static std::set<BlockFilterType> g_enabled_filter_types;
+
 void Interrupt()
 {
     InterruptHTTPServer();
@@ -199,6 +205,8 @@ void Interrupt()
     InterruptMapPort();
     if (g_connman)
         g_connman->Interrupt();
+    InterruptTxIndex();
+    ForEachBlockFilterIndex([](BlockFilterIndex& index) { index.Interrupt(); });
 }
 
 /** Preparing steps before shutting down or restarting the wallet */
@@ -247,9 +255,13 @@ void PrepareShutdown()
     g_connman.reset();
     peerLogic.reset();
 
-    DumpMasternodes();
-    DumpBudgets(g_budgetman);
-    DumpMasternodePayments();
+    // Stop the indexes before flushing the chainstate, they will resume from their best block
+    StopTxIndex();
+    ForEachBlockFilterIndex([](BlockFilterIndex& index) { index.Stop(); });
+    DestroyAllBlockFilterIndexes();
+
+    FlushTierTwoCaches();
+    g_tiertwo_cachedb.reset();
     if (::mempool.IsLoaded() && gArgs.GetBoolArg("-persistmempool", DEFAULT_PERSIST_MEMPOOL)) {
         DumpMempool(::mempool);
     }
@@ -475,6 +487,8 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-sysperms", _("Create new files with system default permissions, instead of umask 077 (only effective with disabled wallet functionality)"));
 #endif
     strUsage += HelpMessageOpt("-txindex", strprintf(_("Maintain a full transaction index, used by the getrawtransaction rpc call (default: %u)"), DEFAULT_TXINDEX));
+    strUsage += HelpMessageOpt("-blockfilterindex=<type>", strprintf(_("Maintain an index of compact filters by block (default: %s, values: %s).") + " " +
+            _("If <type> is not supplied or if <type> = 1, indexes for all known types are enabled."), DEFAULT_BLOCKFILTERINDEX, ListBlockFilterTypes()));
     strUsage += HelpMessageOpt("-forcestart", _("Attempt to force blockchain corruption recovery") + " " + _("on startup"));
 
     strUsage += HelpMessageGroup(_("Connection options:"));
@@ -545,6 +559,8 @@ std::string HelpMessage(HelpMessageMode mode)
         strUsage += HelpMessageOpt("-limitdescendantcount=<n>", strprintf(_("Do not accept transactions if any ancestor would have <n> or more in-mempool descendants (default: %u)"), DEFAULT_DESCENDANT_LIMIT));
         strUsage += HelpMessageOpt("-limitdescendantsize=<n>", strprintf(_("Do not accept transactions if any ancestor would have more than <n> kilobytes of in-mempool descendants (default: %u)."), DEFAULT_DESCENDANT_SIZE_LIMIT));
         strUsage += HelpMessageOpt("-sporkkey=<privkey>", _("Enable spork administration functionality with the appropriate private key."));
+        strUsage += HelpMessageOpt("-mnlistcheckpointinterval=<n>", strprintf("Keep in memory the masternode list of every <n>th block while rebuilding older lists (default: %u)", DEFAULT_MNLIST_CHECKPOINT_INTERVAL));
+        strUsage += HelpMessageOpt("-mnlistcachesize=<n>", strprintf("Maximum estimated size of the masternode lists cache in megabytes (default: %u)", DEFAULT_MNLIST_CACHE_SIZE));
         strUsage += HelpMessageOpt("-nuparams=upgradeName:activationHeight", "Use given activation height for specified network upgrade (regtest-only)");
     }
     strUsage += HelpMessageOpt("-debug=<category>", strprintf(_("Output debugging information (default: %u, supplying <category> is optional)"), 0) + ". " +
@@ -559,9 +575,11 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-logtimemicros", strprintf("Add microsecond precision to debug timestamps (default: %u)", DEFAULT_LOGTIMEMICROS));
     if (showDebug) {
         strUsage += HelpMessageOpt("-mocktime=<n>", "Replace actual time with <n> seconds since epoch (default: 0)");
+        strUsage += HelpMessageOpt("-feefilter", strprintf("Tell other nodes to filter invs to us by our mempool min fee (default: %u)", DEFAULT_FEEFILTER));
         strUsage += HelpMessageOpt("-limitfreerelay=<n>", strprintf(_("Continuously rate-limit free transactions to <n>*1000 bytes per minute (default:%u)"), DEFAULT_LIMITFREERELAY));
         strUsage += HelpMessageOpt("-relaypriority", strprintf(_("Require high priority for relaying free or low-fee transactions (default:%u)"), DEFAULT_RELAYPRIORITY));
         strUsage += HelpMessageOpt("-maxsigcachesize=<n>", strprintf(_("Limit size of signature cache to <n> MiB (default: %u)"), DEFAULT_MAX_SIG_CACHE_SIZE));
+        strUsage += HelpMessageOpt("-maxsaplingproofcachesize=<n>", strprintf(_("Limit size of shielded proofs cache to <n> MiB (default: %u)"), DEFAULT_MAX_SAPLING_PROOF_CACHE_SIZE));
     }
     strUsage += HelpMessageOpt("-maxtipage=<n>", strprintf("Maximum tip age in seconds to consider node in initial block download (default: %u)", DEFAULT_MAX_TIP_AGE));
     strUsage += HelpMessageOpt("-minrelaytxfee=<amt>", strprintf(_("Fees (in %s/Kb) smaller than this are considered zero fee for relaying, mining and transaction creation (default: %s)"), CURRENCY_UNIT, FormatMoney(::minRelayTxFee.GetFeePerK())));
@@ -1103,6 +1121,22 @@ bool AppInitParameterInteraction()
     if (gArgs.GetBoolArg("-benchmark", false))
         UIWarning(strprintf(_("Warning: Unsupported argument %s ignored, use %s"), "-benchmark", "-debug=bench."));
 
+    // -blockfilterindex
+    const std::vector<std::string>& filter_types = gArgs.GetArgs("-blockfilterindex");
+    if (!filter_types.empty() && filter_types.back() != "0") {
+        if (filter_types.back() == "1" || filter_types.back().empty()) {
+            g_enabled_filter_types = AllBlockFilterTypes();
+        } else {
+            for (const auto& name : filter_types) {
+                BlockFilterType filter_type;
+                if (!BlockFilterTypeByName(name, filter_type)) {
+                    return UIError(strprintf(_("Unknown -blockfilterindex value %s."), name));
+                }
+                g_enabled_filter_types.insert(filter_type);
+            }
+        }
+    }
+
     // Checkmempool and checkblockindex default to true in regtest mode
     int ratio = std::min<int>(
             std::max<int>(gArgs.GetArg("-checkmempool", Params().DefaultConsistencyChecks() ? 1 : 0), 0), 1000000);
@@ -1229,6 +1263,10 @@ bool AppInitSanityChecks()
 {
     // ********************************************************* Step 4: sanity checks
 
+    // Select the fastest SHA256 implementation supported by the CPU
+    std::string sha256_algo = SHA256AutoDetect();
+    LogPrintf("Using the '%s' SHA256 implementation\n", sha256_algo);
+
     // Initialize elliptic curve code
     RandomInit();
     ECC_Start();
@@ -1274,11 +1312,18 @@ bool AppInitMain()
     std::ostringstream strErrors;
 
     InitSignatureCache();
+    InitSaplingProofCache();
 
     LogPrintf("Using %u threads for script verification\n", nScriptCheckThreads);
     if (nScriptCheckThreads) {
-        for (int i = 0; i < nScriptCheckThreads - 1; i++)
+        for (int i = 0; i < nScriptCheckThreads - 1; i++) {
             threadGroup.create_thread(&ThreadScriptCheck);
+            threadGroup.create_thread(&ThreadSaplingProofCheck);
+            threadGroup.create_thread(&ThreadSignedMessageCheck);
+#ifdef ENABLE_WALLET
+            threadGroup.create_thread(&ThreadSaplingTrialDecryption);
+#endif
+        }
     }
 
     if (gArgs.IsArgSet("-sporkkey")) // spork priv key
@@ -1519,8 +1564,18 @@ bool AppInitMain()
     nTotalCache = std::max(nTotalCache, nMinDbCache << 20); // total cache cannot be less than nMinDbCache
     nTotalCache = std::min(nTotalCache, nMaxDbCache << 20); // total cache cannot be greater than nMaxDbcache
     int64_t nBlockTreeDBCache = nTotalCache / 8;
-    nBlockTreeDBCache = std::min(nBlockTreeDBCache, (gArgs.GetBoolArg("-txindex", DEFAULT_TXINDEX) ? nMaxBlockDBAndTxIndexCache : nMaxBlockDBCache) << 20);
+    nBlockTreeDBCache = std::min(nBlockTreeDBCache, nMaxBlockDBCache << 20);
     nTotalCache -= nBlockTreeDBCache;
+    int64_t nTxIndexCache = 0;
+    if (gArgs.GetBoolArg("-txindex", DEFAULT_TXINDEX)) {
+        nTxIndexCache = std::min(nTotalCache / 8, nMaxTxIndexCache << 20);
+        nTotalCache -= nTxIndexCache;
+    }
+    int64_t nFilterIndexCache = 0;
+    if (!g_enabled_filter_types.empty()) {
+        nFilterIndexCache = std::min(nTotalCache / 8, nMaxFilterIndexCache << 20);
+        nTotalCache -= nFilterIndexCache;
+    }
     int64_t nCoinDBCache = std::min(nTotalCache / 2, (nTotalCache / 4) + (1 << 23)); // use 25%-50% of the remainder for disk cache
     nCoinDBCache = std::min(nCoinDBCache, nMaxCoinsDBCache << 20); // cap total coins db cache
     nTotalCache -= nCoinDBCache;
@@ -1528,6 +1583,13 @@ bool AppInitMain()
     int64_t nEvoDbCache = 1024 * 1024 * 16; // TODO
     LogPrintf("Cache configuration:\n");
     LogPrintf("* Using %.1fMiB for block index database\n", nBlockTreeDBCache * (1.0 / 1024 / 1024));
+    if (gArgs.GetBoolArg("-txindex", DEFAULT_TXINDEX)) {
+        LogPrintf("* Using %.1fMiB for transaction index database\n", nTxIndexCache * (1.0 / 1024 / 1024));
+    }
+    if (!g_enabled_filter_types.empty()) {
+        LogPrintf("* Using %.1fMiB for %s block filter index database\n",
+                  nFilterIndexCache / g_enabled_filter_types.size() * (1.0 / 1024 / 1024), ListBlockFilterTypes());
+    }
     LogPrintf("* Using %.1fMiB for chain state database\n", nCoinDBCache * (1.0 / 1024 / 1024));
     LogPrintf("* Using %.1fMiB for in-memory UTXO set\n", nCoinCacheUsage * (1.0 / 1024 / 1024));
 
@@ -1558,7 +1620,9 @@ bool AppInitMain()
                 deterministicMNManager.reset();
                 evoDb.reset();
                 evoDb.reset(new CEvoDB(nEvoDbCache, false, fReindex));
-                deterministicMNManager.reset(new CDeterministicMNManager(*evoDb));
+                deterministicMNManager.reset(new CDeterministicMNManager(*evoDb,
+                        gArgs.GetArg("-mnlistcheckpointinterval", DEFAULT_MNLIST_CHECKPOINT_INTERVAL),
+                        std::max<int64_t>(gArgs.GetArg("-mnlistcachesize", DEFAULT_MNLIST_CACHE_SIZE), 1) << 20));
 
                 pblocktree = new CBlockTreeDB(nBlockTreeDBCache, false, fReset);
 
@@ -1573,8 +1637,7 @@ bool AppInitMain()
                 uiInterface.InitMessage(_("Loading sporks..."));
                 sporkManager.LoadSporksFromDB();
 
-                // LoadBlockIndex will load fTxIndex from the db, or set it if
-                // we're reindexing. It will also load fHavePruned if we've
+                // LoadBlockIndex will load fHavePruned if we've
                 // ever removed a block file from disk.
                 // Note that it also sets fReindex based on the disk flag!
                 // From here on out fReindex and fReset mean something different!
@@ -1592,12 +1655,6 @@ bool AppInitMain()
                 if (!mapBlockIndex.empty() && mapBlockIndex.count(consensus.hashGenesisBlock) == 0)
                     return UIError(_("Incorrect or no genesis block found. Wrong datadir for network?"));
 
-                // Check for changed -txindex state
-                if (fTxIndex != gArgs.GetBoolArg("-txindex", DEFAULT_TXINDEX)) {
-                    strLoadError = strprintf(_("You need to rebuild the database using %s to change %s"), "-reindex-chainstate", "-txindex");
-                    break;
-                }
-
                 // At this point blocktree args are consistent with what's on disk.
                 // If we're not mid-reindex (based on disk + args), add a genesis block on disk.
                 // This is called again in ThreadImport in the reindex completes.
@@ -1728,6 +1785,16 @@ bool AppInitMain()
         mempool.ReadFeeEstimates(est_filein);
     fFeeEstimatesInitialized = true;
 
+    // Start the indexes. They catch up with the chain in the background, the block
+    // filter indexes only once the initial block download is over.
+    if (gArgs.GetBoolArg("-txindex", DEFAULT_TXINDEX)) {
+        StartTxIndex(nTxIndexCache, fReindex);
+    }
+    for (const BlockFilterType& filter_type : g_enabled_filter_types) {
+        InitBlockFilterIndex(filter_type, nFilterIndexCache / g_enabled_filter_types.size(), false, fReindex);
+        GetBlockFilterIndex(filter_type)->Start();
+    }
+
 // ********************************************************* Step 8: Backup and Load wallet
 #ifdef ENABLE_WALLET
     if (!InitLoadWallet())
@@ -1799,47 +1866,21 @@ bool AppInitMain()
 
     mnodeman.SetBestHeight(nChainHeight);
     LoadBlockHashesCache(mnodeman);
-    CMasternodeDB mndb;
-    CMasternodeDB::ReadResult readResult = mndb.Read(mnodeman);
-    if (readResult == CMasternodeDB::FileError)
-        LogPrintf("Missing masternode cache file - mncache.dat, will try to recreate\n");
-    else if (readResult != CMasternodeDB::Ok) {
-        LogPrintf("Error reading mncache.dat - cached data discarded\n");
-    }
-
-    uiInterface.InitMessage(_("Loading budget cache..."));
+    if (nChainHeight > 0) g_budgetman.SetBestHeight(nChainHeight);
 
-    CBudgetDB budgetdb;
-    const bool fDryRun = (nChainHeight <= 0);
-    if (!fDryRun) g_budgetman.SetBestHeight(nChainHeight);
-    CBudgetDB::ReadResult readResult2 = budgetdb.Read(g_budgetman, fDryRun);
-
-    if (readResult2 == CBudgetDB::FileError)
-        LogPrintf("Missing budget cache - budget.dat, will try to recreate\n");
-    else if (readResult2 != CBudgetDB::Ok) {
-        LogPrintf("Error reading budget.dat - cached data discarded\n");
-    }
-
-    //flag our cached items so we send them to our peers
-    g_budgetman.ResetSync();
-    g_budgetman.ClearSeen();
-
-    uiInterface.InitMessage(_("Loading masternode payment cache..."));
-
-    CMasternodePaymentDB mnpayments;
-    CMasternodePaymentDB::ReadResult readResult3 = mnpayments.Read(masternodePayments);
-
-    if (readResult3 == CMasternodePaymentDB::FileError)
-        LogPrintf("Missing masternode payment cache - mnpayments.dat, will try to recreate\n");
-    else if (readResult3 != CMasternodePaymentDB::Ok) {
-        LogPrintf("Error reading mnpayments.dat - cached data discarded\n");
-    }
+    // The legacy cache files are imported synchronously (only once), otherwise
+    // the caches are loaded in the background by ThreadCheckMasternodes.
+    g_tiertwo_cachedb.reset(new CTierTwoCacheDB(TIERTWO_CACHE_DB_CACHE_SIZE));
+    ImportLegacyTierTwoCaches(nChainHeight);
+    scheduler.scheduleEvery(FlushTierTwoCaches, TIERTWO_CACHE_FLUSH_INTERVAL * 1000);
+    // Publish the budget changes (e.g. the votes received) for the RPC readers
+    scheduler.scheduleEvery([]{ g_budgetman.PublishSnapshot(); }, BUDGET_SNAPSHOT_INTERVAL * 1000);
 
     fMasterNode = gArgs.GetBoolArg("-masternode", DEFAULT_MASTERNODE);
 
-    if ((fMasterNode || masternodeConfig.getCount() > -1) && fTxIndex == false) {
+    if ((fMasterNode || masternodeConfig.getCount() > -1) && !GetTxIndex()) {
         return UIError(strprintf(_("Enabling Masternode support requires turning on transaction indexing."
-                                   "Please add %s to your configuration and start with %s"), "txindex=1", "-reindex"));
+                                   "Please add %s to your configuration"), "txindex=1"));
     }
 
     if (fMasterNode) {
@@ -7,6 +7,7 @@
 
 #include "kernel.h"
 
+#include "crypto/common.h"
 #include "db.h"
 #include "legacy/stakemodifier.h"
 #include "policy/policy.h"
@@ -83,6 +84,59 @@ bool CStakeKernel::CheckKernelHash(bool fSkipLog) const
     return res;
 }
 
+CStakeKernelSearch::CStakeKernelSearch(const CBlockIndex* pindexPrev, unsigned int _nBits):
+    hashPrevBlock(pindexPrev->GetBlockHash()),
+    nBits(_nBits),
+    stakeModifier(pindexPrev->GetStakeModifierV2())
+{
+    bnTargetPerCoin.SetCompact(nBits);
+}
+
+bool CStakeKernelSearch::IsSupported(const CBlockIndex* pindexPrev)
+{
+    return Params().GetConsensus().NetworkUpgradeActive(pindexPrev->nHeight + 1, Consensus::UPGRADE_V3_4);
+}
+
+bool CStakeKernelSearch::IsPreparedFor(const CBlockIndex* pindexPrev, unsigned int _nBits) const
+{
+    return hashPrevBlock == pindexPrev->GetBlockHash() && nBits == _nBits;
+}
+
+void CStakeKernelSearch::AddCandidate(const COutPoint& outpoint, const CBlockIndex* pindexFrom, CAmount nValue)
+{
+    // Same layout as CStakeKernel::GetHash:
+    // stakeModifier (32) | nTimeBlockFrom (4) | outpoint.n (4) | outpoint.hash (32) | nTime (4)
+    unsigned char prefix[64];
+    memcpy(prefix, stakeModifier.begin(), 32);
+    WriteLE32(prefix + 32, pindexFrom->nTime);
+    WriteLE32(prefix + 36, outpoint.n);
+    memcpy(prefix + 40, outpoint.hash.begin(), 24);
+
+    vCandidates.emplace_back();
+    Candidate& c = vCandidates.back();
+    c.outpoint = outpoint;
+    c.midstate.Write(prefix, sizeof(prefix));
+    memcpy(c.tail, outpoint.hash.begin() + 24, 8);
+    c.bnTarget = bnTargetPerCoin * (arith_uint256(nValue) / 100);
+}
+
+size_t CStakeKernelSearch::FindKernel(int nTimeTx, size_t nStart, size_t nEnd) const
+{
+    nEnd = std::min(nEnd, vCandidates.size());
+    unsigned char tail[12];
+    WriteLE32(tail + 8, nTimeTx);
+    uint256 hash;
+    for (size_t i = nStart; i < nEnd; i++) {
+        const Candidate& c = vCandidates[i];
+        memcpy(tail, c.tail, 8);
+        CSHA256 hasher(c.midstate);
+        hasher.Write(tail, sizeof(tail)).Finalize(hash.begin());
+        CSHA256().Write(hash.begin(), CSHA256::OUTPUT_SIZE).Finalize(hash.begin());
+        if (UintToArith256(hash) < c.bnTarget) return i;
+    }
+    return nEnd;
+}
+
 
 /*
  * PoS Validation
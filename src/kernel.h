@@ -8,6 +8,8 @@
 #ifndef PIVX_KERNEL_H
 #define PIVX_KERNEL_H
 
+#include "arith_uint256.h"
+#include "crypto/sha256.h"
 #include "stakeinput.h"
 
 class CStakeKernel {
@@ -39,6 +41,54 @@ private:
     CAmount stakeValue{0};     // target multiplier
 };
 
+/*
+ * CStakeKernelSearch   Kernel search engine used by the staker.
+ *
+ * Prepares the kernel preimage of every candidate once per tip: the constant prefix
+ * (stake modifier v2, time of the block from, uniqueness) is absorbed into a SHA256
+ * midstate and the weighted target of each coin is precomputed. Hashing a time slot
+ * then only costs the tail compression and the outer hash of each candidate, with no
+ * allocation, serialization or big-number multiplication in the loop.
+ * Only available once the stake modifier v2 is enforced (v3.4 upgrade).
+ */
+class CStakeKernelSearch
+{
+public:
+    CStakeKernelSearch(const CBlockIndex* pindexPrev, unsigned int nBits);
+
+    // Whether the search engine can be used for a block on top of pindexPrev
+    static bool IsSupported(const CBlockIndex* pindexPrev);
+
+    // Add a candidate coin
+    void AddCandidate(const COutPoint& outpoint, const CBlockIndex* pindexFrom, CAmount nValue);
+
+    // Whether this engine was prepared for the same tip and difficulty
+    bool IsPreparedFor(const CBlockIndex* pindexPrev, unsigned int nBits) const;
+
+    size_t Size() const { return vCandidates.size(); }
+    const COutPoint& GetOutPoint(size_t i) const { return vCandidates[i].outpoint; }
+
+    /*
+     * Hash the candidates in [nStart, nEnd) for the block time nTimeTx.
+     * Returns the index of the first candidate meeting its target, or nEnd if none does.
+     */
+    size_t FindKernel(int nTimeTx, size_t nStart, size_t nEnd) const;
+
+private:
+    struct Candidate {
+        COutPoint outpoint;
+        CSHA256 midstate;           // hasher after the first 64 bytes of the preimage
+        unsigned char tail[8];      // last bytes of the outpoint hash (followed by nTime)
+        arith_uint256 bnTarget;     // weighted target
+    };
+
+    uint256 hashPrevBlock;
+    unsigned int nBits{0};
+    uint256 stakeModifier;
+    arith_uint256 bnTargetPerCoin;
+    std::vector<Candidate> vCandidates;
+};
+
 /* PoS Validation */
 
 /*
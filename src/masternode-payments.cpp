@@ -27,8 +27,6 @@ RecursiveMutex cs_vecPayments;
 RecursiveMutex cs_mapMasternodeBlocks;
 RecursiveMutex cs_mapMasternodePayeeVotes;
 
-static const int MNPAYMENTS_DB_VERSION = 1;
-
 //
 // CMasternodePaymentDB
 //
@@ -39,38 +37,6 @@ CMasternodePaymentDB::CMasternodePaymentDB()
     strMagicMessage = "MasternodePayments";
 }
 
-bool CMasternodePaymentDB::Write(const CMasternodePayments& objToSave)
-{
-    int64_t nStart = GetTimeMillis();
-
-    // serialize, checksum data up to that point, then append checksum
-    CDataStream ssObj(SER_DISK, CLIENT_VERSION);
-    ssObj << MNPAYMENTS_DB_VERSION;
-    ssObj << strMagicMessage;                   // masternode cache file specific magic message
-    ssObj << Params().MessageStart(); // network specific magic number
-    ssObj << objToSave;
-    uint256 hash = Hash(ssObj.begin(), ssObj.end());
-    ssObj << hash;
-
-    // open output file, and associate with CAutoFile
-    FILE* file = fsbridge::fopen(pathDB, "wb");
-    CAutoFile fileout(file, SER_DISK, CLIENT_VERSION);
-    if (fileout.IsNull())
-        return error("%s : Failed to open file %s", __func__, pathDB.string());
-
-    // Write and commit header, data
-    try {
-        fileout << ssObj;
-    } catch (const std::exception& e) {
-        return error("%s : Serialize or I/O error - %s", __func__, e.what());
-    }
-    fileout.fclose();
-
-    LogPrint(BCLog::MASTERNODE,"Written info to mnpayments.dat  %dms\n", GetTimeMillis() - nStart);
-
-    return true;
-}
-
 CMasternodePaymentDB::ReadResult CMasternodePaymentDB::Read(CMasternodePayments& objToLoad)
 {
     int64_t nStart = GetTimeMillis();
@@ -187,17 +153,6 @@ void CMasternodePaymentWinner::Relay()
     g_connman->RelayInv(inv);
 }
 
-void DumpMasternodePayments()
-{
-    int64_t nStart = GetTimeMillis();
-
-    CMasternodePaymentDB paymentdb;
-    LogPrint(BCLog::MASTERNODE,"Writing info to mnpayments.dat...\n");
-    paymentdb.Write(masternodePayments);
-
-    LogPrint(BCLog::MASTERNODE,"Budget dump finished  %dms\n", GetTimeMillis() - nStart);
-}
-
 bool IsBlockValueValid(int nHeight, CAmount& nExpectedValue, CAmount nMinted, CAmount& nBudgetAmt)
 {
     if (!masternodeSync.IsSynced()) {
@@ -535,6 +490,39 @@ bool CMasternodePayments::IsScheduled(const CMasternode& mn, int nNotBlockHeight
     return false;
 }
 
+size_t CMasternodePayments::WriteDBChanges(CDBBatch& batch)
+{
+    LOCK2(cs_mapMasternodeBlocks, cs_mapMasternodePayeeVotes);
+    return dbMasternodeBlocks.WriteChanges(batch, mapMasternodeBlocks) +
+           dbMasternodePayeeVotes.WriteChanges(batch, mapMasternodePayeeVotes);
+}
+
+void CMasternodePayments::DBChangesWritten()
+{
+    dbMasternodeBlocks.ChangesWritten();
+    dbMasternodePayeeVotes.ChangesWritten();
+}
+
+bool CMasternodePayments::LoadFromDB(CDBWrapper& db)
+{
+    if (!dbMasternodeBlocks.Load(db, mapMasternodeBlocks, cs_mapMasternodeBlocks) ||
+        !dbMasternodePayeeVotes.Load(db, mapMasternodePayeeVotes, cs_mapMasternodePayeeVotes)) {
+        // discard the cached data, it will be written again with the next flush
+        dbMasternodeBlocks.Wipe(db);
+        dbMasternodePayeeVotes.Wipe(db);
+        SetDBDirty();
+        return false;
+    }
+    return true;
+}
+
+void CMasternodePayments::SetDBDirty()
+{
+    LOCK2(cs_mapMasternodeBlocks, cs_mapMasternodePayeeVotes);
+    dbMasternodeBlocks.SetAllDirty(mapMasternodeBlocks);
+    dbMasternodePayeeVotes.SetAllDirty(mapMasternodePayeeVotes);
+}
+
 bool CMasternodePayments::AddWinningMasternode(CMasternodePaymentWinner& winnerIn)
 {
     // check winner height
@@ -550,6 +538,7 @@ bool CMasternodePayments::AddWinningMasternode(CMasternodePaymentWinner& winnerI
         }
 
         mapMasternodePayeeVotes[winnerIn.GetHash()] = winnerIn;
+        dbMasternodePayeeVotes.SetDirty(winnerIn.GetHash());
 
         if (!mapMasternodeBlocks.count(winnerIn.nBlockHeight)) {
             CMasternodeBlockPayees blockPayees(winnerIn.nBlockHeight);
@@ -560,7 +549,9 @@ bool CMasternodePayments::AddWinningMasternode(CMasternodePaymentWinner& winnerI
     CTxDestination addr;
     ExtractDestination(winnerIn.payee, addr);
     LogPrint(BCLog::MASTERNODE, "mnw - Adding winner %s for block %d\n", EncodeDestination(addr), winnerIn.nBlockHeight);
+    LOCK(cs_mapMasternodeBlocks);
     mapMasternodeBlocks[winnerIn.nBlockHeight].AddPayee(winnerIn.payee, 1);
+    dbMasternodeBlocks.SetDirty(winnerIn.nBlockHeight);
 
     return true;
 }
@@ -687,8 +678,9 @@ void CMasternodePayments::CleanPaymentList(int mnCount, int nHeight)
         if (nHeight - winner.nBlockHeight > nLimit) {
             LogPrint(BCLog::MASTERNODE, "CMasternodePayments::CleanPaymentList - Removing old Masternode payment - block %d\n", winner.nBlockHeight);
             masternodeSync.mapSeenSyncMNW.erase((*it).first);
+            dbMasternodePayeeVotes.SetDirty(it->first);
             mapMasternodePayeeVotes.erase(it++);
-            mapMasternodeBlocks.erase(winner.nBlockHeight);
+            if (mapMasternodeBlocks.erase(winner.nBlockHeight)) dbMasternodeBlocks.SetDirty(winner.nBlockHeight);
         } else {
             ++it;
         }
@@ -8,6 +8,7 @@
 
 #include "key.h"
 #include "masternode.h"
+#include "tiertwo_cachedb.h"
 
 
 extern RecursiveMutex cs_vecPayments;
@@ -36,9 +37,7 @@ void FillBlockPayee(CMutableTransaction& txCoinbase, CMutableTransaction& txCoin
  */
 bool IsCoinbaseValueValid(const CTransactionRef& tx, CAmount nBudgetAmt, CValidationState& _state);
 
-void DumpMasternodePayments();
-
-/** Save Masternode Payment Data (mnpayments.dat)
+/** Legacy Masternode Payment Data file (mnpayments.dat), only read to import it in the tier two caches db
  */
 class CMasternodePaymentDB
 {
@@ -58,7 +57,6 @@ public:
     };
 
     CMasternodePaymentDB();
-    bool Write(const CMasternodePayments& objToSave);
     ReadResult Read(CMasternodePayments& objToLoad);
 };
 
@@ -237,6 +235,10 @@ class CMasternodePayments
 private:
     int nLastBlockHeight;
 
+    // Incremental persistence of the votes and block payees
+    CTierTwoDBTable<uint256, CMasternodePaymentWinner> dbMasternodePayeeVotes{DB_MNPAYMENTS_VOTES};
+    CTierTwoDBTable<int, CMasternodeBlockPayees> dbMasternodeBlocks{DB_MNPAYMENTS_BLOCKS};
+
 public:
     std::map<uint256, CMasternodePaymentWinner> mapMasternodePayeeVotes;
     std::map<int, CMasternodeBlockPayees> mapMasternodeBlocks;
@@ -250,10 +252,21 @@ public:
     void Clear()
     {
         LOCK2(cs_mapMasternodeBlocks, cs_mapMasternodePayeeVotes);
+        for (const auto& it : mapMasternodeBlocks) dbMasternodeBlocks.SetDirty(it.first);
+        for (const auto& it : mapMasternodePayeeVotes) dbMasternodePayeeVotes.SetDirty(it.first);
         mapMasternodeBlocks.clear();
         mapMasternodePayeeVotes.clear();
     }
 
+    // Add to batch the changes since the last call (see CTierTwoDBTable). Returns the number of changed entries.
+    size_t WriteDBChanges(CDBBatch& batch);
+    // Record the changes of the last WriteDBChanges as written, after the batch was written to the db
+    void DBChangesWritten();
+    // Load the cached data from db, keeping the entries already in memory
+    bool LoadFromDB(CDBWrapper& db);
+    // Mark all the entries to write with the next flush (e.g. after the import of the legacy flat file)
+    void SetDBDirty();
+
     bool AddWinningMasternode(CMasternodePaymentWinner& winner);
     void ProcessBlock(int nBlockHeight);
 
@@ -17,6 +17,8 @@
 #include "addrman.h"
 // clang-format on
 
+#include <algorithm>
+
 class CMasternodeSync;
 CMasternodeSync masternodeSync;
 
@@ -107,6 +109,11 @@ void CMasternodeSync::Reset()
     RequestedMasternodeAssets = MASTERNODE_SYNC_INITIAL;
     RequestedMasternodeAttempt = 0;
     nAssetSyncStarted = GetTime();
+    {
+        LOCK(cs_assets);
+        mapAssetSync.clear();
+        mapPeerStats.clear();
+    }
 }
 
 void CMasternodeSync::AddedMasternodeList(const uint256& hash)
@@ -224,34 +231,56 @@ void CMasternodeSync::ProcessMessage(CNode* pfrom, std::string& strCommand, CDat
         int nCount;
         vRecv >> nItemID >> nCount;
 
-        if (RequestedMasternodeAssets >= MASTERNODE_SYNC_FINISHED) return;
-
-        //this means we will receive no further communication
-        switch (nItemID) {
-        case (MASTERNODE_SYNC_LIST):
-            if (nItemID != RequestedMasternodeAssets) return;
-            sumMasternodeList += nCount;
-            countMasternodeList++;
-            break;
-        case (MASTERNODE_SYNC_MNW):
-            if (nItemID != RequestedMasternodeAssets) return;
-            sumMasternodeWinner += nCount;
-            countMasternodeWinner++;
-            break;
-        case (MASTERNODE_SYNC_BUDGET_PROP):
-            if (RequestedMasternodeAssets != MASTERNODE_SYNC_BUDGET) return;
-            sumBudgetItemProp += nCount;
-            countBudgetItemProp++;
-            break;
-        case (MASTERNODE_SYNC_BUDGET_FIN):
-            if (RequestedMasternodeAssets != MASTERNODE_SYNC_BUDGET) return;
-            sumBudgetItemFin += nCount;
-            countBudgetItemFin++;
-            break;
-        }
+        ProcessSyncStatusCount(pfrom->GetId(), nItemID, nCount);
+    }
+}
 
-        LogPrint(BCLog::MASTERNODE, "CMasternodeSync:ProcessMessage - ssc - got inventory count %d %d\n", nItemID, nCount);
+void CMasternodeSync::ProcessSyncStatusCount(NodeId id, int nItemID, int nCount)
+{
+    if (RequestedMasternodeAssets >= MASTERNODE_SYNC_FINISHED) return;
+
+    //this means we will receive no further communication
+    LOCK(cs_assets);
+    const int nAsset = (nItemID == MASTERNODE_SYNC_BUDGET_PROP || nItemID == MASTERNODE_SYNC_BUDGET_FIN) ?
+                       MASTERNODE_SYNC_BUDGET : nItemID;
+    auto itAsset = mapAssetSync.find(nAsset);
+    if (itAsset == mapAssetSync.end()) return;
+    TierTwoAssetSync& asset = itAsset->second;
+    auto itRequested = asset.mapRequested.find(id);
+    if (itRequested == asset.mapRequested.end() || asset.setAnswered.count(id)) return;
+
+    switch (nItemID) {
+    case (MASTERNODE_SYNC_LIST):
+        sumMasternodeList += nCount;
+        countMasternodeList++;
+        break;
+    case (MASTERNODE_SYNC_MNW):
+        sumMasternodeWinner += nCount;
+        countMasternodeWinner++;
+        break;
+    case (MASTERNODE_SYNC_BUDGET_PROP):
+        sumBudgetItemProp += nCount;
+        countBudgetItemProp++;
+        break;
+    case (MASTERNODE_SYNC_BUDGET_FIN):
+        sumBudgetItemFin += nCount;
+        countBudgetItemFin++;
+        break;
+    default:
+        return;
     }
+
+    LogPrint(BCLog::MASTERNODE, "CMasternodeSync:ProcessMessage - ssc - got inventory count %d %d\n", nItemID, nCount);
+
+    asset.mapAnnounced[id] += nCount;
+    // the budget finalizations are announced after the proposals
+    if (nItemID == MASTERNODE_SYNC_BUDGET_PROP) return;
+
+    asset.setAnswered.emplace(id);
+    TierTwoPeerStats& stats = mapPeerStats[id];
+    // count the answer itself as an item, so that the peers with nothing to send are rated on the latency
+    stats.nItems += asset.mapAnnounced[id] + 1;
+    stats.nMillis += std::max<int64_t>(GetTimeMillis() - itRequested->second, 1);
 }
 
 void CMasternodeSync::ClearFulfilledRequest()
@@ -264,12 +293,71 @@ void CMasternodeSync::ClearFulfilledRequest()
     });
 }
 
+int TierTwoAssetSync::GetExpectedCount() const
+{
+    int nExpected = 0;
+    for (const NodeId& id : setAnswered) {
+        auto it = mapAnnounced.find(id);
+        if (it != mapAnnounced.end()) nExpected = std::max(nExpected, it->second);
+    }
+    return nExpected;
+}
+
+int TierTwoAssetSync::CountInFlight(int64_t nNowMillis) const
+{
+    int nCount = 0;
+    for (const auto& it : mapRequested) {
+        if (!setAnswered.count(it.first) && it.second > nNowMillis - MASTERNODE_SYNC_TIMEOUT * 2 * 1000) nCount++;
+    }
+    return nCount;
+}
+
+int CMasternodeSync::GetSeenCount(int nAsset) const
+{
+    switch (nAsset) {
+    case MASTERNODE_SYNC_LIST:
+        return mapSeenSyncMNB.size();
+    case MASTERNODE_SYNC_MNW:
+        return mapSeenSyncMNW.size();
+    case MASTERNODE_SYNC_BUDGET:
+        return mapSeenSyncBudget.size();
+    }
+    return 0;
+}
+
+int64_t CMasternodeSync::GetLastItemTime(int nAsset) const
+{
+    switch (nAsset) {
+    case MASTERNODE_SYNC_LIST:
+        return lastMasternodeList;
+    case MASTERNODE_SYNC_MNW:
+        return lastMasternodeWinner;
+    case MASTERNODE_SYNC_BUDGET:
+        return lastBudgetItem;
+    }
+    return 0;
+}
+
+static const char* GetAssetRequestName(int nAsset)
+{
+    switch (nAsset) {
+    case MASTERNODE_SYNC_LIST:
+        return "mnsync";
+    case MASTERNODE_SYNC_MNW:
+        return "mnwsync";
+    case MASTERNODE_SYNC_BUDGET:
+        return "busync";
+    }
+    return "getspork";
+}
+
 void CMasternodeSync::Process()
 {
     static int tick = 0;
     const bool isRegTestNet = Params().IsRegTestNet();
 
-    if (tick++ % MASTERNODE_SYNC_TIMEOUT != 0) return;
+    // The scheduler runs every second, to move on as soon as an asset is complete
+    if (tick++ % MASTERNODE_SYNC_TIMEOUT != 0 && (isRegTestNet || IsSynced())) return;
 
     if (IsSynced()) {
         /*
@@ -296,9 +384,6 @@ void CMasternodeSync::Process()
     if (!IsBlockchainSynced() &&
         RequestedMasternodeAssets > MASTERNODE_SYNC_SPORKS) return;
 
-    // Skip after legacy obsolete. !TODO: remove when transition to DMN is complete
-    bool fLegacyMnObsolete = deterministicMNManager->LegacyMNObsolete();
-
     CMasternodeSync* sync = this;
 
     // New sync architecture, regtest only for now.
@@ -310,134 +395,202 @@ void CMasternodeSync::Process()
     }
 
     // Mainnet sync
-    g_connman->ForEachNodeContinueIf([sync, fLegacyMnObsolete](CNode* pnode){
-        return sync->SyncWithNode(pnode, fLegacyMnObsolete);
-    });
-}
-
-bool CMasternodeSync::SyncWithNode(CNode* pnode, bool fLegacyMnObsolete)
-{
-    CNetMsgMaker msgMaker(pnode->GetSendVersion());
-
-    //set to synced
     if (RequestedMasternodeAssets == MASTERNODE_SYNC_SPORKS) {
-        if (pnode->HasFulfilledRequest("getspork")) return true;
-        pnode->FulfilledRequest("getspork");
-
-        g_connman->PushMessage(pnode, msgMaker.Make(NetMsgType::GETSPORKS)); //get current network sporks
-        if (RequestedMasternodeAttempt >= 2) SwitchToNextAsset();
-        RequestedMasternodeAttempt++;
-        return false;
+        SyncSporks();
+        return;
     }
 
-    if (pnode->nVersion >= ActiveProtocol()) {
-        if (RequestedMasternodeAssets == MASTERNODE_SYNC_LIST) {
-            if (fLegacyMnObsolete) {
-                SwitchToNextAsset();
-                return false;
-            }
+    // Skip after legacy obsolete. !TODO: remove when transition to DMN is complete
+    if (deterministicMNManager->LegacyMNObsolete() &&
+            (RequestedMasternodeAssets == MASTERNODE_SYNC_LIST || RequestedMasternodeAssets == MASTERNODE_SYNC_MNW)) {
+        SwitchToNextAsset();
+    }
 
-            LogPrint(BCLog::MASTERNODE, "CMasternodeSync::Process() - lastMasternodeList %lld (GetTime() - MASTERNODE_SYNC_TIMEOUT) %lld\n", lastMasternodeList, GetTime() - MASTERNODE_SYNC_TIMEOUT);
-            if (lastMasternodeList > 0 && lastMasternodeList < GetTime() - MASTERNODE_SYNC_TIMEOUT * 2 && RequestedMasternodeAttempt >= MASTERNODE_SYNC_THRESHOLD) { //hasn't received a new item in the last five seconds, so we'll move to the
-                SwitchToNextAsset();
-                return false;
-            }
+    // The legacy masternodes must be known to validate their winners and budget votes:
+    // the list is synced first, then the winners and the budget together.
+    // (GetNextAsset skips the list and the winners after legacy obsolete)
+    std::vector<int> vAssets;
+    if (RequestedMasternodeAssets == MASTERNODE_SYNC_LIST) {
+        vAssets.emplace_back(MASTERNODE_SYNC_LIST);
+    } else {
+        for (int nAsset = RequestedMasternodeAssets; nAsset != MASTERNODE_SYNC_FINISHED; nAsset = GetNextAsset(nAsset)) {
+            vAssets.emplace_back(nAsset);
+        }
+    }
 
-            if (pnode->HasFulfilledRequest("mnsync")) return true;
-            pnode->FulfilledRequest("mnsync");
-
-            // timeout
-            if (lastMasternodeList == 0 &&
-                (RequestedMasternodeAttempt >= MASTERNODE_SYNC_THRESHOLD * 3 || GetTime() - nAssetSyncStarted > MASTERNODE_SYNC_TIMEOUT * 5)) {
-                if (sporkManager.IsSporkActive(SPORK_8_MASTERNODE_PAYMENT_ENFORCEMENT)) {
-                    LogPrintf("CMasternodeSync::Process - ERROR - Sync has failed on %s, will retry later\n", "MASTERNODE_SYNC_LIST");
-                    RequestedMasternodeAssets = MASTERNODE_SYNC_FAILED;
-                    RequestedMasternodeAttempt = 0;
-                    lastFailure = GetTime();
-                    nCountFailures++;
-                } else {
-                    SwitchToNextAsset();
-                }
-                return false;
+    std::vector<int> vPending;
+    size_t nCompleted = 0;
+    bool fFailed = false;
+    {
+        LOCK(cs_assets);
+        for (int nAsset : vAssets) {
+            if (!CheckAssetComplete(nAsset, fFailed)) {
+                vPending.emplace_back(nAsset);
+            } else if (fFailed) {
+                LogPrintf("CMasternodeSync::Process - ERROR - Sync has failed on asset %d, will retry later\n", nAsset);
+                break;
+            } else if (vPending.empty()) {
+                // the assets are synced in order: move past the completed ones
+                nCompleted++;
             }
+        }
+    }
 
-            if (RequestedMasternodeAttempt >= MASTERNODE_SYNC_THRESHOLD * 3) return false;
-
-            mnodeman.DsegUpdate(pnode);
-            RequestedMasternodeAttempt++;
-            return false;
+    // act on the result without holding cs_assets (activating the masternode takes other locks)
+    if (fFailed) {
+        RequestedMasternodeAssets = MASTERNODE_SYNC_FAILED;
+        RequestedMasternodeAttempt = 0;
+        lastFailure = GetTime();
+        nCountFailures++;
+        return;
+    }
+    for (size_t i = 0; i < nCompleted; i++) {
+        SwitchToNextAsset();
+        if (vAssets[i] == MASTERNODE_SYNC_BUDGET) {
+            // Try to activate our masternode if possible
+            activeMasternode.ManageStatus();
         }
+    }
 
-        if (RequestedMasternodeAssets == MASTERNODE_SYNC_MNW) {
-            if (fLegacyMnObsolete) {
-                SwitchToNextAsset();
-                return false;
-            }
+    if (!vPending.empty()) {
+        RequestAssets(vPending);
+    }
+}
 
-            if (lastMasternodeWinner > 0 && lastMasternodeWinner < GetTime() - MASTERNODE_SYNC_TIMEOUT * 2 && RequestedMasternodeAttempt >= MASTERNODE_SYNC_THRESHOLD) { //hasn't received a new item in the last five seconds, so we'll move to the
-                SwitchToNextAsset();
-                return false;
-            }
+void CMasternodeSync::SyncSporks()
+{
+    // the sporks are sent in one round trip: ask a few peers at once, and move on after MASTERNODE_SYNC_TIMEOUT seconds
+    if (RequestedMasternodeAttempt > 0 && GetTime() - nAssetSyncStarted >= MASTERNODE_SYNC_TIMEOUT) {
+        SwitchToNextAsset();
+        return;
+    }
 
-            if (pnode->HasFulfilledRequest("mnwsync")) return true;
-            pnode->FulfilledRequest("mnwsync");
-
-            // timeout
-            if (lastMasternodeWinner == 0 &&
-                (RequestedMasternodeAttempt >= MASTERNODE_SYNC_THRESHOLD * 3 || GetTime() - nAssetSyncStarted > MASTERNODE_SYNC_TIMEOUT * 5)) {
-                if (sporkManager.IsSporkActive(SPORK_8_MASTERNODE_PAYMENT_ENFORCEMENT)) {
-                    LogPrintf("CMasternodeSync::Process - ERROR - Sync has failed on %s, will retry later\n", "MASTERNODE_SYNC_MNW");
-                    RequestedMasternodeAssets = MASTERNODE_SYNC_FAILED;
-                    RequestedMasternodeAttempt = 0;
-                    lastFailure = GetTime();
-                    nCountFailures++;
-                } else {
-                    SwitchToNextAsset();
-                }
-                return false;
-            }
+    int nAttempt = RequestedMasternodeAttempt;
+    g_connman->ForEachNode([&nAttempt](CNode* pnode) {
+        if (nAttempt >= MASTERNODE_SYNC_PARALLEL_PEERS || pnode->HasFulfilledRequest("getspork")) return;
+        pnode->FulfilledRequest("getspork");
+        g_connman->PushMessage(pnode, CNetMsgMaker(pnode->GetSendVersion()).Make(NetMsgType::GETSPORKS)); //get current network sporks
+        nAttempt++;
+    });
+    if (RequestedMasternodeAttempt == 0 && nAttempt > 0) {
+        nAssetSyncStarted = GetTime();
+    }
+    RequestedMasternodeAttempt = nAttempt;
+}
 
-            if (RequestedMasternodeAttempt >= MASTERNODE_SYNC_THRESHOLD * 3) return false;
+bool CMasternodeSync::CheckAssetComplete(int nAsset, bool& fFailed)
+{
+    AssertLockHeld(cs_assets);
+    TierTwoAssetSync& asset = mapAssetSync[nAsset];
+    if (asset.fComplete) return true;
+    if (asset.nStarted == 0) return false;
+
+    const int64_t nNow = GetTime();
+    const int64_t nLastItem = GetLastItemTime(nAsset);
+    const int nRequested = asset.mapRequested.size();
+
+    if ((int) asset.setAnswered.size() >= MASTERNODE_SYNC_THRESHOLD && GetSeenCount(nAsset) >= asset.GetExpectedCount() &&
+            nLastItem < nNow - MASTERNODE_SYNC_TIMEOUT) {
+        // we have seen at least as many items as the largest count announced, and nothing new came for a while.
+        // This doesn't prove that every announced item arrived (the items are not tracked per peer),
+        // it only shortens the wait: the timeouts below stay the rule.
+        LogPrint(BCLog::MASTERNODE, "%s - asset %d complete, %d items in %ds\n", __func__, nAsset, GetSeenCount(nAsset), nNow - asset.nStarted);
+        asset.fComplete = true;
+    } else if (nLastItem >= asset.nStarted && nLastItem < nNow - MASTERNODE_SYNC_TIMEOUT * 2 && nRequested >= MASTERNODE_SYNC_THRESHOLD) {
+        // hasn't received a new item in the last ten seconds
+        asset.fComplete = true;
+    } else if (nLastItem < asset.nStarted &&
+               (nRequested >= MASTERNODE_SYNC_THRESHOLD * 3 || nNow - asset.nStarted > MASTERNODE_SYNC_TIMEOUT * 5)) {
+        // timeout. Maybe there are no budgets at all, so just finish syncing
+        fFailed = nAsset != MASTERNODE_SYNC_BUDGET && sporkManager.IsSporkActive(SPORK_8_MASTERNODE_PAYMENT_ENFORCEMENT);
+        asset.fComplete = !fFailed;
+        return true;
+    }
+    return asset.fComplete;
+}
 
-            int nMnCount = mnodeman.CountEnabled();
-            g_connman->PushMessage(pnode, msgMaker.Make(NetMsgType::GETMNWINNERS, nMnCount)); //sync payees
-            RequestedMasternodeAttempt++;
-            return false;
+void CMasternodeSync::RequestAssets(const std::vector<int>& vAssets)
+{
+    struct Candidate {
+        NodeId id;
+        std::set<int> setFulfilled;
+        double nItemsPerSecond{0};
+        int nBusy{0};
+    };
+    std::vector<Candidate> vCandidates;
+    g_connman->ForEachNode([&vCandidates, &vAssets](CNode* pnode) {
+        if (pnode->nVersion < ActiveProtocol()) return;
+        Candidate c;
+        c.id = pnode->GetId();
+        for (int nAsset : vAssets) {
+            if (pnode->HasFulfilledRequest(GetAssetRequestName(nAsset))) c.setFulfilled.emplace(nAsset);
         }
+        vCandidates.emplace_back(std::move(c));
+    });
 
-        if (RequestedMasternodeAssets == MASTERNODE_SYNC_BUDGET) {
-            // We'll start rejecting votes if we accidentally get set as synced too soon
-            if (lastBudgetItem > 0 && lastBudgetItem < GetTime() - MASTERNODE_SYNC_TIMEOUT * 2 && RequestedMasternodeAttempt >= MASTERNODE_SYNC_THRESHOLD) {
-                // Hasn't received a new item in the last five seconds, so we'll move to the
-                SwitchToNextAsset();
-
-                // Try to activate our masternode if possible
-                activeMasternode.ManageStatus();
-                return false;
+    // asset --> peers to ask
+    std::vector<std::pair<int, NodeId>> vRequests;
+    {
+        LOCK(cs_assets);
+        const int64_t nNowMillis = GetTimeMillis();
+        std::set<NodeId> setConnected;
+        for (Candidate& c : vCandidates) {
+            setConnected.emplace(c.id);
+            auto it = mapPeerStats.find(c.id);
+            if (it != mapPeerStats.end()) c.nItemsPerSecond = it->second.GetItemsPerSecond();
+            for (const auto& p : mapAssetSync) {
+                if (!p.second.fComplete && p.second.mapRequested.count(c.id) && !p.second.setAnswered.count(c.id)) c.nBusy++;
             }
+        }
+        for (auto it = mapPeerStats.begin(); it != mapPeerStats.end(); ) {
+            it = setConnected.count(it->first) ? std::next(it) : mapPeerStats.erase(it);
+        }
 
-            // timeout
-            if (lastBudgetItem == 0 &&
-                (RequestedMasternodeAttempt >= MASTERNODE_SYNC_THRESHOLD * 3 || GetTime() - nAssetSyncStarted > MASTERNODE_SYNC_TIMEOUT * 5)) {
-                // maybe there is no budgets at all, so just finish syncing
-                SwitchToNextAsset();
-                activeMasternode.ManageStatus();
-                return false;
+        for (int nAsset : vAssets) {
+            TierTwoAssetSync& asset = mapAssetSync[nAsset];
+            int nToRequest = std::min<int>(MASTERNODE_SYNC_PARALLEL_PEERS - asset.CountInFlight(nNowMillis),
+                                           MASTERNODE_SYNC_THRESHOLD * 3 - asset.mapRequested.size());
+            if (nToRequest <= 0) continue;
+            // spread the assets over the idle peers first, then prefer the fastest ones
+            std::sort(vCandidates.begin(), vCandidates.end(), [](const Candidate& a, const Candidate& b) {
+                return a.nBusy != b.nBusy ? a.nBusy < b.nBusy : a.nItemsPerSecond > b.nItemsPerSecond;
+            });
+            for (Candidate& c : vCandidates) {
+                if (nToRequest <= 0) break;
+                if (asset.mapRequested.count(c.id) || c.setFulfilled.count(nAsset)) continue;
+                if (asset.nStarted == 0) asset.nStarted = GetTime();
+                asset.mapRequested.emplace(c.id, nNowMillis);
+                vRequests.emplace_back(nAsset, c.id);
+                c.nBusy++;
+                nToRequest--;
             }
-
-            if (pnode->HasFulfilledRequest("busync")) return true;
-            pnode->FulfilledRequest("busync");
-
-            if (RequestedMasternodeAttempt >= MASTERNODE_SYNC_THRESHOLD * 3) return false;
-
-            uint256 n;
-            g_connman->PushMessage(pnode, msgMaker.Make(NetMsgType::BUDGETVOTESYNC, n)); //sync masternode votes
-            RequestedMasternodeAttempt++;
-            return false;
+        }
+        auto it = mapAssetSync.find(RequestedMasternodeAssets);
+        if (it != mapAssetSync.end()) {
+            RequestedMasternodeAttempt = it->second.mapRequested.size();
         }
     }
 
-    return true;
+    for (const auto& r : vRequests) {
+        const int nAsset = r.first;
+        g_connman->ForNode(r.second, [nAsset](CNode* pnode) {
+            const char* strRequest = GetAssetRequestName(nAsset);
+            if (pnode->HasFulfilledRequest(strRequest)) return false;
+            pnode->FulfilledRequest(strRequest);
+
+            CNetMsgMaker msgMaker(pnode->GetSendVersion());
+            LogPrint(BCLog::MASTERNODE, "CMasternodeSync::Process() - requesting asset %d from peer=%d\n", nAsset, pnode->GetId());
+            if (nAsset == MASTERNODE_SYNC_LIST) {
+                mnodeman.DsegUpdate(pnode);
+            } else if (nAsset == MASTERNODE_SYNC_MNW) {
+                int nMnCount = mnodeman.CountEnabled();
+                g_connman->PushMessage(pnode, msgMaker.Make(NetMsgType::GETMNWINNERS, nMnCount)); //sync payees
+            } else if (nAsset == MASTERNODE_SYNC_BUDGET) {
+                uint256 n;
+                //sync masternode votes, only the ones we don't have yet
+                g_connman->PushMessage(pnode, msgMaker.Make(NetMsgType::BUDGETVOTESYNC, n, g_budgetman.GetVotesDigests()));
+            }
+            return true;
+        });
+    }
 }
-
-
@@ -7,11 +7,13 @@
 #define MASTERNODE_SYNC_H
 
 #include "net.h"    // for NodeId
+#include "sync.h"
 #include "uint256.h"
 
 #include <atomic>
 #include <string>
 #include <map>
+#include <set>
 
 #define MASTERNODE_SYNC_INITIAL 0
 #define MASTERNODE_SYNC_SPORKS 1
@@ -25,6 +27,8 @@
 
 #define MASTERNODE_SYNC_TIMEOUT 5
 #define MASTERNODE_SYNC_THRESHOLD 2
+// Number of peers an asset is requested from at the same time
+#define MASTERNODE_SYNC_PARALLEL_PEERS 3
 
 class CMasternodeSync;
 extern CMasternodeSync masternodeSync;
@@ -34,6 +38,32 @@ struct TierTwoPeerData {
     std::map<const char*, std::pair<int64_t, bool>> mapMsgData;
 };
 
+// Download of an asset (MN list, MN winners or budget), requested from several peers at once
+struct TierTwoAssetSync {
+    // Time of the first request
+    int64_t nStarted{0};
+    // peer --> time of the request (in milliseconds)
+    std::map<NodeId, int64_t> mapRequested;
+    // peer --> number of items announced (SYNCSTATUSCOUNT)
+    std::map<NodeId, int> mapAnnounced;
+    // peers that announced all their items
+    std::set<NodeId> setAnswered;
+    bool fComplete{false};
+
+    // Highest number of items announced by a peer that answered
+    int GetExpectedCount() const;
+    // Number of requests without answer, sent less than MASTERNODE_SYNC_TIMEOUT * 2 seconds ago
+    int CountInFlight(int64_t nNowMillis) const;
+};
+
+// Throughput of a peer, measured on the answers to the sync requests
+struct TierTwoPeerStats {
+    int64_t nItems{0};
+    int64_t nMillis{0};
+
+    double GetItemsPerSecond() const { return nMillis > 0 ? (double) nItems * 1000 / nMillis : 0; }
+};
+
 //
 // CMasternodeSync : Sync masternode assets in stages
 //
@@ -85,12 +115,6 @@ public:
 
     void Reset();
     void Process();
-    /*
-     * Process sync with a single node.
-     * If it returns false, the Process() step is complete.
-     * Otherwise Process() calls it again for a different node.
-     */
-    bool SyncWithNode(CNode* pnode, bool fLegacyMnObsolete);
     bool IsSynced();
     bool NotCompleted();
     bool IsSporkListSynced();
@@ -110,6 +134,24 @@ private:
     std::map<NodeId, TierTwoPeerData> peersSyncState;
     static int GetNextAsset(int currentAsset);
 
+    // Sync scheduler state (mainnet)
+    Mutex cs_assets;
+    // asset --> download progress
+    std::map<int, TierTwoAssetSync> mapAssetSync GUARDED_BY(cs_assets);
+    std::map<NodeId, TierTwoPeerStats> mapPeerStats GUARDED_BY(cs_assets);
+
+    // Request the sporks from the first peers
+    void SyncSporks();
+    // Request the assets being synced from the fastest peers, spreading them over different peers
+    void RequestAssets(const std::vector<int>& vAssets);
+    // Check whether the download of the asset is over. Sets fFailed if it timed out without any item.
+    bool CheckAssetComplete(int nAsset, bool& fFailed) EXCLUSIVE_LOCKS_REQUIRED(cs_assets);
+    // Number of items of the asset seen during the sync, and time of the last one
+    int GetSeenCount(int nAsset) const;
+    int64_t GetLastItemTime(int nAsset) const;
+    // Record the item count announced by a peer
+    void ProcessSyncStatusCount(NodeId id, int nItemID, int nCount);
+
     void SyncRegtest(CNode* pnode);
 
     template <typename... Args>
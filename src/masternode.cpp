@@ -141,12 +141,14 @@ bool CMasternode::UpdateFromNewBroadcast(CMasternodeBroadcast& mnb)
 {
     if (mnb.sigTime > sigTime) {
         // TODO: lock cs. Need to be careful as mnb.lastPing.CheckAndUpdate locks cs_main internally.
+        const CPubKey oldPubKeyMasternode = pubKeyMasternode;
         pubKeyMasternode = mnb.pubKeyMasternode;
         pubKeyCollateralAddress = mnb.pubKeyCollateralAddress;
         sigTime = mnb.sigTime;
         vchSig = mnb.vchSig;
         protocolVersion = mnb.protocolVersion;
         addr = mnb.addr;
+        mnodeman.UpdateIndexes(*this, oldPubKeyMasternode);
         int nDoS = 0;
         if (mnb.lastPing.IsNull() || (!mnb.lastPing.IsNull() && mnb.lastPing.CheckAndUpdate(nDoS, false))) {
             lastPing = mnb.lastPing;
@@ -365,16 +367,20 @@ bool CMasternodeBroadcast::Sign(const std::string strSignKey)
     return Sign(key, pubkey);
 }
 
-bool CMasternodeBroadcast::CheckSignature() const
+uint256 CMasternodeBroadcast::GetSignedHash() const
 {
-    std::string strError = "";
     std::string strMessage = (
                             nMessVersion == MessageVersion::MESS_VER_HASH ?
                             GetSignatureHash().GetHex() :
                             GetStrMessage()
                             );
+    return CMessageSigner::GetMessageHash(strMessage);
+}
 
-    if(!CMessageSigner::VerifyMessage(pubKeyCollateralAddress, vchSig, strMessage, strError))
+bool CMasternodeBroadcast::CheckSignature() const
+{
+    std::string strError = "";
+    if(!CHashSigner::VerifyHash(GetSignedHash(), pubKeyCollateralAddress, vchSig, strError))
         return error("%s : VerifyMessage (nMessVersion=%d) failed: %s", __func__, nMessVersion, strError);
 
     return true;
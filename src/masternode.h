@@ -280,6 +280,8 @@ public:
     bool Sign(const CKey& key, const CPubKey& pubKey);
     bool Sign(const std::string strSignKey);
     bool CheckSignature() const;
+    // the broadcast signs the message built from its signature hash
+    uint256 GetSignedHash() const override;
 
     ADD_SERIALIZE_METHODS;
 
@@ -6,6 +6,7 @@
 #include "masternodeman.h"
 
 #include "addrman.h"
+#include "coins.h"
 #include "evo/deterministicmns.h"
 #include "fs.h"
 #include "masternode-payments.h"
@@ -19,6 +20,8 @@
 #include "util/system.h"
 
 #include <boost/thread/thread.hpp>
+#include <future>
+#include <thread>
 
 #define MN_WINNER_MINIMUM_AGE 8000    // Age in seconds. This should be > MASTERNODE_REMOVAL_SECONDS to avoid misconfigured new nodes in the list.
 
@@ -36,50 +39,81 @@ struct CompareScoreMN {
     }
 };
 
-//
-// CMasternodeDB
-//
+/** Minimum number of masternodes to compute the scores of a table with several threads */
+static const size_t SCORE_TABLE_PARALLEL_MIN_SIZE = 256;
+/** Max number of threads computing the scores of a table */
+static const unsigned int SCORE_TABLE_MAX_THREADS = 4;
+
+/**
+ * Scores of all the masternodes (legacy and deterministic) for a block hash.
+ * The entries are ordered from the best to the worst compact score, ties in the order
+ * the masternodes are iterated (legacy list, then deterministic list), which is the
+ * order the winner is chosen among equal scores.
+ */
+class CMasternodeScoreTable
+{
+public:
+    struct Entry {
+        arith_uint256 score;
+        int64_t nCompactScore{0};
+        COutPoint collateral;
+        MasternodeRef mn;           // legacy masternodes
+        CDeterministicMNCPtr dmn;   // deterministic masternodes
+    };
+
+    // version of the masternode lists the table was built from
+    uint64_t nLegacyListVersion{0};
+    uint32_t nDMNTotalRegistered{0};
+    size_t nDMNCount{0};
+
+    std::vector<Entry> vEntries;
+    std::unordered_map<COutPoint, size_t, SaltedOutpointHasher> mapPositions;
+
+    bool IsCurrent(uint64_t nLegacyVersion, const CDeterministicMNList& mnList) const
+    {
+        return nLegacyListVersion == nLegacyVersion &&
+               nDMNTotalRegistered == mnList.GetTotalRegisteredCount() &&
+               nDMNCount == mnList.GetAllMNsCount();
+    }
 
-static const int MASTERNODE_DB_VERSION = 1;
+    const Entry* Find(const COutPoint& collateral) const
+    {
+        auto it = mapPositions.find(collateral);
+        return it != mapPositions.end() ? &vEntries[it->second] : nullptr;
+    }
+};
 
-CMasternodeDB::CMasternodeDB()
+// Same as CMasternode::CalculateScore, with the hashes depending only on the block hash computed once
+static void CalculateScores(const uint256& hash, std::vector<CMasternodeScoreTable::Entry>::iterator begin,
+                            std::vector<CMasternodeScoreTable::Entry>::iterator end)
 {
-    pathMN = GetDataDir() / "mncache.dat";
-    strMagicMessage = "MasternodeCache";
+    CHashWriter ssBlock(SER_GETHASH, PROTOCOL_VERSION);
+    ssBlock << hash;
+    const arith_uint256& hash2 = UintToArith256(CHashWriter(ssBlock).GetHash());
+
+    for (auto it = begin; it != end; ++it) {
+        CHashWriter ss2(ssBlock);
+        const arith_uint256& aux = UintToArith256(it->collateral.hash) + it->collateral.n;
+        ss2 << aux;
+        const arith_uint256& hash3 = UintToArith256(ss2.GetHash());
+        it->score = (hash3 > hash2 ? hash3 - hash2 : hash2 - hash3);
+        it->nCompactScore = it->score.GetCompact(false);
+    }
 }
 
-bool CMasternodeDB::Write(const CMasternodeMan& mnodemanToSave)
+static bool IsValidDMN(const CDeterministicMNList& mnList, const CDeterministicMNCPtr& dmn)
 {
-    int64_t nStart = GetTimeMillis();
-
-    // serialize, checksum data up to that point, then append checksum
-    CDataStream ssMasternodes(SER_DISK, CLIENT_VERSION);
-    ssMasternodes << MASTERNODE_DB_VERSION;
-    ssMasternodes << strMagicMessage;                   // masternode cache file specific magic message
-    ssMasternodes << Params().MessageStart(); // network specific magic number
-    ssMasternodes << mnodemanToSave;
-    uint256 hash = Hash(ssMasternodes.begin(), ssMasternodes.end());
-    ssMasternodes << hash;
-
-    // open output file, and associate with CAutoFile
-    FILE* file = fsbridge::fopen(pathMN, "wb");
-    CAutoFile fileout(file, SER_DISK, CLIENT_VERSION);
-    if (fileout.IsNull())
-        return error("%s : Failed to open file %s", __func__, pathMN.string());
-
-    // Write and commit header, data
-    try {
-        fileout << ssMasternodes;
-    } catch (const std::exception& e) {
-        return error("%s : Serialize or I/O error - %s", __func__, e.what());
-    }
-    //    FileCommit(fileout);
-    fileout.fclose();
+    return mnList.IsMNValid(dmn->proTxHash);
+}
 
-    LogPrint(BCLog::MASTERNODE,"Written info to mncache.dat  %dms\n", GetTimeMillis() - nStart);
-    LogPrint(BCLog::MASTERNODE,"  %s\n", mnodemanToSave.ToString());
+//
+// CMasternodeDB
+//
 
-    return true;
+CMasternodeDB::CMasternodeDB()
+{
+    pathMN = GetDataDir() / "mncache.dat";
+    strMagicMessage = "MasternodeCache";
 }
 
 CMasternodeDB::ReadResult CMasternodeDB::Read(CMasternodeMan& mnodemanToLoad)
@@ -158,19 +192,9 @@ CMasternodeDB::ReadResult CMasternodeDB::Read(CMasternodeMan& mnodemanToLoad)
     return Ok;
 }
 
-void DumpMasternodes()
-{
-    int64_t nStart = GetTimeMillis();
-
-    CMasternodeDB mndb;
-    LogPrint(BCLog::MASTERNODE,"Writing info to mncache.dat...\n");
-    mndb.Write(mnodeman);
-
-    LogPrint(BCLog::MASTERNODE,"Masternode dump finished  %dms\n", GetTimeMillis() - nStart);
-}
-
 CMasternodeMan::CMasternodeMan():
         cvLastBlockHashes(CACHED_BLOCK_HASHES, UINT256_ZERO),
+        scoreTablesCache(CACHED_BLOCK_HASHES),
         nDsqCount(0)
 {}
 
@@ -195,7 +219,9 @@ bool CMasternodeMan::Add(CMasternode& mn)
     const auto& it = mapMasternodes.find(mn.vin.prevout);
     if (it == mapMasternodes.end()) {
         LogPrint(BCLog::MASTERNODE, "Adding new Masternode %s\n", mn.vin.prevout.ToString());
-        mapMasternodes.emplace(mn.vin.prevout, std::make_shared<CMasternode>(mn));
+        const auto& res = mapMasternodes.emplace(mn.vin.prevout, std::make_shared<CMasternode>(mn));
+        AddToIndexes(res.first->second);
+        nLegacyListVersion++;
         LogPrint(BCLog::MASTERNODE, "Masternode added. New total count: %d\n", mapMasternodes.size());
         return true;
     }
@@ -268,7 +294,9 @@ int CMasternodeMan::CheckAndRemove(bool forceExpiredRemoval)
                 }
             }
 
+            RemoveFromIndexes(*it->second);
             it = mapMasternodes.erase(it);
+            nLegacyListVersion++;
             LogPrint(BCLog::MASTERNODE, "Masternode removed.\n");
         } else {
             ++it;
@@ -330,10 +358,55 @@ int CMasternodeMan::CheckAndRemove(bool forceExpiredRemoval)
     return mapMasternodes.size();
 }
 
+size_t CMasternodeMan::WriteDBChanges(CDBBatch& batch)
+{
+    LOCK(cs);
+    return dbMasternodes.WriteChanges(batch, mapMasternodes) +
+           dbAskedUsForMasternodeList.WriteChanges(batch, mAskedUsForMasternodeList) +
+           dbWeAskedForMasternodeList.WriteChanges(batch, mWeAskedForMasternodeList) +
+           dbWeAskedForMasternodeListEntry.WriteChanges(batch, mWeAskedForMasternodeListEntry) +
+           dbSeenMasternodeBroadcast.WriteChanges(batch, mapSeenMasternodeBroadcast) +
+           dbSeenMasternodePing.WriteChanges(batch, mapSeenMasternodePing);
+}
+
+void CMasternodeMan::DBChangesWritten()
+{
+    dbMasternodes.ChangesWritten();
+    dbAskedUsForMasternodeList.ChangesWritten();
+    dbWeAskedForMasternodeList.ChangesWritten();
+    dbWeAskedForMasternodeListEntry.ChangesWritten();
+    dbSeenMasternodeBroadcast.ChangesWritten();
+    dbSeenMasternodePing.ChangesWritten();
+}
+
+bool CMasternodeMan::LoadFromDB(CDBWrapper& db)
+{
+    bool fOk = dbMasternodes.Load(db, mapMasternodes, cs) &&
+               dbAskedUsForMasternodeList.Load(db, mAskedUsForMasternodeList, cs) &&
+               dbWeAskedForMasternodeList.Load(db, mWeAskedForMasternodeList, cs) &&
+               dbWeAskedForMasternodeListEntry.Load(db, mWeAskedForMasternodeListEntry, cs) &&
+               dbSeenMasternodeBroadcast.Load(db, mapSeenMasternodeBroadcast, cs) &&
+               dbSeenMasternodePing.Load(db, mapSeenMasternodePing, cs);
+    WITH_LOCK(cs, RebuildIndexes(); );
+    nLegacyListVersion++;
+    if (!fOk) {
+        // discard the cached data, it will be written again with the next flush
+        dbMasternodes.Wipe(db);
+        dbAskedUsForMasternodeList.Wipe(db);
+        dbWeAskedForMasternodeList.Wipe(db);
+        dbWeAskedForMasternodeListEntry.Wipe(db);
+        dbSeenMasternodeBroadcast.Wipe(db);
+        dbSeenMasternodePing.Wipe(db);
+    }
+    return fOk;
+}
+
 void CMasternodeMan::Clear()
 {
     LOCK(cs);
     mapMasternodes.clear();
+    RebuildIndexes();
+    nLegacyListVersion++;
     mAskedUsForMasternodeList.clear();
     mWeAskedForMasternodeList.clear();
     mWeAskedForMasternodeListEntry.clear();
@@ -433,30 +506,96 @@ void CMasternodeMan::DsegUpdate(CNode* pnode)
     mWeAskedForMasternodeList[pnode->addr] = askAgain;
 }
 
+void CMasternodeMan::AddToIndexes(const MasternodeRef& mn)
+{
+    AssertLockHeld(cs);
+    const COutPoint& collateral = mn->vin.prevout;
+    mapCollateralIndex[collateral] = mn;
+    mapOperatorKeyIndex.emplace(mn->pubKeyMasternode.GetID(), collateral);
+}
+
+template <typename Index, typename Key>
+static void EraseIndexEntry(Index& index, const Key& key, const COutPoint& collateral)
+{
+    auto range = index.equal_range(key);
+    for (auto it = range.first; it != range.second; ++it) {
+        if (it->second == collateral) {
+            index.erase(it);
+            return;
+        }
+    }
+}
+
+void CMasternodeMan::RemoveFromIndexes(const CMasternode& mn)
+{
+    AssertLockHeld(cs);
+    const COutPoint& collateral = mn.vin.prevout;
+    mapCollateralIndex.erase(collateral);
+    EraseIndexEntry(mapOperatorKeyIndex, mn.pubKeyMasternode.GetID(), collateral);
+}
+
+void CMasternodeMan::RebuildIndexes()
+{
+    AssertLockHeld(cs);
+    mapCollateralIndex.clear();
+    mapOperatorKeyIndex.clear();
+    mapCollateralIndex.reserve(mapMasternodes.size());
+    for (const auto& it : mapMasternodes) {
+        AddToIndexes(it.second);
+    }
+}
+
+void CMasternodeMan::UpdateIndexes(const CMasternode& mn, const CPubKey& oldPubKeyMasternode)
+{
+    LOCK(cs);
+    const COutPoint& collateral = mn.vin.prevout;
+    auto it = mapCollateralIndex.find(collateral);
+    if (it == mapCollateralIndex.end() || it->second.get() != &mn) {
+        // not in the list
+        return;
+    }
+    if (oldPubKeyMasternode != mn.pubKeyMasternode) {
+        EraseIndexEntry(mapOperatorKeyIndex, oldPubKeyMasternode.GetID(), collateral);
+        mapOperatorKeyIndex.emplace(mn.pubKeyMasternode.GetID(), collateral);
+    }
+}
+
+template <typename Index, typename Key>
+CMasternode* CMasternodeMan::FindInIndex(const Index& index, const Key& key) const
+{
+    AssertLockHeld(cs);
+    auto range = index.equal_range(key);
+    const COutPoint* pcollateral = nullptr;
+    for (auto it = range.first; it != range.second; ++it) {
+        if (pcollateral == nullptr || it->second < *pcollateral) {
+            pcollateral = &it->second;
+        }
+    }
+    if (pcollateral == nullptr) return nullptr;
+    auto it = mapCollateralIndex.find(*pcollateral);
+    return it != mapCollateralIndex.end() ? it->second.get() : nullptr;
+}
+
 CMasternode* CMasternodeMan::Find(const COutPoint& collateralOut)
 {
     LOCK(cs);
-    auto it = mapMasternodes.find(collateralOut);
-    return it != mapMasternodes.end() ? it->second.get() : nullptr;
+    auto it = mapCollateralIndex.find(collateralOut);
+    return it != mapCollateralIndex.end() ? it->second.get() : nullptr;
 }
 
 const CMasternode* CMasternodeMan::Find(const COutPoint& collateralOut) const
 {
     LOCK(cs);
-    auto const& it = mapMasternodes.find(collateralOut);
-    return it != mapMasternodes.end() ? it->second.get() : nullptr;
+    auto const& it = mapCollateralIndex.find(collateralOut);
+    return it != mapCollateralIndex.end() ? it->second.get() : nullptr;
 }
 
 CMasternode* CMasternodeMan::Find(const CPubKey& pubKeyMasternode)
 {
     LOCK(cs);
-
-    for (auto& it : mapMasternodes) {
-        MasternodeRef& mn = it.second;
-        if (mn->pubKeyMasternode == pubKeyMasternode)
-            return mn.get();
-    }
-    return nullptr;
+    CMasternode* pmn = FindInIndex(mapOperatorKeyIndex, pubKeyMasternode.GetID());
+    // the index is by key id
+    return (pmn && pmn->pubKeyMasternode == pubKeyMasternode) ? pmn : nullptr;
 }
 
 void CMasternodeMan::CheckSpentCollaterals(const std::vector<CTransactionRef>& vtx)
@@ -469,8 +608,8 @@ void CMasternodeMan::CheckSpentCollaterals(const std::vector<CTransactionRef>& v
     LOCK(cs);
     for (const auto& tx : vtx) {
         for (const auto& in : tx->vin) {
-            auto it = mapMasternodes.find(in.prevout);
-            if (it != mapMasternodes.end()) {
+            auto it = mapCollateralIndex.find(in.prevout);
+            if (it != mapCollateralIndex.end()) {
                 it->second->SetSpent();
             }
         }
@@ -557,11 +696,14 @@ MasternodeRef CMasternodeMan::GetNextMasternodeInQueueForPayment(int nBlockHeigh
     int nCountTenth = 0;
     arith_uint256 nHigh = ARITH_UINT256_ZERO;
     const uint256& hash = GetHashAtHeight(nBlockHeight - 101);
+    CDeterministicMNList mnListScores;
+    const auto scores = GetScoreTable(hash, mnListScores);
     for (const auto& s: vecMasternodeLastPaid) {
         const MasternodeRef pmn = s.second;
         if (!pmn) break;
 
-        const arith_uint256& n = pmn->CalculateScore(hash);
+        const auto* entry = scores->Find(pmn->vin.prevout);
+        const arith_uint256& n = entry ? entry->score : pmn->CalculateScore(hash);
         if (n > nHigh) {
             nHigh = n;
             pBestMasternode = pmn;
@@ -572,41 +714,91 @@ MasternodeRef CMasternodeMan::GetNextMasternodeInQueueForPayment(int nBlockHeigh
     return pBestMasternode;
 }
 
-MasternodeRef CMasternodeMan::GetCurrentMasterNode(const uint256& hash) const
+std::shared_ptr<const CMasternodeScoreTable> CMasternodeMan::GetScoreTable(const uint256& hash, CDeterministicMNList& mnListRet) const
 {
-    int minProtocol = ActiveProtocol();
-    int64_t score = 0;
-    MasternodeRef winner = nullptr;
+    mnListRet = CDeterministicMNList();
+    if (deterministicMNManager->IsDIP3Enforced()) {
+        mnListRet = deterministicMNManager->GetListAtChainTip();
+    }
 
-    // scan for winner
-    for (const auto& it : mapMasternodes) {
-        const MasternodeRef& mn = it.second;
-        if (mn->protocolVersion < minProtocol || !mn->IsEnabled()) continue;
-        // calculate the score of the masternode
-        const int64_t n = mn->CalculateScore(hash).GetCompact(false);
-        // determine the winner
-        if (n > score) {
-            score = n;
-            winner = mn;
+    {
+        LOCK(cs_scores);
+        std::shared_ptr<const CMasternodeScoreTable> cached;
+        if (scoreTablesCache.get(hash, cached) && cached->IsCurrent(nLegacyListVersion, mnListRet)) {
+            return cached;
         }
     }
 
-    // scan also dmns
-    if (deterministicMNManager->IsDIP3Enforced()) {
-        auto mnList = deterministicMNManager->GetListAtChainTip();
-        mnList.ForEachMN(true, [&](const CDeterministicMNCPtr& dmn) {
-            const MasternodeRef mn = MakeMasternodeRefForDMN(dmn);
-            // calculate the score of the masternode
-            const int64_t n = mn->CalculateScore(hash).GetCompact(false);
-            // determine the winner
-            if (n > score) {
-                score = n;
-                winner = mn;
-            }
-        });
+    auto table = std::make_shared<CMasternodeScoreTable>();
+    {
+        LOCK(cs);
+        table->nLegacyListVersion = nLegacyListVersion;
+        table->vEntries.reserve(mapMasternodes.size() + mnListRet.GetAllMNsCount());
+        for (const auto& it : mapMasternodes) {
+            CMasternodeScoreTable::Entry entry;
+            entry.collateral = it.first;
+            entry.mn = it.second;
+            table->vEntries.emplace_back(std::move(entry));
+        }
     }
+    table->nDMNTotalRegistered = mnListRet.GetTotalRegisteredCount();
+    table->nDMNCount = mnListRet.GetAllMNsCount();
+    mnListRet.ForEachMN(false, [&](const CDeterministicMNCPtr& dmn) {
+        CMasternodeScoreTable::Entry entry;
+        entry.collateral = dmn->collateralOutpoint;
+        entry.dmn = dmn;
+        table->vEntries.emplace_back(std::move(entry));
+    });
 
-    return winner;
+    // compute the scores, splitting the masternodes between a few threads for the big lists
+    auto& vEntries = table->vEntries;
+    const unsigned int nThreads = vEntries.size() < SCORE_TABLE_PARALLEL_MIN_SIZE ? 1 :
+            std::max(1u, std::min(SCORE_TABLE_MAX_THREADS, std::thread::hardware_concurrency()));
+    const size_t nChunk = (vEntries.size() + nThreads - 1) / nThreads;
+    std::vector<std::future<void>> futures;
+    for (unsigned int i = 1; i < nThreads; i++) {
+        const size_t nBegin = std::min(vEntries.size(), i * nChunk);
+        const size_t nEnd = std::min(vEntries.size(), nBegin + nChunk);
+        futures.emplace_back(std::async(std::launch::async, CalculateScores, std::cref(hash),
+                                        vEntries.begin() + nBegin, vEntries.begin() + nEnd));
+    }
+    CalculateScores(hash, vEntries.begin(), vEntries.begin() + std::min(vEntries.size(), nChunk));
+    for (auto& f : futures) {
+        f.get();
+    }
+
+    std::stable_sort(vEntries.begin(), vEntries.end(), [](const CMasternodeScoreTable::Entry& a, const CMasternodeScoreTable::Entry& b) {
+        return a.nCompactScore > b.nCompactScore;
+    });
+    table->mapPositions.reserve(vEntries.size());
+    for (size_t i = 0; i < vEntries.size(); i++) {
+        table->mapPositions.emplace(vEntries[i].collateral, i);
+    }
+
+    LOCK(cs_scores);
+    scoreTablesCache.insert(hash, table, 1);
+    return table;
+}
+
+MasternodeRef CMasternodeMan::GetCurrentMasterNode(const uint256& hash) const
+{
+    int minProtocol = ActiveProtocol();
+    CDeterministicMNList mnList;
+    const auto scores = GetScoreTable(hash, mnList);
+
+    // the winner is the enabled masternode with the best (non-zero) score
+    for (const auto& entry : scores->vEntries) {
+        if (entry.nCompactScore <= 0) break;
+        if (entry.mn) {
+            if (entry.mn->protocolVersion < minProtocol || !entry.mn->IsEnabled()) continue;
+            return entry.mn;
+        }
+        if (IsValidDMN(mnList, entry.dmn)) {
+            return MakeMasternodeRefForDMN(mnList.GetMN(entry.dmn->proTxHash));
+        }
+    }
+
+    return nullptr;
 }
 
 std::vector<std::pair<MasternodeRef, int>> CMasternodeMan::GetMnScores(int nLast) const
@@ -631,13 +823,19 @@ int CMasternodeMan::GetMasternodeRank(const CTxIn& vin, int64_t nBlockHeight) co
     // height outside range
     if (hash == UINT256_ZERO) return -1;
 
-    // scan for winner
+    // walk the masternodes from the best score, counting the ones eligible
     int minProtocol = ActiveProtocol();
-    std::vector<std::pair<int64_t, CTxIn> > vecMasternodeScores;
-    {
-        LOCK(cs);
-        for (const auto& it : mapMasternodes) {
-            const MasternodeRef& mn = it.second;
+    const bool fCheckAge = sporkManager.IsSporkActive(SPORK_8_MASTERNODE_PAYMENT_ENFORCEMENT);
+    CDeterministicMNList mnList;
+    const auto scores = GetScoreTable(hash, mnList);
+    if (!scores->Find(vin.prevout)) {
+        return -1;
+    }
+
+    int rank = 0;
+    for (const auto& entry : scores->vEntries) {
+        if (entry.mn) {
+            const MasternodeRef& mn = entry.mn;
             if (!mn->IsEnabled()) {
                 continue; // Skip not enabled
             }
@@ -645,29 +843,14 @@ int CMasternodeMan::GetMasternodeRank(const CTxIn& vin, int64_t nBlockHeight) co
                 LogPrint(BCLog::MASTERNODE,"Skipping Masternode with obsolete version %d\n", mn->protocolVersion);
                 continue; // Skip obsolete versions
             }
-            if (sporkManager.IsSporkActive(SPORK_8_MASTERNODE_PAYMENT_ENFORCEMENT) &&
-                    GetAdjustedTime() - mn->sigTime < MN_WINNER_MINIMUM_AGE) {
+            if (fCheckAge && GetAdjustedTime() - mn->sigTime < MN_WINNER_MINIMUM_AGE) {
                 continue; // Skip masternodes younger than (default) 1 hour
             }
-            vecMasternodeScores.emplace_back(mn->CalculateScore(hash).GetCompact(false), mn->vin);
+        } else if (!IsValidDMN(mnList, entry.dmn)) {
+            continue;
         }
-    }
-
-    // scan also dmns
-    if (deterministicMNManager->IsDIP3Enforced()) {
-        auto mnList = deterministicMNManager->GetListAtChainTip();
-        mnList.ForEachMN(true, [&](const CDeterministicMNCPtr& dmn) {
-            const MasternodeRef mn = MakeMasternodeRefForDMN(dmn);
-            vecMasternodeScores.emplace_back(mn->CalculateScore(hash).GetCompact(false), mn->vin);
-        });
-    }
-
-    sort(vecMasternodeScores.rbegin(), vecMasternodeScores.rend(), CompareScoreMN());
-
-    int rank = 0;
-    for (std::pair<int64_t, CTxIn> & s : vecMasternodeScores) {
         rank++;
-        if (s.second.prevout == vin.prevout) {
+        if (entry.collateral == vin.prevout) {
             return rank;
         }
     }
@@ -681,26 +864,21 @@ std::vector<std::pair<int64_t, MasternodeRef>> CMasternodeMan::GetMasternodeRank
     const uint256& hash = GetHashAtHeight(nBlockHeight - 1);
     // height outside range
     if (hash == UINT256_ZERO) return vecMasternodeScores;
-    {
-        LOCK(cs);
-        // scan for winner
-        for (const auto& it : mapMasternodes) {
-            const MasternodeRef mn = it.second;
-            const uint32_t score = mn->IsEnabled() ? mn->CalculateScore(hash).GetCompact(false) : 9999;
 
-            vecMasternodeScores.emplace_back(score, mn);
+    CDeterministicMNList mnList;
+    const auto scores = GetScoreTable(hash, mnList);
+    vecMasternodeScores.reserve(scores->vEntries.size());
+    for (const auto& entry : scores->vEntries) {
+        if (entry.mn) {
+            const uint32_t score = entry.mn->IsEnabled() ? entry.nCompactScore : 9999;
+            vecMasternodeScores.emplace_back(score, entry.mn);
+        } else {
+            const auto& dmn = mnList.GetMN(entry.dmn->proTxHash);
+            if (!dmn) continue;
+            const uint32_t score = mnList.IsMNValid(dmn) ? entry.nCompactScore : 9999;
+            vecMasternodeScores.emplace_back(score, MakeMasternodeRefForDMN(dmn));
         }
     }
-    // scan also dmns
-    if (deterministicMNManager->IsDIP3Enforced()) {
-        auto mnList = deterministicMNManager->GetListAtChainTip();
-        mnList.ForEachMN(false, [&](const CDeterministicMNCPtr& dmn) {
-            const MasternodeRef mn = MakeMasternodeRefForDMN(dmn);
-            const uint32_t score = mnList.IsMNValid(dmn) ? mn->CalculateScore(hash).GetCompact(false) : 9999;
-
-            vecMasternodeScores.emplace_back(score, mn);
-        });
-    }
     sort(vecMasternodeScores.rbegin(), vecMasternodeScores.rend(), CompareScoreMN());
     return vecMasternodeScores;
 }
@@ -872,7 +1050,9 @@ void CMasternodeMan::Remove(const COutPoint& collateralOut)
     LOCK(cs);
     const auto it = mapMasternodes.find(collateralOut);
     if (it != mapMasternodes.end()) {
+        RemoveFromIndexes(*it->second);
         mapMasternodes.erase(it);
+        nLegacyListVersion++;
     }
 }
 
@@ -965,6 +1145,7 @@ void CMasternodeMan::CacheBlockHash(const CBlockIndex* pindex)
 void CMasternodeMan::UncacheBlockHash(const CBlockIndex* pindex)
 {
     cvLastBlockHashes.Set(pindex->nHeight, UINT256_ZERO);
+    WITH_LOCK(cs_scores, scoreTablesCache.erase(pindex->GetBlockHash()); );
 }
 
 uint256 CMasternodeMan::GetHashAtHeight(int nHeight) const
@@ -1012,10 +1193,14 @@ bool CMasternodeMan::IsWithinDepth(const uint256& nHash, int depth) const
 
 void ThreadCheckMasternodes()
 {
-    if (fLiteMode) return; //disable all Masternode related functionality
-
     // Make this thread recognisable as the wallet flushing thread
     util::ThreadRename("pivx-masternodeman");
+
+    // Load the tier two caches in the background (the tier two sync starts only after it)
+    LoadTierTwoCaches();
+
+    if (fLiteMode) return; //disable all Masternode related functionality
+
     LogPrintf("Masternodes thread started\n");
 
     unsigned int c = 0;
@@ -7,14 +7,20 @@
 #define MASTERNODEMAN_H
 
 #include "activemasternode.h"
+#include "coins.h"
 #include "cyclingvector.h"
 #include "key.h"
 #include "key_io.h"
 #include "masternode.h"
 #include "net.h"
+#include "saltedhasher.h"
 #include "sync.h"
+#include "tiertwo_cachedb.h"
+#include "unordered_lru_cache.h"
 #include "util/system.h"
 
+#include <unordered_map>
+
 #define MASTERNODES_DUMP_SECONDS (15 * 60)
 #define MASTERNODES_DSEG_SECONDS (3 * 60 * 60)
 
@@ -22,14 +28,14 @@
 static const unsigned int CACHED_BLOCK_HASHES = 200;
 
 class CMasternodeMan;
+class CMasternodeScoreTable;
 class CActiveMasternode;
+class CDeterministicMNList;
 
 extern CMasternodeMan mnodeman;
 extern CActiveMasternode activeMasternode;
 
-void DumpMasternodes();
-
-/** Access to the MN database (mncache.dat)
+/** Legacy MN database file (mncache.dat), only read to import it in the tier two caches db
  */
 class CMasternodeDB
 {
@@ -49,7 +55,6 @@ public:
     };
 
     CMasternodeDB();
-    bool Write(const CMasternodeMan& mnodemanToSave);
     ReadResult Read(CMasternodeMan& mnodemanToLoad);
 };
 
@@ -72,12 +77,44 @@ private:
     // which Masternodes we've asked for
     std::map<COutPoint, int64_t> mWeAskedForMasternodeListEntry;
 
+    // Memory Only. Hash indexes of mapMasternodes, by collateral and operator key (guarded by cs).
+    // The operator key isn't unique for legacy masternodes: it maps to all the collaterals using it.
+    std::unordered_map<COutPoint, MasternodeRef, SaltedOutpointHasher> mapCollateralIndex;
+    std::unordered_multimap<CKeyID, COutPoint, StaticSaltedHasher> mapOperatorKeyIndex;
+
+    void AddToIndexes(const MasternodeRef& mn);
+    void RemoveFromIndexes(const CMasternode& mn);
+    void RebuildIndexes();
+    // Return the lowest collateral (the first in mapMasternodes) with the given key in the index, or nullptr
+    template <typename Index, typename Key>
+    CMasternode* FindInIndex(const Index& index, const Key& key) const;
+
     // Memory Only. Updated in NewBlock (blocks arrive in order)
     std::atomic<int> nBestHeight;
 
     // Memory Only. Cache last block hashes. Used to verify mn pings and winners.
     CyclingVector<uint256> cvLastBlockHashes;
 
+    // Memory Only. Bumped at every change of the set of legacy masternodes (invalidating the score tables).
+    std::atomic<uint64_t> nLegacyListVersion{0};
+
+    // Memory Only. Scores of all the masternodes for the last (CACHED_BLOCK_HASHES) block hashes used.
+    mutable Mutex cs_scores;
+    mutable unordered_lru_cache<uint256, std::shared_ptr<const CMasternodeScoreTable>, StaticSaltedHasher> scoreTablesCache GUARDED_BY(cs_scores);
+
+    // Return the score table of the block hash, computing it if not cached (or outdated),
+    // and the masternode list at the chain tip it refers to.
+    std::shared_ptr<const CMasternodeScoreTable> GetScoreTable(const uint256& hash, CDeterministicMNList& mnListRet) const;
+
+    // Incremental persistence of the maps (nDsqCount is not persisted). The masternodes are updated
+    // in place through their refs all over the masternode code: the tables are diffed at each flush.
+    CTierTwoDBTable<COutPoint, MasternodeRef> dbMasternodes{DB_MN_LIST, true};
+    CTierTwoDBTable<CNetAddr, int64_t> dbAskedUsForMasternodeList{DB_MN_ASKED_US_FOR_LIST, true};
+    CTierTwoDBTable<CNetAddr, int64_t> dbWeAskedForMasternodeList{DB_MN_WE_ASKED_FOR_LIST, true};
+    CTierTwoDBTable<COutPoint, int64_t> dbWeAskedForMasternodeListEntry{DB_MN_WE_ASKED_FOR_ENTRY, true};
+    CTierTwoDBTable<uint256, CMasternodeBroadcast> dbSeenMasternodeBroadcast{DB_MN_SEEN_BROADCASTS, true};
+    CTierTwoDBTable<uint256, CMasternodePing> dbSeenMasternodePing{DB_MN_SEEN_PINGS, true};
+
     // Return the banning score (0 if no ban score increase is needed).
     int ProcessMNBroadcast(CNode* pfrom, CMasternodeBroadcast& mnb);
     int ProcessMNPing(CNode* pfrom, CMasternodePing& mnp);
@@ -107,10 +144,20 @@ public:
 
         READWRITE(mapSeenMasternodeBroadcast);
         READWRITE(mapSeenMasternodePing);
+        if (ser_action.ForRead()) {
+            RebuildIndexes();
+        }
     }
 
     CMasternodeMan();
 
+    /// Add to batch the changes since the last call (see CTierTwoDBTable). Returns the number of changed entries.
+    size_t WriteDBChanges(CDBBatch& batch);
+    /// Record the changes of the last WriteDBChanges as written, after the batch was written to the db
+    void DBChangesWritten();
+    /// Load the cached data from db, keeping the entries already in memory
+    bool LoadFromDB(CDBWrapper& db);
+
     /// Add an entry
     bool Add(CMasternode& mn);
 
@@ -138,6 +185,9 @@ public:
     const CMasternode* Find(const COutPoint& collateralOut) const;
     CMasternode* Find(const CPubKey& pubKeyMasternode);
 
+    /// Update the indexes of a masternode whose operator key changed (see CMasternode::UpdateFromNewBroadcast)
+    void UpdateIndexes(const CMasternode& mn, const CPubKey& oldPubKeyMasternode);
+
     /// Check all transactions in a block, for spent masternode collateral outpoints (marking them as spent)
     void CheckSpentCollaterals(const std::vector<CTransactionRef>& vtx);
 
@@ -3,15 +3,72 @@
 // Distributed under the MIT/X11 software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#include "checkqueue.h"
 #include "hash.h"
 #include "key_io.h"
 #include "messagesigner.h"
+#include "saltedhasher.h"
+#include "sync.h"
 #include "tinyformat.h"
 #include "util/system.h"
+#include "unordered_lru_cache.h"
 #include "utilstrencodings.h"
 
 const std::string strMessageMagic = "DarkNet Signed Message:\n";
 
+// Signers recovered from (hash, signature) pairs. A null CKeyID marks a signature
+// from which no key could be recovered.
+static Mutex cs_sigcache;
+static unordered_lru_cache<uint256, CKeyID, StaticSaltedHasher> sigcache GUARDED_BY(cs_sigcache){MAX_MESSAGE_SIGCACHE_SIZE};
+
+static uint256 GetSigCacheKey(const uint256& hash, const std::vector<unsigned char>& vchSig)
+{
+    return Hash(hash.begin(), hash.end(), vchSig.begin(), vchSig.end());
+}
+
+static CKeyID RecoverSigner(const uint256& hash, const std::vector<unsigned char>& vchSig)
+{
+    const uint256& cacheKey = GetSigCacheKey(hash, vchSig);
+    CKeyID keyID;
+    if (WITH_LOCK(cs_sigcache, return sigcache.get(cacheKey, keyID))) {
+        return keyID;
+    }
+    CPubKey pubkeyFromSig;
+    keyID = pubkeyFromSig.RecoverCompact(hash, vchSig) ? pubkeyFromSig.GetID() : CKeyID();
+    WITH_LOCK(cs_sigcache, sigcache.insert(cacheKey, keyID, 1));
+    return keyID;
+}
+
+bool IsMessageSignatureCached(const uint256& hash, const std::vector<unsigned char>& vchSig)
+{
+    const uint256& cacheKey = GetSigCacheKey(hash, vchSig);
+    LOCK(cs_sigcache);
+    return sigcache.exists(cacheKey);
+}
+
+bool CSignatureRecoveryCheck::operator()()
+{
+    RecoverSigner(hash, vchSig);
+    // The outcome is checked later against the expected signer,
+    // never abort the rest of the batch.
+    return true;
+}
+
+static CCheckQueue<CSignatureRecoveryCheck> sigcheckqueue(32);
+
+void ThreadSignedMessageCheck()
+{
+    util::ThreadRename("pivx-msgsigch");
+    sigcheckqueue.Thread();
+}
+
+void BatchRecoverSignatures(std::vector<CSignatureRecoveryCheck>& vChecks)
+{
+    CCheckQueueControl<CSignatureRecoveryCheck> control(&sigcheckqueue);
+    control.Add(vChecks);
+    control.Wait();
+}
+
 bool CMessageSigner::GetKeysFromSecret(const std::string& strSecret, CKey& keyRet, CPubKey& pubkeyRet)
 {
     keyRet = KeyIO::DecodeSecret(strSecret);
@@ -67,15 +124,15 @@ bool CHashSigner::VerifyHash(const uint256& hash, const CPubKey& pubkey, const s
 
 bool CHashSigner::VerifyHash(const uint256& hash, const CKeyID& keyID, const std::vector<unsigned char>& vchSig, std::string& strErrorRet)
 {
-    CPubKey pubkeyFromSig;
-    if(!pubkeyFromSig.RecoverCompact(hash, vchSig)) {
+    const CKeyID& keyIDFromSig = RecoverSigner(hash, vchSig);
+    if(keyIDFromSig.IsNull()) {
         strErrorRet = "Error recovering public key.";
         return false;
     }
 
-    if(pubkeyFromSig.GetID() != keyID) {
+    if(keyIDFromSig != keyID) {
         strErrorRet = strprintf("Keys don't match: pubkey=%s, pubkeyFromSig=%s, hash=%s, vchSig=%s",
-                EncodeDestination(keyID), EncodeDestination(pubkeyFromSig.GetID()),
+                EncodeDestination(keyID), EncodeDestination(keyIDFromSig),
                 hash.ToString(), EncodeBase64(&vchSig[0], vchSig.size()));
         return false;
     }
@@ -119,14 +176,15 @@ bool CSignedMessage::Sign(const std::string strSignKey)
 bool CSignedMessage::CheckSignature(const CKeyID& keyID) const
 {
     std::string strError = "";
+    return CHashSigner::VerifyHash(GetSignedHash(), keyID, vchSig, strError);
+}
 
+uint256 CSignedMessage::GetSignedHash() const
+{
     if (nMessVersion == MessageVersion::MESS_VER_HASH) {
-        uint256 hash = GetSignatureHash();
-        return CHashSigner::VerifyHash(hash, keyID, vchSig, strError);
+        return GetSignatureHash();
     }
-
-    std::string strMessage = GetStrMessage();
-    return CMessageSigner::VerifyMessage(keyID, vchSig, strMessage, strError);
+    return CMessageSigner::GetMessageHash(GetStrMessage());
 }
 
 std::string CSignedMessage::GetSignatureBase64() const
@@ -67,6 +67,8 @@ public:
     bool Sign(const CKey& key, const CKeyID& keyID);
     bool Sign(const std::string strSignKey);
     bool CheckSignature(const CKeyID& keyID) const;
+    // Hash actually covered by vchSig (depends on nMessVersion)
+    virtual uint256 GetSignedHash() const;
 
     // Pure virtual functions (used in Sign-Verify functions)
     // Must be implemented in child classes
@@ -79,4 +81,41 @@ public:
     std::string GetSignatureBase64() const;
 };
 
+/** Recovers the signer of a hash signature in a CCheckQueue worker thread.
+ *  The result (valid or not) is stored in the signature cache, so that the
+ *  later sequential CheckSignature() calls only need a lookup.
+ */
+class CSignatureRecoveryCheck
+{
+private:
+    uint256 hash;
+    std::vector<unsigned char> vchSig;
+
+public:
+    CSignatureRecoveryCheck() {}
+    CSignatureRecoveryCheck(const uint256& _hash, const std::vector<unsigned char>& _vchSig) :
+        hash(_hash),
+        vchSig(_vchSig)
+    {}
+
+    bool operator()();
+
+    void swap(CSignatureRecoveryCheck& check)
+    {
+        std::swap(hash, check.hash);
+        vchSig.swap(check.vchSig);
+    }
+};
+
+/** Maximum number of recovered signers kept in the signature cache */
+static const size_t MAX_MESSAGE_SIGCACHE_SIZE = 100000;
+
+/** Whether the signer of (hash, vchSig) was already recovered */
+bool IsMessageSignatureCached(const uint256& hash, const std::vector<unsigned char>& vchSig);
+/** Recover the signers of a batch of signatures in parallel, filling the cache.
+ *  Runs on the calling thread only, when no worker threads were started. */
+void BatchRecoverSignatures(std::vector<CSignatureRecoveryCheck>& vChecks);
+/** Run an instance of the signed-message check thread */
+void ThreadSignedMessageCheck();
+
 #endif
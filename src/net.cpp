@@ -413,6 +413,10 @@ void CNode::CloseSocketDisconnect()
     if (hSocket != INVALID_SOCKET) {
         LogPrint(BCLog::NET, "disconnecting peer=%d\n", id);
         CloseSocket(hSocket);
+#ifdef USE_EPOLL
+        // closing the socket removed it from the epoll set
+        nEpollEvents = 0;
+#endif
     }
 }
 
@@ -1068,14 +1072,326 @@ void CConnman::AcceptConnection(const ListenSocket& hListenSocket) {
         LOCK(cs_vNodes);
         vNodes.push_back(pnode);
     }
+    UpdateNodeSocketEvents(pnode);
 
     // We received a new connection, harvest entropy from the time (and our peer count)
     RandAddEvent((uint32_t)id);
 }
 
+// Whether to wait for the node's socket to be ready for receiving or for sending data
+static void GetNodeSocketEvents(CNode* pnode, bool& select_recv, bool& select_send)
+{
+    // Implement the following logic:
+    // * If there is data to send, select() for sending data. As this only
+    //   happens when optimistic write failed, we choose to first drain the
+    //   write buffer in this case before receiving more. This avoids
+    //   needlessly queueing received data, if the remote peer is not themselves
+    //   receiving data. This means properly utilizing TCP flow control signalling.
+    // * Otherwise, if there is space left in the receive buffer, select() for
+    //   receiving data.
+    // * Hand off all complete messages to the processor, to be handled without
+    //   blocking here.
+    {
+        LOCK(pnode->cs_vSend);
+        select_send = !pnode->vSendMsg.empty();
+    }
+    select_recv = !select_send && !pnode->fPauseRecv;
+}
+
+bool CConnman::GenerateSelectSet(std::set<SOCKET>& recv_set, std::set<SOCKET>& send_set, std::set<SOCKET>& error_set)
+{
+    for (const ListenSocket& hListenSocket : vhListenSocket) {
+        recv_set.insert(hListenSocket.socket);
+    }
+
+    {
+        LOCK(cs_vNodes);
+        for (CNode* pnode : vNodes) {
+            bool select_recv, select_send;
+            GetNodeSocketEvents(pnode, select_recv, select_send);
+
+            LOCK(pnode->cs_hSocket);
+            if (pnode->hSocket == INVALID_SOCKET)
+                continue;
+
+            error_set.insert(pnode->hSocket);
+            if (select_send) {
+                send_set.insert(pnode->hSocket);
+            } else if (select_recv) {
+                recv_set.insert(pnode->hSocket);
+            }
+        }
+    }
+
+    const bool have_fds = !recv_set.empty() || !send_set.empty() || !error_set.empty();
+#ifndef WIN32
+    if (wakeupPipe[0] != -1) {
+        recv_set.insert(wakeupPipe[0]);
+    }
+#endif
+    return have_fds;
+}
+
+#ifdef USE_EPOLL
+void CConnman::UpdateNodeSocketEvents(CNode* pnode)
+{
+    LOCK2(pnode->cs_vSend, pnode->cs_hSocket);
+    if (pnode->hSocket == INVALID_SOCKET || epollFd == -1)
+        return;
+
+    bool select_recv, select_send;
+    GetNodeSocketEvents(pnode, select_recv, select_send);
+    const uint32_t events = EPOLLERR | EPOLLHUP | (select_send ? EPOLLOUT : 0) | (select_recv ? EPOLLIN : 0);
+    if (events == pnode->nEpollEvents)
+        return;
+
+    // the node is only deleted by the socket handler, once its socket was closed (removing it from the set)
+    epoll_event event;
+    event.events = events;
+    event.data.ptr = pnode;
+    if (epoll_ctl(epollFd, pnode->nEpollEvents == 0 ? EPOLL_CTL_ADD : EPOLL_CTL_MOD, pnode->hSocket, &event) != 0) {
+        LogPrintf("socket epoll_ctl error %s\n", NetworkErrorString(WSAGetLastError()));
+        return;
+    }
+    pnode->nEpollEvents = events;
+}
+#else
+void CConnman::UpdateNodeSocketEvents(CNode* pnode)
+{
+    // the select sets are generated again at each loop of the socket handler
+}
+#endif
+
+#ifdef USE_EPOLL
+void CConnman::SocketEvents(std::set<SOCKET>& recv_set, std::set<SOCKET>& send_set, std::set<SOCKET>& error_set)
+{
+    // The listening sockets and the wakeup pipe are registered in StartSocketEvents, and the nodes
+    // sockets are kept up to date by UpdateNodeSocketEvents: only wait here.
+    vEpollReadyNodes.clear();
+    static const int MAX_EPOLL_EVENTS = 256;
+    epoll_event events[MAX_EPOLL_EVENTS];
+    int nEvents = epoll_wait(epollFd, events, MAX_EPOLL_EVENTS, SELECT_TIMEOUT_MILLISECONDS);
+    if (nEvents < 0) {
+        if (WSAGetLastError() != WSAEINTR) {
+            LogPrintf("socket epoll_wait error %s\n", NetworkErrorString(WSAGetLastError()));
+            interruptNet.sleep_for(std::chrono::milliseconds(SELECT_TIMEOUT_MILLISECONDS));
+        }
+        return;
+    }
+
+    // Only the ready sockets are reported, and their nodes listed in vEpollReadyNodes
+    for (int i = 0; i < nEvents; i++) {
+        const void* ptr = events[i].data.ptr;
+        SOCKET socket_id = INVALID_SOCKET;
+        if (ptr == wakeupPipe) {
+            socket_id = wakeupPipe[0];
+        }
+        for (const ListenSocket& hListenSocket : vhListenSocket) {
+            if (ptr == &hListenSocket) socket_id = hListenSocket.socket;
+        }
+        if (socket_id == INVALID_SOCKET) {
+            CNode* pnode = static_cast<CNode*>(events[i].data.ptr);
+            LOCK(pnode->cs_hSocket);
+            if (pnode->hSocket == INVALID_SOCKET)
+                continue;
+            socket_id = pnode->hSocket;
+            vEpollReadyNodes.push_back(pnode);
+        }
+        if (events[i].events & EPOLLIN)               recv_set.insert(socket_id);
+        if (events[i].events & EPOLLOUT)              send_set.insert(socket_id);
+        if (events[i].events & (EPOLLERR | EPOLLHUP)) error_set.insert(socket_id);
+    }
+}
+#elif defined(USE_POLL)
+void CConnman::SocketEvents(std::set<SOCKET>& recv_set, std::set<SOCKET>& send_set, std::set<SOCKET>& error_set)
+{
+    std::set<SOCKET> recv_select_set, send_select_set, error_select_set;
+    GenerateSelectSet(recv_select_set, send_select_set, error_select_set);
+
+    std::map<SOCKET, struct pollfd> pollfds;
+    for (SOCKET socket_id : recv_select_set) {
+        pollfds[socket_id].fd = socket_id;
+        pollfds[socket_id].events |= POLLIN;
+    }
+    for (SOCKET socket_id : send_select_set) {
+        pollfds[socket_id].fd = socket_id;
+        pollfds[socket_id].events |= POLLOUT;
+    }
+    for (SOCKET socket_id : error_select_set) {
+        pollfds[socket_id].fd = socket_id;
+        // These flags are ignored, but we set them for clarity
+        pollfds[socket_id].events |= POLLERR | POLLHUP;
+    }
+
+    std::vector<struct pollfd> vpollfds;
+    vpollfds.reserve(pollfds.size());
+    for (const auto& it : pollfds) {
+        vpollfds.push_back(it.second);
+    }
+
+    if (poll(vpollfds.data(), vpollfds.size(), SELECT_TIMEOUT_MILLISECONDS) < 0) {
+        if (WSAGetLastError() != WSAEINTR) {
+            LogPrintf("socket poll error %s\n", NetworkErrorString(WSAGetLastError()));
+            interruptNet.sleep_for(std::chrono::milliseconds(SELECT_TIMEOUT_MILLISECONDS));
+        }
+        return;
+    }
+
+    for (const struct pollfd& pollfd_entry : vpollfds) {
+        if (pollfd_entry.revents & POLLIN)              recv_set.insert(pollfd_entry.fd);
+        if (pollfd_entry.revents & POLLOUT)             send_set.insert(pollfd_entry.fd);
+        if (pollfd_entry.revents & (POLLERR | POLLHUP)) error_set.insert(pollfd_entry.fd);
+    }
+}
+#else
+void CConnman::SocketEvents(std::set<SOCKET>& recv_set, std::set<SOCKET>& send_set, std::set<SOCKET>& error_set)
+{
+    std::set<SOCKET> recv_select_set, send_select_set, error_select_set;
+    bool have_fds = GenerateSelectSet(recv_select_set, send_select_set, error_select_set);
+
+    struct timeval timeout;
+    timeout.tv_sec = 0;
+    timeout.tv_usec = SELECT_TIMEOUT_MILLISECONDS * 1000; // frequency to poll pnode->vSend
+
+    fd_set fdsetRecv;
+    fd_set fdsetSend;
+    fd_set fdsetError;
+    FD_ZERO(&fdsetRecv);
+    FD_ZERO(&fdsetSend);
+    FD_ZERO(&fdsetError);
+    SOCKET hSocketMax = 0;
+
+    for (SOCKET hSocket : recv_select_set) {
+        FD_SET(hSocket, &fdsetRecv);
+        hSocketMax = std::max(hSocketMax, hSocket);
+    }
+    for (SOCKET hSocket : send_select_set) {
+        FD_SET(hSocket, &fdsetSend);
+        hSocketMax = std::max(hSocketMax, hSocket);
+    }
+    for (SOCKET hSocket : error_select_set) {
+        FD_SET(hSocket, &fdsetError);
+        hSocketMax = std::max(hSocketMax, hSocket);
+    }
+
+    int nSelect = select(have_fds ? hSocketMax + 1 : 0,
+                         &fdsetRecv, &fdsetSend, &fdsetError, &timeout);
+    if (interruptNet)
+        return;
+
+    if (nSelect == SOCKET_ERROR) {
+        if (have_fds) {
+            int nErr = WSAGetLastError();
+            LogPrintf("socket select error %s\n", NetworkErrorString(nErr));
+            for (unsigned int i = 0; i <= hSocketMax; i++)
+                FD_SET(i, &fdsetRecv);
+        }
+        FD_ZERO(&fdsetSend);
+        FD_ZERO(&fdsetError);
+        if (!interruptNet.sleep_for(std::chrono::milliseconds(SELECT_TIMEOUT_MILLISECONDS)))
+            return;
+    }
+
+    for (SOCKET hSocket : recv_select_set) {
+        if (FD_ISSET(hSocket, &fdsetRecv)) {
+            recv_set.insert(hSocket);
+        }
+    }
+    for (SOCKET hSocket : send_select_set) {
+        if (FD_ISSET(hSocket, &fdsetSend)) {
+            send_set.insert(hSocket);
+        }
+    }
+    for (SOCKET hSocket : error_select_set) {
+        if (FD_ISSET(hSocket, &fdsetError)) {
+            error_set.insert(hSocket);
+        }
+    }
+}
+#endif
+
+bool CConnman::StartSocketEvents(std::string& strError)
+{
+#ifndef WIN32
+    if (pipe(wakeupPipe) != 0 ||
+            fcntl(wakeupPipe[0], F_SETFL, fcntl(wakeupPipe[0], F_GETFL) | O_NONBLOCK) == -1 ||
+            fcntl(wakeupPipe[1], F_SETFL, fcntl(wakeupPipe[1], F_GETFL) | O_NONBLOCK) == -1) {
+        // the socket handler will only rely on the select timeout
+        LogPrintf("%s: failed to create the wakeup pipe of the socket handler\n", __func__);
+        wakeupPipe[0] = wakeupPipe[1] = -1;
+    }
+#endif
+#ifdef USE_EPOLL
+    epollFd = epoll_create1(EPOLL_CLOEXEC);
+    if (epollFd == -1) {
+        strError = strprintf("Failed to create the epoll instance of the network thread: %s", NetworkErrorString(WSAGetLastError()));
+        return false;
+    }
+    // the events point to the listening socket, the wakeup pipe, or the node (see SocketEvents)
+    std::vector<std::pair<SOCKET, void*>> vEpollSockets;
+    for (ListenSocket& hListenSocket : vhListenSocket) {
+        vEpollSockets.emplace_back(hListenSocket.socket, &hListenSocket);
+    }
+    if (wakeupPipe[0] != -1) {
+        vEpollSockets.emplace_back(wakeupPipe[0], wakeupPipe);
+    }
+    for (const auto& p : vEpollSockets) {
+        epoll_event event;
+        event.events = EPOLLIN;
+        event.data.ptr = p.second;
+        if (epoll_ctl(epollFd, EPOLL_CTL_ADD, p.first, &event) != 0) {
+            strError = strprintf("Failed to register a socket in the epoll instance of the network thread: %s", NetworkErrorString(WSAGetLastError()));
+            return false;
+        }
+    }
+#endif
+    return true;
+}
+
+void CConnman::DrainWakeupPipe()
+{
+#ifndef WIN32
+    fWakeupPipePending = false;
+    char buf[128];
+    while (read(wakeupPipe[0], buf, sizeof(buf)) > 0) {}
+#endif
+}
+
+void CConnman::StopSocketEvents()
+{
+#ifdef USE_EPOLL
+    if (epollFd != -1) {
+        close(epollFd);
+        epollFd = -1;
+    }
+#endif
+#ifndef WIN32
+    for (int& fd : wakeupPipe) {
+        if (fd != -1) {
+            close(fd);
+            fd = -1;
+        }
+    }
+#endif
+}
+
+void CConnman::WakeSocketHandler()
+{
+#ifndef WIN32
+    // one pending byte is enough to wake the handler
+    if (wakeupPipe[1] != -1 && !fWakeupPipePending.exchange(true)) {
+        char buf{0};
+        if (write(wakeupPipe[1], &buf, sizeof(buf)) != 1) {
+            LogPrint(BCLog::NET, "write to wakeupPipe failed\n");
+        }
+    }
+#endif
+}
+
 void CConnman::ThreadSocketHandler()
 {
     unsigned int nPrevNodeCount = 0;
+    int64_t nLastInactivityCheck = 0;
     while (!interruptNet) {
         //
         // Disconnect nodes
@@ -1139,98 +1455,51 @@ void CConnman::ThreadSocketHandler()
         //
         // Find which sockets have data to receive
         //
-        struct timeval timeout;
-        timeout.tv_sec = 0;
-        timeout.tv_usec = 50000; // frequency to poll pnode->vSend
-
-        fd_set fdsetRecv;
-        fd_set fdsetSend;
-        fd_set fdsetError;
-        FD_ZERO(&fdsetRecv);
-        FD_ZERO(&fdsetSend);
-        FD_ZERO(&fdsetError);
-        SOCKET hSocketMax = 0;
-        bool have_fds = false;
-
-        for (const ListenSocket& hListenSocket : vhListenSocket) {
-            FD_SET(hListenSocket.socket, &fdsetRecv);
-            hSocketMax = std::max(hSocketMax, hListenSocket.socket);
-            have_fds = true;
-        }
+        std::set<SOCKET> recv_set, send_set, error_set;
+        SocketEvents(recv_set, send_set, error_set);
 
-        {
-            LOCK(cs_vNodes);
-            for (CNode* pnode : vNodes) {
-                // Implement the following logic:
-                // * If there is data to send, select() for sending data. As this only
-                //   happens when optimistic write failed, we choose to first drain the
-                //   write buffer in this case before receiving more. This avoids
-                //   needlessly queueing received data, if the remote peer is not themselves
-                //   receiving data. This means properly utilizing TCP flow control signalling.
-                // * Otherwise, if there is space left in the receive buffer, select() for
-                //   receiving data.
-                // * Hand off all complete messages to the processor, to be handled without
-                //   blocking here.
-
-                bool select_recv = !pnode->fPauseRecv;
-                bool select_send;
-                {
-                    LOCK(pnode->cs_vSend);
-                    select_send = !pnode->vSendMsg.empty();
-                }
-
-                LOCK(pnode->cs_hSocket);
-                if (pnode->hSocket == INVALID_SOCKET)
-                    continue;
-
-                FD_SET(pnode->hSocket, &fdsetError);
-                hSocketMax = std::max(hSocketMax, pnode->hSocket);
-                have_fds = true;
-
-                if (select_send) {
-                    FD_SET(pnode->hSocket, &fdsetSend);
-                    continue;
-                }
-                if (select_recv) {
-                    FD_SET(pnode->hSocket, &fdsetRecv);
-                }
-            }
-        }
-
-        int nSelect = select(have_fds ? hSocketMax + 1 : 0,
-                             &fdsetRecv, &fdsetSend, &fdsetError, &timeout);
         if (interruptNet)
             return;
 
-        if (nSelect == SOCKET_ERROR) {
-            if (have_fds) {
-                int nErr = WSAGetLastError();
-                LogPrintf("socket select error %s\n", NetworkErrorString(nErr));
-                for (unsigned int i = 0; i <= hSocketMax; i++)
-                    FD_SET(i, &fdsetRecv);
-            }
-            FD_ZERO(&fdsetSend);
-            FD_ZERO(&fdsetError);
-            if (!interruptNet.sleep_for(std::chrono::milliseconds(timeout.tv_usec/1000)))
-                return;
+#ifndef WIN32
+        if (wakeupPipe[0] != -1 && recv_set.count(wakeupPipe[0]) > 0) {
+            // the sockets with new data to send are in the next select set
+            DrainWakeupPipe();
         }
+#endif
 
         //
         // Accept new connections
         //
         for (const ListenSocket& hListenSocket : vhListenSocket) {
-            if (hListenSocket.socket != INVALID_SOCKET && FD_ISSET(hListenSocket.socket, &fdsetRecv)) {
+            if (hListenSocket.socket != INVALID_SOCKET && recv_set.count(hListenSocket.socket) > 0) {
                 AcceptConnection(hListenSocket);
             }
         }
 
+        //
+        // Inactivity checking, once per second
+        //
+        const int64_t nTime = GetSystemTimeInSeconds();
+        if (nTime != nLastInactivityCheck) {
+            nLastInactivityCheck = nTime;
+            LOCK(cs_vNodes);
+            for (CNode* pnode : vNodes)
+                InactivityCheck(pnode, nTime);
+        }
+
         //
         // Service each socket
         //
         std::vector<CNode*> vNodesCopy;
         {
             LOCK(cs_vNodes);
+#ifdef USE_EPOLL
+            // only the nodes with a ready socket
+            vNodesCopy = vEpollReadyNodes;
+#else
             vNodesCopy = vNodes;
+#endif
             for (CNode* pnode : vNodesCopy)
                 pnode->AddRef();
         }
@@ -1248,9 +1517,9 @@ void CConnman::ThreadSocketHandler()
                 LOCK(pnode->cs_hSocket);
                 if (pnode->hSocket == INVALID_SOCKET)
                     continue;
-                recvSet = FD_ISSET(pnode->hSocket, &fdsetRecv);
-                sendSet = FD_ISSET(pnode->hSocket, &fdsetSend);
-                errorSet = FD_ISSET(pnode->hSocket, &fdsetError);
+                recvSet = recv_set.count(pnode->hSocket) > 0;
+                sendSet = send_set.count(pnode->hSocket) > 0;
+                errorSet = error_set.count(pnode->hSocket) > 0;
             }
             if (recvSet || errorSet) {
                 {
@@ -1277,12 +1546,16 @@ void CConnman::ThreadSocketHandler()
                                         break;
                                     nSizeAdded += it->vRecv.size() + CMessageHeader::HEADER_SIZE;
                                 }
+                                bool fPauseRecvChanged;
                                 {
                                     LOCK(pnode->cs_vProcessMsg);
                                     pnode->vProcessMsg.splice(pnode->vProcessMsg.end(), pnode->vRecvMsg, pnode->vRecvMsg.begin(), it);
                                     pnode->nProcessQueueSize += nSizeAdded;
-                                    pnode->fPauseRecv = pnode->nProcessQueueSize > nReceiveFloodSize;
+                                    const bool fPauseRecv = pnode->nProcessQueueSize > nReceiveFloodSize;
+                                    fPauseRecvChanged = pnode->fPauseRecv.exchange(fPauseRecv) != fPauseRecv;
                                 }
+                                if (fPauseRecvChanged)
+                                    UpdateNodeSocketEvents(pnode);
                                 WakeMessageHandler();
                             }
                         } else if (nBytes == 0) {
@@ -1307,30 +1580,14 @@ void CConnman::ThreadSocketHandler()
             // Send
             //
             if (sendSet) {
-                LOCK(pnode->cs_vSend);
-                size_t nBytes = SocketSendData(pnode);
-                if (nBytes)
-                    RecordBytesSent(nBytes);
-            }
-
-            //
-            // Inactivity checking
-            //
-            int64_t nTime = GetSystemTimeInSeconds();
-            if (nTime - pnode->nTimeConnected > 60) {
-                if (pnode->nLastRecv == 0 || pnode->nLastSend == 0) {
-                    LogPrint(BCLog::NET, "socket no message in first 60 seconds, %d %d from %d\n", pnode->nLastRecv != 0, pnode->nLastSend != 0, pnode->id);
-                    pnode->fDisconnect = true;
-                } else if (nTime - pnode->nLastSend > TIMEOUT_INTERVAL) {
-                    LogPrintf("socket sending timeout: %is\n", nTime - pnode->nLastSend);
-                    pnode->fDisconnect = true;
-                } else if (nTime - pnode->nLastRecv > (pnode->nVersion > BIP0031_VERSION ? TIMEOUT_INTERVAL : 90 * 60)) {
-                    LogPrintf("socket receive timeout: %is\n", nTime - pnode->nLastRecv);
-                    pnode->fDisconnect = true;
-                } else if (pnode->nPingNonceSent && pnode->nPingUsecStart + TIMEOUT_INTERVAL * 1000000 < GetTimeMicros()) {
-                    LogPrintf("ping timeout: %fs\n", 0.000001 * (GetTimeMicros() - pnode->nPingUsecStart));
-                    pnode->fDisconnect = true;
+                {
+                    LOCK(pnode->cs_vSend);
+                    size_t nBytes = SocketSendData(pnode);
+                    if (nBytes)
+                        RecordBytesSent(nBytes);
                 }
+                // back to receiving once the send queue is drained
+                UpdateNodeSocketEvents(pnode);
             }
         }
         {
@@ -1341,6 +1598,25 @@ void CConnman::ThreadSocketHandler()
     }
 }
 
+void CConnman::InactivityCheck(CNode* pnode, int64_t nTime)
+{
+    if (nTime - pnode->nTimeConnected > 60) {
+        if (pnode->nLastRecv == 0 || pnode->nLastSend == 0) {
+            LogPrint(BCLog::NET, "socket no message in first 60 seconds, %d %d from %d\n", pnode->nLastRecv != 0, pnode->nLastSend != 0, pnode->id);
+            pnode->fDisconnect = true;
+        } else if (nTime - pnode->nLastSend > TIMEOUT_INTERVAL) {
+            LogPrintf("socket sending timeout: %is\n", nTime - pnode->nLastSend);
+            pnode->fDisconnect = true;
+        } else if (nTime - pnode->nLastRecv > (pnode->nVersion > BIP0031_VERSION ? TIMEOUT_INTERVAL : 90 * 60)) {
+            LogPrintf("socket receive timeout: %is\n", nTime - pnode->nLastRecv);
+            pnode->fDisconnect = true;
+        } else if (pnode->nPingNonceSent && pnode->nPingUsecStart + TIMEOUT_INTERVAL * 1000000 < GetTimeMicros()) {
+            LogPrintf("ping timeout: %fs\n", 0.000001 * (GetTimeMicros() - pnode->nPingUsecStart));
+            pnode->fDisconnect = true;
+        }
+    }
+}
+
 void CConnman::WakeMessageHandler()
 {
     {
@@ -1722,6 +1998,7 @@ bool CConnman::OpenNetworkConnection(const CAddress& addrConnect, bool fCountFai
         LOCK(cs_vNodes);
         vNodes.push_back(pnode);
     }
+    UpdateNodeSocketEvents(pnode);
 
     return true;
 }
@@ -2012,6 +2289,10 @@ bool CConnman::Start(CScheduler& scheduler, std::string& strNodeError, Options c
         fMsgProcWake = false;
     }
 
+    if (!StartSocketEvents(strNodeError)) {
+        return false;
+    }
+
     // Send and receive from sockets, accept connections
     threadSocketHandler = std::thread(&TraceThread<std::function<void()> >, "net", std::function<void()>(std::bind(&CConnman::ThreadSocketHandler, this)));
 
@@ -2069,6 +2350,7 @@ void CConnman::Interrupt()
 
     interruptNet();
     InterruptSocks5(true);
+    WakeSocketHandler();
 
     if (semOutbound)
         for (int i=0; i<(nMaxOutbound + nMaxFeeler); i++)
@@ -2088,6 +2370,8 @@ void CConnman::Stop()
     if (threadSocketHandler.joinable())
         threadSocketHandler.join();
 
+    StopSocketEvents();
+
     if (fAddressesInitialized)
     {
         DumpData();
@@ -2433,6 +2717,14 @@ void CConnman::PushMessage(CNode* pnode, CSerializedNetMsg&& msg)
         // If write queue empty, attempt "optimistic write"
         if (optimisticSend == true)
             nBytesSent = SocketSendData(pnode);
+        // the rest is sent when the socket is ready: wait for it now
+        if (optimisticSend && !pnode->vSendMsg.empty()) {
+#ifdef USE_EPOLL
+            UpdateNodeSocketEvents(pnode);
+#else
+            WakeSocketHandler();
+#endif
+        }
     }
     if (nBytesSent)
         RecordBytesSent(nBytesSent);
@@ -9,6 +9,7 @@
 
 #include "addrdb.h"
 #include "addrman.h"
+#include "amount.h"
 #include "bloom.h"
 #include "compat.h"
 #include "fs.h"
@@ -29,6 +30,7 @@
 #include <thread>
 #include <memory>
 #include <condition_variable>
+#include <set>
 
 #ifndef WIN32
 #include <arpa/inet.h>
@@ -78,6 +80,8 @@ static const size_t DEFAULT_MAXSENDBUFFER    = 1 * 1000;
 
 // NOTE: When adjusting this, update rpcnet:setban's help ("24h")
 static const unsigned int DEFAULT_MISBEHAVING_BANTIME = 60 * 60 * 24;  // Default 24-hour ban
+/** Maximum wait for socket events, in milliseconds (e.g. to check for disconnections and timeouts) */
+static const int SELECT_TIMEOUT_MILLISECONDS = 50;
 
 typedef int NodeId;
 
@@ -150,6 +154,8 @@ public:
     bool ForNode(NodeId id, std::function<bool(CNode* pnode)> func);
 
     void PushMessage(CNode* pnode, CSerializedNetMsg&& msg);
+    // Update the events awaited on the node's socket, after its send queue or fPauseRecv changed (epoll only)
+    void UpdateNodeSocketEvents(CNode* pnode);
 
     template<typename Callable>
     bool ForEachNodeContinueIf(Callable&& func)
@@ -282,10 +288,21 @@ private:
     void ThreadOpenConnections();
     void ThreadMessageHandler();
     void AcceptConnection(const ListenSocket& hListenSocket);
+    bool GenerateSelectSet(std::set<SOCKET>& recv_set, std::set<SOCKET>& send_set, std::set<SOCKET>& error_set);
+    // Create the wakeup pipe (and the epoll instance), registering the listening sockets
+    bool StartSocketEvents(std::string& strError);
+    void StopSocketEvents();
+    // Wait for the socket events (with the backend chosen at build time, see compat.h)
+    void SocketEvents(std::set<SOCKET>& recv_set, std::set<SOCKET>& send_set, std::set<SOCKET>& error_set);
+    // Empty the wakeup pipe, once it was reported ready
+    void DrainWakeupPipe();
+    void InactivityCheck(CNode* pnode, int64_t nTime);
     void ThreadSocketHandler();
     void ThreadDNSAddressSeed();
 
     void WakeMessageHandler();
+    // Interrupt the wait for socket events (e.g. when there is new data to send)
+    void WakeSocketHandler();
 
     uint64_t CalculateKeyedNetGroup(const CAddress& ad);
 
@@ -375,11 +392,25 @@ private:
 
     CThreadInterrupt interruptNet;
 
+#ifndef WIN32
+    /** pipe to wake the socket handler (see WakeSocketHandler) */
+    int wakeupPipe[2]{-1, -1};
+    std::atomic<bool> fWakeupPipePending{false};
+#endif
+#ifdef USE_EPOLL
+    /** epoll instance of the socket handler. The sockets stay registered until closed. */
+    int epollFd{-1};
+    /** nodes reported ready by the last SocketEvents call (only accessed by the socket handler) */
+    std::vector<CNode*> vEpollReadyNodes;
+#endif
+
     std::thread threadDNSAddressSeed;
     std::thread threadSocketHandler;
     std::thread threadOpenAddedConnections;
     std::thread threadOpenConnections;
     std::thread threadMessageHandler;
+
+    friend struct CConnmanTest;
 };
 extern std::unique_ptr<CConnman> g_connman;
 void Discover();
@@ -538,6 +569,9 @@ public:
     std::atomic<ServiceFlags> nServices;
     ServiceFlags nServicesExpected;
     SOCKET hSocket;
+#ifdef USE_EPOLL
+    uint32_t nEpollEvents{0}; // events of hSocket registered in the epoll set of the socket handler (guarded by cs_hSocket)
+#endif
     size_t nSendSize;   // total size of all vSendMsg entries
     size_t nSendOffset; // offset inside the first vSendMsg already sent
     uint64_t nSendBytes;
@@ -642,6 +676,13 @@ public:
     // Whether a ping is requested.
     std::atomic<bool> fPingQueued;
 
+    // Minimum fee rate (per kB) of the transactions announced to this peer (BIP133 feefilter)
+    RecursiveMutex cs_feeFilter;
+    CAmount minFeeFilter GUARDED_BY(cs_feeFilter){0};
+    // Last fee filter sent to this peer, and when to send the next one (in usec)
+    CAmount lastSentFeeFilter{0};
+    int64_t nextSendTimeFeeFilter{0};
+
     CNode(NodeId id, ServiceFlags nLocalServicesIn, int nMyStartingHeightIn, SOCKET hSocketIn, const CAddress& addrIn, uint64_t nKeyedNetGroupIn, uint64_t nLocalHostNonceIn, const std::string& addrNameIn = "", bool fInboundIn = false);
     ~CNode();
 
@@ -6,18 +6,24 @@
 
 #include "net_processing.h"
 
+#include "blockencodings.h"
 #include "budget/budgetmanager.h"
 #include "chain.h"
 #include "evo/deterministicmns.h"
+#include "kernel.h"
 #include "masternodeman.h"
 #include "masternode-payments.h"
 #include "masternode-sync.h"
 #include "merkleblock.h"
 #include "netbase.h"
 #include "netmessagemaker.h"
+#include "policy/fees.h"
+#include "policy/policy.h"
 #include "primitives/block.h"
 #include "primitives/transaction.h"
+#include "saltedhasher.h"
 #include "sporkdb.h"
+#include "unordered_lru_cache.h"
 
 int64_t nTimeBestReceived = 0;  // Used only to inform the wallet of when we last received a block
 
@@ -51,6 +57,8 @@ namespace {
 
 /** Number of nodes with fSyncStarted. */
 int nSyncStarted = 0;
+/** Number of nodes with fSyncStarted, syncing headers-first (the others use the legacy getblocks). */
+int nHeadersSyncStarted = 0;
 
 /**
  * Sources of received blocks, to be able to send them reject messages or ban
@@ -97,6 +105,38 @@ int nQueuedValidatedHeaders = 0;
 /** Number of preferable block download peers. */
 int nPreferredDownload = 0;
 
+/** Blocks of the download window received before their parent (headers-first sync), processed
+ *  once the parent is connected. Protected by cs_main. */
+struct BlockWaitingParent {
+    std::shared_ptr<const CBlock> pblock;
+    NodeId nodeid;              //! Peer that sent the block
+    int nHeight;
+    size_t nSize;
+};
+std::map<uint256, BlockWaitingParent> mapBlocksWaitingParent;
+//! Hashes of the blocks waiting for their parent, by parent hash
+std::multimap<uint256, uint256> mapBlocksWaitingParentByPrev;
+size_t nBlocksWaitingParentSize = 0;
+
+/** PoS headers stored before their block (headers-first sync, see IsUnverifiedHeader), and the peer that
+ *  sent them. The entries of the disconnected peers stay until pruned. Protected by cs_main. */
+std::map<CBlockIndex*, NodeId> mapUnverifiedHeaders;
+
+/** Peers that we asked to announce new blocks with a cmpctblock (BIP152 high-bandwidth mode),
+ *  the least recent provider of a new block first. Protected by cs_main. */
+std::list<NodeId> lNodesAnnouncingHeaderAndIDs;
+
+/** The most recently connected block, and its compact encoding (built once the chain is synced),
+ *  to announce and serve the new tip without reading it from disk. */
+Mutex cs_most_recent_block;
+uint256 most_recent_block_hash GUARDED_BY(cs_most_recent_block);
+std::shared_ptr<const CBlock> most_recent_block GUARDED_BY(cs_most_recent_block);
+std::shared_ptr<const CBlockHeaderAndShortTxIDs> most_recent_compact_block GUARDED_BY(cs_most_recent_block);
+
+/** Serialized blocks recently sent to the peers, to serve them again without reading the block files. */
+Mutex cs_recent_raw_blocks;
+unordered_lru_cache<uint256, std::shared_ptr<const std::vector<unsigned char>>, StaticSaltedHasher> recentRawBlocks GUARDED_BY(cs_recent_raw_blocks){MAX_RAW_BLOCKS_CACHE_SIZE};
+
 } // anon namespace
 
 namespace
@@ -211,12 +251,30 @@ struct CNodeState {
     const CBlockIndex* pindexLastCommonBlock;
     //! Whether we've started headers synchronization with this peer.
     bool fSyncStarted;
+    //! Whether the synchronization is headers-first (getheaders), or legacy (getblocks).
+    bool fHeadersSync;
+    //! Number of headers messages that didn't connect to our block index.
+    int nUnconnectingHeaders;
+    //! Number of PoS headers stored from this peer's headers messages, without their block yet (see mapUnverifiedHeaders).
+    size_t nUnverifiedHeaders;
+    //! Last header accepted before the headers got too far ahead of our tip: the headers sync resumes from it.
+    const CBlockIndex* pindexHeadersPaused;
     //! Since when we're stalling block download progress (in microseconds), or 0.
     int64_t nStallingSince;
     std::list<QueuedBlock> vBlocksInFlight;
     int nBlocksInFlight;
     //! Whether we consider this a preferred download peer.
     bool fPreferredDownload;
+    //! Whether this peer can give us compact blocks (it sent us a sendcmpct).
+    bool fProvidesHeaderAndIDs;
+    //! Whether this peer wants new blocks announced with a cmpctblock, instead of an inv.
+    bool fPreferHeaderAndIDs;
+    //! The compact block received from this peer, waiting for the blocktxn with its missing transactions.
+    std::unique_ptr<PartiallyDownloadedBlock> partialBlock;
+    //! Number of new transactions that can still be requested from the invs of this peer (token bucket).
+    double nTxInvTokens;
+    //! When the token bucket was last refilled (in microseconds).
+    int64_t nTxInvLastRefill;
 
     CNodeBlocks nodeBlocks;
 
@@ -228,9 +286,17 @@ struct CNodeState {
         hashLastUnknownBlock.SetNull();
         pindexLastCommonBlock = NULL;
         fSyncStarted = false;
+        fHeadersSync = false;
+        nUnconnectingHeaders = 0;
+        nUnverifiedHeaders = 0;
+        pindexHeadersPaused = nullptr;
         nStallingSince = 0;
         nBlocksInFlight = 0;
         fPreferredDownload = false;
+        fProvidesHeaderAndIDs = false;
+        fPreferHeaderAndIDs = false;
+        nTxInvTokens = MAX_PEER_TX_INV_BURST;
+        nTxInvLastRefill = GetTimeMicros();
     }
 };
 
@@ -306,6 +372,37 @@ void MarkBlockAsInFlight(NodeId nodeid, const uint256& hash, const CBlockIndex*
     mapBlocksInFlight[hash] = std::make_pair(nodeid, it);
 }
 
+/** Ask the peer to announce new blocks with a cmpctblock (high-bandwidth mode). At most MAX_CMPCTBLOCK_HB_PEERS
+ *  peers are in this mode: the one that least recently provided us a new block is moved back to inv announcements.
+ *  Requires cs_main. */
+void MaybeSetPeerAsAnnouncingHeaderAndIDs(NodeId nodeid, CConnman* connman)
+{
+    CNodeState* nodestate = State(nodeid);
+    if (!nodestate || !nodestate->fProvidesHeaderAndIDs) {
+        // Never ask from peers who can't provide compact blocks.
+        return;
+    }
+    for (auto it = lNodesAnnouncingHeaderAndIDs.begin(); it != lNodesAnnouncingHeaderAndIDs.end(); it++) {
+        if (*it == nodeid) {
+            lNodesAnnouncingHeaderAndIDs.erase(it);
+            lNodesAnnouncingHeaderAndIDs.push_back(nodeid);
+            return;
+        }
+    }
+    connman->ForNode(nodeid, [connman](CNode* pfrom) {
+        if (lNodesAnnouncingHeaderAndIDs.size() >= MAX_CMPCTBLOCK_HB_PEERS) {
+            connman->ForNode(lNodesAnnouncingHeaderAndIDs.front(), [connman](CNode* pnodeStop) {
+                connman->PushMessage(pnodeStop, CNetMsgMaker(pnodeStop->GetSendVersion()).Make(NetMsgType::SENDCMPCT, false, CMPCTBLOCKS_VERSION));
+                return true;
+            });
+            lNodesAnnouncingHeaderAndIDs.pop_front();
+        }
+        connman->PushMessage(pfrom, CNetMsgMaker(pfrom->GetSendVersion()).Make(NetMsgType::SENDCMPCT, true, CMPCTBLOCKS_VERSION));
+        lNodesAnnouncingHeaderAndIDs.push_back(pfrom->GetId());
+        return true;
+    });
+}
+
 /** Check whether the last unknown block a peer advertised is not yet known. */
 void ProcessBlockAvailability(NodeId nodeid)
 {
@@ -380,6 +477,8 @@ void FindNextBlocksToDownload(NodeId nodeid, unsigned int count, std::vector<con
     int nWindowEnd = state->pindexLastCommonBlock->nHeight + BLOCK_DOWNLOAD_WINDOW;
     int nMaxHeight = std::min<int>(state->pindexBestKnownBlock->nHeight, nWindowEnd + 1);
     NodeId waitingfor = -1;
+    // When the blocks received ahead of their parent fill the buffer, fetch only the next blocks to connect
+    const bool fWaitingParentFull = nBlocksWaitingParentSize >= MAX_BLOCKS_WAITING_PARENT_SIZE;
     while (pindexWalk->nHeight < nMaxHeight) {
         // Read up to 128 (or more, if more blocks than that are needed) successors of pindexWalk (towards
         // pindexBestKnownBlock) into vToFetch. We fetch 128, because CBlockIndex::GetAncestor may be as expensive
@@ -403,8 +502,14 @@ void FindNextBlocksToDownload(NodeId nodeid, unsigned int count, std::vector<con
             if (pindex->nStatus & BLOCK_HAVE_DATA) {
                 if (pindex->nChainTx)
                     state->pindexLastCommonBlock = pindex;
+            } else if (mapBlocksWaitingParent.count(pindex->GetBlockHash())) {
+                // Already downloaded, waiting for its parent.
+                continue;
             } else if (mapBlocksInFlight.count(pindex->GetBlockHash()) == 0) {
                 // The block is not already downloaded, and not yet in flight.
+                if (fWaitingParentFull && !(pindex->pprev->nStatus & BLOCK_HAVE_DATA)) {
+                    return;
+                }
                 if (pindex->nHeight > nWindowEnd) {
                     // We reached the end of the window.
                     if (vBlocks.size() == 0 && waitingfor != nodeid) {
@@ -425,6 +530,71 @@ void FindNextBlocksToDownload(NodeId nodeid, unsigned int count, std::vector<con
     }
 }
 
+/** Remove from the block index the unverified headers that won't get their block: below our tip (competing
+ *  chain), marked invalid, or sent by a disconnected peer, with their descendants. The ones whose block is
+ *  in flight or waiting for its parent are kept. Recounts the unverified headers of each peer. Requires cs_main. */
+void PruneUnverifiedHeaders()
+{
+    // Drop the verified ones, and keep the chains of the blocks on the way
+    std::set<const CBlockIndex*> setKeep;
+    std::vector<std::pair<CBlockIndex*, NodeId>> vHeaders;
+    for (auto it = mapUnverifiedHeaders.begin(); it != mapUnverifiedHeaders.end();) {
+        CBlockIndex* pindex = it->first;
+        if (!IsUnverifiedHeader(pindex)) {
+            it = mapUnverifiedHeaders.erase(it);
+            continue;
+        }
+        const uint256& hash = pindex->GetBlockHash();
+        if (mapBlocksInFlight.count(hash) || mapBlocksWaitingParent.count(hash)) {
+            for (const CBlockIndex* pindexKeep = pindex; pindexKeep && IsUnverifiedHeader(pindexKeep); pindexKeep = pindexKeep->pprev) {
+                if (!setKeep.insert(pindexKeep).second) break;
+            }
+        }
+        vHeaders.emplace_back(*it);
+        it++;
+    }
+
+    // The parents first: the descendants of a pruned header are pruned (all the unverified headers are in the map)
+    std::sort(vHeaders.begin(), vHeaders.end(), [](const std::pair<CBlockIndex*, NodeId>& a, const std::pair<CBlockIndex*, NodeId>& b) {
+        return a.first->nHeight < b.first->nHeight;
+    });
+    for (auto& it : mapNodeState) {
+        it.second.nUnverifiedHeaders = 0;
+    }
+    const int nTipHeight = chainActive.Height();
+    std::set<const CBlockIndex*> setErase;
+    std::vector<CBlockIndex*> vErase;
+    for (const auto& header : vHeaders) {
+        CBlockIndex* pindex = header.first;
+        auto itState = mapNodeState.find(header.second);
+        const bool fStale = pindex->nHeight <= nTipHeight || (pindex->nStatus & BLOCK_FAILED_MASK) ||
+                            itState == mapNodeState.end() || setErase.count(pindex->pprev);
+        if (fStale && !setKeep.count(pindex)) {
+            setErase.insert(pindex);
+            vErase.push_back(pindex);
+            mapUnverifiedHeaders.erase(pindex);
+        } else if (itState != mapNodeState.end()) {
+            itState->second.nUnverifiedHeaders++;
+        }
+    }
+    if (vErase.empty())
+        return;
+
+    // The peers announcing them move back to the first ancestor kept
+    for (auto& it : mapNodeState) {
+        CNodeState& state = it.second;
+        if (state.pindexBestKnownBlock && setErase.count(state.pindexBestKnownBlock)) {
+            state.hashLastUnknownBlock = state.pindexBestKnownBlock->GetBlockHash();
+            while (setErase.count(state.pindexBestKnownBlock))
+                state.pindexBestKnownBlock = state.pindexBestKnownBlock->pprev;
+        }
+        while (state.pindexHeadersPaused && setErase.count(state.pindexHeadersPaused))
+            state.pindexHeadersPaused = state.pindexHeadersPaused->pprev;
+    }
+    LogPrint(BCLog::NET, "%s: pruned %u unverified headers, %u left\n", __func__, vErase.size(), mapUnverifiedHeaders.size());
+    EraseUnverifiedHeaders(vErase);
+}
+
 } // anon namespace
 
 void PeerLogicValidation::InitializeNode(CNode *pnode) {
@@ -445,8 +615,10 @@ void PeerLogicValidation::FinalizeNode(NodeId nodeid, bool& fUpdateConnectionTim
     LOCK(cs_main);
     CNodeState* state = State(nodeid);
 
-    if (state->fSyncStarted)
+    if (state->fSyncStarted) {
         nSyncStarted--;
+        if (state->fHeadersSync) nHeadersSyncStarted--;
+    }
 
     if (state->nMisbehavior == 0 && state->fCurrentlyConnected) {
         fUpdateConnectionTime = true;
@@ -456,8 +628,13 @@ void PeerLogicValidation::FinalizeNode(NodeId nodeid, bool& fUpdateConnectionTim
         mapBlocksInFlight.erase(entry.hash);
     EraseOrphansFor(nodeid);
     nPreferredDownload -= state->fPreferredDownload;
+    lNodesAnnouncingHeaderAndIDs.remove(nodeid);
+    const bool fUnverifiedHeaders = state->nUnverifiedHeaders > 0;
 
     mapNodeState.erase(nodeid);
+    // Nobody will send the blocks of its headers
+    if (fUnverifiedHeaders)
+        PruneUnverifiedHeaders();
 }
 
 bool GetNodeStateStats(NodeId nodeid, CNodeStateStats& stats)
@@ -628,6 +805,13 @@ PeerLogicValidation::PeerLogicValidation(CConnman* connmanIn) :
 
 void PeerLogicValidation::BlockConnected(const std::shared_ptr<const CBlock>& pblock, const CBlockIndex* pindex)
 {
+    {
+        LOCK(cs_most_recent_block);
+        most_recent_block_hash = pindex->GetBlockHash();
+        most_recent_block = pblock;
+        most_recent_compact_block.reset();
+    }
+
     LOCK(g_cs_orphans);
 
     std::vector<uint256> vOrphanErase;
@@ -664,10 +848,30 @@ void PeerLogicValidation::UpdatedBlockTip(const CBlockIndex* pindexNew, const CB
 
     if (!fInitialDownload) {
         const uint256& hashNewTip = pindexNew->GetBlockHash();
+        std::shared_ptr<const CBlockHeaderAndShortTxIDs> pcmpctblock;
+        {
+            LOCK(cs_most_recent_block);
+            if (most_recent_block && most_recent_block_hash == hashNewTip) {
+                if (!most_recent_compact_block) {
+                    const bool fPrefillShielded = sporkManager.IsSporkActive(SPORK_20_SAPLING_MAINTENANCE);
+                    most_recent_compact_block = std::make_shared<const CBlockHeaderAndShortTxIDs>(*most_recent_block, fPrefillShielded);
+                }
+                pcmpctblock = most_recent_compact_block;
+            }
+        }
         // Relay inventory, but don't relay old inventory during initial block download.
-        connman->ForEachNode([nNewHeight, hashNewTip](CNode* pnode) {
+        // The peers in high-bandwidth mode get the compact block straight away.
+        LOCK(cs_main);
+        connman->ForEachNode([this, nNewHeight, hashNewTip, &pcmpctblock](CNode* pnode) {
             if (nNewHeight > (pnode->nStartingHeight != -1 ? pnode->nStartingHeight - 2000 : 0)) {
-                pnode->PushInventory(CInv(MSG_BLOCK, hashNewTip));
+                const CNodeState* state = State(pnode->GetId());
+                if (pcmpctblock && state && state->fPreferHeaderAndIDs &&
+                        !WITH_LOCK(pnode->cs_inventory, return pnode->filterInventoryKnown.contains(hashNewTip); )) {
+                    pnode->AddInventoryKnown(CInv(MSG_BLOCK, hashNewTip));
+                    connman->PushMessage(pnode, CNetMsgMaker(pnode->GetSendVersion()).Make(NetMsgType::CMPCTBLOCK, *pcmpctblock));
+                } else {
+                    pnode->PushInventory(CInv(MSG_BLOCK, hashNewTip));
+                }
             }
         });
     }
@@ -692,6 +896,9 @@ void PeerLogicValidation::BlockChecked(const CBlock& block, const CValidationSta
                 Misbehaving(it->second, nDoS);
             }
         }
+    } else if (state.IsValid() && it != mapBlockSource.end() && !IsInitialBlockDownload()) {
+        // The peer gave us a new tip: ask it to send the next ones as compact blocks
+        MaybeSetPeerAsAnnouncingHeaderAndIDs(it->second, connman);
     }
 
     if (it != mapBlockSource.end())
@@ -728,8 +935,11 @@ bool static AlreadyHave(const CInv& inv) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
                pcoinsTip->HaveCoinInCache(COutPoint(inv.hash, 1));
     }
 
-    case MSG_BLOCK:
-        return mapBlockIndex.count(inv.hash);
+    case MSG_BLOCK: {
+        // With headers-first sync, the header may be known before the block
+        BlockMap::iterator mi = mapBlockIndex.find(inv.hash);
+        return mi != mapBlockIndex.end() && (mi->second->nStatus & BLOCK_HAVE_DATA);
+    }
     case MSG_TXLOCK_REQUEST:
         // deprecated
         return true;
@@ -897,6 +1107,26 @@ bool static PushTierTwoGetDataRequest(const CInv& inv,
     return false;
 }
 
+/** Returns the block serialized as on the network, from the recently sent blocks or read from disk
+ *  without deserializing it (nullptr if it can't be read). */
+static std::shared_ptr<const std::vector<unsigned char>> GetRawBlock(const CBlockIndex* pindex)
+{
+    const uint256& hash = pindex->GetBlockHash();
+    std::shared_ptr<const std::vector<unsigned char>> pblockData;
+    {
+        LOCK(cs_recent_raw_blocks);
+        if (recentRawBlocks.get(hash, pblockData))
+            return pblockData;
+    }
+    std::shared_ptr<std::vector<unsigned char>> pdata = std::make_shared<std::vector<unsigned char>>();
+    if (!ReadRawBlockFromDisk(*pdata, pindex))
+        return nullptr;
+    pblockData = std::move(pdata);
+    LOCK(cs_recent_raw_blocks);
+    recentRawBlocks.insert(hash, pblockData, pblockData->size());
+    return pblockData;
+}
+
 void static ProcessGetBlockData(CNode* pfrom, const CInv& inv, CConnman* connman, const std::atomic<bool>& interruptMsgProc)
 {
     LOCK(cs_main);
@@ -920,36 +1150,58 @@ void static ProcessGetBlockData(CNode* pfrom, const CInv& inv, CConnman* connman
     }
     // Don't send not-validated blocks
     if (send && (mi->second->nStatus & BLOCK_HAVE_DATA)) {
-        // Send block from disk
-        CBlock block;
-        if (!ReadBlockFromDisk(block, (*mi).second))
-            assert(!"cannot load block from disk");
-        if (inv.type == MSG_BLOCK)
-            connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::BLOCK, block));
-        else // MSG_FILTERED_BLOCK)
-        {
-            bool send_ = false;
-            CMerkleBlock merkleBlock;
+        // Compact blocks are only sent for the recent blocks (the peer is unlikely to have the
+        // transactions of the older ones in its mempool), the full block is sent instead.
+        const bool fCompact = inv.type == MSG_CMPCT_BLOCK && chainActive.Height() - mi->second->nHeight < MAX_CMPCTBLOCK_DEPTH;
+        std::shared_ptr<const CBlockHeaderAndShortTxIDs> pcmpctblock;
+        if (fCompact) {
+            LOCK(cs_most_recent_block);
+            if (most_recent_block_hash == inv.hash) pcmpctblock = most_recent_compact_block;
+        }
+        if (pcmpctblock) {
+            connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::CMPCTBLOCK, *pcmpctblock));
+        } else if (!fCompact && (inv.type == MSG_BLOCK || inv.type == MSG_CMPCT_BLOCK)) {
+            // Send the block as stored on disk (same serialization), without deserializing it
+            std::shared_ptr<const std::vector<unsigned char>> pblockData = GetRawBlock(mi->second);
+            if (!pblockData)
+                assert(!"cannot load block from disk");
+            CSerializedNetMsg msg;
+            msg.command = NetMsgType::BLOCK;
+            msg.data = *pblockData;
+            connman->PushMessage(pfrom, std::move(msg));
+        } else {
+            // Send block from disk
+            CBlock block;
+            if (!ReadBlockFromDisk(block, (*mi).second))
+                assert(!"cannot load block from disk");
+            if (fCompact) {
+                const bool fPrefillShielded = sporkManager.IsSporkActive(SPORK_20_SAPLING_MAINTENANCE);
+                connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::CMPCTBLOCK, CBlockHeaderAndShortTxIDs(block, fPrefillShielded)));
+            } else // MSG_FILTERED_BLOCK)
             {
-                LOCK(pfrom->cs_filter);
-                if (pfrom->pfilter) {
-                    send_ = true;
-                    merkleBlock = CMerkleBlock(block, *pfrom->pfilter);
+                bool send_ = false;
+                CMerkleBlock merkleBlock;
+                {
+                    LOCK(pfrom->cs_filter);
+                    if (pfrom->pfilter) {
+                        send_ = true;
+                        merkleBlock = CMerkleBlock(block, *pfrom->pfilter);
+                    }
                 }
+                if (send_) {
+                    connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::MERKLEBLOCK, merkleBlock));
+                    // CMerkleBlock just contains hashes, so also push any transactions in the block the client did not see
+                    // This avoids hurting performance by pointlessly requiring a round-trip
+                    // Note that there is currently no way for a node to request any single transactions we didnt send here -
+                    // they must either disconnect and retry or request the full block.
+                    // Thus, the protocol spec specified allows for us to provide duplicate txn here,
+                    // however we MUST always provide at least what the remote peer needs
+                    for (std::pair<unsigned int, uint256>& pair : merkleBlock.vMatchedTxn)
+                        connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::TX, *block.vtx[pair.first]));
+                }
+                // else
+                // no response
             }
-            if (send_) {
-                connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::MERKLEBLOCK, merkleBlock));
-                // CMerkleBlock just contains hashes, so also push any transactions in the block the client did not see
-                // This avoids hurting performance by pointlessly requiring a round-trip
-                // Note that there is currently no way for a node to request any single transactions we didnt send here -
-                // they must either disconnect and retry or request the full block.
-                // Thus, the protocol spec specified allows for us to provide duplicate txn here,
-                // however we MUST always provide at least what the remote peer needs
-                for (std::pair<unsigned int, uint256>& pair : merkleBlock.vMatchedTxn)
-                    connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::TX, *block.vtx[pair.first]));
-            }
-            // else
-            // no response
         }
 
         // Trigger them to send a getblocks request for the next batch of inventory
@@ -1027,7 +1279,7 @@ void static ProcessGetData(CNode* pfrom, CConnman* connman, const std::atomic<bo
     if (it != pfrom->vRecvGetData.end()) {
         const CInv &inv = *it;
         it++;
-        if (inv.type == MSG_BLOCK || inv.type == MSG_FILTERED_BLOCK) {
+        if (inv.type == MSG_BLOCK || inv.type == MSG_FILTERED_BLOCK || inv.type == MSG_CMPCT_BLOCK) {
             ProcessGetBlockData(pfrom, inv, connman, interruptMsgProc);
         }
     }
@@ -1080,6 +1332,197 @@ static void CheckBlockSpam(CValidationState& state, CNode* pfrom, const uint256&
     }
 }
 
+void static SendBlockTransactions(const CBlock& block, const BlockTransactionsRequest& req, CNode* pfrom, CConnman* connman)
+{
+    BlockTransactions resp(req);
+    for (size_t i = 0; i < req.indexes.size(); i++) {
+        if (req.indexes[i] >= block.vtx.size()) {
+            LOCK(cs_main);
+            Misbehaving(pfrom->GetId(), 100);
+            LogPrintf("Peer %d sent us a getblocktxn with out-of-bounds tx indices\n", pfrom->GetId());
+            return;
+        }
+        resp.txn[i] = block.vtx[req.indexes[i]];
+    }
+    connman->PushMessage(pfrom, CNetMsgMaker(pfrom->GetSendVersion()).Make(NetMsgType::BLOCKTXN, resp));
+}
+
+// The block (or compact block) doesn't connect to a known block: ask the peer the missing ones
+static void RequestMissingParents(CNode* pfrom, const uint256& hashBlock, const uint256& hashPrevBlock, CConnman* connman)
+{
+    CNetMsgMaker msgMaker(pfrom->GetSendVersion());
+    if (pfrom->nVersion >= HEADERS_FIRST_VERSION) {
+        // the headers up to the block, the download window fetches the blocks
+        CBlockLocator locator = WITH_LOCK(cs_main, return chainActive.GetLocator(pindexBestHeader););
+        connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::GETHEADERS, locator, hashBlock));
+        return;
+    }
+    CBlockLocator locator = WITH_LOCK(cs_main, return chainActive.GetLocator(););
+    if (find(pfrom->vBlockRequested.begin(), pfrom->vBlockRequested.end(), hashBlock) != pfrom->vBlockRequested.end()) {
+        // we already asked for this block, so lets work backwards and ask for the previous block
+        connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::GETBLOCKS, locator, hashPrevBlock));
+        pfrom->vBlockRequested.emplace_back(hashPrevBlock);
+    } else {
+        // ask to sync to this block
+        connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::GETBLOCKS, locator, hashBlock));
+        pfrom->vBlockRequested.emplace_back(hashBlock);
+    }
+}
+
+// Requires cs_main.
+static bool HaveBlockData(const uint256& hash)
+{
+    BlockMap::iterator mi = mapBlockIndex.find(hash);
+    return mi != mapBlockIndex.end() && (mi->second->nStatus & BLOCK_HAVE_DATA);
+}
+
+/** Takes a token from the bucket (nTokens, refilled at nLastRefill) limiting the new transactions requested from
+ *  the invs of a peer. Returns false if the peer announces them faster than MAX_PEER_TX_INV_RATE. */
+bool ConsumeTxInvToken(double& nTokens, int64_t& nLastRefill, int64_t nNow)
+{
+    const int64_t nElapsed = std::max<int64_t>(0, nNow - nLastRefill);
+    nTokens = std::min<double>(MAX_PEER_TX_INV_BURST, nTokens + nElapsed * MAX_PEER_TX_INV_RATE / 1000000);
+    nLastRefill = nNow;
+    if (nTokens < 1)
+        return false;
+    nTokens -= 1;
+    return true;
+}
+
+bool StoreBlockWaitingParent(const std::shared_ptr<const CBlock>& pblock, NodeId nodeid, bool fRequested)
+{
+    BlockMap::iterator miPrev = mapBlockIndex.find(pblock->hashPrevBlock);
+    if (miPrev == mapBlockIndex.end() || (miPrev->second->nStatus & (BLOCK_HAVE_DATA | BLOCK_FAILED_MASK)))
+        return false;
+
+    const uint256& hash = pblock->GetHash();
+    if (mapBlocksWaitingParent.count(hash))
+        return true;
+
+    // Only the blocks of the download window: requested from this peer, after their header
+    BlockMap::iterator mi = mapBlockIndex.find(hash);
+    if (!fRequested || mi == mapBlockIndex.end() || (mi->second->nStatus & BLOCK_HAVE_DATA)) {
+        Misbehaving(nodeid, 20);
+        LogPrint(BCLog::NET, "%s: dropping unrequested block %s from peer=%d, its parent is not received\n", __func__, hash.ToString(), nodeid);
+        return true;
+    }
+
+    const size_t nSize = GetSerializeSize(*pblock, SER_NETWORK, PROTOCOL_VERSION);
+    if (nBlocksWaitingParentSize + nSize > MAX_BLOCKS_WAITING_PARENT_SIZE) {
+        // Drop the blocks that can't be connected anymore
+        const int nHeight = chainActive.Height();
+        for (auto it = mapBlocksWaitingParent.begin(); it != mapBlocksWaitingParent.end();) {
+            if (it->second.nHeight <= nHeight) {
+                auto range = mapBlocksWaitingParentByPrev.equal_range(it->second.pblock->hashPrevBlock);
+                for (auto itPrev = range.first; itPrev != range.second; itPrev++) {
+                    if (itPrev->second == it->first) {
+                        mapBlocksWaitingParentByPrev.erase(itPrev);
+                        break;
+                    }
+                }
+                nBlocksWaitingParentSize -= it->second.nSize;
+                it = mapBlocksWaitingParent.erase(it);
+            } else {
+                it++;
+            }
+        }
+        if (nBlocksWaitingParentSize + nSize > MAX_BLOCKS_WAITING_PARENT_SIZE) {
+            LogPrint(BCLog::NET, "%s: buffer full, dropping block %s (requested again later)\n", __func__, hash.ToString());
+            return true;
+        }
+    }
+
+    mapBlocksWaitingParent.emplace(hash, BlockWaitingParent{pblock, nodeid, miPrev->second->nHeight + 1, nSize});
+    mapBlocksWaitingParentByPrev.emplace(pblock->hashPrevBlock, hash);
+    nBlocksWaitingParentSize += nSize;
+    LogPrint(BCLog::NET, "%s: block %s (%d) from peer=%d waiting for its parent\n", __func__, hash.ToString(), miPrev->second->nHeight + 1, nodeid);
+    return true;
+}
+
+void ProcessBlocksWaitingParent(const uint256& hashParent)
+{
+    std::deque<uint256> queue;
+    queue.push_back(hashParent);
+    while (!queue.empty()) {
+        std::vector<BlockWaitingParent> vChildren;
+        {
+            LOCK(cs_main);
+            const uint256 head = queue.front();
+            queue.pop_front();
+            if (!HaveBlockData(head)) continue;
+            auto range = mapBlocksWaitingParentByPrev.equal_range(head);
+            for (auto it = range.first; it != range.second; it++) {
+                auto itBlock = mapBlocksWaitingParent.find(it->second);
+                if (itBlock == mapBlocksWaitingParent.end()) continue;
+                nBlocksWaitingParentSize -= itBlock->second.nSize;
+                // the peer may have disconnected: mapBlockSource is cleaned by BlockChecked
+                if (State(itBlock->second.nodeid)) mapBlockSource.emplace(it->second, itBlock->second.nodeid);
+                vChildren.emplace_back(std::move(itBlock->second));
+                mapBlocksWaitingParent.erase(itBlock);
+            }
+            mapBlocksWaitingParentByPrev.erase(range.first, range.second);
+        }
+        for (const BlockWaitingParent& child : vChildren) {
+            CValidationState state;
+            ProcessNewBlock(state, child.pblock, nullptr);
+            int nDoS;
+            if (state.IsInvalid(nDoS) && nDoS > 0) {
+                LOCK(cs_main);
+                if (State(child.nodeid)) Misbehaving(child.nodeid, nDoS);
+            }
+            queue.push_back(child.pblock->GetHash());
+        }
+    }
+}
+
+// Processes a block received from the peer (in a block message, or rebuilt from a compact block)
+static void ProcessReceivedBlock(CNode* pfrom, const std::shared_ptr<CBlock>& pblock, const std::string& strCommand, CConnman* connman)
+{
+    const uint256& hashBlock = pblock->GetHash();
+    CInv inv(MSG_BLOCK, hashBlock);
+    pfrom->AddInventoryKnown(inv);
+    CValidationState state;
+    if (!WITH_LOCK(cs_main, return HaveBlockData(hashBlock); )) {
+        {
+            LOCK(cs_main);
+            auto itInFlight = mapBlocksInFlight.find(hashBlock);
+            const bool fRequested = itInFlight != mapBlocksInFlight.end() && itInFlight->second.first == pfrom->GetId();
+            MarkBlockAsReceived(hashBlock);
+            // The peer may send the full block instead of the missing transactions of a compact block
+            CNodeState* nodestate = State(pfrom->GetId());
+            if (nodestate->partialBlock && nodestate->partialBlock->header.GetHash() == hashBlock) {
+                nodestate->partialBlock.reset();
+            }
+            // Received before its parent (download window)
+            if (StoreBlockWaitingParent(pblock, pfrom->GetId(), fRequested))
+                return;
+            mapBlockSource.emplace(hashBlock, pfrom->GetId());
+        }
+        bool fAccepted = true;
+        ProcessNewBlock(state, pblock, nullptr, &fAccepted);
+        if (!fAccepted) {
+            CheckBlockSpam(state, pfrom, hashBlock);
+        }
+        int nDoS;
+        if(state.IsInvalid(nDoS)) {
+            assert (state.GetRejectCode() < REJECT_INTERNAL); // Blocks are never rejected with internal reject codes
+            connman->PushMessage(pfrom, CNetMsgMaker(pfrom->GetSendVersion()).Make(NetMsgType::REJECT, strCommand, state.GetRejectCode(),
+                state.GetRejectReason().substr(0, MAX_REJECT_MESSAGE_LENGTH), inv.hash));
+            if(nDoS > 0) {
+                TRY_LOCK(cs_main, lockMain);
+                if(lockMain) Misbehaving(pfrom->GetId(), nDoS);
+            }
+        }
+        if (fAccepted) {
+            ProcessBlocksWaitingParent(hashBlock);
+        }
+        //disconnect this node if its old protocol version
+        pfrom->DisconnectOldProtocol(pfrom->nVersion, ActiveProtocol(), strCommand);
+    } else {
+        LogPrint(BCLog::NET, "%s : Already processed block %s, skipping ProcessNewBlock()\n", __func__, pblock->GetHash().GetHex());
+    }
+}
+
 bool fRequestedSporksIDB = false;
 bool static ProcessMessage(CNode* pfrom, std::string strCommand, CDataStream& vRecv, int64_t nTimeReceived, CConnman* connman, std::atomic<bool>& interruptMsgProc)
 {
@@ -1276,6 +1719,10 @@ bool static ProcessMessage(CNode* pfrom, std::string strCommand, CDataStream& vR
         LogPrintf("New outbound peer connected: version: %d, blocks=%d, peer=%d%s\n",
                   pfrom->nVersion.load(), pfrom->nStartingHeight, pfrom->GetId(),
                   (fLogIPs ? strprintf(", peeraddr=%s", pfrom->addr.ToString()) : ""));
+
+        // Tell our peer we can provide compact blocks (BIP152), announcing new blocks with an inv for now.
+        // Peers not supporting them ignore the message.
+        connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::SENDCMPCT, false, CMPCTBLOCKS_VERSION));
     }
 
 
@@ -1335,6 +1782,15 @@ bool static ProcessMessage(CNode* pfrom, std::string strCommand, CDataStream& vR
         LOCK(cs_main);
 
         std::vector<CInv> vToFetch;
+        // Once synced, ask compact blocks to the peers providing them (they send the full block if it's not recent)
+        const bool fFetchCompact = State(pfrom->GetId())->fProvidesHeaderAndIDs && !IsInitialBlockDownload();
+        // During the initial download, the blocks announced by the headers-first peers are fetched by the download window
+        const bool fHeadersSync = pfrom->nVersion >= HEADERS_FIRST_VERSION;
+        const bool fFetchAnnounced = !fHeadersSync || !IsInitialBlockDownload();
+        // New transactions announced faster than the rate limit are not requested
+        CNodeState* nodestate = State(pfrom->GetId());
+        const int64_t nNow = GetTimeMicros();
+        unsigned int nTxInvIgnored = 0;
 
         for (unsigned int nInv = 0; nInv < vInv.size(); nInv++) {
             const CInv& inv = vInv[nInv];
@@ -1353,21 +1809,37 @@ bool static ProcessMessage(CNode* pfrom, std::string strCommand, CDataStream& vR
             bool fAlreadyHave = AlreadyHave(inv);
             LogPrint(BCLog::NET, "got inv: %s  %s peer=%d\n", inv.ToString(), fAlreadyHave ? "have" : "new", pfrom->id);
 
-            if (!fAlreadyHave && !fImporting && !fReindex && inv.type != MSG_BLOCK)
-                pfrom->AskFor(inv);
-
+            if (!fAlreadyHave && !fImporting && !fReindex && inv.type != MSG_BLOCK) {
+                if (inv.type == MSG_TX && !pfrom->fWhitelisted && !ConsumeTxInvToken(nodestate->nTxInvTokens, nodestate->nTxInvLastRefill, nNow)) {
+                    nTxInvIgnored++;
+                } else {
+                    pfrom->AskFor(inv);
+                }
+            }
 
             if (inv.type == MSG_BLOCK) {
                 UpdateBlockAvailability(pfrom->GetId(), inv.hash);
                 if (!fAlreadyHave && !fImporting && !fReindex && !mapBlocksInFlight.count(inv.hash)) {
-                    // Add this to the list of blocks to request
-                    vToFetch.push_back(inv);
-                    LogPrint(BCLog::NET, "getblocks (%d) %s to peer=%d\n", pindexBestHeader->nHeight, inv.hash.ToString(), pfrom->id);
+                    if (fHeadersSync && !mapBlockIndex.count(inv.hash)) {
+                        // Ask the headers up to the announced block
+                        connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::GETHEADERS, chainActive.GetLocator(pindexBestHeader), inv.hash));
+                        LogPrint(BCLog::NET, "getheaders (%d) %s to peer=%d\n", pindexBestHeader->nHeight, inv.hash.ToString(), pfrom->id);
+                    }
+                    if (fFetchAnnounced) {
+                        // Add this to the list of blocks to request
+                        vToFetch.emplace_back(fFetchCompact ? MSG_CMPCT_BLOCK : MSG_BLOCK, inv.hash);
+                        // the compact block answering the request is accepted from this peer
+                        if (fFetchCompact) MarkBlockAsInFlight(pfrom->GetId(), inv.hash);
+                        LogPrint(BCLog::NET, "getblocks (%d) %s to peer=%d\n", pindexBestHeader->nHeight, inv.hash.ToString(), pfrom->id);
+                    }
                 }
             }
 
         }
 
+        if (nTxInvIgnored > 0)
+            LogPrint(BCLog::NET, "ignored %u tx invs over the rate limit, peer=%d\n", nTxInvIgnored, pfrom->id);
+
         if (!vToFetch.empty())
             connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::GETDATA, vToFetch));
     }
@@ -1393,7 +1865,7 @@ bool static ProcessMessage(CNode* pfrom, std::string strCommand, CDataStream& vR
     }
 
 
-    else if (strCommand == NetMsgType::GETBLOCKS || strCommand == NetMsgType::GETHEADERS) {
+    else if (strCommand == NetMsgType::GETBLOCKS) {
         CBlockLocator locator;
         uint256 hashStop;
         vRecv >> locator >> hashStop;
@@ -1431,22 +1903,19 @@ bool static ProcessMessage(CNode* pfrom, std::string strCommand, CDataStream& vR
     }
 
 
-    else if (strCommand == NetMsgType::HEADERS && Params().HeadersFirstSyncingActive()) {
+    else if (strCommand == NetMsgType::GETHEADERS) {
         CBlockLocator locator;
         uint256 hashStop;
         vRecv >> locator >> hashStop;
 
         if (locator.vHave.size() > MAX_LOCATOR_SZ) {
-            LogPrint(BCLog::NET, "getblocks locator size %lld > %d, disconnect peer=%d\n", locator.vHave.size(), MAX_LOCATOR_SZ, pfrom->GetId());
+            LogPrint(BCLog::NET, "getheaders locator size %lld > %d, disconnect peer=%d\n", locator.vHave.size(), MAX_LOCATOR_SZ, pfrom->GetId());
             pfrom->fDisconnect = true;
             return true;
         }
 
         LOCK(cs_main);
 
-        if (IsInitialBlockDownload())
-            return true;
-
         CBlockIndex* pindex = NULL;
         if (locator.IsNull()) {
             // If locator is null, return the hashStop block
@@ -1464,7 +1933,7 @@ bool static ProcessMessage(CNode* pfrom, std::string strCommand, CDataStream& vR
         // we must use CBlocks, as CBlockHeaders won't include the 0x00 nTx count at the end
         std::vector<CBlock> vHeaders;
         int nLimit = MAX_HEADERS_RESULTS;
-        LogPrintf("getheaders %d to %s from peer=%d\n", (pindex ? pindex->nHeight : -1), hashStop.ToString(), pfrom->id);
+        LogPrint(BCLog::NET, "getheaders %d to %s from peer=%d\n", (pindex ? pindex->nHeight : -1), hashStop.IsNull() ? "end" : hashStop.ToString(), pfrom->id);
         for (; pindex; pindex = chainActive.Next(pindex)) {
             vHeaders.push_back(pindex->GetBlockHeader());
             if (--nLimit <= 0 || pindex->GetBlockHash() == hashStop)
@@ -1627,7 +2096,7 @@ bool static ProcessMessage(CNode* pfrom, std::string strCommand, CDataStream& vR
         }
     }
 
-    else if (strCommand == NetMsgType::HEADERS && Params().HeadersFirstSyncingActive() && !fImporting && !fReindex) // Ignore headers received while importing
+    else if (strCommand == NetMsgType::HEADERS && !fImporting && !fReindex) // Ignore headers received while importing
     {
         std::vector<CBlockHeader> headers;
 
@@ -1644,44 +2113,109 @@ bool static ProcessMessage(CNode* pfrom, std::string strCommand, CDataStream& vR
             ReadCompactSize(vRecv); // ignore tx count; assume it is 0.
         }
 
-        LOCK(cs_main);
-
         if (nCount == 0) {
             // Nothing interesting. Stop asking this peers for more headers.
             return true;
         }
-        CBlockIndex* pindexLast = NULL;
+
+        {
+            LOCK(cs_main);
+            CNodeState* nodestate = State(pfrom->GetId());
+            if (!mapBlockIndex.count(headers[0].hashPrevBlock)) {
+                // The headers don't connect to our block index: ask the ones in between (the peer
+                // may have announced a block that we don't know the parent of), penalizing the peers
+                // that keep sending unconnecting headers.
+                if (++nodestate->nUnconnectingHeaders % MAX_UNCONNECTING_HEADERS == 0) {
+                    Misbehaving(pfrom->GetId(), 20);
+                }
+                connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::GETHEADERS, chainActive.GetLocator(pindexBestHeader), UINT256_ZERO));
+                LogPrint(BCLog::NET, "received header %s: missing prev block %s, sending getheaders (%d) to end (peer=%d, nUnconnectingHeaders=%d)\n",
+                        headers[0].GetHash().ToString(), headers[0].hashPrevBlock.ToString(), pindexBestHeader->nHeight, pfrom->id, nodestate->nUnconnectingHeaders);
+                // Remember the best block announced by the peer
+                UpdateBlockAvailability(pfrom->GetId(), headers.back().GetHash());
+                return true;
+            }
+            nodestate->nUnconnectingHeaders = 0;
+        }
+
+        uint256 hashLastBlock;
         for (const CBlockHeader& header : headers) {
-            CValidationState state;
-            if (pindexLast != NULL && header.hashPrevBlock != pindexLast->GetBlockHash()) {
+            if (!hashLastBlock.IsNull() && header.hashPrevBlock != hashLastBlock) {
+                LOCK(cs_main);
                 Misbehaving(pfrom->GetId(), 20);
                 return error("non-continuous headers sequence");
             }
+            hashLastBlock = header.GetHash();
+        }
 
-            /*TODO: this has a CBlock cast on it so that it will compile. There should be a solution for this
-             * before headers are reimplemented on mainnet
-             */
-            if (!AcceptBlockHeader((CBlock)header, state, &pindexLast)) {
-                int nDoS;
-                if (state.IsInvalid(nDoS)) {
-                    if (nDoS > 0)
-                        Misbehaving(pfrom->GetId(), nDoS);
-                    std::string strError = "invalid header received " + header.GetHash().ToString();
-                    return error(strError.c_str());
+        std::vector<uint256> vNewHeaders;
+        {
+            LOCK(cs_main);
+            CNodeState* nodestate = State(pfrom->GetId());
+            // Limit the PoS headers that the peers make us store before their blocks can be checked
+            auto fUnverifiedFull = [nodestate]() {
+                return nodestate->nUnverifiedHeaders >= MAX_UNVERIFIED_HEADERS_PER_PEER || mapUnverifiedHeaders.size() >= MAX_UNVERIFIED_HEADERS;
+            };
+            if (fUnverifiedFull()) {
+                PruneUnverifiedHeaders();
+                if (!mapBlockIndex.count(headers[0].hashPrevBlock)) {
+                    // Their parent was pruned (the peer sends it again if it is still on its chain)
+                    connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::GETHEADERS, chainActive.GetLocator(pindexBestHeader), UINT256_ZERO));
+                    return true;
                 }
             }
+            if (fUnverifiedFull()) {
+                LogPrint(BCLog::NET, "too many unverified headers (peer=%d: %u, total: %u), waiting for their blocks\n",
+                         pfrom->id, nodestate->nUnverifiedHeaders, mapUnverifiedHeaders.size());
+                nodestate->pindexHeadersPaused = mapBlockIndex.at(headers[0].hashPrevBlock);
+                return true;
+            }
+            for (const CBlockHeader& header : headers) {
+                const uint256& hash = header.GetHash();
+                if (!mapBlockIndex.count(hash)) vNewHeaders.emplace_back(hash);
+            }
+        }
+
+        CValidationState state;
+        CBlockIndex* pindexLast = nullptr;
+        const bool fAccepted = ProcessNewBlockHeaders(headers, state, &pindexLast);
+
+        LOCK(cs_main);
+        CNodeState* nodestate = State(pfrom->GetId());
+        // (including the headers stored before an invalid one)
+        for (const uint256& hash : vNewHeaders) {
+            BlockMap::iterator mi = mapBlockIndex.find(hash);
+            if (mi != mapBlockIndex.end() && IsUnverifiedHeader(mi->second) &&
+                    mapUnverifiedHeaders.emplace(mi->second, pfrom->GetId()).second) {
+                nodestate->nUnverifiedHeaders++;
+            }
         }
 
+        bool fPaused = false;
+        if (!fAccepted) {
+            int nDoS;
+            if (state.GetRejectReason() == "headers-too-far-ahead") {
+                // Not invalid: the rest is asked again once the blocks caught up (see SendMessages)
+                fPaused = true;
+            } else if (state.IsInvalid(nDoS)) {
+                if (nDoS > 0) {
+                    Misbehaving(pfrom->GetId(), nDoS);
+                }
+                return error("invalid header received from peer=%d: %s", pfrom->id, FormatStateMessage(state));
+            }
+        }
         if (pindexLast)
             UpdateBlockAvailability(pfrom->GetId(), pindexLast->GetBlockHash());
 
-        if (nCount == MAX_HEADERS_RESULTS && pindexLast) {
+        if (fPaused) {
+            nodestate->pindexHeadersPaused = pindexLast ? pindexLast : mapBlockIndex.at(headers[0].hashPrevBlock);
+            LogPrint(BCLog::NET, "headers from peer=%d too far ahead of the tip, pausing at %d\n", pfrom->id, nodestate->pindexHeadersPaused->nHeight);
+        } else if (nCount == MAX_HEADERS_RESULTS && pindexLast) {
             // Headers message had its maximum size; the peer may have more headers.
-            // TODO: optimize: if pindexLast is an ancestor of chainActive.Tip or pindexBestHeader, continue
-            // from there instead.
-            LogPrintf("more getheaders (%d) to end to peer=%d (startheight:%d)\n", pindexLast->nHeight, pfrom->id, pfrom->nStartingHeight);
+            LogPrint(BCLog::NET, "more getheaders (%d) to end to peer=%d (startheight:%d)\n", pindexLast->nHeight, pfrom->id, pfrom->nStartingHeight);
             connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::GETHEADERS, chainActive.GetLocator(pindexLast), UINT256_ZERO));
         }
+        // The blocks are requested by the download window (see SendMessages)
     }
 
     else if (strCommand == NetMsgType::BLOCK && !fImporting && !fReindex) // Ignore blocks received while importing
@@ -1689,51 +2223,213 @@ bool static ProcessMessage(CNode* pfrom, std::string strCommand, CDataStream& vR
         std::shared_ptr<CBlock> pblock = std::make_shared<CBlock>();
         vRecv >> *pblock;
         const uint256& hashBlock = pblock->GetHash();
-        CInv inv(MSG_BLOCK, hashBlock);
-        LogPrint(BCLog::NET, "received block %s peer=%d\n", inv.hash.ToString(), pfrom->id);
+        LogPrint(BCLog::NET, "received block %s peer=%d\n", hashBlock.ToString(), pfrom->id);
 
         // sometimes we will be sent their most recent block and its not the one we want, in that case tell where we are
         if (!mapBlockIndex.count(pblock->hashPrevBlock)) {
-            CBlockLocator locator = WITH_LOCK(cs_main, return chainActive.GetLocator(););
-            if (find(pfrom->vBlockRequested.begin(), pfrom->vBlockRequested.end(), hashBlock) != pfrom->vBlockRequested.end()) {
-                // we already asked for this block, so lets work backwards and ask for the previous block
-                connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::GETBLOCKS, locator, pblock->hashPrevBlock));
-                pfrom->vBlockRequested.emplace_back(pblock->hashPrevBlock);
-            } else {
-                // ask to sync to this block
-                connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::GETBLOCKS, locator, hashBlock));
-                pfrom->vBlockRequested.emplace_back(hashBlock);
-            }
+            RequestMissingParents(pfrom, hashBlock, pblock->hashPrevBlock, connman);
         } else {
-            pfrom->AddInventoryKnown(inv);
+            ProcessReceivedBlock(pfrom, pblock, strCommand, connman);
+        }
+    }
+
+    else if (strCommand == NetMsgType::SENDCMPCT) {
+        bool fAnnounceUsingCMPCTBLOCK = false;
+        uint64_t nCMPCTBLOCKVersion = 0;
+        vRecv >> fAnnounceUsingCMPCTBLOCK >> nCMPCTBLOCKVersion;
+        if (nCMPCTBLOCKVersion == CMPCTBLOCKS_VERSION) {
+            LOCK(cs_main);
+            CNodeState* nodestate = State(pfrom->GetId());
+            nodestate->fProvidesHeaderAndIDs = true;
+            nodestate->fPreferHeaderAndIDs = fAnnounceUsingCMPCTBLOCK;
+        }
+    }
+
+    else if (strCommand == NetMsgType::CMPCTBLOCK && !fImporting && !fReindex) // Ignore blocks received while importing
+    {
+        CBlockHeaderAndShortTxIDs cmpctblock;
+        vRecv >> cmpctblock;
+        const uint256& hashBlock = cmpctblock.header.GetHash();
+        LogPrint(BCLog::NET, "received cmpctblock %s peer=%d\n", hashBlock.ToString(), pfrom->id);
+
+        if (WITH_LOCK(cs_main, return HaveBlockData(hashBlock); )) {
+            pfrom->AddInventoryKnown(CInv(MSG_BLOCK, hashBlock));
+            LogPrint(BCLog::NET, "%s : Already processed block %s, skipping cmpctblock\n", __func__, hashBlock.GetHex());
+            return true;
+        }
+        {
+            LOCK(cs_main);
+            // Only the compact blocks announced by the high-bandwidth peers, or requested from this peer
+            auto itInFlight = mapBlocksInFlight.find(hashBlock);
+            const bool fRequested = itInFlight != mapBlocksInFlight.end() && itInFlight->second.first == pfrom->GetId();
+            if (!fRequested &&
+                    std::find(lNodesAnnouncingHeaderAndIDs.begin(), lNodesAnnouncingHeaderAndIDs.end(), pfrom->GetId()) == lNodesAnnouncingHeaderAndIDs.end()) {
+                LogPrint(BCLog::NET, "Peer %d sent us an unsolicited cmpctblock %s, ignoring\n", pfrom->id, hashBlock.ToString());
+                return true;
+            }
+            BlockMap::iterator mi = mapBlockIndex.find(cmpctblock.header.hashPrevBlock);
+            if (mi == mapBlockIndex.end()) {
+                RequestMissingParents(pfrom, hashBlock, cmpctblock.header.hashPrevBlock, connman);
+                return true;
+            }
+            if (!fRequested && !(mi->second->nStatus & BLOCK_HAVE_DATA)) {
+                // Still syncing: the block is fetched by the download window, once announced by its header
+                LogPrint(BCLog::NET, "Peer %d sent us cmpctblock %s before we have its parent, ignoring\n", pfrom->id, hashBlock.ToString());
+                return true;
+            }
+            // Check the header before spending any work on the transactions
+            CBlockIndex* pindexPrev = mi->second;
+            if (!CheckWork(CBlock(cmpctblock.header), pindexPrev)) {
+                Misbehaving(pfrom->GetId(), 100);
+                return error("Peer %d sent us a compact block with invalid work", pfrom->id);
+            }
             CValidationState state;
-            if (!mapBlockIndex.count(hashBlock)) {
-                {
-                    LOCK(cs_main);
-                    MarkBlockAsReceived(hashBlock);
-                    mapBlockSource.emplace(hashBlock, pfrom->GetId());
+            if (!ContextualCheckBlockHeader(cmpctblock.header, state, pindexPrev)) {
+                int nDoS = 0;
+                if (state.IsInvalid(nDoS) && nDoS > 0) {
+                    Misbehaving(pfrom->GetId(), nDoS);
                 }
-                bool fAccepted = true;
-                ProcessNewBlock(state, pblock, nullptr, &fAccepted);
-                if (!fAccepted) {
-                    CheckBlockSpam(state, pfrom, hashBlock);
+                return error("Peer %d sent us a compact block with invalid header: %s", pfrom->id, FormatStateMessage(state));
+            }
+            // and its stake, with the prefilled coinstake
+            const CBlock blockStake = cmpctblock.GetStakeBlock();
+            std::string strError;
+            if (!blockStake.IsProofOfStake()) {
+                if (Params().GetConsensus().NetworkUpgradeActive(pindexPrev->nHeight + 1, Consensus::UPGRADE_POS)) {
+                    Misbehaving(pfrom->GetId(), 100);
+                    return error("Peer %d sent us a compact block without coinstake", pfrom->id);
                 }
-                int nDoS;
-                if(state.IsInvalid(nDoS)) {
-                    assert (state.GetRejectCode() < REJECT_INTERNAL); // Blocks are never rejected with internal reject codes
-                    connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::REJECT, strCommand, state.GetRejectCode(),
-                        state.GetRejectReason().substr(0, MAX_REJECT_MESSAGE_LENGTH), inv.hash));
-                    if(nDoS > 0) {
-                        TRY_LOCK(cs_main, lockMain);
-                        if(lockMain) Misbehaving(pfrom->GetId(), nDoS);
-                    }
+            } else if (!CheckProofOfStake(blockStake, strError, pindexPrev)) {
+                Misbehaving(pfrom->GetId(), 100);
+                return error("Peer %d sent us a compact block with invalid proof of stake: %s", pfrom->id, strError);
+            }
+        }
+
+        // Rebuild the block with the transactions of the mempool, and of the orphan pool
+        std::vector<std::pair<uint256, CTransactionRef>> vExtraTxn;
+        {
+            LOCK(g_cs_orphans);
+            vExtraTxn.reserve(mapOrphanTransactions.size());
+            for (const auto& it : mapOrphanTransactions) {
+                vExtraTxn.emplace_back(it.first, it.second.tx);
+            }
+        }
+        std::unique_ptr<PartiallyDownloadedBlock> partialBlock(new PartiallyDownloadedBlock(&mempool));
+        ReadStatus status = partialBlock->InitData(cmpctblock, vExtraTxn);
+        if (status == READ_STATUS_INVALID) {
+            LOCK(cs_main);
+            Misbehaving(pfrom->GetId(), 100);
+            return error("Peer %d sent us invalid compact block", pfrom->id);
+        }
+
+        BlockTransactionsRequest req;
+        if (status == READ_STATUS_OK) {
+            for (size_t i = 0; i < partialBlock->GetTxCount(); i++) {
+                if (!partialBlock->IsTxAvailable(i))
+                    req.indexes.push_back(i);
+            }
+            if (req.indexes.empty()) {
+                std::shared_ptr<CBlock> pblock = std::make_shared<CBlock>();
+                status = partialBlock->FillBlock(*pblock, std::vector<CTransactionRef>());
+                if (status == READ_STATUS_OK) {
+                    ProcessReceivedBlock(pfrom, pblock, strCommand, connman);
+                    return true;
+                }
+                if (status == READ_STATUS_CHECKBLOCK_FAILED) {
+                    LOCK(cs_main);
+                    Misbehaving(pfrom->GetId(), 100);
+                    return error("Peer %d sent us a compact block not matching its merkle root", pfrom->id);
                 }
-                //disconnect this node if its old protocol version
-                pfrom->DisconnectOldProtocol(pfrom->nVersion, ActiveProtocol(), strCommand);
-            } else {
-                LogPrint(BCLog::NET, "%s : Already processed block %s, skipping ProcessNewBlock()\n", __func__, pblock->GetHash().GetHex());
             }
         }
+
+        LOCK(cs_main);
+        CNodeState* nodestate = State(pfrom->GetId());
+        // Take over the download from another peer (only the high-bandwidth peers send unsolicited compact blocks)
+        MarkBlockAsInFlight(pfrom->GetId(), hashBlock);
+        if (status == READ_STATUS_OK && !nodestate->partialBlock) {
+            // Ask the missing transactions
+            req.blockhash = hashBlock;
+            nodestate->partialBlock = std::move(partialBlock);
+            connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::GETBLOCKTXN, req));
+        } else {
+            // Short id collision, or already waiting for another compact block of this peer: ask the full block
+            std::vector<CInv> vInv(1);
+            vInv[0] = CInv(MSG_BLOCK, hashBlock);
+            connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::GETDATA, vInv));
+        }
+    }
+
+    else if (strCommand == NetMsgType::GETBLOCKTXN) {
+        BlockTransactionsRequest req;
+        vRecv >> req;
+
+        std::shared_ptr<const CBlock> recent_block;
+        {
+            LOCK(cs_most_recent_block);
+            if (most_recent_block_hash == req.blockhash)
+                recent_block = most_recent_block;
+        }
+        if (recent_block) {
+            SendBlockTransactions(*recent_block, req, pfrom, connman);
+            return true;
+        }
+
+        CBlock block;
+        {
+            LOCK(cs_main);
+            BlockMap::iterator it = mapBlockIndex.find(req.blockhash);
+            if (it == mapBlockIndex.end() || !(it->second->nStatus & BLOCK_HAVE_DATA)) {
+                LogPrint(BCLog::NET, "Peer %d sent us a getblocktxn for a block we don't have\n", pfrom->id);
+                return true;
+            }
+            if (it->second->nHeight >= chainActive.Height() - MAX_BLOCKTXN_DEPTH) {
+                if (!ReadBlockFromDisk(block, it->second))
+                    assert(!"cannot load block from disk");
+            }
+        }
+        if (block.IsNull()) {
+            // Don't read older blocks from disk to send a few transactions: the peer gets the full block
+            // (so it must download all the data we read).
+            LogPrint(BCLog::NET, "Peer %d sent us a getblocktxn for a block > %i deep\n", pfrom->id, MAX_BLOCKTXN_DEPTH);
+            pfrom->vRecvGetData.emplace_back(MSG_BLOCK, req.blockhash);
+            ProcessGetData(pfrom, connman, interruptMsgProc);
+            return true;
+        }
+        SendBlockTransactions(block, req, pfrom, connman);
+    }
+
+    else if (strCommand == NetMsgType::BLOCKTXN && !fImporting && !fReindex) // Ignore blocks received while importing
+    {
+        BlockTransactions resp;
+        vRecv >> resp;
+
+        std::unique_ptr<PartiallyDownloadedBlock> partialBlock;
+        {
+            LOCK(cs_main);
+            CNodeState* nodestate = State(pfrom->GetId());
+            if (!nodestate->partialBlock || nodestate->partialBlock->header.GetHash() != resp.blockhash) {
+                LogPrint(BCLog::NET, "Peer %d sent us block transactions for block we weren't expecting\n", pfrom->id);
+                return true;
+            }
+            partialBlock = std::move(nodestate->partialBlock);
+        }
+
+        std::shared_ptr<CBlock> pblock = std::make_shared<CBlock>();
+        ReadStatus status = partialBlock->FillBlock(*pblock, resp.txn);
+        if (status == READ_STATUS_INVALID || status == READ_STATUS_CHECKBLOCK_FAILED) {
+            LOCK(cs_main);
+            MarkBlockAsReceived(resp.blockhash);
+            Misbehaving(pfrom->GetId(), 100);
+            return error("Peer %d sent us invalid compact block/non-matching block transactions", pfrom->id);
+        } else if (status == READ_STATUS_FAILED) {
+            // Might have collided, fall back to getdata now (the block is still in flight)
+            std::vector<CInv> vInv(1);
+            vInv[0] = CInv(MSG_BLOCK, resp.blockhash);
+            connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::GETDATA, vInv));
+        } else {
+            ProcessReceivedBlock(pfrom, pblock, strCommand, connman);
+        }
     }
 
     // This asymmetric behavior for inbound and outbound connections was introduced
@@ -1900,6 +2596,19 @@ bool static ProcessMessage(CNode* pfrom, std::string strCommand, CDataStream& vR
     }
 
 
+    else if (strCommand == NetMsgType::FEEFILTER) {
+        CAmount newFeeFilter = 0;
+        vRecv >> newFeeFilter;
+        if (Params().GetConsensus().MoneyRange(newFeeFilter)) {
+            {
+                LOCK(pfrom->cs_feeFilter);
+                pfrom->minFeeFilter = newFeeFilter;
+            }
+            LogPrint(BCLog::NET, "received: feefilter of %s from peer=%d\n", CFeeRate(newFeeFilter).ToString(), pfrom->GetId());
+        }
+    }
+
+
     else if (strCommand == NetMsgType::REJECT) {
         try {
             std::string strMsg;
@@ -1950,6 +2659,87 @@ bool static ProcessMessage(CNode* pfrom, std::string strCommand, CDataStream& vR
 }
 
 
+/** Maximum number of tier-two signatures recovered in a single parallel batch */
+static const unsigned int MAX_TIERTWO_SIGCHECK_BATCH = 512;
+
+// Appends to vChecks the signatures carried by a tier-two message that are not cached yet.
+// Returns false if the message is not a (well formed) tier-two signed message.
+static bool GetTierTwoSignatureChecks(const std::string& strCommand, CDataStream& vRecv, std::vector<CSignatureRecoveryCheck>& vChecks)
+{
+    auto addCheck = [&vChecks](const CSignedMessage& msg) {
+        const uint256& hash = msg.GetSignedHash();
+        const std::vector<unsigned char>& vchSig = msg.GetVchSig();
+        if (!vchSig.empty() && !IsMessageSignatureCached(hash, vchSig)) {
+            vChecks.emplace_back(hash, vchSig);
+        }
+    };
+
+    try {
+        if (strCommand == NetMsgType::BUDGETVOTE) {
+            CBudgetVote vote;
+            vRecv >> vote;
+            addCheck(vote);
+        } else if (strCommand == NetMsgType::FINALBUDGETVOTE) {
+            CFinalizedBudgetVote vote;
+            vRecv >> vote;
+            addCheck(vote);
+        } else if (strCommand == NetMsgType::MNWINNER) {
+            CMasternodePaymentWinner winner;
+            vRecv >> winner;
+            addCheck(winner);
+        } else if (strCommand == NetMsgType::MNPING) {
+            CMasternodePing mnp;
+            vRecv >> mnp;
+            addCheck(mnp);
+        } else if (strCommand == NetMsgType::MNBROADCAST) {
+            CMasternodeBroadcast mnb;
+            vRecv >> mnb;
+            addCheck(mnb);
+            addCheck(mnb.lastPing);
+        } else {
+            return false;
+        }
+    } catch (const std::exception& e) {
+        // malformed messages are rejected later by their handler
+        return false;
+    }
+    return true;
+}
+
+// Tier-two messages arrive in bursts of thousands during sync. When the signature of
+// the message being processed is not known yet, recover in parallel the signers of
+// the tier-two messages queued behind it, so that their (sequential) handlers only
+// need a signature cache lookup.
+static void PreVerifyTierTwoSignatures(CNode* pfrom, const std::string& strCommand, const CDataStream& vRecv)
+{
+    std::vector<CSignatureRecoveryCheck> vChecks;
+    CDataStream ss(vRecv);
+    if (!GetTierTwoSignatureChecks(strCommand, ss, vChecks) || vChecks.empty()) {
+        return;
+    }
+
+    // Copy the queued messages out, to not hold cs_vProcessMsg while parsing them
+    std::vector<std::pair<std::string, CDataStream>> vQueued;
+    {
+        LOCK(pfrom->cs_vProcessMsg);
+        const int nVersion = pfrom->GetRecvVersion();
+        for (const CNetMessage& msg : pfrom->vProcessMsg) {
+            if (vQueued.size() >= MAX_TIERTWO_SIGCHECK_BATCH) break;
+            vQueued.emplace_back(msg.hdr.GetCommand(), msg.vRecv);
+            vQueued.back().second.SetVersion(nVersion);
+        }
+    }
+    for (auto& p : vQueued) {
+        if (vChecks.size() >= MAX_TIERTWO_SIGCHECK_BATCH) break;
+        GetTierTwoSignatureChecks(p.first, p.second, vChecks);
+    }
+
+    if (vChecks.size() > 1) {
+        LogPrint(BCLog::NET, "%s: recovering %d tier-two signatures, peer=%d\n", __func__, vChecks.size(), pfrom->GetId());
+    }
+    BatchRecoverSignatures(vChecks);
+}
+
 bool PeerLogicValidation::ProcessMessages(CNode* pfrom, std::atomic<bool>& interruptMsgProc)
 {
     // Message format
@@ -1975,6 +2765,7 @@ bool PeerLogicValidation::ProcessMessages(CNode* pfrom, std::atomic<bool>& inter
         return false;
 
     std::list<CNetMessage> msgs;
+    bool fPauseRecvChanged;
     {
         LOCK(pfrom->cs_vProcessMsg);
         if (pfrom->vProcessMsg.empty())
@@ -1982,9 +2773,12 @@ bool PeerLogicValidation::ProcessMessages(CNode* pfrom, std::atomic<bool>& inter
         // Just take one message
         msgs.splice(msgs.begin(), pfrom->vProcessMsg, pfrom->vProcessMsg.begin());
         pfrom->nProcessQueueSize -= msgs.front().vRecv.size() + CMessageHeader::HEADER_SIZE;
-        pfrom->fPauseRecv = pfrom->nProcessQueueSize > connman->GetReceiveFloodSize();
+        const bool fPauseRecv = pfrom->nProcessQueueSize > connman->GetReceiveFloodSize();
+        fPauseRecvChanged = pfrom->fPauseRecv.exchange(fPauseRecv) != fPauseRecv;
         fMoreWork = !pfrom->vProcessMsg.empty();
     }
+    if (fPauseRecvChanged)
+        connman->UpdateNodeSocketEvents(pfrom);
     CNetMessage& msg(msgs.front());
 
     msg.SetVersion(pfrom->GetRecvVersion());
@@ -2018,6 +2812,10 @@ bool PeerLogicValidation::ProcessMessages(CNode* pfrom, std::atomic<bool>& inter
         return fMoreWork;
     }
 
+    if (nScriptCheckThreads > 0) {
+        PreVerifyTierTwoSignatures(pfrom, strCommand, vRecv);
+    }
+
     // Process message
     bool fRet = false;
     try {
@@ -2066,6 +2864,21 @@ public:
     }
 };
 
+/** Drops the transactions that would be announced last from the queue of a peer (and from vInvTx, its candidates
+ *  still to send), down to INVENTORY_MAX_QUEUED_TX. Returns the number of transactions dropped. */
+size_t LimitInvTxToSend(std::set<uint256>& setInventoryTxToSend, std::vector<std::set<uint256>::iterator>& vInvTx, CTxMemPool* pool)
+{
+    if (vInvTx.size() <= INVENTORY_MAX_QUEUED_TX)
+        return 0;
+    const size_t nExcess = vInvTx.size() - INVENTORY_MAX_QUEUED_TX;
+    std::nth_element(vInvTx.begin(), vInvTx.begin() + nExcess, vInvTx.end(), CompareInvMempoolOrder(pool));
+    for (size_t i = 0; i < nExcess; i++) {
+        setInventoryTxToSend.erase(vInvTx[i]);
+    }
+    vInvTx.erase(vInvTx.begin(), vInvTx.begin() + nExcess);
+    return nExcess;
+}
+
 bool PeerLogicValidation::SendMessages(CNode* pto, std::atomic<bool>& interruptMsgProc)
 {
     {
@@ -2166,16 +2979,31 @@ bool PeerLogicValidation::SendMessages(CNode* pto, std::atomic<bool>& interruptM
         bool fFetch = state.fPreferredDownload || (nPreferredDownload == 0 && !pto->fClient && !pto->fOneShot); // Download if this is a nice peer, or we have no nice peers and this one might do.
         if (!state.fSyncStarted && !pto->fClient && !fImporting && !fReindex) {
             // Only actively request headers from a single peer, unless we're close to end of initial download.
-            if ((nSyncStarted == 0 && fFetch) || pindexBestHeader->GetBlockTime() > GetAdjustedTime() - 6 * 60 * 60) { // NOTE: was "close to today" and 24h in Bitcoin
+            // The peers older than HEADERS_FIRST_VERSION are synced with getblocks, when no other sync is running.
+            const bool fHeadersSync = pto->nVersion >= HEADERS_FIRST_VERSION;
+            const bool fFirstSync = fHeadersSync ? nHeadersSyncStarted == 0 : nSyncStarted == 0;
+            if ((fFirstSync && fFetch) || pindexBestHeader->GetBlockTime() > GetAdjustedTime() - 6 * 60 * 60) { // NOTE: was "close to today" and 24h in Bitcoin
                 state.fSyncStarted = true;
+                state.fHeadersSync = fHeadersSync;
                 nSyncStarted++;
-                //CBlockIndex *pindexStart = pindexBestHeader->pprev ? pindexBestHeader->pprev : pindexBestHeader;
-                //LogPrint(BCLog::NET, "initial getheaders (%d) to peer=%d (startheight:%d)\n", pindexStart->nHeight, pto->id, pto->nStartingHeight);
-                //pto->PushMessage(NetMsgType::GETHEADERS, chainActive.GetLocator(pindexStart), UINT256_ZERO);
-                connman->PushMessage(pto, msgMaker.Make(NetMsgType::GETBLOCKS, chainActive.GetLocator(chainActive.Tip()), UINT256_ZERO));
+                if (fHeadersSync) {
+                    nHeadersSyncStarted++;
+                    const CBlockIndex* pindexStart = pindexBestHeader->pprev ? pindexBestHeader->pprev : pindexBestHeader;
+                    LogPrint(BCLog::NET, "initial getheaders (%d) to peer=%d (startheight:%d)\n", pindexStart->nHeight, pto->id, pto->nStartingHeight);
+                    connman->PushMessage(pto, msgMaker.Make(NetMsgType::GETHEADERS, chainActive.GetLocator(pindexStart), UINT256_ZERO));
+                } else {
+                    connman->PushMessage(pto, msgMaker.Make(NetMsgType::GETBLOCKS, chainActive.GetLocator(chainActive.Tip()), UINT256_ZERO));
+                }
             }
         }
 
+        // Resume the headers sync paused ahead of our tip, once the blocks caught up
+        if (state.pindexHeadersPaused && state.pindexHeadersPaused->nHeight < chainActive.Height() + MAX_HEADERS_AHEAD_OF_TIP / 2) {
+            LogPrint(BCLog::NET, "resume getheaders (%d) to peer=%d\n", state.pindexHeadersPaused->nHeight, pto->id);
+            connman->PushMessage(pto, msgMaker.Make(NetMsgType::GETHEADERS, chainActive.GetLocator(state.pindexHeadersPaused), UINT256_ZERO));
+            state.pindexHeadersPaused = nullptr;
+        }
+
         // Resend wallet transactions that haven't gotten in a block yet
         // Except during reindex, importing and IBD, when old wallet
         // transactions become unconfirmed and spams other nodes.
@@ -2226,18 +3054,26 @@ bool PeerLogicValidation::SendMessages(CNode* pto, std::atomic<bool>& interruptM
                 if (!pto->fRelayTxes) pto->setInventoryTxToSend.clear();
             }
 
+            // Minimum fee rate of the transactions the peer wants to hear about (BIP133)
+            CAmount filterrate = 0;
+            {
+                LOCK(pto->cs_feeFilter);
+                filterrate = pto->minFeeFilter;
+            }
+
             // Respond to BIP35 mempool requests
             if (fSendTrickle && pto->fSendMempool) {
                 auto vtxinfo = mempool.infoAll();
                 pto->fSendMempool = false;
-                // future: back port fee filter rate
                 LOCK(pto->cs_filter);
 
                 for (const auto& txinfo : vtxinfo) {
                     const uint256& hash = txinfo.tx->GetHash();
                     CInv inv(MSG_TX, hash);
                     pto->setInventoryTxToSend.erase(hash);
-                    // future: add fee filter check here..
+                    if (filterrate && txinfo.feeRate.GetFeePerK() < filterrate) {
+                        continue;
+                    }
                     if (pto->pfilter) {
                         if (!pto->pfilter->IsRelevantAndUpdate(*txinfo.tx)) continue;
                     }
@@ -2284,7 +3120,9 @@ bool PeerLogicValidation::SendMessages(CNode* pto, std::atomic<bool>& interruptM
                     if (!txinfo.tx) {
                         continue;
                     }
-                    // todo: back port feerate filter.
+                    if (filterrate && txinfo.feeRate.GetFeePerK() < filterrate) {
+                        continue;
+                    }
                     if (pto->pfilter && !pto->pfilter->IsRelevantAndUpdate(*txinfo.tx)) continue;
                     // Send
                     vInv.emplace_back(CInv(MSG_TX, hash));
@@ -2295,6 +3133,11 @@ bool PeerLogicValidation::SendMessages(CNode* pto, std::atomic<bool>& interruptM
                     }
                     pto->filterInventoryKnown.insert(hash);
                 }
+                // Bound the queue during mempool floods
+                const size_t nDropped = LimitInvTxToSend(pto->setInventoryTxToSend, vInvTx, &mempool);
+                if (nDropped > 0) {
+                    LogPrint(BCLog::NET, "dropped %u queued tx invs, peer=%d\n", nDropped, pto->id);
+                }
             }
         }
         if (!vInv.empty())
@@ -2363,6 +3206,31 @@ bool PeerLogicValidation::SendMessages(CNode* pto, std::atomic<bool>& interruptM
         }
         if (!vGetData.empty())
             connman->PushMessage(pto, msgMaker.Make(NetMsgType::GETDATA, vGetData));
+
+        //
+        // Message: feefilter
+        //
+        if (pto->nVersion >= FEEFILTER_VERSION && gArgs.GetBoolArg("-feefilter", DEFAULT_FEEFILTER)) {
+            // The transactions paying less than minRelayTxFee are never accepted from the peers
+            CAmount currentFilter = std::max(mempool.GetMinFee(gArgs.GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000),
+                                             ::minRelayTxFee).GetFeePerK();
+            int64_t timeNow = GetTimeMicros();
+            if (timeNow > pto->nextSendTimeFeeFilter) {
+                static FeeFilterRounder filterRounder(::minRelayTxFee);
+                CAmount filterToSend = std::max(filterRounder.round(currentFilter), ::minRelayTxFee.GetFeePerK());
+                if (filterToSend != pto->lastSentFeeFilter) {
+                    connman->PushMessage(pto, msgMaker.Make(NetMsgType::FEEFILTER, filterToSend));
+                    pto->lastSentFeeFilter = filterToSend;
+                }
+                pto->nextSendTimeFeeFilter = PoissonNextSend(timeNow, AVG_FEEFILTER_BROADCAST_INTERVAL);
+            }
+            // If the fee filter has changed substantially and it's still more than MAX_FEEFILTER_CHANGE_DELAY
+            // until scheduled broadcast, then move the broadcast to within MAX_FEEFILTER_CHANGE_DELAY.
+            else if (timeNow + MAX_FEEFILTER_CHANGE_DELAY * 1000000 < pto->nextSendTimeFeeFilter &&
+                     (currentFilter < 3 * pto->lastSentFeeFilter / 4 || currentFilter > 4 * pto->lastSentFeeFilter / 3)) {
+                pto->nextSendTimeFeeFilter = timeNow + GetRandInt(MAX_FEEFILTER_CHANGE_DELAY) * 1000000;
+            }
+        }
     }
     return true;
 }
@@ -25,12 +25,46 @@ static const unsigned int DEFAULT_BLOCK_SPAM_FILTER_MAX_SIZE = 100;
 /** Default for -blockspamfiltermaxavg, maximum average size of an index occurrence in the block spam filter */
 static const unsigned int DEFAULT_BLOCK_SPAM_FILTER_MAX_AVG = 10;
 
+/** Maximum depth of the blocks sent as compact blocks (BIP152), the full block is sent for the older ones */
+static const int MAX_CMPCTBLOCK_DEPTH = 5;
+/** Maximum depth of the blocks whose transactions are sent with a blocktxn, the full block is sent for the older ones */
+static const int MAX_BLOCKTXN_DEPTH = 10;
+/** Maximum number of peers asked to announce new blocks with a cmpctblock (high-bandwidth mode) */
+static const unsigned int MAX_CMPCTBLOCK_HB_PEERS = 3;
+/** Maximum total size of the blocks received ahead of their parent (headers-first download window),
+ *  kept in memory until the parent is connected. The blocks that don't fit are requested again later. */
+static const size_t MAX_BLOCKS_WAITING_PARENT_SIZE = 64 * 1024 * 1024;
+/** Number of headers messages not connecting to our block index accepted before the peer is penalized */
+static const int MAX_UNCONNECTING_HEADERS = 10;
+/** Maximum number of PoS headers above our tip stored from a peer before their blocks (headers-first sync):
+ *  one chain up to MAX_HEADERS_AHEAD_OF_TIP, and one headers message of a competing chain. */
+static const size_t MAX_UNVERIFIED_HEADERS_PER_PEER = 6000;
+/** Maximum total number of PoS headers stored before their blocks, from all the peers (including the
+ *  disconnected ones, until their headers are pruned) */
+static const size_t MAX_UNVERIFIED_HEADERS = 4 * MAX_UNVERIFIED_HEADERS_PER_PEER;
+/** Maximum total size of the serialized blocks kept to serve them again to other peers */
+static const size_t MAX_RAW_BLOCKS_CACHE_SIZE = 8 * 1024 * 1024;
+
 /** Average delay between trickled inventory transmissions in seconds.
  *  Blocks and whitelisted receivers bypass this, outbound peers get half this delay. */
 static const unsigned int INVENTORY_BROADCAST_INTERVAL = 5;
 /** Maximum number of inventory items to send per transmission.
  *  Limits the impact of low-fee transaction floods. */
 static const unsigned int INVENTORY_BROADCAST_MAX = 7 * INVENTORY_BROADCAST_INTERVAL;
+/** Maximum number of transactions queued for announcement to a peer.
+ *  When exceeded, the ones with the lowest fee rate are dropped from the queue. */
+static const unsigned int INVENTORY_MAX_QUEUED_TX = 100 * INVENTORY_BROADCAST_MAX;
+/** Average number of new transactions per second accepted from the invs of a peer (whitelisted peers bypass this).
+ *  The rate of a peer trickling to us as an outbound connection: INVENTORY_BROADCAST_MAX every half interval. */
+static const double MAX_PEER_TX_INV_RATE = 2.0 * INVENTORY_BROADCAST_MAX / INVENTORY_BROADCAST_INTERVAL;
+/** Maximum burst of new transactions accepted from the invs of a peer */
+static const unsigned int MAX_PEER_TX_INV_BURST = 10 * INVENTORY_BROADCAST_MAX;
+/** Average delay between feefilter broadcasts in seconds. */
+static const unsigned int AVG_FEEFILTER_BROADCAST_INTERVAL = 10 * 60;
+/** Maximum feefilter broadcast delay after significant change. */
+static const unsigned int MAX_FEEFILTER_CHANGE_DELAY = 5 * 60;
+/** Default for -feefilter, send the minimum fee of our mempool to the peers (BIP133) */
+static const bool DEFAULT_FEEFILTER = true;
 
 class PeerLogicValidation : public CValidationInterface, public NetEventsInterface {
 private:
@@ -70,5 +104,12 @@ struct CNodeStateStats {
 bool GetNodeStateStats(NodeId nodeid, CNodeStateStats& stats);
 /** Increase a node's misbehavior score. */
 void Misbehaving(NodeId nodeid, int howmuch) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
+/** Keeps a block of the download window whose parent header is known, but not the parent block,
+ *  until the parent is connected (the proof of stake is checked against it). The block must have been
+ *  requested from the peer after its header: otherwise it is dropped, and the peer penalized.
+ *  Returns false if the block can be processed now. */
+bool StoreBlockWaitingParent(const std::shared_ptr<const CBlock>& pblock, NodeId nodeid, bool fRequested) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
+/** Processes the blocks waiting for the given (just received) block, and recursively their own children. */
+void ProcessBlocksWaitingParent(const uint256& hashParent);
 
 #endif // BITCOIN_NET_PROCESSING_H
@@ -7,9 +7,11 @@
 
 #include "amount.h"
 #include "feerate.h"
+#include "random.h"
 #include "uint256.h"
 
 #include <map>
+#include <set>
 #include <string>
 #include <vector>
 
@@ -261,4 +263,20 @@ private:
     /** Classes to track historical data on transaction confirmations */
     TxConfirmStats feeStats;
 };
+
+/** Rounds the fee rate sent in the feefilter messages to the boundaries of the fee buckets,
+ *  so that the exact minimum fee of our mempool isn't disclosed to the peers. */
+class FeeFilterRounder
+{
+public:
+    /** Create new FeeFilterRounder */
+    explicit FeeFilterRounder(const CFeeRate& minIncrementalFee);
+
+    /** Quantize a minimum fee for privacy purpose before broadcast **/
+    CAmount round(CAmount currentMinFee);
+
+private:
+    std::set<double> feeset;
+    FastRandomContext insecure_rand;
+};
 #endif /*BITCOIN_POLICYESTIMATOR_H */
@@ -10,12 +10,15 @@
 #include "clientversion.h"
 #include "core_io.h"
 #include "consensus/upgrades.h"
+#include "index/blockfilterindex.h"
+#include "index/txindex.h"
 #include "kernel.h"
 #include "key_io.h"
 #include "masternodeman.h"
 #include "policy/feerate.h"
 #include "policy/policy.h"
 #include "rpc/server.h"
+#include "sapling/sapling_validation.h"
 #include "sync.h"
 #include "txdb.h"
 #include "util/system.h"
@@ -643,6 +646,170 @@ UniValue getblockheader(const JSONRPCRequest& request)
     return blockheaderToJSON(pblockindex);
 }
 
+UniValue getblockfilter(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() < 1 || request.params.size() > 2)
+        throw std::runtime_error(
+            "getblockfilter \"blockhash\" ( \"filtertype\" )\n"
+            "\nRetrieve a BIP 157 content filter for a particular block.\n"
+
+            "\nArguments:\n"
+            "1. \"blockhash\"     (string, required) The hash of the block\n"
+            "2. \"filtertype\"    (string, optional, default=basic) The type name of the filter\n"
+
+            "\nResult:\n"
+            "{\n"
+            "  \"filter\" : (string) the hex-encoded filter data\n"
+            "  \"header\" : (string) the hex-encoded filter header\n"
+            "}\n"
+
+            "\nExamples:\n" +
+            HelpExampleCli("getblockfilter", "\"00000000c937983704a73af28acdec37b049d214adbda81d7e2a3dd146f6ed09\" \"basic\"") +
+            HelpExampleRpc("getblockfilter", "\"00000000c937983704a73af28acdec37b049d214adbda81d7e2a3dd146f6ed09\", \"basic\""));
+
+    uint256 block_hash = ParseHashV(request.params[0], "blockhash");
+    std::string filtertype_name = "basic";
+    if (request.params.size() > 1) {
+        filtertype_name = request.params[1].get_str();
+    }
+
+    BlockFilterType filtertype;
+    if (!BlockFilterTypeByName(filtertype_name, filtertype)) {
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Unknown filtertype");
+    }
+
+    BlockFilterIndex* index = GetBlockFilterIndex(filtertype);
+    if (!index) {
+        throw JSONRPCError(RPC_MISC_ERROR, "Index is not enabled for filtertype " + filtertype_name);
+    }
+
+    const CBlockIndex* block_index;
+    bool block_was_connected;
+    {
+        LOCK(cs_main);
+        BlockMap::const_iterator it = mapBlockIndex.find(block_hash);
+        if (it == mapBlockIndex.end()) {
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
+        }
+        block_index = it->second;
+        block_was_connected = block_index->IsValid(BLOCK_VALID_SCRIPTS);
+    }
+
+    bool index_ready = index->BlockUntilSyncedToCurrentChain();
+
+    BlockFilter filter;
+    uint256 filter_header;
+    if (!index->LookupFilter(block_index, filter) ||
+        !index->LookupFilterHeader(block_index, filter_header)) {
+        int err_code;
+        std::string errmsg = "Filter not found.";
+
+        if (!block_was_connected) {
+            err_code = RPC_INVALID_ADDRESS_OR_KEY;
+            errmsg += " Block was not connected to active chain.";
+        } else if (!index_ready) {
+            err_code = RPC_MISC_ERROR;
+            errmsg += " Block filters are still in the process of being indexed.";
+        } else {
+            err_code = RPC_INTERNAL_ERROR;
+            errmsg += " This error is unexpected and indicates index corruption.";
+        }
+
+        throw JSONRPCError(err_code, errmsg);
+    }
+
+    UniValue ret(UniValue::VOBJ);
+    ret.pushKV("filter", HexStr(filter.GetEncodedFilter()));
+    ret.pushKV("header", filter_header.GetHex());
+    return ret;
+}
+
+static UniValue SummaryToJSON(const IndexSummary& summary, int tip_height, const std::string& index_name)
+{
+    UniValue ret_summary(UniValue::VOBJ);
+    if (!index_name.empty() && index_name != summary.name) return ret_summary;
+
+    UniValue entry(UniValue::VOBJ);
+    entry.pushKV("synced", summary.synced);
+    entry.pushKV("best_block_height", summary.best_block_height);
+    entry.pushKV("progress", tip_height > 0 ? std::min(1.0, (double)summary.best_block_height / tip_height) : 1.0);
+
+    ret_summary.pushKV(summary.name, entry);
+    return ret_summary;
+}
+
+UniValue getindexinfo(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() > 1)
+        throw std::runtime_error(
+            "getindexinfo ( \"index_name\" )\n"
+            "\nReturns the status of one or all available indices currently running in the node.\n"
+
+            "\nArguments:\n"
+            "1. \"index_name\"    (string, optional) Filter results for an index with a specific name.\n"
+
+            "\nResult:\n"
+            "{\n"
+            "  \"name\" : {                 (json object) The name of the index\n"
+            "    \"synced\" : true|false,   (boolean) Whether the index is synced or not\n"
+            "    \"best_block_height\" : n, (numeric) The block height to which the index is synced\n"
+            "    \"progress\" : x.xxx       (numeric) Fraction of the active chain covered by the index\n"
+            "  },\n"
+            "  ...\n"
+            "}\n"
+
+            "\nExamples:\n" +
+            HelpExampleCli("getindexinfo", "") +
+            HelpExampleRpc("getindexinfo", "") +
+            HelpExampleCli("getindexinfo", "\"txindex\"") +
+            HelpExampleRpc("getindexinfo", "\"txindex\""));
+
+    const std::string index_name = request.params[0].isNull() ? "" : request.params[0].get_str();
+    const int tip_height = WITH_LOCK(cs_main, return chainActive.Height(); );
+
+    UniValue result(UniValue::VOBJ);
+    const std::shared_ptr<TxIndex> txindex = GetTxIndex();
+    if (txindex) {
+        result.pushKVs(SummaryToJSON(txindex->GetSummary(), tip_height, index_name));
+    }
+
+    ForEachBlockFilterIndex([&result, tip_height, &index_name](const BlockFilterIndex& index) {
+        result.pushKVs(SummaryToJSON(index.GetSummary(), tip_height, index_name));
+    });
+
+    return result;
+}
+
+UniValue settxindex(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() != 1)
+        throw std::runtime_error(
+            "settxindex enable\n"
+            "\nEnable or disable the transaction index without restarting the node.\n"
+            "An enabled index catches up with the chain in the background, resuming from the\n"
+            "block it was synced to when it was last disabled. Use getindexinfo to follow its progress.\n"
+
+            "\nArguments:\n"
+            "1. enable    (boolean, required) true to start the index, false to stop it\n"
+
+            "\nResult:\n"
+            "true|false   (boolean) Whether the index state was changed\n"
+
+            "\nExamples:\n" +
+            HelpExampleCli("settxindex", "true") +
+            HelpExampleRpc("settxindex", "false"));
+
+    const bool fEnable = request.params[0].get_bool();
+    if (fEnable) {
+        return StartTxIndex(nDefaultTxIndexCache << 20);
+    }
+
+    if (fMasterNode) {
+        throw JSONRPCError(RPC_MISC_ERROR, "The transaction index is required by masternodes");
+    }
+    return StopTxIndex();
+}
+
 UniValue getsupplyinfo(const JSONRPCRequest& request)
 {
     if (request.fHelp || request.params.size() > 1)
@@ -1155,6 +1322,12 @@ UniValue mempoolInfoToJSON()
     size_t maxmempool = gArgs.GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000;
     ret.pushKV("mempoolminfee", ValueFromAmount(std::max(mempool.GetMinFee(maxmempool), ::minRelayTxFee).GetFeePerK()));
     ret.pushKV("minrelaytxfee", ValueFromAmount(::minRelayTxFee.GetFeePerK()));
+    uint64_t nProofCacheHits, nProofCacheMisses;
+    GetSaplingProofCacheStats(nProofCacheHits, nProofCacheMisses);
+    UniValue proofCache(UniValue::VOBJ);
+    proofCache.pushKV("hits", nProofCacheHits);
+    proofCache.pushKV("misses", nProofCacheMisses);
+    ret.pushKV("shieldedproofcache", proofCache);
 
     return ret;
 }
@@ -1175,6 +1348,10 @@ UniValue getmempoolinfo(const JSONRPCRequest& request)
             "  \"maxmempool\": xxxxx,         (numeric) Maximum memory usage for the mempool\n"
             "  \"mempoolminfee\": xxxxx       (numeric) Minimum fee rate in " + CURRENCY_UNIT + "/kB for tx to be accepted. Is the maximum of minrelaytxfee and minimum mempool fee\n"
             "  \"minrelaytxfee\": xxxxx       (numeric) Current minimum relay fee for transactions\n"
+            "  \"shieldedproofcache\": {      (json object) Shielded proofs verification cache\n"
+            "     \"hits\": xxxxx             (numeric) Number of shielded txs whose proofs were found already verified\n"
+            "     \"misses\": xxxxx           (numeric) Number of shielded txs whose proofs had to be verified\n"
+            "  }\n"
             "}\n"
 
             "\nExamples:\n" +
@@ -1446,17 +1623,20 @@ static const CRPCCommand commands[] =
     { "blockchain",         "getblock",               &getblock,               true,  {"blockhash","verbose"} },
     { "blockchain",         "getblockchaininfo",      &getblockchaininfo,      true,  {} },
     { "blockchain",         "getblockcount",          &getblockcount,          true,  {} },
+    { "blockchain",         "getblockfilter",         &getblockfilter,         true,  {"blockhash","filtertype"} },
     { "blockchain",         "getblockhash",           &getblockhash,           true,  {"height"} },
     { "blockchain",         "getblockheader",         &getblockheader,         false, {"blockhash","verbose"} },
     { "blockchain",         "getblockindexstats",     &getblockindexstats,     true,  {"height","range"} },
     { "blockchain",         "getchaintips",           &getchaintips,           true,  {} },
     { "blockchain",         "getdifficulty",          &getdifficulty,          true,  {} },
     { "blockchain",         "getfeeinfo",             &getfeeinfo,             true,  {"blocks"} },
+    { "blockchain",         "getindexinfo",           &getindexinfo,           true,  {"index_name"} },
     { "blockchain",         "getmempoolinfo",         &getmempoolinfo,         true,  {} },
     { "blockchain",         "getrawmempool",          &getrawmempool,          true,  {"verbose"} },
     { "blockchain",         "getsupplyinfo",          &getsupplyinfo,          true,  {"force_update"} },
     { "blockchain",         "gettxout",               &gettxout,               true,  {"txid","n","include_mempool"} },
     { "blockchain",         "gettxoutsetinfo",        &gettxoutsetinfo,        true,  {} },
+    { "blockchain",         "settxindex",             &settxindex,             true,  {"enable"} },
     { "blockchain",         "verifychain",            &verifychain,            true,  {"nblocks"} },
 
     /* Not shown in help */
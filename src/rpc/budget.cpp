@@ -23,7 +23,7 @@
 
 #include <univalue.h>
 
-void budgetToJSON(const CBudgetProposal* pbudgetProposal, UniValue& bObj, int nCurrentHeight)
+void budgetToJSON(const CBudgetProposal* pbudgetProposal, UniValue& bObj, int nCurrentHeight, CAmount nAllotted)
 {
     CTxDestination address1;
     ExtractDestination(pbudgetProposal->GetPayee(), address1);
@@ -48,7 +48,7 @@ void budgetToJSON(const CBudgetProposal* pbudgetProposal, UniValue& bObj, int nC
     bObj.pushKV("IsValid", fValid);
     if (!fValid)
         bObj.pushKV("IsInvalidReason", pbudgetProposal->IsInvalidReason());
-    bObj.pushKV("Allotted", ValueFromAmount(pbudgetProposal->GetAllotted()));
+    bObj.pushKV("Allotted", ValueFromAmount(nAllotted));
 }
 
 void checkBudgetInputs(const UniValue& params, std::string &strProposalName, std::string &strURL,
@@ -215,6 +215,7 @@ UniValue submitbudget(const JSONRPCRequest& request)
         throw std::runtime_error(strError);
     }
     proposal.Relay();
+    g_budgetman.PublishSnapshot();
 
     return proposal.GetHash().ToString();
 }
@@ -552,8 +553,8 @@ UniValue getbudgetvotes(const JSONRPCRequest& request)
             HelpExampleCli("getbudgetvotes", "\"test-proposal\"") + HelpExampleRpc("getbudgetvotes", "\"test-proposal\""));
 
     std::string strProposalName = SanitizeString(request.params[0].get_str());
-    const CBudgetProposal* pbudgetProposal = g_budgetman.FindProposalByName(strProposalName);
-    if (pbudgetProposal == NULL) throw std::runtime_error("Unknown proposal name");
+    const auto& pbudgetProposal = g_budgetman.GetSnapshot()->FindProposalByName(strProposalName);
+    if (pbudgetProposal == nullptr) throw std::runtime_error("Unknown proposal name");
     return pbudgetProposal->GetVotesArray();
 }
 
@@ -621,11 +622,11 @@ UniValue getbudgetprojection(const JSONRPCRequest& request)
     UniValue resultObj(UniValue::VOBJ);
     CAmount nTotalAllotted = 0;
 
-    std::vector<CBudgetProposal> winningProps = g_budgetman.GetBudget();
-    for (const CBudgetProposal& p : winningProps) {
+    const auto& snapshot = g_budgetman.GetSnapshot();
+    for (const auto& p : snapshot->vProjection) {
         UniValue bObj(UniValue::VOBJ);
-        budgetToJSON(&p, bObj, g_budgetman.GetBestHeight());
-        nTotalAllotted += p.GetAllotted();
+        budgetToJSON(p.first.get(), bObj, snapshot->nHeight, p.second);
+        nTotalAllotted += p.second;
         bObj.pushKV("TotalBudgetAllotted", ValueFromAmount(nTotalAllotted));
         ret.push_back(bObj);
     }
@@ -672,24 +673,24 @@ UniValue getbudgetinfo(const JSONRPCRequest& request)
             HelpExampleCli("getbudgetprojection", "") + HelpExampleRpc("getbudgetprojection", ""));
 
     UniValue ret(UniValue::VARR);
-    int nCurrentHeight = g_budgetman.GetBestHeight();
+    const auto& snapshot = g_budgetman.GetSnapshot();
+    int nCurrentHeight = snapshot->nHeight;
 
     if (request.params.size() == 1) {
         std::string strProposalName = SanitizeString(request.params[0].get_str());
-        const CBudgetProposal* pbudgetProposal = g_budgetman.FindProposalByName(strProposalName);
-        if (pbudgetProposal == NULL) throw std::runtime_error("Unknown proposal name");
+        const auto& pbudgetProposal = snapshot->FindProposalByName(strProposalName);
+        if (pbudgetProposal == nullptr) throw std::runtime_error("Unknown proposal name");
         UniValue bObj(UniValue::VOBJ);
-        budgetToJSON(pbudgetProposal, bObj, nCurrentHeight);
+        budgetToJSON(pbudgetProposal.get(), bObj, nCurrentHeight, snapshot->GetAllotted(pbudgetProposal->GetHash()));
         ret.push_back(bObj);
         return ret;
     }
 
-    std::vector<CBudgetProposal*> winningProps = g_budgetman.GetAllProposals();
-    for (CBudgetProposal* pbudgetProposal : winningProps) {
+    for (const auto& pbudgetProposal : snapshot->vProposals) {
         if (!pbudgetProposal->IsValid()) continue;
 
         UniValue bObj(UniValue::VOBJ);
-        budgetToJSON(pbudgetProposal, bObj, nCurrentHeight);
+        budgetToJSON(pbudgetProposal.get(), bObj, nCurrentHeight, snapshot->GetAllotted(pbudgetProposal->GetHash()));
         ret.push_back(bObj);
     }
 
@@ -810,8 +811,8 @@ UniValue mnfinalbudget(const JSONRPCRequest& request)
     if (strCommand == "show") {
         UniValue resultObj(UniValue::VOBJ);
 
-        std::vector<CFinalizedBudget*> winningFbs = g_budgetman.GetFinalizedBudgets();
-        for (CFinalizedBudget* finalizedBudget : winningFbs) {
+        const auto& snapshot = g_budgetman.GetSnapshot();
+        for (const auto& finalizedBudget : snapshot->vFinalizedBudgets) {
             const uint256& nHash = finalizedBudget->GetHash();
             UniValue bObj(UniValue::VOBJ);
             bObj.pushKV("FeeTX", finalizedBudget->GetFeeTXHash().ToString());
@@ -819,7 +820,7 @@ UniValue mnfinalbudget(const JSONRPCRequest& request)
             bObj.pushKV("BlockEnd", (int64_t)finalizedBudget->GetBlockEnd());
             bObj.pushKV("Proposals", finalizedBudget->GetProposalsStr());
             bObj.pushKV("VoteCount", (int64_t)finalizedBudget->GetVoteCount());
-            bObj.pushKV("Status", g_budgetman.GetFinalizedBudgetStatus(nHash));
+            bObj.pushKV("Status", snapshot->GetFinalizedBudgetStatus(*finalizedBudget));
 
             bool fValid = finalizedBudget->IsValid();
             bObj.pushKV("IsValid", fValid);
@@ -837,11 +838,10 @@ UniValue mnfinalbudget(const JSONRPCRequest& request)
         if (request.params.size() != 2)
             throw std::runtime_error("Correct usage is 'mnbudget getvotes budget-hash'");
 
-        LOCK(g_budgetman.cs_budgets);
         std::string strHash = request.params[1].get_str();
         uint256 hash(uint256S(strHash));
-        CFinalizedBudget* pfinalBudget = g_budgetman.FindFinalizedBudget(hash);
-        if (pfinalBudget == NULL) return "Unknown budget hash";
+        const auto& pfinalBudget = g_budgetman.GetSnapshot()->FindFinalizedBudget(hash);
+        if (pfinalBudget == nullptr) return "Unknown budget hash";
         return pfinalBudget->GetVotesObject();
     }
 
@@ -148,6 +148,7 @@ static const CRPCConvertParam vRPCConvertParams[] = {
     { "setmocktime", 0, "timestamp" },
     { "setstakesplitthreshold", 0, "value" },
     { "settxfee", 0, "amount" },
+    { "settxindex", 0, "enable" },
     { "shieldsendmany", 1, "amounts" },
     { "shieldsendmany", 2, "minconf" },
     { "shieldsendmany", 3, "fee" },
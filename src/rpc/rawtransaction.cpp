@@ -8,6 +8,7 @@
 #include "core_io.h"
 #include "evo/specialtx.h"
 #include "evo/providertx.h"
+#include "index/txindex.h"
 #include "init.h"
 #include "keystore.h"
 #include "key_io.h"
@@ -215,6 +216,12 @@ UniValue getrawtransaction(const JSONRPCRequest& request)
             + HelpExampleCli("getrawtransaction", "\"mytxid\" true \"myblockhash\"")
         );
 
+    const std::shared_ptr<TxIndex> txindex = GetTxIndex();
+    if (txindex && request.params[2].isNull()) {
+        // Wait for the index to catch up with the chain, as it is synced in the background
+        txindex->BlockUntilSyncedToCurrentChain();
+    }
+
     LOCK(cs_main);
 
     bool in_active_chain = true;
@@ -246,7 +253,7 @@ UniValue getrawtransaction(const JSONRPCRequest& request)
             }
             errmsg = "No such transaction found in the provided block";
         } else {
-            errmsg = fTxIndex
+            errmsg = txindex
               ? "No such mempool or blockchain transaction"
               : "No such mempool transaction. Use -txindex to enable blockchain transaction queries";
         }
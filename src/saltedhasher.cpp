@@ -3,6 +3,8 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include "saltedhasher.h"
+
+#include "pubkey.h"
 #include "random.h"
 
 #include <limits>
@@ -10,3 +12,8 @@
 SaltedHasherBase::SaltedHasherBase() : k0(GetRand(std::numeric_limits<uint64_t>::max())), k1(GetRand(std::numeric_limits<uint64_t>::max())) {}
 
 SaltedHasherBase StaticSaltedHasher::s;
+
+std::size_t SaltedHasherImpl<CKeyID>::CalcHash(const CKeyID& v, uint64_t k0, uint64_t k1)
+{
+    return CSipHasher(k0, k1).Write(v.begin(), v.size()).Finalize();
+}
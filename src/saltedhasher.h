@@ -8,6 +8,8 @@
 #include "hash.h"
 #include "uint256.h"
 
+class CKeyID;
+
 /** Helper classes for std::unordered_map and std::unordered_set hashing */
 
 template<typename T> struct SaltedHasherImpl;
@@ -39,6 +41,12 @@ struct SaltedHasherImpl<uint256>
     }
 };
 
+template<>
+struct SaltedHasherImpl<CKeyID>
+{
+    static std::size_t CalcHash(const CKeyID& v, uint64_t k0, uint64_t k1);
+};
+
 struct SaltedHasherBase
 {
     /** Salt */
@@ -10,9 +10,82 @@
 #include "consensus/validation.h" // for CValidationState
 #include "util/system.h" // for error()
 #include "consensus/upgrades.h" // for CurrentEpochBranchId()
+#include "cuckoocache.h"
+#include "random.h"
+#include "script/sigcache.h" // for SignatureCacheHasher
 
 #include <librustzcash.h>
 
+#include <atomic>
+
+#include <boost/thread/shared_mutex.hpp>
+
+namespace {
+/**
+ * Valid shielded proofs cache, to avoid verifying the Groth16 proofs and the
+ * binding signature twice for every shielded transaction (once when accepted
+ * into memory pool, and again when accepted into the block chain)
+ */
+class CSaplingProofCache
+{
+private:
+    //! Entries are SHA256(nonce || txid || sapling signature hash):
+    uint256 nonce;
+    typedef CuckooCache::cache<uint256, SignatureCacheHasher> map_type;
+    map_type setValid;
+    boost::shared_mutex cs_proofcache;
+
+public:
+    std::atomic<uint64_t> nHits{0};
+    std::atomic<uint64_t> nMisses{0};
+
+    CSaplingProofCache()
+    {
+        GetRandBytes(nonce.begin(), 32);
+    }
+
+    void ComputeEntry(uint256& entry, const uint256& txid, const uint256& dataToBeSigned)
+    {
+        CSHA256().Write(nonce.begin(), 32).Write(txid.begin(), 32).Write(dataToBeSigned.begin(), 32).Finalize(entry.begin());
+    }
+
+    bool Get(const uint256& entry)
+    {
+        boost::shared_lock<boost::shared_mutex> lock(cs_proofcache);
+        // Entries are not erased on block validation: TestBlockValidity would
+        // otherwise evict them before the block is connected.
+        return setValid.contains(entry, false);
+    }
+
+    void Set(uint256& entry)
+    {
+        boost::unique_lock<boost::shared_mutex> lock(cs_proofcache);
+        setValid.insert(entry);
+    }
+
+    uint32_t setup_bytes(size_t n)
+    {
+        return setValid.setup_bytes(n);
+    }
+};
+
+static CSaplingProofCache saplingProofCache;
+}
+
+void InitSaplingProofCache()
+{
+    size_t nMaxCacheSize = std::min(std::max((int64_t)0, gArgs.GetArg("-maxsaplingproofcachesize", DEFAULT_MAX_SAPLING_PROOF_CACHE_SIZE)), MAX_MAX_SAPLING_PROOF_CACHE_SIZE) * ((size_t) 1 << 20);
+    size_t nElems = saplingProofCache.setup_bytes(nMaxCacheSize);
+    LogPrintf("Using %zu MiB out of %zu requested for shielded proof cache, able to store %zu elements\n",
+            (nElems*sizeof(uint256)) >>20, nMaxCacheSize>>20, nElems);
+}
+
+void GetSaplingProofCacheStats(uint64_t& nHits, uint64_t& nMisses)
+{
+    nHits = saplingProofCache.nHits;
+    nMisses = saplingProofCache.nMisses;
+}
+
 namespace SaplingValidation {
 
 // Verifies that Shielded txs are properly formed and performs content-independent checks
@@ -97,6 +170,62 @@ bool CheckTransactionWithoutProofVerification(const CTransaction& tx, CValidatio
     return true;
 }
 
+// Verifies the spend/output proofs and the binding signature of a shielded transaction
+static bool CheckProofs(const CTransaction& tx, const uint256& dataToBeSigned, CValidationState& state, int dosLevelPotentiallyRelaxing)
+{
+    // Sapling verification process
+    auto ctx = librustzcash_sapling_verification_ctx_init();
+
+    for (const SpendDescription &spend : tx.sapData->vShieldedSpend) {
+        if (!librustzcash_sapling_check_spend(
+                ctx,
+                spend.cv.begin(),
+                spend.anchor.begin(),
+                spend.nullifier.begin(),
+                spend.rk.begin(),
+                spend.zkproof.begin(),
+                spend.spendAuthSig.begin(),
+                dataToBeSigned.begin())) {
+            librustzcash_sapling_verification_ctx_free(ctx);
+            return state.DoS(
+                    dosLevelPotentiallyRelaxing,
+                    error("%s: Sapling spend description invalid", __func__ ),
+                    REJECT_INVALID, "bad-txns-sapling-spend-description-invalid");
+        }
+    }
+
+    for (const OutputDescription &output : tx.sapData->vShieldedOutput) {
+        if (!librustzcash_sapling_check_output(
+                ctx,
+                output.cv.begin(),
+                output.cmu.begin(),
+                output.ephemeralKey.begin(),
+                output.zkproof.begin())) {
+            librustzcash_sapling_verification_ctx_free(ctx);
+            // This should be a non-contextual check, but we check it here
+            // as we need to pass over the outputs anyway in order to then
+            // call librustzcash_sapling_final_check().
+            return state.DoS(100, error("%s: Sapling output description invalid", __func__ ),
+                             REJECT_INVALID, "bad-txns-sapling-output-description-invalid");
+        }
+    }
+
+    if (!librustzcash_sapling_final_check(
+            ctx,
+            tx.sapData->valueBalance,
+            tx.sapData->bindingSig.begin(),
+            dataToBeSigned.begin())) {
+        librustzcash_sapling_verification_ctx_free(ctx);
+        return state.DoS(
+                dosLevelPotentiallyRelaxing,
+                error("%s: Sapling binding signature invalid", __func__ ),
+                REJECT_INVALID, "bad-txns-sapling-binding-signature-invalid");
+    }
+
+    librustzcash_sapling_verification_ctx_free(ctx);
+    return true;
+}
+
 /**
 * Check a transaction contextually against a set of consensus rules valid at a given block height.
 *
@@ -116,7 +245,8 @@ bool ContextualCheckTransaction(
         const CChainParams& chainparams,
         const int nHeight,
         const bool isMined,
-        bool isInitBlockDownload)
+        bool isInitBlockDownload,
+        std::vector<CSaplingProofCheck>* pvChecks)
 {
     const int DOS_LEVEL_BLOCK = 100;
     // DoS level set to 10 to be more forgiving.
@@ -171,59 +301,35 @@ bool ContextualCheckTransaction(
                              REJECT_INVALID, "error-computing-signature-hash");
         }
 
-        // Sapling verification process
-        auto ctx = librustzcash_sapling_verification_ctx_init();
-
-        for (const SpendDescription &spend : tx.sapData->vShieldedSpend) {
-            if (!librustzcash_sapling_check_spend(
-                    ctx,
-                    spend.cv.begin(),
-                    spend.anchor.begin(),
-                    spend.nullifier.begin(),
-                    spend.rk.begin(),
-                    spend.zkproof.begin(),
-                    spend.spendAuthSig.begin(),
-                    dataToBeSigned.begin())) {
-                librustzcash_sapling_verification_ctx_free(ctx);
-                return state.DoS(
-                        dosLevelPotentiallyRelaxing,
-                        error("%s: Sapling spend description invalid", __func__ ),
-                        REJECT_INVALID, "bad-txns-sapling-spend-description-invalid");
-            }
+        uint256 cacheEntry;
+        saplingProofCache.ComputeEntry(cacheEntry, tx.GetHash(), dataToBeSigned);
+        if (saplingProofCache.Get(cacheEntry)) {
+            // Proofs already verified (e.g. when the tx was accepted to the mempool)
+            saplingProofCache.nHits++;
+            return true;
         }
-
-        for (const OutputDescription &output : tx.sapData->vShieldedOutput) {
-            if (!librustzcash_sapling_check_output(
-                    ctx,
-                    output.cv.begin(),
-                    output.cmu.begin(),
-                    output.ephemeralKey.begin(),
-                    output.zkproof.begin())) {
-                librustzcash_sapling_verification_ctx_free(ctx);
-                // This should be a non-contextual check, but we check it here
-                // as we need to pass over the outputs anyway in order to then
-                // call librustzcash_sapling_final_check().
-                return state.DoS(100, error("%s: Sapling output description invalid", __func__ ),
-                                 REJECT_INVALID, "bad-txns-sapling-output-description-invalid");
+        saplingProofCache.nMisses++;
+
+        if (pvChecks) {
+            // Defer the proofs verification to the caller
+            pvChecks->emplace_back(tx, dataToBeSigned);
+        } else {
+            if (!CheckProofs(tx, dataToBeSigned, state, dosLevelPotentiallyRelaxing)) {
+                return false; // Failure reason has been set in validation state object
             }
+            // Cache the result of mempool acceptance, for the block validation
+            if (!isMined) saplingProofCache.Set(cacheEntry);
         }
-
-        if (!librustzcash_sapling_final_check(
-                ctx,
-                tx.sapData->valueBalance,
-                tx.sapData->bindingSig.begin(),
-                dataToBeSigned.begin())) {
-            librustzcash_sapling_verification_ctx_free(ctx);
-            return state.DoS(
-                    dosLevelPotentiallyRelaxing,
-                    error("%s: Sapling binding signature invalid", __func__ ),
-                    REJECT_INVALID, "bad-txns-sapling-binding-signature-invalid");
-        }
-
-        librustzcash_sapling_verification_ctx_free(ctx);
     }
     return true;
 }
 
-
 } // End SaplingValidation namespace
+
+bool CSaplingProofCheck::operator()()
+{
+    // The DoS score is irrelevant here: on failure the block is re-checked serially
+    // to fill the validation state with the proper rejection reason.
+    CValidationState state;
+    return SaplingValidation::CheckProofs(*ptx, dataToBeSigned, state, 100);
+}
@@ -7,10 +7,49 @@
 #define PIVX_SAPLING_VALIDATION_H
 
 #include "chainparams.h"
+#include "uint256.h"
+
+#include <vector>
 
 class CTransaction;
 class CValidationState;
 
+// Limit the shielded-valid cache size to 8MB (about 250000 entries on 64-bit systems).
+static const unsigned int DEFAULT_MAX_SAPLING_PROOF_CACHE_SIZE = 8;
+// Maximum shielded-valid cache size allowed
+static const int64_t MAX_MAX_SAPLING_PROOF_CACHE_SIZE = 1024;
+
+/**
+ * Closure representing the verification of the Sapling spend/output proofs
+ * and the binding signature of one shielded transaction.
+ * Note that this stores a reference to the transaction.
+ */
+class CSaplingProofCheck
+{
+private:
+    const CTransaction* ptx;
+    uint256 dataToBeSigned;
+
+public:
+    CSaplingProofCheck() : ptx(nullptr) {}
+    CSaplingProofCheck(const CTransaction& txIn, const uint256& dataToBeSignedIn) :
+        ptx(&txIn),
+        dataToBeSigned(dataToBeSignedIn) {}
+
+    bool operator()();
+
+    void swap(CSaplingProofCheck& check)
+    {
+        std::swap(ptx, check.ptx);
+        std::swap(dataToBeSigned, check.dataToBeSigned);
+    }
+};
+
+/** Initialize the shielded-valid cache (to be called once in AppInitMain/BasicTestingSetup) */
+void InitSaplingProofCache();
+/** Number of shielded-valid cache lookups that skipped (hits) or required (misses) the proofs verification */
+void GetSaplingProofCacheStats(uint64_t& nHits, uint64_t& nMisses);
+
 namespace SaplingValidation {
 
 /** Context-independent validity checks */
@@ -21,9 +60,13 @@ bool CheckTransactionWithoutProofVerification(const CTransaction& tx, CValidatio
 
 /** Check a transaction contextually against a set of consensus rules */
 // Note: if v5 upgrade wasn't enforced, this method returns true without performing any check.
+// Note2: shielded txs accepted by the mempool are stored in the shielded-valid cache, so their proofs
+// are not verified again when they are included in a block.
+// Note3: if pvChecks is not nullptr, the proofs verification is not performed here but
+// appended to pvChecks, so the caller can run it later (e.g. in the sapling check queue).
 bool ContextualCheckTransaction(const CTransaction &tx, CValidationState &state,
                                 const CChainParams &chainparams, int nHeight, bool isMined,
-                                bool sInitBlockDownload);
+                                bool sInitBlockDownload, std::vector<CSaplingProofCheck>* pvChecks = nullptr);
 
 }; // End SaplingValidation namespace
 
@@ -5,8 +5,77 @@
 
 #include "sapling/saplingscriptpubkeyman.h"
 #include "chain.h" // for CBlockIndex
+#include "checkqueue.h"
 #include "validation.h" // for ReadBlockFromDisk()
 
+namespace {
+
+//! Number of incoming viewing keys tried by each trial decryption job
+static const size_t TRIAL_DECRYPTION_KEYS_PER_JOB = 16;
+
+struct SaplingTrialDecryptionResult
+{
+    size_t nKey{0};
+    Optional<libzcash::SaplingNotePlaintext> plaintext{nullopt};
+};
+
+/**
+ * Trial decryption of a shielded output with a range of incoming viewing keys.
+ * Records the first key (in range order) that decrypts the output.
+ */
+class CSaplingTrialDecryption
+{
+private:
+    const OutputDescription* output{nullptr};
+    const std::vector<libzcash::SaplingIncomingViewingKey>* ivks{nullptr};
+    size_t nBegin{0};
+    size_t nEnd{0};
+    SaplingTrialDecryptionResult* pResult{nullptr};
+
+public:
+    CSaplingTrialDecryption() {}
+    CSaplingTrialDecryption(const OutputDescription* _output,
+                            const std::vector<libzcash::SaplingIncomingViewingKey>* _ivks,
+                            size_t _nBegin, size_t _nEnd,
+                            SaplingTrialDecryptionResult* _pResult) :
+        output(_output), ivks(_ivks), nBegin(_nBegin), nEnd(_nEnd), pResult(_pResult) {}
+
+    bool operator()()
+    {
+        for (size_t i = nBegin; i < nEnd; i++) {
+            auto result = libzcash::SaplingNotePlaintext::decrypt(output->encCiphertext, (*ivks)[i], output->ephemeralKey, output->cmu);
+            if (result) {
+                pResult->nKey = i;
+                pResult->plaintext = *result;
+                break;
+            }
+        }
+        // Misses are not failures, never interrupt the other jobs
+        return true;
+    }
+
+    void swap(CSaplingTrialDecryption& check)
+    {
+        std::swap(output, check.output);
+        std::swap(ivks, check.ivks);
+        std::swap(nBegin, check.nBegin);
+        std::swap(nEnd, check.nEnd);
+        std::swap(pResult, check.pResult);
+    }
+};
+
+} // anon namespace
+
+static CCheckQueue<CSaplingTrialDecryption> saplingdecryptqueue(4);
+// The queue has a single master at a time
+static Mutex cs_saplingdecryptqueue;
+
+void ThreadSaplingTrialDecryption()
+{
+    util::ThreadRename("pivx-saplingdec");
+    saplingdecryptqueue.Thread();
+}
+
 void SaplingScriptPubKeyMan::AddToSaplingSpends(const uint256& nullifier, const uint256& wtxid)
 {
     AssertLockHeld(wallet->cs_wallet);
@@ -108,108 +177,144 @@ void SaplingScriptPubKeyMan::UpdateNullifierNoteMapWithTx(const CWalletTx& wtx)
     }
 }
 
-template<typename NoteDataMap>
-void CopyPreviousWitnesses(NoteDataMap& noteDataMap, int indexHeight, int64_t nWitnessCacheSize)
+void SaplingScriptPubKeyMan::AddToWitnessedNotes(const CWalletTx& wtx)
 {
-    for (auto& item : noteDataMap) {
-        auto* nd = &(item.second);
-        // skip externally sent notes
-        if (!nd->IsMyNote()) continue;
-        // Only increment witnesses that are behind the current height
-        if (nd->witnessHeight < indexHeight) {
-            // Check the validity of the cache
-            // The only time a note witnessed above the current height
-            // would be invalid here is during a reindex when blocks
-            // have been decremented, and we are incrementing the blocks
-            // immediately after.
-            assert(nWitnessCacheSize >= (int64_t) nd->witnesses.size());
-            // Witnesses being incremented should always be either -1
-            // (never incremented or decremented) or one below indexHeight
-            assert((nd->witnessHeight == -1) || (nd->witnessHeight == indexHeight - 1));
-            // Copy the witness for the previous block if we have one
-            if (nd->witnesses.size() > 0) {
-                nd->witnesses.push_front(nd->witnesses.front());
-            }
-            if (nd->witnesses.size() > WITNESS_CACHE_SIZE) {
-                nd->witnesses.pop_back();
-            }
+    AssertLockHeld(wallet->cs_wallet);
+    for (const mapSaplingNoteData_t::value_type& item : wtx.mapSaplingNoteData) {
+        if (item.second.IsMyNote()) {
+            setWitnessedNotes.emplace(item.first);
         }
     }
 }
 
-template<typename NoteDataMap>
-void AppendNoteCommitment(NoteDataMap& noteDataMap, int indexHeight, int64_t nWitnessCacheSize, const uint256& note_commitment)
+bool SaplingScriptPubKeyMan::IsSaplingSpentAtOrBelow(const uint256& nullifier, int nHeight) const
 {
-    for (auto& item : noteDataMap) {
-        auto* nd = &(item.second);
-        // skip externally sent notes
-        if (!nd->IsMyNote()) continue;
-        if (nd->witnessHeight < indexHeight && nd->witnesses.size() > 0) {
-            // Check the validity of the cache
-            // See comment in CopyPreviousWitnesses about validity.
-            assert(nWitnessCacheSize >= (int64_t) nd->witnesses.size());
-            nd->witnesses.front().append(note_commitment);
+    AssertLockHeld(wallet->cs_wallet);
+    auto range = mapTxSaplingNullifiers.equal_range(nullifier);
+    for (auto it = range.first; it != range.second; ++it) {
+        auto mit = wallet->mapWallet.find(it->second);
+        if (mit != wallet->mapWallet.end() && mit->second.isConfirmed() && mit->second.m_confirm.block_height <= nHeight) {
+            return true;
         }
     }
+    return false;
 }
 
-template<typename OutPoint, typename NoteData, typename Witness>
-void WitnessNoteIfMine(std::map<OutPoint, NoteData>& noteDataMap, int indexHeight, int64_t nWitnessCacheSize, const OutPoint& key, const Witness& witness)
+std::vector<SaplingNoteData*> SaplingScriptPubKeyMan::GetWitnessedNotes(int nChainHeight)
 {
-    auto ndIt = noteDataMap.find(key);
-    if (ndIt != noteDataMap.end()) {
-        auto* nd = &ndIt->second;
-        // skip externally sent and already witnessed notes
-        if (!nd->IsMyNote() || nd->witnessHeight >= indexHeight) return;
-        if (nd->witnesses.size() > 0) {
-            // We think this can happen because we write out the
-            // witness cache state after every block increment or
-            // decrement, but the block index itself is written in
-            // batches. So if the node crashes in between these two
-            // operations, it is possible for IncrementNoteWitnesses
-            // to be called again on previously-cached blocks. This
-            // doesn't affect existing cached notes because of the
-            // NoteData::witnessHeight checks. See #1378 for details.
-            LogPrintf("Inconsistent witness cache state found for %s\n- Cache size: %d\n- Top (height %d): %s\n- New (height %d): %s\n",
-                      key.ToString(), nd->witnesses.size(),
-                      nd->witnessHeight,
-                      nd->witnesses.front().root().GetHex(),
-                      indexHeight,
-                      witness.root().GetHex());
-            nd->witnesses.clear();
+    AssertLockHeld(wallet->cs_wallet);
+    std::vector<SaplingNoteData*> vNotes;
+    vNotes.reserve(setWitnessedNotes.size());
+    for (auto it = setWitnessedNotes.begin(); it != setWitnessedNotes.end();) {
+        SaplingNoteData* nd = nullptr;
+        auto wit = wallet->mapWallet.find(it->hash);
+        if (wit != wallet->mapWallet.end()) {
+            auto ndIt = wit->second.mapSaplingNoteData.find(*it);
+            if (ndIt != wit->second.mapSaplingNoteData.end() && ndIt->second.IsMyNote()) {
+                nd = &ndIt->second;
+            }
+        }
+        // Drop the notes no longer in the wallet, and the ones spent deeper than the
+        // witness cache (a reorg can't make them unspent anymore)
+        if (!nd || (nd->nullifier && IsSaplingSpentAtOrBelow(*nd->nullifier, nChainHeight - (int) WITNESS_CACHE_SIZE))) {
+            it = setWitnessedNotes.erase(it);
+            continue;
         }
-        nd->witnesses.push_front(witness);
-        // Set height to one less than pindex so it gets incremented
-        nd->witnessHeight = indexHeight - 1;
+        vNotes.emplace_back(nd);
+        it++;
+    }
+    return vNotes;
+}
+
+static void CopyPreviousWitness(SaplingNoteData& nd, int indexHeight, int64_t nWitnessCacheSize)
+{
+    // Only increment witnesses that are behind the current height
+    if (nd.witnessHeight < indexHeight) {
         // Check the validity of the cache
-        assert(nWitnessCacheSize >= (int64_t) nd->witnesses.size());
+        // The only time a note witnessed above the current height
+        // would be invalid here is during a reindex when blocks
+        // have been decremented, and we are incrementing the blocks
+        // immediately after.
+        assert(nWitnessCacheSize >= (int64_t) nd.witnesses.size());
+        // Witnesses being incremented should always be either -1
+        // (never incremented or decremented) or one below indexHeight
+        assert((nd.witnessHeight == -1) || (nd.witnessHeight == indexHeight - 1));
+        // Copy the witness for the previous block if we have one
+        if (nd.witnesses.size() > 0) {
+            nd.witnesses.push_front(nd.witnesses.front());
+        }
+        if (nd.witnesses.size() > WITNESS_CACHE_SIZE) {
+            nd.witnesses.pop_back();
+        }
     }
 }
 
-template<typename NoteDataMap>
-void UpdateWitnessHeights(NoteDataMap& noteDataMap, int indexHeight, int64_t nWitnessCacheSize)
+static void AppendNoteCommitments(SaplingNoteData& nd, int indexHeight, int64_t nWitnessCacheSize,
+                                  const std::vector<uint256>& vCommitments, size_t nStart)
 {
-    for (auto& item : noteDataMap) {
-        auto* nd = &(item.second);
-        // skip externally sent notes
-        if (!nd->IsMyNote()) continue;
-        if (nd->witnessHeight < indexHeight) {
-            nd->witnessHeight = indexHeight;
-            // Check the validity of the cache
-            // See comment in CopyPreviousWitnesses about validity.
-            assert(nWitnessCacheSize >= (int64_t) nd->witnesses.size());
+    if (nd.witnessHeight < indexHeight && nd.witnesses.size() > 0) {
+        // Check the validity of the cache
+        // See comment in CopyPreviousWitness about validity.
+        assert(nWitnessCacheSize >= (int64_t) nd.witnesses.size());
+        SaplingWitness& witness = nd.witnesses.front();
+        for (size_t i = nStart; i < vCommitments.size(); i++) {
+            witness.append(vCommitments[i]);
         }
     }
 }
 
+static SaplingNoteData* WitnessNoteIfMine(mapSaplingNoteData_t& noteDataMap, int indexHeight, int64_t nWitnessCacheSize, const SaplingOutPoint& key, const SaplingWitness& witness)
+{
+    auto ndIt = noteDataMap.find(key);
+    if (ndIt == noteDataMap.end()) return nullptr;
+    SaplingNoteData* nd = &ndIt->second;
+    // skip externally sent and already witnessed notes
+    if (!nd->IsMyNote() || nd->witnessHeight >= indexHeight) return nullptr;
+    if (nd->witnesses.size() > 0) {
+        // We think this can happen because we write out the
+        // witness cache state after every block increment or
+        // decrement, but the block index itself is written in
+        // batches. So if the node crashes in between these two
+        // operations, it is possible for IncrementNoteWitnesses
+        // to be called again on previously-cached blocks. This
+        // doesn't affect existing cached notes because of the
+        // NoteData::witnessHeight checks. See #1378 for details.
+        LogPrintf("Inconsistent witness cache state found for %s\n- Cache size: %d\n- Top (height %d): %s\n- New (height %d): %s\n",
+                  key.ToString(), nd->witnesses.size(),
+                  nd->witnessHeight,
+                  nd->witnesses.front().root().GetHex(),
+                  indexHeight,
+                  witness.root().GetHex());
+        nd->witnesses.clear();
+    }
+    nd->witnesses.push_front(witness);
+    // Set height to one less than pindex so it gets incremented
+    nd->witnessHeight = indexHeight - 1;
+    // Check the validity of the cache
+    assert(nWitnessCacheSize >= (int64_t) nd->witnesses.size());
+    return nd;
+}
+
+static void UpdateWitnessHeight(SaplingNoteData& nd, int indexHeight, int64_t nWitnessCacheSize)
+{
+    if (nd.witnessHeight < indexHeight) {
+        nd.witnessHeight = indexHeight;
+        // Check the validity of the cache
+        // See comment in CopyPreviousWitness about validity.
+        assert(nWitnessCacheSize >= (int64_t) nd.witnesses.size());
+    }
+}
+
 void SaplingScriptPubKeyMan::IncrementNoteWitnesses(const CBlockIndex* pindex,
                                      const CBlock* pblock,
                                      SaplingMerkleTree& saplingTree)
 {
     LOCK(wallet->cs_wallet);
     int chainHeight = pindex->nHeight;
-    for (std::pair<const uint256, CWalletTx>& wtxItem : wallet->mapWallet) {
-        ::CopyPreviousWitnesses(wtxItem.second.mapSaplingNoteData, chainHeight, nWitnessCacheSize);
+    // Only our notes are updated, not the whole wallet
+    const std::vector<SaplingNoteData*> vNotes = GetWitnessedNotes(chainHeight);
+    for (SaplingNoteData* nd : vNotes) {
+        ::CopyPreviousWitness(*nd, chainHeight, nWitnessCacheSize);
     }
 
     if (nWitnessCacheSize < WITNESS_CACHE_SIZE) {
@@ -217,34 +322,56 @@ void SaplingScriptPubKeyMan::IncrementNoteWitnesses(const CBlockIndex* pindex,
         nWitnessCacheNeedsUpdate = true;
     }
 
+    // Note commitments of the block
+    std::vector<uint256> vCommitments;
+    for (const auto& tx : pblock->vtx) {
+        if (!tx->IsShieldedTx()) continue;
+        for (const OutputDescription& output : tx->sapData->vShieldedOutput) {
+            vCommitments.emplace_back(output.cmu);
+        }
+    }
+
+    // Increment existing witnesses, one pass over the commitments per note
+    for (SaplingNoteData* nd : vNotes) {
+        ::AppendNoteCommitments(*nd, chainHeight, nWitnessCacheSize, vCommitments, 0);
+    }
+
+    // Append the commitments to the tree, and witness our new notes
+    std::vector<std::pair<SaplingNoteData*, size_t>> vNewNotes;
+    size_t nPos = 0;
     for (const auto& tx : pblock->vtx) {
         if (!tx->IsShieldedTx()) continue;
 
         const uint256& hash = tx->GetHash();
-        bool txIsOurs = wallet->mapWallet.count(hash);
+        auto wit = wallet->mapWallet.find(hash);
 
         // Sapling
         for (uint32_t i = 0; i < tx->sapData->vShieldedOutput.size(); i++) {
-            const uint256& note_commitment = tx->sapData->vShieldedOutput[i].cmu;
-            saplingTree.append(note_commitment);
-
-            // Increment existing witnesses
-            for (std::pair<const uint256, CWalletTx>& wtxItem : wallet->mapWallet) {
-                ::AppendNoteCommitment(wtxItem.second.mapSaplingNoteData, chainHeight, nWitnessCacheSize, note_commitment);
-            }
+            saplingTree.append(vCommitments[nPos++]);
 
             // If this is our note, witness it
-            if (txIsOurs) {
+            if (wit != wallet->mapWallet.end()) {
                 SaplingOutPoint outPoint {hash, i};
-                ::WitnessNoteIfMine(wallet->mapWallet.at(hash).mapSaplingNoteData, chainHeight, nWitnessCacheSize, outPoint, saplingTree.witness());
+                SaplingNoteData* nd = ::WitnessNoteIfMine(wit->second.mapSaplingNoteData, chainHeight, nWitnessCacheSize, outPoint, saplingTree.witness());
+                if (nd) {
+                    vNewNotes.emplace_back(nd, nPos);
+                    setWitnessedNotes.emplace(outPoint);
+                }
             }
         }
+    }
 
+    // Increment the new witnesses with the commitments following them
+    for (const auto& it : vNewNotes) {
+        ::AppendNoteCommitments(*it.first, chainHeight, nWitnessCacheSize, vCommitments, it.second);
     }
 
     // Update witness heights
-    for (std::pair<const uint256, CWalletTx>& wtxItem : wallet->mapWallet) {
-        ::UpdateWitnessHeights(wtxItem.second.mapSaplingNoteData, chainHeight, nWitnessCacheSize);
+    for (SaplingNoteData* nd : vNotes) {
+        ::UpdateWitnessHeight(*nd, chainHeight, nWitnessCacheSize);
+    }
+    for (const auto& it : vNewNotes) {
+        ::UpdateWitnessHeight(*it.first, chainHeight, nWitnessCacheSize);
     }
 
     // For performance reasons, we write out the witness cache in
@@ -252,53 +379,47 @@ void SaplingScriptPubKeyMan::IncrementNoteWitnesses(const CBlockIndex* pindex,
     // of the wallet.dat is maintained).
 }
 
-template<typename NoteDataMap>
-void DecrementNoteWitnesses(NoteDataMap& noteDataMap, int indexHeight, int64_t nWitnessCacheSize)
+static void DecrementNoteWitness(SaplingNoteData& nd, int indexHeight, int64_t nWitnessCacheSize)
 {
-    for (auto& item : noteDataMap) {
-        auto* nd = &(item.second);
-        // skip externally sent notes
-        if (!nd->IsMyNote()) continue;
-        // Only decrement witnesses that are not above the current height
-        if (nd->witnessHeight <= indexHeight) {
-            // Check the validity of the cache
-            // See comment below (this would be invalid if there were a
-            // prior decrement).
-            assert(nWitnessCacheSize >= (int64_t) nd->witnesses.size());
-            // Witnesses being decremented should always be either -1
-            // (never incremented or decremented) or equal to the height
-            // of the block being removed (indexHeight)
-            assert((nd->witnessHeight == -1) || (nd->witnessHeight == indexHeight));
-            if (nd->witnesses.size() > 0) {
-                nd->witnesses.pop_front();
-            }
-            // indexHeight is the height of the block being removed, so
-            // the new witness cache height is one below it.
-            nd->witnessHeight = indexHeight - 1;
-        }
+    // Only decrement witnesses that are not above the current height
+    if (nd.witnessHeight <= indexHeight) {
         // Check the validity of the cache
-        // Technically if there are notes witnessed above the current
-        // height, their cache will now be invalid (relative to the new
-        // value of nWitnessCacheSize). However, this would only occur
-        // during a reindex, and by the time the reindex reaches the tip
-        // of the chain again, the existing witness caches will be valid
-        // again.
-        // We don't set nWitnessCacheSize to zero at the start of the
-        // reindex because the on-disk blocks had already resulted in a
-        // chain that didn't trigger the assertion below.
-        if (nd->witnessHeight < indexHeight) {
-            // Subtract 1 to compare to what nWitnessCacheSize will be after
-            // decrementing.
-            assert((nWitnessCacheSize - 1) >= (int64_t) nd->witnesses.size());
+        // See comment below (this would be invalid if there were a
+        // prior decrement).
+        assert(nWitnessCacheSize >= (int64_t) nd.witnesses.size());
+        // Witnesses being decremented should always be either -1
+        // (never incremented or decremented) or equal to the height
+        // of the block being removed (indexHeight)
+        assert((nd.witnessHeight == -1) || (nd.witnessHeight == indexHeight));
+        if (nd.witnesses.size() > 0) {
+            nd.witnesses.pop_front();
         }
+        // indexHeight is the height of the block being removed, so
+        // the new witness cache height is one below it.
+        nd.witnessHeight = indexHeight - 1;
+    }
+    // Check the validity of the cache
+    // Technically if there are notes witnessed above the current
+    // height, their cache will now be invalid (relative to the new
+    // value of nWitnessCacheSize). However, this would only occur
+    // during a reindex, and by the time the reindex reaches the tip
+    // of the chain again, the existing witness caches will be valid
+    // again.
+    // We don't set nWitnessCacheSize to zero at the start of the
+    // reindex because the on-disk blocks had already resulted in a
+    // chain that didn't trigger the assertion below.
+    if (nd.witnessHeight < indexHeight) {
+        // Subtract 1 to compare to what nWitnessCacheSize will be after
+        // decrementing.
+        assert((nWitnessCacheSize - 1) >= (int64_t) nd.witnesses.size());
     }
 }
 
 void SaplingScriptPubKeyMan::DecrementNoteWitnesses(int nChainHeight)
 {
     LOCK(wallet->cs_wallet);
-    for (std::pair<const uint256, CWalletTx>& wtxItem : wallet->mapWallet) {
-        ::DecrementNoteWitnesses(wtxItem.second.mapSaplingNoteData, nChainHeight, nWitnessCacheSize);
+    for (SaplingNoteData* nd : GetWitnessedNotes(nChainHeight)) {
+        ::DecrementNoteWitness(*nd, nChainHeight, nWitnessCacheSize);
     }
     nWitnessCacheSize -= 1;
     nWitnessCacheNeedsUpdate = true;
@@ -319,50 +440,85 @@ void SaplingScriptPubKeyMan::DecrementNoteWitnesses(int nChainHeight)
  * It should never be necessary to call this method with a CWalletTx, because
  * the result of FindMySaplingNotes (for the addresses available at the time) will
  * already have been cached in CWalletTx.mapSaplingNoteData.
+ *
+ * The wallet lock is not needed: the trial decryption runs before it is taken,
+ * and the notes found are recorded by AddToWalletIfInvolvingMe.
  */
-std::pair<mapSaplingNoteData_t, SaplingIncomingViewingKeyMap> SaplingScriptPubKeyMan::FindMySaplingNotes(const CTransaction &tx) const
+SaplingNotesFound SaplingScriptPubKeyMan::FindMySaplingNotes(const CTransaction &tx) const
 {
     // First check that this tx is a Shielded tx.
     if (!tx.IsShieldedTx()) {
         return {};
     }
 
-    LOCK(wallet->cs_KeyStore);
     const uint256& hash = tx.GetHash();
+    const std::vector<OutputDescription>& vOutputs = tx.sapData->vShieldedOutput;
+
+    // Copy the incoming viewing keys, so the trial decryption runs without holding cs_KeyStore
+    std::vector<libzcash::SaplingIncomingViewingKey> ivks;
+    {
+        LOCK(wallet->cs_KeyStore);
+        ivks.reserve(wallet->mapSaplingFullViewingKeys.size());
+        for (const auto& it : wallet->mapSaplingFullViewingKeys) {
+            ivks.emplace_back(it.first);
+        }
+    }
+
+    // Protocol Spec: 4.19 Block Chain Scanning (Sapling)
+    // Split the (output x ivk) pairs in jobs of consecutive keys for the same output,
+    // and run them on the worker threads (if any).
+    const size_t nJobsPerOutput = (ivks.size() + TRIAL_DECRYPTION_KEYS_PER_JOB - 1) / TRIAL_DECRYPTION_KEYS_PER_JOB;
+    std::vector<SaplingTrialDecryptionResult> vResults(vOutputs.size() * nJobsPerOutput);
+    std::vector<CSaplingTrialDecryption> vJobs;
+    vJobs.reserve(vResults.size());
+    for (size_t i = 0; i < vOutputs.size(); i++) {
+        for (size_t j = 0; j < nJobsPerOutput; j++) {
+            const size_t nBegin = j * TRIAL_DECRYPTION_KEYS_PER_JOB;
+            const size_t nEnd = std::min(nBegin + TRIAL_DECRYPTION_KEYS_PER_JOB, ivks.size());
+            vJobs.emplace_back(&vOutputs[i], &ivks, nBegin, nEnd, &vResults[i * nJobsPerOutput + j]);
+        }
+    }
+    if (nScriptCheckThreads && vJobs.size() > 1) {
+        LOCK(cs_saplingdecryptqueue);
+        CCheckQueueControl<CSaplingTrialDecryption> control(&saplingdecryptqueue);
+        control.Add(vJobs);
+        control.Wait();
+    } else {
+        for (CSaplingTrialDecryption& job : vJobs) job();
+    }
 
     mapSaplingNoteData_t noteData;
     SaplingIncomingViewingKeyMap viewingKeysToAdd;
+    for (uint32_t i = 0; i < vOutputs.size(); ++i) {
+        // First key decrypting the output
+        const SaplingTrialDecryptionResult* hit = nullptr;
+        for (size_t j = 0; j < nJobsPerOutput && !hit; j++) {
+            const SaplingTrialDecryptionResult& res = vResults[i * nJobsPerOutput + j];
+            if (res.plaintext) hit = &res;
+        }
+        if (!hit) continue;
 
-    // Protocol Spec: 4.19 Block Chain Scanning (Sapling)
-    for (uint32_t i = 0; i < tx.sapData->vShieldedOutput.size(); ++i) {
-        const OutputDescription output = tx.sapData->vShieldedOutput[i];
-        for (auto it = wallet->mapSaplingFullViewingKeys.begin(); it != wallet->mapSaplingFullViewingKeys.end(); ++it) {
-            libzcash::SaplingIncomingViewingKey ivk = it->first;
-            auto result = libzcash::SaplingNotePlaintext::decrypt(output.encCiphertext, ivk, output.ephemeralKey, output.cmu);
-            if (!result) {
-                continue;
-            }
+        const libzcash::SaplingIncomingViewingKey& ivk = ivks[hit->nKey];
+        const libzcash::SaplingNotePlaintext& result = *hit->plaintext;
 
-            // Check if we already have it.
-            Optional<libzcash::SaplingPaymentAddress> address = ivk.address(result.get().d);
-            if (address && wallet->mapSaplingIncomingViewingKeys.count(address.get()) == 0) {
-                viewingKeysToAdd[address.get()] = ivk;
-            }
-            // We don't cache the nullifier here as computing it requires knowledge of the note position
-            // in the commitment tree, which can only be determined when the transaction has been mined.
-            SaplingOutPoint op {hash, i};
-            SaplingNoteData nd;
-            nd.ivk = ivk;
-            nd.amount = result->value();
-            nd.address = address;
-            const auto& memo = result->memo();
-            // don't save empty memo (starting with 0xF6)
-            if (memo[0] < 0xF6) {
-                nd.memo = memo;
-            }
-            noteData.insert(std::make_pair(op, nd));
-            break;
+        // Check if we already have it.
+        Optional<libzcash::SaplingPaymentAddress> address = ivk.address(result.d);
+        if (address && WITH_LOCK(wallet->cs_KeyStore, return wallet->mapSaplingIncomingViewingKeys.count(address.get()) == 0)) {
+            viewingKeysToAdd[address.get()] = ivk;
+        }
+        // We don't cache the nullifier here as computing it requires knowledge of the note position
+        // in the commitment tree, which can only be determined when the transaction has been mined.
+        SaplingOutPoint op {hash, i};
+        SaplingNoteData nd;
+        nd.ivk = ivk;
+        nd.amount = result.value();
+        nd.address = address;
+        const auto& memo = result.memo();
+        // don't save empty memo (starting with 0xF6)
+        if (memo[0] < 0xF6) {
+            nd.memo = memo;
         }
+        noteData.insert(std::make_pair(op, nd));
     }
 
     return std::make_pair(noteData, viewingKeysToAdd);
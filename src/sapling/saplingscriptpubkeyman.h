@@ -133,6 +133,11 @@ enum KeyAddResult {
 };
 
 typedef std::map<SaplingOutPoint, SaplingNoteData> mapSaplingNoteData_t;
+/** Notes of a transaction found by trial decryption, and the viewing keys of their addresses to add to the keystore */
+typedef std::pair<mapSaplingNoteData_t, SaplingIncomingViewingKeyMap> SaplingNotesFound;
+
+/** Run a worker thread of the Sapling outputs trial decryption queue */
+void ThreadSaplingTrialDecryption();
 
 /*
  * Sapling keys manager
@@ -167,6 +172,11 @@ public:
      */
     void DecrementNoteWitnesses(int nChainHeight);
 
+    /**
+     * Add the own notes of this tx to the set of notes whose witnesses are maintained.
+     */
+    void AddToWitnessedNotes(const CWalletTx& wtx);
+
     /**
      * Update mapSaplingNullifiersToNotes
      * with the cached nullifiers in this tx.
@@ -270,8 +280,8 @@ public:
     Optional<libzcash::SaplingExtendedSpendingKey> GetSpendingKeyForPaymentAddress(const libzcash::SaplingPaymentAddress &addr) const;
 
     //! Finds all output notes in the given tx that have been sent to a
-    //! SaplingPaymentAddress in this wallet
-    std::pair<mapSaplingNoteData_t, SaplingIncomingViewingKeyMap> FindMySaplingNotes(const CTransaction& tx) const;
+    //! SaplingPaymentAddress in this wallet (needs only cs_KeyStore, taken briefly)
+    SaplingNotesFound FindMySaplingNotes(const CTransaction& tx) const;
 
     //! Find all of the addresses in the given tx that have been sent to a SaplingPaymentAddress in this wallet.
     std::vector<libzcash::SaplingPaymentAddress> FindMySaplingAddresses(const CTransaction& tx) const;
@@ -423,6 +433,17 @@ private:
      */
     typedef std::multimap<uint256, uint256> TxNullifiers;
     TxNullifiers mapTxSaplingNullifiers;
+
+    /**
+     * Own notes whose witnesses are updated on every block: unspent notes, and spent
+     * notes until the spend is buried deeper than the witness cache.
+     * Block processing cost depends on these notes only, not on the wallet history.
+     */
+    std::set<SaplingOutPoint> setWitnessedNotes;
+    //! Return the notes to update at nChainHeight, dropping the stale ones from setWitnessedNotes
+    std::vector<SaplingNoteData*> GetWitnessedNotes(int nChainHeight);
+    //! Whether the nullifier is spent by a wallet tx confirmed at or below nHeight
+    bool IsSaplingSpentAtOrBelow(const uint256& nullifier, int nHeight) const;
 };
 
 #endif //PIVX_SAPLINGSCRIPTPUBKEYMAN_H
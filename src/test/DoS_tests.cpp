@@ -17,6 +17,7 @@
 #include "pow.h"
 #include "script/sign.h"
 #include "serialize.h"
+#include "txmempool.h"
 #include "util/system.h"
 #include "validation.h"
 
@@ -35,6 +36,8 @@ struct COrphanTx {
 };
 extern RecursiveMutex g_cs_orphans;
 extern std::map<uint256, COrphanTx> mapOrphanTransactions GUARDED_BY(g_cs_orphans);
+extern bool ConsumeTxInvToken(double& nTokens, int64_t& nLastRefill, int64_t nNow);
+extern size_t LimitInvTxToSend(std::set<uint256>& setInventoryTxToSend, std::vector<std::set<uint256>::iterator>& vInvTx, CTxMemPool* pool);
 
 CService ip(uint32_t i)
 {
@@ -240,4 +243,78 @@ BOOST_AUTO_TEST_CASE(DoS_mapOrphans)
     BOOST_CHECK(mapOrphanTransactions.empty());
 }
 
+BOOST_AUTO_TEST_CASE(DoS_txinv_rate)
+{
+    // A peer can announce a burst of new transactions
+    double nTokens = MAX_PEER_TX_INV_BURST;
+    int64_t nLastRefill = 1000000;
+    int64_t nNow = nLastRefill;
+    for (unsigned int i = 0; i < MAX_PEER_TX_INV_BURST; i++) {
+        BOOST_CHECK(ConsumeTxInvToken(nTokens, nLastRefill, nNow));
+    }
+    BOOST_CHECK(!ConsumeTxInvToken(nTokens, nLastRefill, nNow));
+
+    // then MAX_PEER_TX_INV_RATE per second
+    nNow += 1000000;
+    for (int i = 0; i < (int)MAX_PEER_TX_INV_RATE; i++) {
+        BOOST_CHECK(ConsumeTxInvToken(nTokens, nLastRefill, nNow));
+    }
+    BOOST_CHECK(!ConsumeTxInvToken(nTokens, nLastRefill, nNow));
+    nNow += 500000;
+    for (int i = 0; i < (int)MAX_PEER_TX_INV_RATE / 2; i++) {
+        BOOST_CHECK(ConsumeTxInvToken(nTokens, nLastRefill, nNow));
+    }
+    BOOST_CHECK(!ConsumeTxInvToken(nTokens, nLastRefill, nNow));
+
+    // The bucket refills up to the burst
+    nNow += 3600 * 1000000LL;
+    for (unsigned int i = 0; i < MAX_PEER_TX_INV_BURST; i++) {
+        BOOST_CHECK(ConsumeTxInvToken(nTokens, nLastRefill, nNow));
+    }
+    BOOST_CHECK(!ConsumeTxInvToken(nTokens, nLastRefill, nNow));
+
+    // and not when the clock goes backwards
+    nNow -= 10 * 1000000;
+    BOOST_CHECK(!ConsumeTxInvToken(nTokens, nLastRefill, nNow));
+}
+
+BOOST_AUTO_TEST_CASE(DoS_txinv_queue)
+{
+    // Queue of transactions to announce, over the limit, with different fee rates (same size)
+    const size_t nExcess = 10;
+    TestMemPoolEntryHelper entry;
+    std::set<uint256> setInventoryTxToSend;
+    std::vector<uint256> vLowestFees;
+    for (size_t i = 0; i < INVENTORY_MAX_QUEUED_TX + nExcess; i++) {
+        CMutableTransaction tx;
+        tx.vin.resize(1);
+        tx.vin[0].prevout = COutPoint(InsecureRand256(), 0);
+        tx.vin[0].scriptSig = CScript() << OP_11;
+        tx.vout.resize(1);
+        tx.vout[0].nValue = 1 * COIN;
+        tx.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+        mempool.addUnchecked(tx.GetHash(), entry.Fee(1000 + i).FromTx(tx));
+        setInventoryTxToSend.insert(tx.GetHash());
+        if (i < nExcess) vLowestFees.emplace_back(tx.GetHash());
+    }
+    std::vector<std::set<uint256>::iterator> vInvTx;
+    for (auto it = setInventoryTxToSend.begin(); it != setInventoryTxToSend.end(); it++) {
+        vInvTx.push_back(it);
+    }
+
+    // The transactions that would be announced last are dropped
+    BOOST_CHECK_EQUAL(LimitInvTxToSend(setInventoryTxToSend, vInvTx, &mempool), nExcess);
+    BOOST_CHECK_EQUAL(setInventoryTxToSend.size(), INVENTORY_MAX_QUEUED_TX);
+    BOOST_CHECK_EQUAL(vInvTx.size(), INVENTORY_MAX_QUEUED_TX);
+    for (const uint256& hash : vLowestFees) {
+        BOOST_CHECK(!setInventoryTxToSend.count(hash));
+    }
+
+    // A queue within the limit is kept
+    BOOST_CHECK_EQUAL(LimitInvTxToSend(setInventoryTxToSend, vInvTx, &mempool), (size_t)0);
+    BOOST_CHECK_EQUAL(setInventoryTxToSend.size(), INVENTORY_MAX_QUEUED_TX);
+
+    mempool.clear();
+}
+
 BOOST_AUTO_TEST_SUITE_END()
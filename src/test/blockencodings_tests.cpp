@@ -0,0 +1,250 @@
+// Copyright (c) 2016 The Bitcoin Core developers
+// Copyright (c) 2021 The PIVX developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "test/test_pivx.h"
+
+#include "blockencodings.h"
+#include "consensus/merkle.h"
+#include "streams.h"
+#include "txmempool.h"
+
+#include <boost/test/unit_test.hpp>
+
+static std::vector<std::pair<uint256, CTransactionRef>> extra_txn;
+
+BOOST_FIXTURE_TEST_SUITE(blockencodings_tests, BasicTestingSetup)
+
+static CBlock BuildBlockTestCase(bool fProofOfStake)
+{
+    CBlock block;
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vin[0].scriptSig.resize(10);
+    tx.vout.resize(1);
+    tx.vout[0].nValue = 42;
+
+    block.vtx.resize(fProofOfStake ? 4 : 3);
+    block.vtx[0] = MakeTransactionRef(tx);
+    block.nVersion = CBlockHeader::CURRENT_VERSION;
+    block.hashPrevBlock = InsecureRand256();
+    block.nBits = 0x207fffff;
+
+    size_t nIndex = 1;
+    if (fProofOfStake) {
+        CMutableTransaction txCoinStake;
+        txCoinStake.vin.resize(1);
+        txCoinStake.vin[0].prevout.hash = InsecureRand256();
+        txCoinStake.vin[0].prevout.n = 0;
+        txCoinStake.vout.resize(2);
+        txCoinStake.vout[0].SetEmpty();
+        txCoinStake.vout[1].nValue = 42;
+        block.vtx[nIndex++] = MakeTransactionRef(txCoinStake);
+        block.vchBlockSig = InsecureRandBytes(72);
+    }
+
+    tx.vin[0].prevout.hash = InsecureRand256();
+    tx.vin[0].prevout.n = 0;
+    block.vtx[nIndex++] = MakeTransactionRef(tx);
+
+    tx.vin.resize(10);
+    for (size_t i = 0; i < tx.vin.size(); i++) {
+        tx.vin[i].prevout.hash = InsecureRand256();
+        tx.vin[i].prevout.n = 0;
+    }
+    block.vtx[nIndex++] = MakeTransactionRef(tx);
+
+    bool mutated;
+    block.hashMerkleRoot = BlockMerkleRoot(block, &mutated);
+    assert(!mutated);
+    return block;
+}
+
+static void RoundTripTest(bool fProofOfStake)
+{
+    CTxMemPool pool(CFeeRate(0));
+    TestMemPoolEntryHelper entry;
+    CBlock block(BuildBlockTestCase(fProofOfStake));
+    const size_t nPrefilled = fProofOfStake ? 2 : 1;
+    const size_t nMempoolTx = block.vtx.size() - 1;
+
+    // the last tx is in the mempool, the one before is missing
+    CMutableTransaction txMempool(*block.vtx[nMempoolTx]);
+    pool.addUnchecked(txMempool.GetHash(), entry.FromTx(txMempool));
+
+    // Do a simple ShortTxIDs RT
+    {
+        CBlockHeaderAndShortTxIDs shortIDs(block, false);
+        BOOST_CHECK_EQUAL(shortIDs.BlockTxCount(), block.vtx.size());
+
+        CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
+        stream << shortIDs;
+
+        CBlockHeaderAndShortTxIDs shortIDs2;
+        stream >> shortIDs2;
+        BOOST_CHECK(shortIDs2.vchBlockSig == block.vchBlockSig);
+        // the stake can be checked before the block is rebuilt
+        const CBlock blockStake = shortIDs2.GetStakeBlock();
+        BOOST_CHECK_EQUAL(blockStake.GetHash(), block.GetHash());
+        BOOST_CHECK_EQUAL(blockStake.vtx.size(), nPrefilled);
+        BOOST_CHECK_EQUAL(blockStake.IsProofOfStake(), fProofOfStake);
+
+        PartiallyDownloadedBlock partialBlock(&pool);
+        BOOST_CHECK(partialBlock.InitData(shortIDs2, extra_txn) == READ_STATUS_OK);
+        BOOST_CHECK_EQUAL(partialBlock.GetTxCount(), block.vtx.size());
+        // the coinbase (and the coinstake) are prefilled
+        for (size_t i = 0; i < nPrefilled; i++) {
+            BOOST_CHECK(partialBlock.IsTxAvailable(i));
+        }
+        BOOST_CHECK(!partialBlock.IsTxAvailable(nMempoolTx - 1));
+        BOOST_CHECK(partialBlock.IsTxAvailable(nMempoolTx));
+
+        // Wrong transaction
+        {
+            PartiallyDownloadedBlock tmp = partialBlock;
+            CBlock block2;
+            BOOST_CHECK(tmp.FillBlock(block2, {block.vtx[nMempoolTx]}) == READ_STATUS_CHECKBLOCK_FAILED); // Merkle root mismatch
+        }
+        // Too many transactions
+        {
+            PartiallyDownloadedBlock tmp = partialBlock;
+            CBlock block2;
+            BOOST_CHECK(tmp.FillBlock(block2, {block.vtx[nMempoolTx - 1], block.vtx[nMempoolTx]}) == READ_STATUS_INVALID);
+        }
+
+        CBlock block3;
+        BOOST_CHECK(partialBlock.FillBlock(block3, {block.vtx[nMempoolTx - 1]}) == READ_STATUS_OK);
+        BOOST_CHECK_EQUAL(block.GetHash().ToString(), block3.GetHash().ToString());
+        BOOST_CHECK_EQUAL(block.hashMerkleRoot.ToString(), BlockMerkleRoot(block3).ToString());
+        BOOST_CHECK(block3.vchBlockSig == block.vchBlockSig);
+        BOOST_CHECK(block3.IsProofOfStake() == fProofOfStake);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(SimpleRoundTripTest)
+{
+    RoundTripTest(false);
+}
+
+BOOST_AUTO_TEST_CASE(ProofOfStakeRoundTripTest)
+{
+    RoundTripTest(true);
+}
+
+BOOST_AUTO_TEST_CASE(EmptyBlockRoundTripTest)
+{
+    CTxMemPool pool(CFeeRate(0));
+    CMutableTransaction coinbase;
+    coinbase.vin.resize(1);
+    coinbase.vin[0].scriptSig.resize(10);
+    coinbase.vout.resize(1);
+    coinbase.vout[0].nValue = 42;
+
+    CBlock block;
+    block.vtx.resize(1);
+    block.vtx[0] = MakeTransactionRef(std::move(coinbase));
+    block.nVersion = CBlockHeader::CURRENT_VERSION;
+    block.hashPrevBlock = InsecureRand256();
+    block.nBits = 0x207fffff;
+
+    bool mutated;
+    block.hashMerkleRoot = BlockMerkleRoot(block, &mutated);
+    assert(!mutated);
+
+    // Test simple header round-trip with only coinbase
+    {
+        CBlockHeaderAndShortTxIDs shortIDs(block, false);
+
+        CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
+        stream << shortIDs;
+
+        CBlockHeaderAndShortTxIDs shortIDs2;
+        stream >> shortIDs2;
+
+        PartiallyDownloadedBlock partialBlock(&pool);
+        BOOST_CHECK(partialBlock.InitData(shortIDs2, extra_txn) == READ_STATUS_OK);
+        BOOST_CHECK(partialBlock.IsTxAvailable(0));
+
+        CBlock block2;
+        std::vector<CTransactionRef> vtx_missing;
+        BOOST_CHECK(partialBlock.FillBlock(block2, vtx_missing) == READ_STATUS_OK);
+        BOOST_CHECK_EQUAL(block.GetHash().ToString(), block2.GetHash().ToString());
+        BOOST_CHECK_EQUAL(block.hashMerkleRoot.ToString(), BlockMerkleRoot(block2).ToString());
+    }
+}
+
+BOOST_AUTO_TEST_CASE(PrefillShieldedRoundTripTest)
+{
+    CTxMemPool pool(CFeeRate(0));
+    CBlock block(BuildBlockTestCase(false));
+
+    // coinbase, transparent, shielded, transparent, shielded
+    CMutableTransaction txShielded;
+    txShielded.nVersion = CTransaction::TxVersion::SAPLING;
+    txShielded.vin.resize(1);
+    txShielded.vin[0].prevout.hash = InsecureRand256();
+    txShielded.sapData->valueBalance = 42;
+    CMutableTransaction txShielded2(txShielded);
+    txShielded2.vin[0].prevout.hash = InsecureRand256();
+    block.vtx.insert(block.vtx.begin() + 2, MakeTransactionRef(txShielded));
+    block.vtx.emplace_back(MakeTransactionRef(txShielded2));
+    BOOST_CHECK(block.vtx[2]->IsShieldedTx() && block.vtx[4]->IsShieldedTx());
+    bool mutated;
+    block.hashMerkleRoot = BlockMerkleRoot(block, &mutated);
+    assert(!mutated);
+
+    for (bool fPrefillShielded : {false, true}) {
+        CBlockHeaderAndShortTxIDs shortIDs(block, fPrefillShielded);
+        BOOST_CHECK_EQUAL(shortIDs.BlockTxCount(), block.vtx.size());
+
+        CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
+        stream << shortIDs;
+        CBlockHeaderAndShortTxIDs shortIDs2;
+        stream >> shortIDs2;
+
+        // nothing in the mempool: only the prefilled transactions are available
+        PartiallyDownloadedBlock partialBlock(&pool);
+        BOOST_CHECK(partialBlock.InitData(shortIDs2, extra_txn) == READ_STATUS_OK);
+        BOOST_CHECK_EQUAL(partialBlock.GetTxCount(), block.vtx.size());
+        std::vector<CTransactionRef> vMissing;
+        for (size_t i = 0; i < block.vtx.size(); i++) {
+            const bool fPrefilled = i == 0 || (fPrefillShielded && block.vtx[i]->IsShieldedTx());
+            BOOST_CHECK_EQUAL(partialBlock.IsTxAvailable(i), fPrefilled);
+            if (!fPrefilled) vMissing.emplace_back(block.vtx[i]);
+        }
+        BOOST_CHECK_EQUAL(vMissing.size(), fPrefillShielded ? 2 : 4);
+
+        CBlock block2;
+        BOOST_CHECK(partialBlock.FillBlock(block2, vMissing) == READ_STATUS_OK);
+        BOOST_CHECK_EQUAL(block.GetHash().ToString(), block2.GetHash().ToString());
+        BOOST_CHECK_EQUAL(block.hashMerkleRoot.ToString(), BlockMerkleRoot(block2).ToString());
+        BOOST_CHECK(block2.vtx[2]->IsShieldedTx() && block2.vtx[4]->IsShieldedTx());
+    }
+}
+
+BOOST_AUTO_TEST_CASE(TransactionsRequestSerializationTest)
+{
+    BlockTransactionsRequest req1;
+    req1.blockhash = InsecureRand256();
+    req1.indexes.resize(4);
+    req1.indexes[0] = 0;
+    req1.indexes[1] = 1;
+    req1.indexes[2] = 3;
+    req1.indexes[3] = 4;
+
+    CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
+    stream << req1;
+
+    BlockTransactionsRequest req2;
+    stream >> req2;
+
+    BOOST_CHECK_EQUAL(req1.blockhash.ToString(), req2.blockhash.ToString());
+    BOOST_CHECK_EQUAL(req1.indexes.size(), req2.indexes.size());
+    BOOST_CHECK_EQUAL(req1.indexes[0], req2.indexes[0]);
+    BOOST_CHECK_EQUAL(req1.indexes[1], req2.indexes[1]);
+    BOOST_CHECK_EQUAL(req1.indexes[2], req2.indexes[2]);
+    BOOST_CHECK_EQUAL(req1.indexes[3], req2.indexes[3]);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,128 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Copyright (c) 2021 The PIVX developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "test/test_pivx.h"
+
+#include "blockfilter.h"
+#include "random.h"
+#include "script/standard.h"
+#include "streams.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(blockfilter_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(gcsfilter_test)
+{
+    GCSFilter::ElementSet included_elements, excluded_elements;
+    for (int i = 0; i < 100; ++i) {
+        GCSFilter::Element element1(32);
+        element1[0] = i;
+        included_elements.insert(std::move(element1));
+
+        GCSFilter::Element element2(32);
+        element2[1] = i;
+        excluded_elements.insert(std::move(element2));
+    }
+
+    GCSFilter filter({0, 0, 10, 1 << 10}, included_elements);
+    for (const auto& element : included_elements) {
+        BOOST_CHECK(filter.Match(element));
+
+        auto insertion = excluded_elements.insert(element);
+        BOOST_CHECK(filter.MatchAny(excluded_elements));
+        excluded_elements.erase(insertion.first);
+    }
+
+    // Reconstructing the filter from its encoding yields the same filter
+    GCSFilter filter2(filter.GetParams(), filter.GetEncoded());
+    BOOST_CHECK_EQUAL(filter2.GetN(), filter.GetN());
+    for (const auto& element : included_elements) {
+        BOOST_CHECK(filter2.Match(element));
+    }
+
+    // An encoding with trailing data is rejected
+    std::vector<unsigned char> encoded = filter.GetEncoded();
+    encoded.push_back(0);
+    BOOST_CHECK_THROW(GCSFilter(filter.GetParams(), encoded), std::ios_base::failure);
+}
+
+BOOST_AUTO_TEST_CASE(gcsfilter_default_constructor)
+{
+    GCSFilter filter;
+    BOOST_CHECK_EQUAL(filter.GetN(), 0);
+    BOOST_CHECK_EQUAL(filter.GetEncoded().size(), 1);
+
+    const GCSFilter::Params& params = filter.GetParams();
+    BOOST_CHECK_EQUAL(params.m_siphash_k0, 0);
+    BOOST_CHECK_EQUAL(params.m_siphash_k1, 0);
+    BOOST_CHECK_EQUAL(params.m_P, 0);
+    BOOST_CHECK_EQUAL(params.m_M, 1);
+}
+
+BOOST_AUTO_TEST_CASE(blockfilter_basic_test)
+{
+    CKey stakerKey, ownerKey, key;
+    stakerKey.MakeNewKey(true);
+    ownerKey.MakeNewKey(true);
+    key.MakeNewKey(true);
+    const CKeyID stakerId = stakerKey.GetPubKey().GetID();
+    const CKeyID ownerId = ownerKey.GetPubKey().GetID();
+    const CScript p2pkh = GetScriptForDestination(key.GetPubKey().GetID());
+    const CScript p2cs = GetScriptForStakeDelegation(stakerId, ownerId);
+    const COutPoint spent(GetRandHash(), 3);
+
+    CMutableTransaction tx1;
+    tx1.vin.emplace_back(spent);
+    tx1.vout.emplace_back(100, p2pkh);
+    tx1.vout.emplace_back(200, p2cs);
+    tx1.vout.emplace_back(0, CScript() << OP_RETURN << std::vector<unsigned char>(4, 0x42));
+    tx1.vout.emplace_back(300, CScript());
+
+    CBlock block;
+    block.vtx.emplace_back(MakeTransactionRef(tx1));
+
+    BlockFilter block_filter(BlockFilterType::BASIC, block);
+    BOOST_CHECK_EQUAL(block_filter.GetBlockHash(), block.GetHash());
+    const GCSFilter& filter = block_filter.GetFilter();
+
+    // Output scripts, and the keys of the P2CS delegation as P2PKH
+    BOOST_CHECK(filter.Match(GCSFilter::Element(p2pkh.begin(), p2pkh.end())));
+    BOOST_CHECK(filter.Match(GCSFilter::Element(p2cs.begin(), p2cs.end())));
+    const CScript stakerScript = GetScriptForDestination(stakerId);
+    const CScript ownerScript = GetScriptForDestination(ownerId);
+    BOOST_CHECK(filter.Match(GCSFilter::Element(stakerScript.begin(), stakerScript.end())));
+    BOOST_CHECK(filter.Match(GCSFilter::Element(ownerScript.begin(), ownerScript.end())));
+    // Spent outpoints
+    BOOST_CHECK(filter.Match(BasicFilterOutPointElement(spent)));
+    // OP_RETURN and empty scripts are excluded
+    GCSFilter::ElementSet elements;
+    AddBasicFilterElements(CTransaction(tx1), elements);
+    BOOST_CHECK_EQUAL(elements.size(), 5);
+    BOOST_CHECK_EQUAL(filter.GetN(), 5);
+
+    // Serialization roundtrip
+    CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
+    stream << block_filter;
+    BlockFilter block_filter2;
+    stream >> block_filter2;
+    BOOST_CHECK(block_filter2.GetFilterType() == block_filter.GetFilterType());
+    BOOST_CHECK_EQUAL(block_filter2.GetBlockHash(), block_filter.GetBlockHash());
+    BOOST_CHECK(block_filter2.GetEncodedFilter() == block_filter.GetEncodedFilter());
+    BOOST_CHECK_EQUAL(block_filter2.ComputeHeader(UINT256_ZERO), block_filter.ComputeHeader(UINT256_ZERO));
+}
+
+BOOST_AUTO_TEST_CASE(blockfilter_type_names)
+{
+    BOOST_CHECK_EQUAL(BlockFilterTypeName(BlockFilterType::BASIC), "basic");
+    BOOST_CHECK_EQUAL(BlockFilterTypeName(static_cast<BlockFilterType>(255)), "");
+
+    BlockFilterType filter_type;
+    BOOST_CHECK(BlockFilterTypeByName("basic", filter_type));
+    BOOST_CHECK(filter_type == BlockFilterType::BASIC);
+    BOOST_CHECK(!BlockFilterTypeByName("unknown", filter_type));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
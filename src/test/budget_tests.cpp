@@ -290,4 +290,166 @@ BOOST_FIXTURE_TEST_CASE(IsCoinbaseValueValid_test, TestingSetup)
 
 }
 
+BOOST_AUTO_TEST_CASE(budget_vote_batch_sigcheck)
+{
+    std::vector<CKey> keys(10);
+    std::vector<CBudgetVote> votes;
+    for (size_t i = 0; i < keys.size(); i++) {
+        keys[i].MakeNewKey(true);
+        CBudgetVote vote(CTxIn(GetRandHash(), 0), GetRandHash(), CBudgetVote::VOTE_YES);
+        BOOST_CHECK(vote.Sign(keys[i], keys[i].GetPubKey().GetID()));
+        votes.emplace_back(vote);
+    }
+    // corrupt the last signature
+    std::vector<unsigned char> vchSig = votes.back().GetVchSig();
+    vchSig[10] ^= 0xff;
+    votes.back().SetVchSig(vchSig);
+
+    std::vector<CSignatureRecoveryCheck> vChecks;
+    for (const CBudgetVote& vote : votes) {
+        vChecks.emplace_back(vote.GetSignedHash(), vote.GetVchSig());
+    }
+    BatchRecoverSignatures(vChecks);
+
+    for (size_t i = 0; i < votes.size(); i++) {
+        BOOST_CHECK(IsMessageSignatureCached(votes[i].GetSignedHash(), votes[i].GetVchSig()));
+        // the cached signer is still checked against the expected key
+        BOOST_CHECK_EQUAL(votes[i].CheckSignature(keys[i].GetPubKey().GetID()), i != votes.size() - 1);
+        BOOST_CHECK(!votes[i].CheckSignature(keys[(i + 1) % keys.size()].GetPubKey().GetID()));
+    }
+}
+
+BOOST_AUTO_TEST_CASE(budget_votes_digest)
+{
+    const uint256& nProposalHash = GetRandHash();
+    std::map<COutPoint, CBudgetVote> mapVotes;
+    for (int i = 0; i < 100; i++) {
+        CBudgetVote vote(CTxIn(GetRandHash(), i), nProposalHash, CBudgetVote::VOTE_YES);
+        vote.SetValid(true);
+        mapVotes.emplace(vote.GetVin().prevout, vote);
+    }
+    CBudgetVotesDigest digest(nProposalHash, mapVotes);
+    BOOST_CHECK(digest.IsValid());
+    BOOST_CHECK(digest.vBuckets == CBudgetVotesDigest(nProposalHash, mapVotes).vBuckets);
+
+    // a peer missing one vote (or with a different one) differs only in the bucket of that voter
+    std::map<COutPoint, CBudgetVote> mapPeerVotes(mapVotes);
+    const COutPoint missingVoter = mapPeerVotes.begin()->first;
+    mapPeerVotes.erase(missingVoter);
+    auto it = std::next(mapPeerVotes.begin(), 50);
+    const COutPoint changedVoter = it->first;
+    it->second = CBudgetVote(CTxIn(changedVoter), nProposalHash, CBudgetVote::VOTE_NO);
+    it->second.SetValid(true);
+    CBudgetVotesDigest peerDigest(nProposalHash, mapPeerVotes);
+
+    size_t nToSend = 0;
+    for (const auto& vote : mapVotes) {
+        if (!digest.IsBucketSynced(peerDigest, vote.first)) nToSend++;
+    }
+    BOOST_CHECK(!digest.IsBucketSynced(peerDigest, missingVoter));
+    BOOST_CHECK(!digest.IsBucketSynced(peerDigest, changedVoter));
+    BOOST_CHECK(nToSend < mapVotes.size());
+
+    // invalid votes are not part of the digest
+    mapPeerVotes.emplace(missingVoter, mapVotes.at(missingVoter));
+    mapPeerVotes.at(missingVoter).SetValid(false);
+    BOOST_CHECK(!CBudgetVotesDigest(nProposalHash, mapPeerVotes).IsBucketSynced(digest, missingVoter));
+
+    // malformed digests never match
+    CBudgetVotesDigest emptyDigest;
+    BOOST_CHECK(!digest.IsBucketSynced(emptyDigest, missingVoter));
+}
+
+BOOST_AUTO_TEST_CASE(budget_vote_tallies)
+{
+    CBudgetProposal prop("test", "https://test.com", 1, CScript() << OP_TRUE, 10 * COIN, 0, UINT256_ZERO);
+    const uint256& nPropHash = prop.GetHash();
+    const int64_t nTime = GetAdjustedTime() - 2 * BUDGET_VOTE_UPDATE_MIN;
+    std::string strError;
+
+    std::vector<CTxIn> voters;
+    for (int i = 0; i < 9; i++) {
+        voters.emplace_back(GetRandHash(), i);
+        CBudgetVote vote(voters.back(), nPropHash, (CBudgetVote::VoteDirection) (i % 3));
+        vote.SetTime(nTime);
+        BOOST_CHECK(prop.AddOrUpdateVote(vote, strError));
+    }
+    BOOST_CHECK_EQUAL(prop.GetAbstains(), 3);
+    BOOST_CHECK_EQUAL(prop.GetYeas(), 3);
+    BOOST_CHECK_EQUAL(prop.GetNays(), 3);
+
+    // replaced votes move between the tallies
+    CBudgetVote vote(voters[0], nPropHash, CBudgetVote::VOTE_YES);
+    vote.SetTime(nTime + BUDGET_VOTE_UPDATE_MIN);
+    BOOST_CHECK(prop.AddOrUpdateVote(vote, strError));
+    // rejected updates don't change them
+    vote = CBudgetVote(voters[1], nPropHash, CBudgetVote::VOTE_NO);
+    vote.SetTime(nTime + 1);
+    BOOST_CHECK(!prop.AddOrUpdateVote(vote, strError));
+    // invalid votes are not counted
+    vote = CBudgetVote(CTxIn(GetRandHash(), 0), nPropHash, CBudgetVote::VOTE_NO);
+    vote.SetTime(nTime);
+    vote.SetValid(false);
+    BOOST_CHECK(prop.AddOrUpdateVote(vote, strError));
+    BOOST_CHECK_EQUAL(prop.GetAbstains(), 2);
+    BOOST_CHECK_EQUAL(prop.GetYeas(), 4);
+    BOOST_CHECK_EQUAL(prop.GetNays(), 3);
+    BOOST_CHECK_EQUAL(prop.GetNetYeas(), 1);
+
+    // the tallies are rebuilt when the proposal is read from disk
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << prop;
+    CBudgetProposal prop2;
+    ss >> prop2;
+    // (the validity of the votes isn't serialized)
+    BOOST_CHECK_EQUAL(prop2.GetAbstains(), 2);
+    BOOST_CHECK_EQUAL(prop2.GetYeas(), 4);
+    BOOST_CHECK_EQUAL(prop2.GetNays(), 4);
+}
+
+BOOST_AUTO_TEST_CASE(budget_snapshot)
+{
+    CBudgetManager budgetman;
+    std::string strError;
+    const CTxBudgetPayment txBudgetPayment(GetRandHash(), CScript() << OP_TRUE, 100 * COIN);
+    CFinalizedBudget fin("main (test)", 144, {txBudgetPayment}, GetRandHash());
+    const uint256& nBudgetHash = fin.GetHash();
+    budgetman.ForceAddFinalizedBudget(nBudgetHash, fin.GetFeeTXHash(), fin);
+
+    budgetman.PublishSnapshot();
+    const auto& snapshot1 = budgetman.GetSnapshot();
+    BOOST_CHECK_EQUAL(snapshot1->nVersion, 1);
+    BOOST_CHECK_EQUAL(snapshot1->vFinalizedBudgets.size(), 1);
+    BOOST_CHECK(snapshot1->FindFinalizedBudget(nBudgetHash) != nullptr);
+    BOOST_CHECK_EQUAL(snapshot1->FindFinalizedBudget(nBudgetHash)->GetVoteCount(), 0);
+    // the paid proposal is unknown
+    BOOST_CHECK(snapshot1->GetFinalizedBudgetStatus(fin) != "OK");
+
+    // nothing changed: nothing is published
+    budgetman.PublishSnapshot();
+    BOOST_CHECK(budgetman.GetSnapshot() == snapshot1);
+    // unchanged items are shared between snapshots
+    budgetman.PublishSnapshot(true);
+    const auto& snapshot2 = budgetman.GetSnapshot();
+    BOOST_CHECK_EQUAL(snapshot2->nVersion, 2);
+    BOOST_CHECK(snapshot2->FindFinalizedBudget(nBudgetHash) == snapshot1->FindFinalizedBudget(nBudgetHash));
+
+    // a new vote is published with a new copy, the old snapshot is untouched
+    CFinalizedBudgetVote vote(CTxIn(GetRandHash(), 0), nBudgetHash);
+    BOOST_CHECK(budgetman.UpdateFinalizedBudget(vote, nullptr, strError));
+    BOOST_CHECK(budgetman.GetSnapshot() == snapshot2);
+    budgetman.PublishSnapshot();
+    const auto& snapshot3 = budgetman.GetSnapshot();
+    BOOST_CHECK_EQUAL(snapshot3->nVersion, 3);
+    BOOST_CHECK_EQUAL(snapshot3->FindFinalizedBudget(nBudgetHash)->GetVoteCount(), 1);
+    BOOST_CHECK_EQUAL(snapshot2->FindFinalizedBudget(nBudgetHash)->GetVoteCount(), 0);
+
+    // removed items disappear from the next snapshot
+    budgetman.Clear();
+    budgetman.PublishSnapshot();
+    BOOST_CHECK(budgetman.GetSnapshot()->vFinalizedBudgets.empty());
+    BOOST_CHECK(budgetman.GetSnapshot()->FindFinalizedBudget(nBudgetHash) == nullptr);
+    BOOST_CHECK(budgetman.GetSnapshot()->FindProposalByName("test") == nullptr);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
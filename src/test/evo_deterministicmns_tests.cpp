@@ -555,8 +555,89 @@ BOOST_FIXTURE_TEST_CASE(dip3_protx, TestChain400Setup)
         ProcessNewBlock(state, std::make_shared<const CBlock>(block), nullptr);
         BOOST_CHECK_EQUAL(chainActive.Height(), nHeight);   // bad block not connected
     }
+    // Rebuild the historical lists with a cold cache, a short checkpoint interval and a tiny memory cap
+    {
+        CDeterministicMNManager coldManager(*evoDb, 3, 1);
+        for (int h = nHeight; h >= Params().GetConsensus().vUpgrades[Consensus::UPGRADE_V6_0].nActivationHeight; h--) {
+            const CBlockIndex* pindex = WITH_LOCK(cs_main, return chainActive[h]; );
+            const auto& expected = deterministicMNManager->GetListForBlock(pindex);
+            const auto& rebuilt = coldManager.GetListForBlock(pindex);
+            BOOST_CHECK(rebuilt.GetBlockHash() == pindex->GetBlockHash());
+            BOOST_CHECK(::SerializeHash(rebuilt) == ::SerializeHash(expected));
+        }
+    }
 
     UpdateNetworkUpgradeParameters(Consensus::UPGRADE_V6_0, Consensus::NetworkUpgrade::NO_ACTIVATION_HEIGHT);
 }
 
+static std::vector<CDeterministicMNCPtr> SortedValidMNs(const CDeterministicMNList& mnList)
+{
+    std::vector<CDeterministicMNCPtr> result;
+    mnList.ForEachMN(true, [&](const CDeterministicMNCPtr& dmn) { result.emplace_back(dmn); });
+    std::sort(result.begin(), result.end(), [](const CDeterministicMNCPtr& a, const CDeterministicMNCPtr& b) {
+        auto lastPaid = [](const CDeterministicMNState& s) {
+            if (s.nPoSeRevivedHeight != -1 && s.nPoSeRevivedHeight > s.nLastPaidHeight) return s.nPoSeRevivedHeight;
+            return s.nLastPaidHeight == 0 ? s.nRegisteredHeight : s.nLastPaidHeight;
+        };
+        const int ah = lastPaid(*a->pdmnState), bh = lastPaid(*b->pdmnState);
+        return ah == bh ? a->proTxHash < b->proTxHash : ah < bh;
+    });
+    return result;
+}
+
+BOOST_FIXTURE_TEST_CASE(dmnlist_payment_queue, BasicTestingSetup)
+{
+    CDeterministicMNList mnList(UINT256_ZERO, 0, 0);
+    for (uint64_t i = 0; i < 50; i++) {
+        auto dmn = std::make_shared<CDeterministicMN>(i);
+        dmn->proTxHash = InsecureRand256();
+        dmn->collateralOutpoint = COutPoint(InsecureRand256(), 0);
+        auto state = std::make_shared<CDeterministicMNState>();
+        state->nRegisteredHeight = InsecureRandRange(20);
+        state->keyIDOwner = CKeyID(uint160(InsecureRandBytes(20)));
+        state->keyIDOperator = CKeyID(uint160(InsecureRandBytes(20)));
+        dmn->pdmnState = state;
+        mnList.AddMN(dmn);
+    }
+
+    for (int nHeight = 20; nHeight < 300; nHeight++) {
+        // pay the projected payee, and randomly ban, revive or remove masternodes
+        auto payee = mnList.GetMNPayee();
+        if (payee) {
+            auto newState = std::make_shared<CDeterministicMNState>(*payee->pdmnState);
+            newState->nLastPaidHeight = nHeight;
+            mnList.UpdateMN(payee->proTxHash, newState);
+        }
+
+        std::vector<CDeterministicMNCPtr> all;
+        mnList.ForEachMN(false, [&](const CDeterministicMNCPtr& dmn) { all.emplace_back(dmn); });
+        const auto& dmn = all[InsecureRandRange(all.size())];
+        switch (InsecureRandRange(4)) {
+        case 0: {
+            auto s = std::make_shared<CDeterministicMNState>(*dmn->pdmnState);
+            s->nPoSeBanHeight = s->nPoSeBanHeight == -1 ? nHeight : -1;
+            if (s->nPoSeBanHeight == -1) s->nPoSeRevivedHeight = nHeight;
+            mnList.UpdateMN(dmn->proTxHash, s);
+            break;
+        }
+        case 1:
+            if (all.size() > 10) mnList.RemoveMN(dmn->proTxHash);
+            break;
+        default:
+            break;
+        }
+
+        const auto expected = SortedValidMNs(mnList);
+        BOOST_CHECK_EQUAL(mnList.GetValidMNsCount(), expected.size());
+        const auto projected = mnList.GetProjectedMNPayees(expected.size() + 5);
+        BOOST_REQUIRE_EQUAL(projected.size(), expected.size());
+        for (size_t i = 0; i < expected.size(); i++) {
+            BOOST_CHECK(projected[i]->proTxHash == expected[i]->proTxHash);
+        }
+        if (!expected.empty()) {
+            BOOST_CHECK(mnList.GetMNPayee()->proTxHash == expected[0]->proTxHash);
+        }
+    }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
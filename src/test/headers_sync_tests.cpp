@@ -0,0 +1,242 @@
+// Copyright (c) 2021 The PIVX developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "test/test_pivx.h"
+
+#include "blockassembler.h"
+#include "blocksignature.h"
+#include "consensus/merkle.h"
+#include "consensus/validation.h"
+#include "net_processing.h"
+#include "validation.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(headers_sync_tests, TestChain100Setup)
+
+// Block building on pindexPrev (not necessarily the tip), without its proof of work
+static std::shared_ptr<CBlock> Block(const CBlockIndex* pindexPrev, const CScript& scriptPubKey)
+{
+    auto pblock = std::make_shared<CBlock>(BlockAssembler(Params(), false).CreateNewBlock(scriptPubKey)->block);
+    pblock->hashPrevBlock = pindexPrev->GetBlockHash();
+    pblock->nTime = pindexPrev->nTime + 60;
+    pblock->nBits = pindexPrev->nBits;
+
+    CMutableTransaction txCoinbase(*pblock->vtx[0]);
+    txCoinbase.vin[0].scriptSig = CScript() << (pindexPrev->nHeight + 1) << OP_0;
+    pblock->vtx[0] = MakeTransactionRef(std::move(txCoinbase));
+    return pblock;
+}
+
+// Chain of nBlocks valid PoW blocks on top of the tip
+static std::vector<std::shared_ptr<const CBlock>> BuildChain(int nBlocks, const CScript& scriptPubKey)
+{
+    std::vector<std::shared_ptr<const CBlock>> vBlocks;
+    CBlockIndex* pindexPrev = WITH_LOCK(cs_main, return chainActive.Tip(); );
+    // the entries of the previous blocks of the chain, not in the block index
+    std::vector<std::unique_ptr<CBlockIndex>> vIndexes;
+    std::vector<uint256> vHashes(nBlocks);
+    for (int i = 0; i < nBlocks; i++) {
+        auto pblock = FinalizeBlock(Block(pindexPrev, scriptPubKey));
+        vHashes[i] = pblock->GetHash();
+        vIndexes.emplace_back(new CBlockIndex(*pblock));
+        vIndexes.back()->phashBlock = &vHashes[i];
+        vIndexes.back()->pprev = pindexPrev;
+        vIndexes.back()->nHeight = pindexPrev->nHeight + 1;
+        pindexPrev = vIndexes.back().get();
+        vBlocks.emplace_back(pblock);
+    }
+    return vBlocks;
+}
+
+static std::vector<CBlockHeader> Headers(const std::vector<std::shared_ptr<const CBlock>>& vBlocks)
+{
+    std::vector<CBlockHeader> vHeaders;
+    for (const auto& pblock : vBlocks) {
+        vHeaders.emplace_back(pblock->GetBlockHeader());
+    }
+    return vHeaders;
+}
+
+static CBlockIndex* LookupIndex(const uint256& hash)
+{
+    LOCK(cs_main);
+    BlockMap::iterator mi = mapBlockIndex.find(hash);
+    return mi != mapBlockIndex.end() ? mi->second : nullptr;
+}
+
+BOOST_AUTO_TEST_CASE(block_needs_parent_data)
+{
+    const CScript scriptPubKey = CScript() << ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+    const auto vBlocks = BuildChain(2, scriptPubKey);
+
+    CValidationState state;
+    BOOST_CHECK(ProcessNewBlockHeaders(Headers(vBlocks), state));
+    CBlockIndex* pindex1 = LookupIndex(vBlocks[0]->GetHash());
+    CBlockIndex* pindex2 = LookupIndex(vBlocks[1]->GetHash());
+    BOOST_REQUIRE(pindex1 && pindex2);
+    BOOST_CHECK(!(pindex1->nStatus & BLOCK_HAVE_DATA));
+    // no stake modifier until the block is received
+    BOOST_CHECK(pindex1->vStakeModifier.empty());
+
+    // The child is refused while its parent is known by its header only, without being marked invalid
+    BOOST_CHECK(!ProcessNewBlock(state, vBlocks[1], nullptr));
+    BOOST_CHECK_EQUAL(state.GetRejectReason(), "prevblk-not-received");
+    int nDoS;
+    BOOST_CHECK(state.IsInvalid(nDoS) && nDoS == 0);
+    BOOST_CHECK(!(pindex2->nStatus & (BLOCK_HAVE_DATA | BLOCK_FAILED_MASK)));
+
+    // and accepted once the parent is connected
+    state = CValidationState();
+    BOOST_CHECK(ProcessNewBlock(state, vBlocks[0], nullptr));
+    BOOST_CHECK(!pindex1->vStakeModifier.empty());
+    BOOST_CHECK(ProcessNewBlock(state, vBlocks[1], nullptr));
+    BOOST_CHECK_EQUAL(WITH_LOCK(cs_main, return chainActive.Tip()), pindex2);
+}
+
+BOOST_AUTO_TEST_CASE(headers_then_blocks_out_of_order)
+{
+    const CScript scriptPubKey = CScript() << ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+    const auto vBlocks = BuildChain(8, scriptPubKey);
+
+    // Reference: the stake modifiers set connecting the blocks in order
+    std::vector<uint256> vHashes;
+    std::vector<std::unique_ptr<CBlockIndex>> vExpected;
+    vHashes.reserve(vBlocks.size());
+    CBlockIndex* pindexPrev = WITH_LOCK(cs_main, return chainActive.Tip(); );
+    for (const auto& pblock : vBlocks) {
+        vHashes.emplace_back(pblock->GetHash());
+        vExpected.emplace_back(new CBlockIndex(*pblock));
+        vExpected.back()->phashBlock = &vHashes.back();
+        vExpected.back()->pprev = pindexPrev;
+        vExpected.back()->nHeight = pindexPrev->nHeight + 1;
+        vExpected.back()->SetNewStakeModifier();
+        pindexPrev = vExpected.back().get();
+    }
+
+    // Headers first: the PoW headers move the best header
+    CValidationState state;
+    CBlockIndex* pindexLast = nullptr;
+    BOOST_CHECK(ProcessNewBlockHeaders(Headers(vBlocks), state, &pindexLast));
+    BOOST_REQUIRE(pindexLast);
+    BOOST_CHECK_EQUAL(pindexLast->GetBlockHash(), vBlocks.back()->GetHash());
+    BOOST_CHECK_EQUAL(WITH_LOCK(cs_main, return pindexBestHeader), pindexLast);
+
+    // Then the blocks, in reverse order: they wait for their parent
+    {
+        LOCK(cs_main);
+        for (size_t i = vBlocks.size() - 1; i > 0; i--) {
+            BOOST_CHECK(StoreBlockWaitingParent(vBlocks[i], -1, true));
+        }
+        // already waiting
+        BOOST_CHECK(StoreBlockWaitingParent(vBlocks.back(), -1, true));
+        // the parent of the first one is connected
+        BOOST_CHECK(!StoreBlockWaitingParent(vBlocks[0], -1, true));
+    }
+    BOOST_CHECK(ProcessNewBlock(state, vBlocks[0], nullptr));
+    ProcessBlocksWaitingParent(vBlocks[0]->GetHash());
+    BOOST_CHECK_EQUAL(WITH_LOCK(cs_main, return chainActive.Tip()), pindexLast);
+
+    // The deferred stake modifiers are the ones set in order
+    for (size_t i = 0; i < vBlocks.size(); i++) {
+        CBlockIndex* pindex = LookupIndex(vHashes[i]);
+        BOOST_REQUIRE(pindex);
+        BOOST_CHECK(pindex->nStatus & BLOCK_HAVE_DATA);
+        BOOST_CHECK(pindex->vStakeModifier == vExpected[i]->vStakeModifier);
+        BOOST_CHECK_EQUAL(pindex->GeneratedStakeModifier(), vExpected[i]->GeneratedStakeModifier());
+        BOOST_CHECK_EQUAL(pindex->GetStakeEntropyBit(), vExpected[i]->GetStakeEntropyBit());
+    }
+}
+
+BOOST_AUTO_TEST_CASE(unrequested_blocks_waiting_parent)
+{
+    const CScript scriptPubKey = CScript() << ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+    const auto vBlocks = BuildChain(3, scriptPubKey);
+
+    // Only the headers of the first two blocks are known
+    CValidationState state;
+    BOOST_CHECK(ProcessNewBlockHeaders(Headers({vBlocks[0], vBlocks[1]}), state));
+    {
+        LOCK(cs_main);
+        // not requested from the peer
+        BOOST_CHECK(StoreBlockWaitingParent(vBlocks[1], -1, false));
+        // requested, but its header is unknown
+        BOOST_CHECK(StoreBlockWaitingParent(vBlocks[2], -1, true));
+    }
+
+    // Both were dropped: only the parent is connected
+    BOOST_CHECK(ProcessNewBlock(state, vBlocks[0], nullptr));
+    ProcessBlocksWaitingParent(vBlocks[0]->GetHash());
+    BOOST_CHECK_EQUAL(WITH_LOCK(cs_main, return chainActive.Tip()->GetBlockHash()), vBlocks[0]->GetHash());
+}
+
+BOOST_AUTO_TEST_CASE(unverified_pos_headers)
+{
+    // PoS from the next block
+    const int nPosActivation = Params().GetConsensus().vUpgrades[Consensus::UPGRADE_POS].nActivationHeight;
+    const int nTipHeight = WITH_LOCK(cs_main, return chainActive.Height(); );
+    UpdateNetworkUpgradeParameters(Consensus::UPGRADE_POS, nTipHeight + 1);
+    const CScript scriptPubKey = CScript() << ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+    CBlockIndex* pindexTip = WITH_LOCK(cs_main, return chainActive.Tip(); );
+
+    // Block with a coinstake spending an unknown output, correctly signed
+    auto pblock = Block(pindexTip, scriptPubKey);
+    CMutableTransaction txCoinStake;
+    txCoinStake.vin.emplace_back(COutPoint(InsecureRand256(), 0));
+    txCoinStake.vout.emplace_back();
+    txCoinStake.vout[0].SetEmpty();
+    txCoinStake.vout.emplace_back(250 * COIN, scriptPubKey);
+    pblock->vtx.emplace_back(MakeTransactionRef(txCoinStake));
+    pblock->hashMerkleRoot = BlockMerkleRoot(*pblock);
+    BOOST_REQUIRE(SignBlockWithKey(*pblock, coinbaseKey));
+    BOOST_REQUIRE(pblock->IsProofOfStake());
+
+    // Its header doesn't move the best header
+    CValidationState state;
+    BOOST_CHECK(ProcessNewBlockHeaders({pblock->GetBlockHeader()}, state));
+    CBlockIndex* pindex = LookupIndex(pblock->GetHash());
+    BOOST_REQUIRE(pindex);
+    BOOST_CHECK_EQUAL(WITH_LOCK(cs_main, return pindexBestHeader), pindexTip);
+
+    // The stake is rejected, but the failure depends on the context: the entry isn't marked invalid
+    BOOST_CHECK(!ProcessNewBlock(state, pblock, nullptr));
+    int nDoS;
+    BOOST_CHECK(state.IsInvalid(nDoS) && nDoS == 100);
+    BOOST_CHECK(!(pindex->nStatus & (BLOCK_HAVE_DATA | BLOCK_FAILED_MASK)));
+    BOOST_CHECK_EQUAL(WITH_LOCK(cs_main, return chainActive.Tip()), pindexTip);
+    BOOST_CHECK_EQUAL(WITH_LOCK(cs_main, return pindexBestHeader), pindexTip);
+
+    // It stays unverified (not written to disk) until pruned
+    BOOST_CHECK(WITH_LOCK(cs_main, return IsUnverifiedHeader(pindex); ));
+    WITH_LOCK(cs_main, EraseUnverifiedHeaders({pindex}); );
+    BOOST_CHECK(!LookupIndex(pblock->GetHash()));
+
+    // Headers too far ahead of the tip are not stored (checking the block index for each one is too slow here)
+    fCheckBlockIndex = false;
+    std::vector<CBlockHeader> vHeaders;
+    uint256 hashPrev = pindexTip->GetBlockHash();
+    for (int i = 0; i < MAX_HEADERS_AHEAD_OF_TIP + 1; i++) {
+        CBlockHeader header;
+        header.hashPrevBlock = hashPrev;
+        header.hashMerkleRoot = InsecureRand256();
+        header.nTime = pindexTip->nTime + 60 * (i + 1);
+        header.nBits = pindexTip->nBits;
+        vHeaders.emplace_back(header);
+        hashPrev = header.GetHash();
+    }
+    state = CValidationState();
+    CBlockIndex* pindexLast = nullptr;
+    BOOST_CHECK(!ProcessNewBlockHeaders(vHeaders, state, &pindexLast));
+    fCheckBlockIndex = true;
+    BOOST_CHECK_EQUAL(state.GetRejectReason(), "headers-too-far-ahead");
+    BOOST_CHECK(state.IsInvalid(nDoS) && nDoS == 0);
+    BOOST_REQUIRE(pindexLast);
+    BOOST_CHECK_EQUAL(pindexLast->nHeight, nTipHeight + MAX_HEADERS_AHEAD_OF_TIP);
+    BOOST_CHECK(!LookupIndex(vHeaders.back().GetHash()));
+    BOOST_CHECK_EQUAL(WITH_LOCK(cs_main, return pindexBestHeader), pindexTip);
+
+    UpdateNetworkUpgradeParameters(Consensus::UPGRADE_POS, nPosActivation);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
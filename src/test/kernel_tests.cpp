@@ -0,0 +1,83 @@
+// Copyright (c) 2021 The PIVX developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "test/test_pivx.h"
+
+#include "amount.h"
+#include "chain.h"
+#include "kernel.h"
+#include "stakeinput.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(kernel_tests, RegTestingSetup)
+
+BOOST_AUTO_TEST_CASE(stake_kernel_search_matches_kernel_check)
+{
+    // Parent of the staked block, with the stake modifier v2 enforced
+    const uint256 hashPrev = InsecureRand256();
+    CBlockIndex indexPrev;
+    indexPrev.phashBlock = &hashPrev;
+    indexPrev.nHeight = Params().GetConsensus().vUpgrades[Consensus::UPGRADE_V3_4].nActivationHeight + 100;
+    indexPrev.SetStakeModifier(InsecureRand256());
+    BOOST_CHECK(CStakeKernelSearch::IsSupported(&indexPrev));
+
+    // Blocks of the stake inputs
+    std::vector<CBlockIndex> vIndexFrom(4);
+    for (size_t i = 0; i < vIndexFrom.size(); i++) {
+        vIndexFrom[i].nHeight = (int)i + 1;
+        vIndexFrom[i].nTime = 1600000000 + InsecureRandRange(1000000);
+    }
+
+    // Difficulty giving roughly one hit every two hashes for a 100 PIV input
+    const CAmount nBaseValue = 100 * COIN;
+    arith_uint256 bnTarget = UintToArith256(uint256S("7fffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffff"));
+    bnTarget /= arith_uint256(nBaseValue / 100);
+    const unsigned int nBits = bnTarget.GetCompact();
+
+    CStakeKernelSearch search(&indexPrev, nBits);
+    BOOST_CHECK(search.IsPreparedFor(&indexPrev, nBits));
+    std::vector<std::unique_ptr<CPivStake>> vStakes;
+    for (size_t i = 0; i < 40; i++) {
+        const COutPoint outpoint(InsecureRand256(), (uint32_t)InsecureRandRange(10));
+        // values from 1/4 to 1 time the base value (the weighted target must not overflow)
+        const CAmount nValue = nBaseValue / 4 + (CAmount)InsecureRandRange(3 * nBaseValue / 4);
+        const CBlockIndex* pindexFrom = &vIndexFrom[i % vIndexFrom.size()];
+        vStakes.emplace_back(new CPivStake(CTxOut(nValue, CScript()), outpoint, pindexFrom));
+        search.AddCandidate(outpoint, pindexFrom, nValue);
+    }
+    BOOST_CHECK_EQUAL(search.Size(), vStakes.size());
+
+    int nHits = 0, nMisses = 0;
+    const int nTimeStart = 1610000000;
+    for (int nTimeTx = nTimeStart; nTimeTx < nTimeStart + 10 * 16; nTimeTx += 16) {
+        size_t nFirstHit = vStakes.size();
+        for (size_t i = 0; i < vStakes.size(); i++) {
+            CStakeKernel kernel(&indexPrev, vStakes[i].get(), nBits, nTimeTx);
+            const bool fHit = kernel.CheckKernelHash(true);
+            // The cached midstate gives the same answer as the full kernel hash
+            BOOST_CHECK_EQUAL(search.FindKernel(nTimeTx, i, i + 1) == i, fHit);
+            if (fHit) {
+                nHits++;
+                if (nFirstHit == vStakes.size()) nFirstHit = i;
+            } else {
+                nMisses++;
+            }
+        }
+        // The batch search returns the first kernel found, or the end of the range
+        BOOST_CHECK_EQUAL(search.FindKernel(nTimeTx, 0, vStakes.size()), nFirstHit);
+    }
+    // Both paths were exercised
+    BOOST_CHECK(nHits > 0);
+    BOOST_CHECK(nMisses > 0);
+
+    // A different tip or difficulty needs a new engine
+    CBlockIndex indexOther(indexPrev);
+    const uint256 hashOther = InsecureRand256();
+    indexOther.phashBlock = &hashOther;
+    BOOST_CHECK(!search.IsPreparedFor(&indexOther, nBits));
+    BOOST_CHECK(!search.IsPreparedFor(&indexPrev, nBits + 1));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
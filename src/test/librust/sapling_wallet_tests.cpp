@@ -174,6 +174,51 @@ BOOST_AUTO_TEST_CASE(FindMySaplingNotes)
     BOOST_CHECK_EQUAL(2, noteMap.size());
 }
 
+BOOST_AUTO_TEST_CASE(FindMySaplingNotesManyKeys)
+{
+    auto consensusParams = Params().GetConsensus();
+
+    CWallet& wallet = *pwalletMain;
+    LOCK(wallet.cs_wallet);
+    wallet.SetupSPKM(false);
+
+    // Add enough keys to split the trial decryption of each output in several jobs
+    auto sk = GetTestMasterSaplingSpendingKey();
+    std::vector<libzcash::SaplingExtendedSpendingKey> vKeys;
+    for (uint32_t i = 0; i < 40; i++) {
+        vKeys.emplace_back(sk.Derive(i | ZIP32_HARDENED_KEY_LIMIT));
+        BOOST_CHECK(wallet.AddSaplingZKey(vKeys.back()));
+    }
+    const auto& skTo = vKeys[25];
+
+    // Pay one of them (the change goes to the master key, which is not in the wallet)
+    auto testNote = GetTestSaplingNote(sk.DefaultAddress(), 50000000);
+    auto builder = TransactionBuilder(consensusParams, 1);
+    builder.AddSaplingSpend(sk.expsk, testNote.note, testNote.tree.root(), testNote.tree.witness());
+    builder.AddSaplingOutput(sk.ToXFVK().fvk.ovk, skTo.DefaultAddress(), 25000000, {});
+    builder.SetFee(10000000);
+    auto tx = builder.Build().GetTxOrThrow();
+
+    // Start the trial decryption workers, as init does with -par (interrupted with the fixture threads)
+    for (int i = 0; i < 2; i++) {
+        threadGroup.create_thread(&ThreadSaplingTrialDecryption);
+    }
+
+    // Same result with the serial and the parallel trial decryption (repeated, to vary the interleaving)
+    const int nScriptCheckThreadsPrev = nScriptCheckThreads;
+    for (int nThreads : {0, 2, 2, 2, 2, 2}) {
+        nScriptCheckThreads = nThreads;
+        auto noteMap = wallet.GetSaplingScriptPubKeyMan()->FindMySaplingNotes(tx).first;
+        BOOST_CHECK_EQUAL(1, noteMap.size());
+        for (const auto& it : noteMap) {
+            BOOST_CHECK(it.second.ivk == skTo.ToXFVK().fvk.in_viewing_key());
+            BOOST_CHECK(it.second.address == skTo.DefaultAddress());
+            BOOST_CHECK_EQUAL(*it.second.amount, 25000000);
+        }
+    }
+    nScriptCheckThreads = nScriptCheckThreadsPrev;
+}
+
 // Generate note A and spend to create note B, from which we spend to create two conflicting transactions
 BOOST_AUTO_TEST_CASE(GetConflictedSaplingNotes)
 {
@@ -909,6 +954,104 @@ BOOST_AUTO_TEST_CASE(ClearNoteWitnessCache)
     BOOST_CHECK_EQUAL(0, wallet.GetSaplingScriptPubKeyMan()->nWitnessCacheSize);
 }
 
+// Check the wallet witnesses of the notes against the ones built from scratch
+// with the first nCommitments commitments of the chain.
+static void CheckWitnessesMatchTree(CWallet& wallet,
+                                    const std::vector<SaplingOutPoint>& saplingNotes,
+                                    const std::vector<size_t>& vNotePositions,
+                                    const std::vector<uint256>& vCommitments,
+                                    size_t nCommitments)
+{
+    SaplingMerkleTree tree;
+    std::vector<Optional<SaplingWitness>> expected(saplingNotes.size());
+    for (size_t i = 0; i < nCommitments; i++) {
+        tree.append(vCommitments[i]);
+        for (size_t j = 0; j < saplingNotes.size(); j++) {
+            if (vNotePositions[j] < i) {
+                expected[j]->append(vCommitments[i]);
+            } else if (vNotePositions[j] == i) {
+                expected[j] = tree.witness();
+            }
+        }
+    }
+
+    std::vector<Optional<SaplingWitness>> saplingWitnesses;
+    uint256 anchor = GetWitnessesAndAnchors(wallet, saplingNotes, saplingWitnesses);
+    BOOST_CHECK_EQUAL(saplingWitnesses.size(), saplingNotes.size());
+    for (size_t j = 0; j < saplingNotes.size(); j++) {
+        BOOST_CHECK_EQUAL((bool) saplingWitnesses[j], (bool) expected[j]);
+        if (saplingWitnesses[j] && expected[j]) {
+            BOOST_CHECK_EQUAL(saplingWitnesses[j]->position(), expected[j]->position());
+            BOOST_CHECK(saplingWitnesses[j]->root() == expected[j]->root());
+        }
+    }
+    if (nCommitments > 0) {
+        BOOST_CHECK(anchor == tree.root());
+    }
+}
+
+BOOST_AUTO_TEST_CASE(IndexedWitnessesMatchTree)
+{
+    libzcash::SaplingExtendedSpendingKey sk = GetTestMasterSaplingSpendingKey();
+    // Notes sent to this key are not ours, but are part of the tree
+    libzcash::SaplingExtendedSpendingKey skOther = sk.Derive(1 | ZIP32_HARDENED_KEY_LIMIT);
+    CWallet& wallet = *pwalletMain;
+    {
+        LOCK(wallet.cs_wallet);
+        setupWallet(wallet);
+        BOOST_CHECK(wallet.AddSaplingZKey(sk));
+    }
+
+    const size_t numBlocks = 6;
+    std::vector<CBlock> blocks(numBlocks);
+    std::vector<CBlockIndex> indices(numBlocks);
+    std::vector<SaplingMerkleTree> trees;       // tree before each block
+    std::vector<size_t> vBlockEnd;              // commitments in the chain after each block
+    std::vector<uint256> vCommitments;          // all the commitments, in chain order
+    std::vector<SaplingOutPoint> saplingNotes;  // our notes
+    std::vector<size_t> vNotePositions;         // position of our notes in vCommitments
+    SaplingMerkleTree saplingTree;
+
+    // Connect blocks with one note of ours and one of another key, in alternate order
+    for (size_t i = 0; i < numBlocks; i++) {
+        const ShieldedDestination ours{sk, 10}, other{skOther, 20};
+        std::vector<ShieldedDestination> vDest = (i % 2) ? std::vector<ShieldedDestination>{other, ours}
+                                                         : std::vector<ShieldedDestination>{ours, other};
+        CWalletTx wtx = GetValidSaplingReceive(Params().GetConsensus(), wallet, 30, vDest, true);
+        auto saplingNoteData = wallet.GetSaplingScriptPubKeyMan()->FindMySaplingNotes(*wtx.tx).first;
+        wtx.SetSaplingNoteData(saplingNoteData);
+        BOOST_CHECK_EQUAL(wtx.mapSaplingNoteData.size(), 1);
+        for (const auto& it : wtx.mapSaplingNoteData) {
+            saplingNotes.emplace_back(it.first);
+            vNotePositions.emplace_back(vCommitments.size() + it.first.n);
+        }
+        for (const OutputDescription& output : wtx.tx->sapData->vShieldedOutput) {
+            vCommitments.emplace_back(output.cmu);
+        }
+        vBlockEnd.emplace_back(vCommitments.size());
+        wallet.LoadToWallet(wtx);
+
+        blocks[i].vtx.emplace_back(wtx.tx);
+        indices[i].nHeight = (int) i + 1;
+        trees.emplace_back(saplingTree);
+        wallet.IncrementNoteWitnesses(&indices[i], &blocks[i], saplingTree);
+        CheckWitnessesMatchTree(wallet, saplingNotes, vNotePositions, vCommitments, vBlockEnd[i]);
+    }
+
+    // Disconnect the last two blocks: their notes lose the witness, the others go back
+    wallet.DecrementNoteWitnesses(&indices[numBlocks - 1]);
+    CheckWitnessesMatchTree(wallet, saplingNotes, vNotePositions, vCommitments, vBlockEnd[numBlocks - 2]);
+    wallet.DecrementNoteWitnesses(&indices[numBlocks - 2]);
+    CheckWitnessesMatchTree(wallet, saplingNotes, vNotePositions, vCommitments, vBlockEnd[numBlocks - 3]);
+
+    // Connect them again
+    saplingTree = trees[numBlocks - 2];
+    for (size_t i = numBlocks - 2; i < numBlocks; i++) {
+        wallet.IncrementNoteWitnesses(&indices[i], &blocks[i], saplingTree);
+        CheckWitnessesMatchTree(wallet, saplingNotes, vNotePositions, vCommitments, vBlockEnd[i]);
+    }
+}
+
 BOOST_AUTO_TEST_CASE(UpdatedSaplingNoteData)
 {
     auto consensusParams = Params().GetConsensus();
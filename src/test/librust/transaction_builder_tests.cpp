@@ -49,6 +49,17 @@ BOOST_AUTO_TEST_CASE(TransparentToSapling)
     CValidationState state;
     BOOST_CHECK(SaplingValidation::ContextualCheckTransaction(tx, state, Params(), 2, true, false));
     BOOST_CHECK_EQUAL(state.GetRejectReason(), "");
+
+    // Mempool acceptance fills the shielded-valid cache, block validation hits it
+    uint64_t nHits, nMisses, nHitsBefore, nMissesBefore;
+    GetSaplingProofCacheStats(nHitsBefore, nMissesBefore);
+    BOOST_CHECK(SaplingValidation::ContextualCheckTransaction(tx, state, Params(), 2, false, false));
+    std::vector<CSaplingProofCheck> vChecks;
+    BOOST_CHECK(SaplingValidation::ContextualCheckTransaction(tx, state, Params(), 2, true, false, &vChecks));
+    BOOST_CHECK(vChecks.empty());
+    GetSaplingProofCacheStats(nHits, nMisses);
+    BOOST_CHECK_EQUAL(nHits, nHitsBefore + 1);
+    BOOST_CHECK_EQUAL(nMisses, nMissesBefore + 1);
 }
 
 BOOST_AUTO_TEST_CASE(SaplingToSapling)
@@ -99,6 +110,18 @@ BOOST_AUTO_TEST_CASE(SaplingToSapling)
     BOOST_CHECK_EQUAL(tx2.sapData->valueBalance, 10000000);
     BOOST_CHECK(SaplingValidation::ContextualCheckTransaction(tx2, state, Params(), 3, true, false));
     BOOST_CHECK_EQUAL(state.GetRejectReason(), "");
+
+    // --- Defer the proofs verification, then run the queued checks
+    std::vector<CSaplingProofCheck> vChecks;
+    BOOST_CHECK(SaplingValidation::ContextualCheckTransaction(tx, state, Params(), 3, true, false, &vChecks));
+    BOOST_CHECK(SaplingValidation::ContextualCheckTransaction(tx2, state, Params(), 3, true, false, &vChecks));
+    BOOST_CHECK_EQUAL(vChecks.size(), 2);
+    for (auto& check : vChecks) {
+        BOOST_CHECK(check());
+    }
+    // Checks bound to the wrong sighash must fail
+    CSaplingProofCheck badCheck(tx2, uint256S("1234"));
+    BOOST_CHECK(!badCheck());
 }
 
 BOOST_AUTO_TEST_CASE(ThrowsOnTransparentInputWithoutKeyStore)
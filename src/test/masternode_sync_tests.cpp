@@ -0,0 +1,126 @@
+// Copyright (c) 2021 The PIVX developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "test/test_pivx.h"
+
+#include "masternode-sync.h"
+#include "net.h"
+#include "netbase.h"
+#include "protocol.h"
+#include "utiltime.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(masternode_sync_tests, TestingSetup)
+
+static int CountFulfilled(const std::vector<std::unique_ptr<CNode>>& vNodes, const std::string& strRequest)
+{
+    return std::count_if(vNodes.begin(), vNodes.end(), [&](const std::unique_ptr<CNode>& pnode) {
+        return pnode->HasFulfilledRequest(strRequest);
+    });
+}
+
+static void SendSyncStatusCount(CNode* pnode, int nItemID, int nCount)
+{
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << nItemID << nCount;
+    std::string strCommand = NetMsgType::SYNCSTATUSCOUNT;
+    masternodeSync.ProcessMessage(pnode, strCommand, ss);
+}
+
+// Runs a scheduler round at the given (mock) time
+static void ProcessAt(int64_t nTime)
+{
+    SetMockTime(nTime);
+    masternodeSync.lastProcess = nTime;
+    masternodeSync.Process();
+}
+
+BOOST_AUTO_TEST_CASE(sync_scheduler)
+{
+    std::vector<std::unique_ptr<CNode>> vNodes;
+    for (int i = 0; i < 8; i++) {
+        CAddress addr(LookupNumeric(strprintf("10.0.0.%d", i + 1).c_str(), 51472), NODE_NONE);
+        vNodes.emplace_back(new CNode(i, NODE_NETWORK, 0, INVALID_SOCKET, addr, 0, 0, "", false));
+        vNodes.back()->SetSendVersion(PROTOCOL_VERSION);
+        vNodes.back()->nVersion = PROTOCOL_VERSION;
+        vNodes.back()->fSuccessfullyConnected = true;
+        CConnmanTest::AddNode(*vNodes.back());
+    }
+
+    int64_t nTime = GetTime();
+    SetMockTime(nTime);
+    masternodeSync.Reset();
+    masternodeSync.RequestedMasternodeAssets = MASTERNODE_SYNC_LIST;
+    masternodeSync.fBlockchainSynced = true;
+
+    // Request fan-out: the list is asked to several peers at once, once
+    ProcessAt(nTime);
+    BOOST_CHECK_EQUAL(masternodeSync.RequestedMasternodeAssets, MASTERNODE_SYNC_LIST);
+    BOOST_CHECK_EQUAL(CountFulfilled(vNodes, "mnsync"), MASTERNODE_SYNC_PARALLEL_PEERS);
+    BOOST_CHECK_EQUAL(masternodeSync.RequestedMasternodeAttempt, MASTERNODE_SYNC_PARALLEL_PEERS);
+    ProcessAt(nTime);
+    BOOST_CHECK_EQUAL(CountFulfilled(vNodes, "mnsync"), MASTERNODE_SYNC_PARALLEL_PEERS);
+
+    // Only the counts of the peers asked are recorded
+    std::vector<CNode*> vAsked;
+    for (const auto& pnode : vNodes) {
+        if (pnode->HasFulfilledRequest("mnsync")) {
+            vAsked.emplace_back(pnode.get());
+        } else {
+            SendSyncStatusCount(pnode.get(), MASTERNODE_SYNC_LIST, 100);
+        }
+    }
+    for (size_t i = 0; i < vAsked.size(); i++) {
+        SendSyncStatusCount(vAsked[i], MASTERNODE_SYNC_LIST, i == 0 ? 3 : 2);
+    }
+    SendSyncStatusCount(vAsked[1], MASTERNODE_SYNC_LIST, 50);
+    BOOST_CHECK_EQUAL(masternodeSync.countMasternodeList, MASTERNODE_SYNC_PARALLEL_PEERS);
+    BOOST_CHECK_EQUAL(masternodeSync.sumMasternodeList, 3 + 2 * (MASTERNODE_SYNC_PARALLEL_PEERS - 1));
+
+    // Completion: not before the largest count announced is seen and the items stopped coming
+    masternodeSync.AddedMasternodeList(InsecureRand256());
+    masternodeSync.AddedMasternodeList(InsecureRand256());
+    ProcessAt(nTime);
+    BOOST_CHECK_EQUAL(masternodeSync.RequestedMasternodeAssets, MASTERNODE_SYNC_LIST);
+    nTime += MASTERNODE_SYNC_TIMEOUT + 1;
+    ProcessAt(nTime);
+    BOOST_CHECK_EQUAL(masternodeSync.RequestedMasternodeAssets, MASTERNODE_SYNC_LIST);
+    masternodeSync.AddedMasternodeList(InsecureRand256());
+    ProcessAt(nTime);
+    BOOST_CHECK_EQUAL(masternodeSync.RequestedMasternodeAssets, MASTERNODE_SYNC_LIST);
+    nTime += MASTERNODE_SYNC_TIMEOUT + 1;
+    ProcessAt(nTime);
+    BOOST_CHECK_EQUAL(masternodeSync.RequestedMasternodeAssets, MASTERNODE_SYNC_MNW);
+
+    // The winners and the budget are then requested together, from different peers
+    ProcessAt(nTime);
+    BOOST_CHECK_EQUAL(CountFulfilled(vNodes, "mnwsync"), MASTERNODE_SYNC_PARALLEL_PEERS);
+    BOOST_CHECK_EQUAL(CountFulfilled(vNodes, "busync"), MASTERNODE_SYNC_PARALLEL_PEERS);
+    for (const auto& pnode : vNodes) {
+        BOOST_CHECK(!pnode->HasFulfilledRequest("mnwsync") || !pnode->HasFulfilledRequest("busync"));
+    }
+    // the winners went to the peers that answered the list
+    for (CNode* pnode : vAsked) {
+        BOOST_CHECK(pnode->HasFulfilledRequest("mnwsync"));
+    }
+
+    // Failure path: no winner arrives before the timeout, with the payments enforced
+    // (SPORK_8 is active past its default activation time)
+    BOOST_CHECK_EQUAL(masternodeSync.nCountFailures, 0);
+    nTime = std::max<int64_t>(nTime, 4070908800LL) + MASTERNODE_SYNC_TIMEOUT * 5 + 1;
+    ProcessAt(nTime);
+    BOOST_CHECK_EQUAL(masternodeSync.RequestedMasternodeAssets, MASTERNODE_SYNC_FAILED);
+    BOOST_CHECK_EQUAL(masternodeSync.nCountFailures, 1);
+    // and not retried before a minute
+    ProcessAt(nTime + 30);
+    BOOST_CHECK_EQUAL(masternodeSync.RequestedMasternodeAssets, MASTERNODE_SYNC_FAILED);
+    BOOST_CHECK_EQUAL(masternodeSync.nCountFailures, 1);
+
+    CConnmanTest::ClearNodes();
+    SetMockTime(0);
+    masternodeSync.Reset();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,284 @@
+// Copyright (c) 2021 The PIVX developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "test/test_pivx.h"
+
+#include "chain.h"
+#include "masternode.h"
+#include "masternodeman.h"
+#include "spork.h"
+#include "validation.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(masternode_tests, RegTestingSetup)
+
+static const int64_t MN_TEST_MIN_AGE = 8000;   // MN_WINNER_MINIMUM_AGE
+
+// A legacy masternode enabled since long enough to be ranked
+static CMasternode MakeEnabledMasternode(const COutPoint& collateral)
+{
+    const int64_t nNow = GetAdjustedTime();
+    CMasternode mn;
+    mn.vin = CTxIn(collateral);
+    mn.sigTime = nNow - std::max<int64_t>(MN_TEST_MIN_AGE, MasternodeMinPingSeconds()) - 1;
+    mn.lastPing.vin = mn.vin;
+    mn.lastPing.blockHash = InsecureRand256();
+    mn.lastPing.sigTime = nNow;
+    return mn;
+}
+
+static int64_t CompactScore(const CMasternode& mn, const uint256& hash)
+{
+    return mn.CalculateScore(hash).GetCompact(false);
+}
+
+static bool IsEligibleForRank(const CMasternode& mn)
+{
+    return mn.IsEnabled() && mn.protocolVersion >= ActiveProtocol() &&
+           (!sporkManager.IsSporkActive(SPORK_8_MASTERNODE_PAYMENT_ENFORCEMENT) ||
+            GetAdjustedTime() - mn.sigTime >= MN_TEST_MIN_AGE);
+}
+
+// The winner as chosen by scoring every masternode with CalculateScore:
+// the first one, in collateral order, with the best score.
+static const CMasternode* ReferenceWinner(const std::map<COutPoint, CMasternode*>& mapMNs, const uint256& hash)
+{
+    int64_t nBest = 0;
+    const CMasternode* winner = nullptr;
+    for (const auto& it : mapMNs) {
+        const CMasternode* mn = it.second;
+        if (mn->protocolVersion < ActiveProtocol() || !mn->IsEnabled()) continue;
+        const int64_t n = CompactScore(*mn, hash);
+        if (n > nBest) {
+            nBest = n;
+            winner = mn;
+        }
+    }
+    return winner;
+}
+
+static void CheckScoresMatchReference(const CMasternodeMan& man, const std::map<COutPoint, CMasternode*>& mapMNs,
+                                      const uint256& hash, int nHeight)
+{
+    // Winner
+    const CMasternode* expectedWinner = ReferenceWinner(mapMNs, hash);
+    MasternodeRef winner = man.GetCurrentMasterNode(hash);
+    BOOST_CHECK_EQUAL((bool) winner, expectedWinner != nullptr);
+    if (winner && expectedWinner) {
+        BOOST_CHECK(winner->vin.prevout == expectedWinner->vin.prevout);
+    }
+
+    // Ranks: the order among equal scores is not defined by the reference sort,
+    // so a masternode must rank after all the better ones and before the worse ones.
+    std::vector<int64_t> vEligibleScores;
+    for (const auto& it : mapMNs) {
+        if (IsEligibleForRank(*it.second)) vEligibleScores.emplace_back(CompactScore(*it.second, hash));
+    }
+    std::set<int> setRanks;
+    for (const auto& it : mapMNs) {
+        const CMasternode* mn = it.second;
+        const int nRank = man.GetMasternodeRank(mn->vin, nHeight);
+        if (!IsEligibleForRank(*mn)) {
+            BOOST_CHECK_EQUAL(nRank, -1);
+            continue;
+        }
+        const int64_t nScore = CompactScore(*mn, hash);
+        const int nBetter = std::count_if(vEligibleScores.begin(), vEligibleScores.end(), [&](int64_t n) { return n > nScore; });
+        const int nEqual = std::count(vEligibleScores.begin(), vEligibleScores.end(), nScore);
+        BOOST_CHECK(nRank > nBetter && nRank <= nBetter + nEqual);
+        setRanks.emplace(nRank);
+    }
+    BOOST_CHECK_EQUAL(setRanks.size(), vEligibleScores.size());
+
+    // Full ranking, disabled masternodes last
+    const auto vRanks = man.GetMasternodeRanks(nHeight);
+    BOOST_CHECK_EQUAL(vRanks.size(), mapMNs.size());
+    std::vector<int64_t> vExpectedScores;
+    for (const auto& it : mapMNs) {
+        vExpectedScores.emplace_back(it.second->IsEnabled() ? (uint32_t) CompactScore(*it.second, hash) : 9999);
+    }
+    std::sort(vExpectedScores.rbegin(), vExpectedScores.rend());
+    for (size_t i = 0; i < vRanks.size() && i < vExpectedScores.size(); i++) {
+        BOOST_CHECK_EQUAL(vRanks[i].first, vExpectedScores[i]);
+        const CMasternode* mn = mapMNs.at(vRanks[i].second->vin.prevout);
+        BOOST_CHECK_EQUAL(vRanks[i].first, mn->IsEnabled() ? (uint32_t) CompactScore(*mn, hash) : 9999);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(score_tables_match_calculate_score)
+{
+    CMasternodeMan man;
+    std::map<COutPoint, CMasternode*> mapMNs;
+    auto addMasternode = [&](const CMasternode& mnIn) {
+        CMasternode mn(mnIn);
+        BOOST_CHECK(man.Add(mn));
+        mapMNs.emplace(mn.vin.prevout, man.Find(mn.vin.prevout));
+    };
+
+    // Block hashes of the last blocks
+    const int nTipHeight = 1000;
+    const int nBlocks = 5;
+    std::vector<uint256> vHashes(nBlocks);
+    std::vector<CBlockIndex> vIndex(nBlocks);
+    man.SetBestHeight(nTipHeight);
+    for (int i = 0; i < nBlocks; i++) {
+        vHashes[i] = InsecureRand256();
+        vIndex[i].phashBlock = &vHashes[i];
+        vIndex[i].nHeight = nTipHeight - i;
+        man.CacheBlockHash(&vIndex[i]);
+    }
+
+    // Two masternodes with the same compact score for the first hash
+    std::map<int64_t, COutPoint> mapScores;
+    COutPoint tie1, tie2;
+    for (int i = 0; i < (1 << 20) && tie1.IsNull(); i++) {
+        CMasternode mn;
+        mn.vin = CTxIn(COutPoint(InsecureRand256(), InsecureRandRange(4)));
+        auto res = mapScores.emplace(CompactScore(mn, vHashes[0]), mn.vin.prevout);
+        if (!res.second) {
+            tie1 = res.first->second;
+            tie2 = mn.vin.prevout;
+        }
+    }
+    BOOST_REQUIRE(!tie1.IsNull());
+    addMasternode(MakeEnabledMasternode(tie1));
+    addMasternode(MakeEnabledMasternode(tie2));
+
+    // Enabled, obsolete, too young and pre-enabled masternodes
+    for (int i = 0; i < 200; i++) {
+        CMasternode mn = MakeEnabledMasternode(COutPoint(InsecureRand256(), InsecureRandRange(4)));
+        const int nKind = InsecureRandRange(8);
+        if (nKind == 0) {
+            mn.protocolVersion = ActiveProtocol() - 1;
+        } else if (nKind == 1) {
+            mn.sigTime = mn.lastPing.sigTime - MasternodeMinPingSeconds() - 1;
+        } else if (nKind == 2) {
+            mn.sigTime = mn.lastPing.sigTime - 1;
+        }
+        addMasternode(mn);
+    }
+    // and disabled ones
+    int nDisabled = 0;
+    for (auto& it : mapMNs) {
+        if (it.first != tie1 && it.first != tie2 && nDisabled++ < 10) it.second->Disable();
+    }
+
+    // The block hashes are at the heights before the ones ranked
+    for (int i = 0; i < nBlocks; i++) {
+        CheckScoresMatchReference(man, mapMNs, vHashes[i], nTipHeight - i + 1);
+    }
+
+    // With the tie at the top, the winner is the first masternode in collateral order
+    const int64_t nTieScore = CompactScore(*mapMNs.at(tie1), vHashes[0]);
+    BOOST_CHECK_EQUAL(nTieScore, CompactScore(*mapMNs.at(tie2), vHashes[0]));
+    for (auto& it : mapMNs) {
+        if (CompactScore(*it.second, vHashes[0]) > nTieScore) it.second->Disable();
+    }
+    MasternodeRef winner = man.GetCurrentMasterNode(vHashes[0]);
+    BOOST_REQUIRE(winner);
+    BOOST_CHECK(winner->vin.prevout == std::min(tie1, tie2));
+    CheckScoresMatchReference(man, mapMNs, vHashes[0], nTipHeight + 1);
+
+    // Removing a masternode refreshes the tables
+    man.Remove(std::min(tie1, tie2));
+    mapMNs.erase(std::min(tie1, tie2));
+    winner = man.GetCurrentMasterNode(vHashes[0]);
+    BOOST_REQUIRE(winner);
+    BOOST_CHECK(winner->vin.prevout == std::max(tie1, tie2));
+    for (int i = 0; i < nBlocks; i++) {
+        CheckScoresMatchReference(man, mapMNs, vHashes[i], nTipHeight - i + 1);
+    }
+}
+
+// Every masternode is found by its collateral, and every operator key
+// leads to the masternode with the lowest collateral using it.
+static void CheckIndexesMatchList(CMasternodeMan& man, const std::map<COutPoint, CMasternode*>& mapMNs,
+                                  const std::vector<CPubKey>& vKeys)
+{
+    for (const auto& it : mapMNs) {
+        BOOST_CHECK_EQUAL(man.Find(it.first), it.second);
+    }
+    for (const CPubKey& key : vKeys) {
+        auto it = std::find_if(mapMNs.begin(), mapMNs.end(), [&](const std::pair<const COutPoint, CMasternode*>& p) { return p.second->pubKeyMasternode == key; });
+        BOOST_CHECK_EQUAL(man.Find(key), it != mapMNs.end() ? it->second : nullptr);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(indexes_follow_masternode_list)
+{
+    // UpdateFromNewBroadcast refreshes the indexes of the global manager
+    CMasternodeMan& man = mnodeman;
+    man.Clear();
+    std::map<COutPoint, CMasternode*> mapMNs;
+
+    // A few operator keys, shared by several masternodes
+    std::vector<CPubKey> vKeys;
+    for (int i = 0; i < 8; i++) {
+        CKey key;
+        key.MakeNewKey(true);
+        vKeys.emplace_back(key.GetPubKey());
+    }
+    for (int i = 0; i < 40; i++) {
+        CMasternode mn = MakeEnabledMasternode(COutPoint(InsecureRand256(), InsecureRandRange(4)));
+        mn.pubKeyMasternode = vKeys[InsecureRandRange(vKeys.size() - 2)];
+        BOOST_CHECK(man.Add(mn));
+        mapMNs.emplace(mn.vin.prevout, man.Find(mn.vin.prevout));
+    }
+    // Adding a known collateral changes nothing
+    CMasternode mnDup(*mapMNs.begin()->second);
+    mnDup.pubKeyMasternode = vKeys.back();
+    BOOST_CHECK(!man.Add(mnDup));
+    CheckIndexesMatchList(man, mapMNs, vKeys);
+
+    // Remove
+    for (int i = 0; i < 5; i++) {
+        auto it = std::next(mapMNs.begin(), InsecureRandRange(mapMNs.size()));
+        man.Remove(it->first);
+        mapMNs.erase(it);
+    }
+    man.Remove(COutPoint(InsecureRand256(), 0));
+    CheckIndexesMatchList(man, mapMNs, vKeys);
+
+    // UpdateFromNewBroadcast, moving masternodes to other (and to unused) keys
+    for (int i = 0; i < 10; i++) {
+        CMasternode* mn = std::next(mapMNs.begin(), InsecureRandRange(mapMNs.size()))->second;
+        CMasternodeBroadcast mnb(*mn);
+        mnb.sigTime = mn->sigTime + 1;
+        mnb.lastPing = CMasternodePing();
+        mnb.pubKeyMasternode = vKeys[InsecureRandRange(vKeys.size())];
+        BOOST_CHECK(mn->UpdateFromNewBroadcast(mnb));
+        BOOST_CHECK(mn->pubKeyMasternode == mnb.pubKeyMasternode);
+        CheckIndexesMatchList(man, mapMNs, vKeys);
+    }
+    // An older broadcast is ignored
+    CMasternode* mnOld = mapMNs.begin()->second;
+    CMasternodeBroadcast mnbOld(*mnOld);
+    mnbOld.sigTime = mnOld->sigTime - 1;
+    mnbOld.pubKeyMasternode = vKeys.back();
+    BOOST_CHECK(!mnOld->UpdateFromNewBroadcast(mnbOld));
+    CheckIndexesMatchList(man, mapMNs, vKeys);
+
+    // CheckAndRemove drops the disabled and obsolete masternodes
+    int n = 0;
+    for (auto it = mapMNs.begin(); it != mapMNs.end(); n++) {
+        if (n % 3 == 0) {
+            it->second->Disable();
+        } else if (n % 7 == 0) {
+            it->second->protocolVersion = ActiveProtocol() - 1;
+        } else {
+            ++it;
+            continue;
+        }
+        it = mapMNs.erase(it);
+    }
+    BOOST_CHECK_EQUAL(man.CheckAndRemove(), (int) mapMNs.size());
+    CheckIndexesMatchList(man, mapMNs, vKeys);
+
+    man.Clear();
+    mapMNs.clear();
+    CheckIndexesMatchList(man, mapMNs, vKeys);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
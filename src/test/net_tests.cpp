@@ -215,4 +215,76 @@ BOOST_AUTO_TEST_CASE(ipv4_peer_with_ipv6_addrMe_test)
     BOOST_CHECK(1);
 }
 
+#ifndef WIN32
+BOOST_AUTO_TEST_CASE(socket_events_test)
+{
+    CConnman connman(0x1337, 0x1337);
+    BOOST_REQUIRE(CConnmanTest::StartSocketEvents(connman));
+    std::set<SOCKET> recv_set, send_set, error_set;
+    auto WaitEvents = [&]() {
+        recv_set.clear();
+        send_set.clear();
+        error_set.clear();
+        CConnmanTest::SocketEvents(connman, recv_set, send_set, error_set);
+    };
+
+    // The wakeup pipe is reported until drained
+    const SOCKET hWakeup = CConnmanTest::WakeupSocket(connman);
+    BOOST_REQUIRE(hWakeup != INVALID_SOCKET);
+    CConnmanTest::WakeSocketHandler(connman);
+    WaitEvents();
+    BOOST_CHECK(recv_set.count(hWakeup));
+    CConnmanTest::DrainWakeupPipe(connman);
+    WaitEvents();
+    BOOST_CHECK(!recv_set.count(hWakeup));
+
+    // Node connected to the other end of a socket pair
+    int fds[2];
+    BOOST_REQUIRE(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+    const SOCKET hSocket = fds[0];
+    in_addr ipv4Addr;
+    ipv4Addr.s_addr = 0xa0b0c001;
+    CAddress addr = CAddress(CService(ipv4Addr, 7777), NODE_NETWORK);
+    CNode* pnode = new CNode(0, NODE_NETWORK, 0, hSocket, addr, 0, 0, "", true);
+    CConnmanTest::AddNode(connman, *pnode);
+
+    // Nothing to receive or to send: the socket isn't reported
+    WaitEvents();
+    BOOST_CHECK(!recv_set.count(hSocket));
+    BOOST_CHECK(!send_set.count(hSocket));
+
+    // Data received
+    const char buf[] = "data";
+    BOOST_REQUIRE(write(fds[1], buf, sizeof(buf)) == sizeof(buf));
+    WaitEvents();
+    BOOST_CHECK(recv_set.count(hSocket));
+    BOOST_CHECK(!send_set.count(hSocket));
+
+    // Data waiting to be sent: only the writability is awaited
+    WITH_LOCK(pnode->cs_vSend, pnode->vSendMsg.emplace_back(buf, buf + sizeof(buf)); );
+    connman.UpdateNodeSocketEvents(pnode);
+    WaitEvents();
+    BOOST_CHECK(send_set.count(hSocket));
+    BOOST_CHECK(!recv_set.count(hSocket));
+    WITH_LOCK(pnode->cs_vSend, pnode->vSendMsg.clear(); );
+    connman.UpdateNodeSocketEvents(pnode);
+
+    // Receiving paused: the pending data isn't reported
+    pnode->fPauseRecv = true;
+    connman.UpdateNodeSocketEvents(pnode);
+    WaitEvents();
+    BOOST_CHECK(!recv_set.count(hSocket));
+    pnode->fPauseRecv = false;
+    connman.UpdateNodeSocketEvents(pnode);
+    WaitEvents();
+    BOOST_CHECK(recv_set.count(hSocket));
+
+    // the node is deleted here, not by the connman (closing its socket)
+    CConnmanTest::ClearNodes(connman);
+    delete pnode;
+    close(fds[1]);
+    CConnmanTest::StopSocketEvents(connman);
+}
+#endif
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -188,4 +188,24 @@ BOOST_AUTO_TEST_CASE(BlockPolicyEstimates)
     }
 }
 
+BOOST_AUTO_TEST_CASE(FeeFilterRounding)
+{
+    const CFeeRate minRelayFee(10000);
+    FeeFilterRounder rounder(minRelayFee);
+    BOOST_CHECK_EQUAL(rounder.round(0), 0);
+
+    // The rounded fee is one of the bucket boundaries around the fee
+    for (CAmount nFee : {10000, 12345, 250000, 9000000}) {
+        for (int i = 0; i < 20; i++) {
+            const CAmount nRounded = rounder.round(nFee);
+            BOOST_CHECK(nRounded >= nFee / FEE_SPACING - 1);
+            BOOST_CHECK(nRounded <= nFee * FEE_SPACING + 1);
+        }
+    }
+
+    // Fees above the tracked range are rounded to the highest boundary
+    BOOST_CHECK(rounder.round(2 * MAX_FEERATE) <= MAX_FEERATE);
+    BOOST_CHECK(rounder.round(2 * MAX_FEERATE) > MAX_FEERATE / FEE_SPACING);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -10,6 +10,7 @@
 #include "blockassembler.h"
 #include "consensus/merkle.h"
 #include "guiinterface.h"
+#include "index/txindex.h"
 #include "evo/deterministicmns.h"
 #include "evo/evodb.h"
 #include "evo/evonotificationinterface.h"
@@ -17,6 +18,7 @@
 #include "net_processing.h"
 #include "rpc/server.h"
 #include "rpc/register.h"
+#include "sapling/sapling_validation.h"
 #include "script/sigcache.h"
 #include "sporkdb.h"
 #include "txmempool.h"
@@ -40,12 +42,73 @@ std::ostream& operator<<(std::ostream& os, const uint256& num)
     return os;
 }
 
+void CConnmanTest::AddNode(CNode& node)
+{
+    LOCK(g_connman->cs_vNodes);
+    g_connman->vNodes.push_back(&node);
+}
+
+void CConnmanTest::ClearNodes()
+{
+    LOCK(g_connman->cs_vNodes);
+    g_connman->vNodes.clear();
+}
+
+bool CConnmanTest::StartSocketEvents(CConnman& connman)
+{
+    std::string strError;
+    return connman.StartSocketEvents(strError);
+}
+
+void CConnmanTest::StopSocketEvents(CConnman& connman)
+{
+    connman.StopSocketEvents();
+}
+
+void CConnmanTest::AddNode(CConnman& connman, CNode& node)
+{
+    WITH_LOCK(connman.cs_vNodes, connman.vNodes.push_back(&node); );
+    connman.UpdateNodeSocketEvents(&node);
+}
+
+void CConnmanTest::ClearNodes(CConnman& connman)
+{
+    LOCK(connman.cs_vNodes);
+    connman.vNodes.clear();
+}
+
+void CConnmanTest::SocketEvents(CConnman& connman, std::set<SOCKET>& recv_set, std::set<SOCKET>& send_set, std::set<SOCKET>& error_set)
+{
+    connman.SocketEvents(recv_set, send_set, error_set);
+}
+
+void CConnmanTest::WakeSocketHandler(CConnman& connman)
+{
+    connman.WakeSocketHandler();
+}
+
+void CConnmanTest::DrainWakeupPipe(CConnman& connman)
+{
+    connman.DrainWakeupPipe();
+}
+
+SOCKET CConnmanTest::WakeupSocket(CConnman& connman)
+{
+#ifndef WIN32
+    return connman.wakeupPipe[0];
+#else
+    return INVALID_SOCKET;
+#endif
+}
+
 BasicTestingSetup::BasicTestingSetup(const std::string& chainName)
     : m_path_root(fs::temp_directory_path() / "test_pivx" / strprintf("%lu_%i", (unsigned long)GetTime(), (int)(InsecureRandRange(1 << 30))))
 {
+    SHA256AutoDetect();
     ECC_Start();
     SetupEnvironment();
     InitSignatureCache();
+    InitSaplingProofCache();
     fCheckBlockIndex = true;
     SelectParams(chainName);
     evoDb.reset(new CEvoDB(1 << 20, true, true));
@@ -104,6 +167,11 @@ TestingSetup::TestingSetup(const std::string& chainName) : BasicTestingSetup(cha
             bool ok = ActivateBestChain(state);
             BOOST_CHECK(ok);
         }
+        // Like -txindex on a node, and wait for the index to be in sync with the genesis block
+        StartTxIndex(1 << 20, true);
+        while (!GetTxIndex()->BlockUntilSyncedToCurrentChain()) {
+            MilliSleep(10);
+        }
         nScriptCheckThreads = 3;
         for (int i=0; i < nScriptCheckThreads-1; i++)
             threadGroup.create_thread(&ThreadScriptCheck);
@@ -112,6 +180,7 @@ TestingSetup::TestingSetup(const std::string& chainName) : BasicTestingSetup(cha
 
 TestingSetup::~TestingSetup()
 {
+        StopTxIndex();
         threadGroup.interrupt_all();
         threadGroup.join_all();
         GetMainSignals().FlushBackgroundCallbacks();
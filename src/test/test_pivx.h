@@ -5,10 +5,13 @@
 #ifndef PIVX_TEST_TEST_PIVX_H
 #define PIVX_TEST_TEST_PIVX_H
 
+#include "compat.h"
 #include "fs.h"
 #include "scheduler.h"
 #include "txdb.h"
 
+#include <set>
+
 #include <boost/thread.hpp>
 
 extern FastRandomContext insecure_rand_ctx;
@@ -50,6 +53,21 @@ private:
  * and wallet (if enabled) setup.
  */
 class CConnman;
+class CNode;
+struct CConnmanTest {
+    static void AddNode(CNode& node);
+    static void ClearNodes();
+    // Socket handler internals, on a given connman
+    static bool StartSocketEvents(CConnman& connman);
+    static void StopSocketEvents(CConnman& connman);
+    static void AddNode(CConnman& connman, CNode& node);
+    static void ClearNodes(CConnman& connman);
+    static void SocketEvents(CConnman& connman, std::set<SOCKET>& recv_set, std::set<SOCKET>& send_set, std::set<SOCKET>& error_set);
+    static void WakeSocketHandler(CConnman& connman);
+    static void DrainWakeupPipe(CConnman& connman);
+    static SOCKET WakeupSocket(CConnman& connman);
+};
+
 class PeerLogicValidation;
 class EvoNotificationInterface;
 struct TestingSetup: public BasicTestingSetup
@@ -0,0 +1,128 @@
+// Copyright (c) 2021 The PIVX developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "test/test_pivx.h"
+
+#include "random.h"
+#include "tiertwo_cachedb.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(tiertwo_cachedb_tests, BasicTestingSetup)
+
+static size_t FlushTable(CDBWrapper& db, CTierTwoDBTable<uint256, int64_t>& table, const std::map<uint256, int64_t>& m)
+{
+    CDBBatch batch;
+    size_t nChanged = table.WriteChanges(batch, m);
+    BOOST_CHECK(db.WriteBatch(batch));
+    table.ChangesWritten();
+    return nChanged;
+}
+
+static std::map<uint256, int64_t> ReadTable(CDBWrapper& db, char chTable)
+{
+    CTierTwoDBTable<uint256, int64_t> table(chTable);
+    std::map<uint256, int64_t> mRead;
+    BOOST_CHECK(table.Read(db, mRead));
+    return mRead;
+}
+
+BOOST_AUTO_TEST_CASE(tiertwo_cachedb_dirty_table)
+{
+    CTierTwoCacheDB db(1 << 20, true);
+    CTierTwoDBTable<uint256, int64_t> table('t');
+    CTierTwoDBTable<uint256, int64_t> otherTable('u');
+
+    std::map<uint256, int64_t> m;
+    for (int i = 0; i < 100; i++) {
+        m.emplace(GetRandHash(), i);
+    }
+    std::map<uint256, int64_t> mOther{{GetRandHash(), -1}};
+    table.SetAllDirty(m);
+    otherTable.SetAllDirty(mOther);
+    BOOST_CHECK_EQUAL(FlushTable(db, table, m), 100);
+    BOOST_CHECK_EQUAL(FlushTable(db, otherTable, mOther), 1);
+    // nothing marked
+    BOOST_CHECK_EQUAL(FlushTable(db, table, m), 0);
+
+    // only the marked keys are written (or erased)
+    auto it = m.begin();
+    it->second = 1000;
+    table.SetDirty(it->first);
+    it = std::next(it, 10);
+    table.SetDirty(it->first);
+    it = m.erase(it);
+    // not marked: not written
+    const int64_t nWritten = it->second;
+    it->second = 1500;
+    const uint256 key = GetRandHash();
+    m.emplace(key, 2000);
+    table.SetDirty(key);
+    table.SetDirty(key);
+    // a batch that is not written is added again to the next one
+    {
+        CDBBatch batch;
+        BOOST_CHECK_EQUAL(table.WriteChanges(batch, m), 3);
+    }
+    BOOST_CHECK_EQUAL(FlushTable(db, table, m), 3);
+    BOOST_CHECK_EQUAL(FlushTable(db, table, m), 0);
+
+    std::map<uint256, int64_t> mRead = ReadTable(db, 't');
+    BOOST_CHECK_EQUAL(mRead.size(), m.size());
+    BOOST_CHECK_EQUAL(mRead.at(m.begin()->first), 1000);
+    BOOST_CHECK_EQUAL(mRead.at(key), 2000);
+    BOOST_CHECK_EQUAL(mRead.at(it->first), nWritten);
+
+    // loading keeps the entries already in memory
+    std::map<uint256, int64_t> mLive{{key, 5000}};
+    CTierTwoDBTable<uint256, int64_t> table2('t');
+    RecursiveMutex cs;
+    BOOST_CHECK(table2.Load(db, mLive, cs));
+    BOOST_CHECK_EQUAL(mLive.size(), m.size());
+    BOOST_CHECK_EQUAL(mLive.at(key), 5000);
+
+    // wipe
+    table2.Wipe(db);
+    BOOST_CHECK(ReadTable(db, 't').empty());
+    BOOST_CHECK(ReadTable(db, 'u') == mOther);
+}
+
+BOOST_AUTO_TEST_CASE(tiertwo_cachedb_diff_table)
+{
+    CTierTwoCacheDB db(1 << 20, true);
+    CTierTwoDBTable<uint256, int64_t> table('t', true);
+
+    std::map<uint256, int64_t> m;
+    for (int i = 0; i < 100; i++) {
+        m.emplace(GetRandHash(), i);
+    }
+    BOOST_CHECK_EQUAL(FlushTable(db, table, m), 100);
+    // nothing changed
+    BOOST_CHECK_EQUAL(FlushTable(db, table, m), 0);
+
+    // only the modified, added and removed entries are written
+    auto it = m.begin();
+    it->second = 1000;
+    it = std::next(it, 10);
+    it = m.erase(it);
+    m.erase(std::prev(m.end()));
+    m.emplace(GetRandHash(), 2000);
+    m.emplace(GetRandHash(), 3000);
+    // until the batch is written, the changes are not recorded
+    {
+        CDBBatch batch;
+        BOOST_CHECK_EQUAL(table.WriteChanges(batch, m), 5);
+    }
+    BOOST_CHECK_EQUAL(FlushTable(db, table, m), 5);
+    BOOST_CHECK_EQUAL(FlushTable(db, table, m), 0);
+
+    // a new tracker reads back the same content, and knows what was written
+    CTierTwoDBTable<uint256, int64_t> table2('t', true);
+    std::map<uint256, int64_t> mRead;
+    BOOST_CHECK(table2.Read(db, mRead));
+    BOOST_CHECK(mRead == m);
+    BOOST_CHECK_EQUAL(FlushTable(db, table2, m), 0);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
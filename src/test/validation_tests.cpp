@@ -155,4 +155,27 @@ BOOST_FIXTURE_TEST_CASE(zerocoin_rejection_tests, WalletRegTestingSetup)
     CheckMempoolZcRejection(mtx);
 }
 
+BOOST_FIXTURE_TEST_CASE(read_raw_block_from_disk, TestChain100Setup)
+{
+    for (int nHeight : {1, 50, 100}) {
+        const CBlockIndex* pindex = WITH_LOCK(cs_main, return chainActive[nHeight]; );
+        CBlock block;
+        BOOST_CHECK(ReadBlockFromDisk(block, pindex));
+
+        // The raw data is the block serialized as on the network
+        std::vector<unsigned char> vRaw;
+        BOOST_CHECK(ReadRawBlockFromDisk(vRaw, pindex));
+        CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+        ss << block;
+        BOOST_CHECK(vRaw == std::vector<unsigned char>(ss.begin(), ss.end()));
+    }
+
+    // The header must match the block index hash
+    CBlockIndex indexWrongHash = *WITH_LOCK(cs_main, return chainActive[10]; );
+    const uint256 hashOther = WITH_LOCK(cs_main, return chainActive[11]->GetBlockHash(); );
+    indexWrongHash.phashBlock = &hashOther;
+    std::vector<unsigned char> vRaw;
+    BOOST_CHECK(!ReadRawBlockFromDisk(vRaw, &indexWrongHash));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
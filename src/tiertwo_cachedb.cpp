@@ -0,0 +1,146 @@
+// Copyright (c) 2021 The PIVX developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "tiertwo_cachedb.h"
+
+#include "budget/budgetdb.h"
+#include "budget/budgetmanager.h"
+#include "masternode-payments.h"
+#include "masternodeman.h"
+#include "util/system.h"
+
+#include <atomic>
+
+static const int TIERTWO_CACHE_DB_VERSION = 1;
+
+std::unique_ptr<CTierTwoCacheDB> g_tiertwo_cachedb;
+
+// Serializes the loads and the flushes (the tables of the managers are not thread safe)
+static Mutex cs_tiertwo_cachedb;
+// Whether the content of the db was loaded in the managers (or the db was initialized from them)
+static std::atomic<bool> fTierTwoCacheLoaded{false};
+
+CTierTwoCacheDB::CTierTwoCacheDB(size_t nCacheSize, bool fMemory, bool fWipe) :
+    CDBWrapper(GetDataDir() / "tiertwo", nCacheSize, fMemory, fWipe)
+{}
+
+static size_t WriteTierTwoChanges(CDBBatch& batch)
+{
+    return mnodeman.WriteDBChanges(batch) +
+           g_budgetman.WriteDBChanges(batch) +
+           masternodePayments.WriteDBChanges(batch);
+}
+
+static void TierTwoChangesWritten()
+{
+    mnodeman.DBChangesWritten();
+    g_budgetman.DBChangesWritten();
+    masternodePayments.DBChangesWritten();
+}
+
+void ImportLegacyTierTwoCaches(int nChainHeight)
+{
+    assert(g_tiertwo_cachedb);
+    LOCK(cs_tiertwo_cachedb);
+    int nVersion;
+    if (g_tiertwo_cachedb->ReadVersion(nVersion)) {
+        return;
+    }
+
+    CMasternodeDB mndb;
+    CMasternodeDB::ReadResult readResult = mndb.Read(mnodeman);
+    if (readResult == CMasternodeDB::FileError)
+        LogPrintf("Missing masternode cache file - mncache.dat, will try to recreate\n");
+    else if (readResult != CMasternodeDB::Ok) {
+        LogPrintf("Error reading mncache.dat - cached data discarded\n");
+    }
+
+    CBudgetDB budgetdb;
+    const bool fDryRun = (nChainHeight <= 0);
+    CBudgetDB::ReadResult readResult2 = budgetdb.Read(g_budgetman, fDryRun);
+    if (readResult2 == CBudgetDB::FileError)
+        LogPrintf("Missing budget cache - budget.dat, will try to recreate\n");
+    else if (readResult2 != CBudgetDB::Ok) {
+        LogPrintf("Error reading budget.dat - cached data discarded\n");
+    }
+    //flag our cached items so we send them to our peers
+    g_budgetman.ResetSync();
+    g_budgetman.ClearSeen();
+
+    CMasternodePaymentDB mnpayments;
+    CMasternodePaymentDB::ReadResult readResult3 = mnpayments.Read(masternodePayments);
+    if (readResult3 == CMasternodePaymentDB::FileError)
+        LogPrintf("Missing masternode payment cache - mnpayments.dat, will try to recreate\n");
+    else if (readResult3 != CMasternodePaymentDB::Ok) {
+        LogPrintf("Error reading mnpayments.dat - cached data discarded\n");
+    }
+
+    // Write everything, and mark the db as initialized
+    g_budgetman.SetDBDirty();
+    masternodePayments.SetDBDirty();
+    CDBBatch batch;
+    const size_t nEntries = WriteTierTwoChanges(batch);
+    batch.Write(DB_TIERTWO_VERSION, TIERTWO_CACHE_DB_VERSION);
+    if (!g_tiertwo_cachedb->WriteBatch(batch, true)) {
+        // not initialized: the import is done again at the next start
+        LogPrintf("%s: failed to write the tier two caches db\n", __func__);
+    } else {
+        TierTwoChangesWritten();
+    }
+    fTierTwoCacheLoaded = true;
+    LogPrintf("Imported %d tier two cache entries\n", nEntries);
+}
+
+void LoadTierTwoCaches()
+{
+    assert(g_tiertwo_cachedb);
+    LOCK(cs_tiertwo_cachedb);
+    if (fTierTwoCacheLoaded) {
+        return;
+    }
+
+    const int64_t nStart = GetTimeMillis();
+    if (!mnodeman.LoadFromDB(*g_tiertwo_cachedb)) {
+        LogPrintf("Error reading the masternode cache - cached data discarded\n");
+    }
+    LogPrint(BCLog::MASTERNODE, "  %s\n", mnodeman.ToString());
+
+    if (!g_budgetman.LoadFromDB(*g_tiertwo_cachedb)) {
+        LogPrintf("Error reading the budget cache - cached data discarded\n");
+    }
+    if (g_budgetman.GetBestHeight() > 0) {
+        g_budgetman.CheckAndRemove();
+    }
+    //flag our cached items so we send them to our peers
+    g_budgetman.ResetSync();
+    LogPrint(BCLog::MNBUDGET, "%s\n", g_budgetman.ToString());
+
+    if (!masternodePayments.LoadFromDB(*g_tiertwo_cachedb)) {
+        LogPrintf("Error reading the masternode payment cache - cached data discarded\n");
+    }
+    LogPrint(BCLog::MASTERNODE, "  %s\n", masternodePayments.ToString());
+
+    fTierTwoCacheLoaded = true;
+    LogPrintf("Loaded tier two caches %dms\n", GetTimeMillis() - nStart);
+}
+
+void FlushTierTwoCaches()
+{
+    LOCK(cs_tiertwo_cachedb);
+    // What is received before the load is merged with the db content, and written with the first flush after it
+    if (!g_tiertwo_cachedb || !fTierTwoCacheLoaded) {
+        return;
+    }
+
+    const int64_t nStart = GetTimeMillis();
+    CDBBatch batch;
+    const size_t nChanged = WriteTierTwoChanges(batch);
+    if (nChanged > 0 && !g_tiertwo_cachedb->WriteBatch(batch)) {
+        // the changes are written again with the next flush
+        LogPrintf("%s: failed to write the tier two caches db\n", __func__);
+        return;
+    }
+    TierTwoChangesWritten();
+    LogPrint(BCLog::MASTERNODE, "Flushed %d tier two cache changes %dms\n", nChanged, GetTimeMillis() - nStart);
+}
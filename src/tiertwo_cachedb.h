@@ -0,0 +1,257 @@
+// Copyright (c) 2021 The PIVX developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef PIVX_TIERTWO_CACHEDB_H
+#define PIVX_TIERTWO_CACHEDB_H
+
+#include "clientversion.h"
+#include "dbwrapper.h"
+#include "hash.h"
+#include "optional.h"
+#include "sync.h"
+
+#include <map>
+#include <memory>
+#include <set>
+#include <type_traits>
+#include <vector>
+
+/** Default interval between two flushes of the tier two caches, in seconds */
+static const int64_t TIERTWO_CACHE_FLUSH_INTERVAL = 5 * 60;
+/** Cache size of the tier two caches db */
+static const size_t TIERTWO_CACHE_DB_CACHE_SIZE = 8 << 20;
+
+// Tables of the tier two caches db
+static const char DB_TIERTWO_VERSION = 'V';
+// budget manager
+static const char DB_BUDGET_PROPOSALS = 'p';
+static const char DB_BUDGET_FEETX_TO_PROPOSAL = 'P';
+static const char DB_BUDGET_ORPHAN_PROPOSAL_VOTES = 'o';
+static const char DB_BUDGET_FINALIZED = 'f';
+static const char DB_BUDGET_FEETX_TO_FINALIZED = 'F';
+static const char DB_BUDGET_UNCONFIRMED_FEETX = 'u';
+static const char DB_BUDGET_ORPHAN_FINALIZED_VOTES = 'O';
+static const char DB_BUDGET_PROPOSAL_VOTES = 'v';
+static const char DB_BUDGET_FINALIZED_VOTES = 'g';
+// masternode manager
+static const char DB_MN_LIST = 'm';
+static const char DB_MN_ASKED_US_FOR_LIST = 'a';
+static const char DB_MN_WE_ASKED_FOR_LIST = 'A';
+static const char DB_MN_WE_ASKED_FOR_ENTRY = 'e';
+static const char DB_MN_SEEN_BROADCASTS = 'b';
+static const char DB_MN_SEEN_PINGS = 'i';
+// masternode payments
+static const char DB_MNPAYMENTS_VOTES = 'w';
+static const char DB_MNPAYMENTS_BLOCKS = 'k';
+
+/** LevelDB store of the budget, masternode list and masternode payments caches.
+ *  Each cached map is kept in its own table of (table, key) -> value entries,
+ *  so that flushes only need to write the entries modified since the last one.
+ */
+class CTierTwoCacheDB : public CDBWrapper
+{
+public:
+    explicit CTierTwoCacheDB(size_t nCacheSize, bool fMemory = false, bool fWipe = false);
+
+private:
+    CTierTwoCacheDB(const CTierTwoCacheDB&);
+    void operator=(const CTierTwoCacheDB&);
+
+public:
+    // The version is written once the db holds a complete copy of the caches
+    bool ReadVersion(int& nVersion) const { return Read(DB_TIERTWO_VERSION, nVersion); }
+    bool WriteVersion(int nVersion) { return Write(DB_TIERTWO_VERSION, nVersion); }
+};
+
+/** A map of one of the tier two managers, persisted in a table of the CTierTwoCacheDB.
+ *  The owner of the map marks the keys that it adds, modifies or removes (SetDirty), and only
+ *  those are written with the next flush (or erased, if no longer in the map). The maps whose
+ *  entries are modified in place all over the code (fDiffHashes) are instead diffed against the
+ *  serialization hash of the entries last written.
+ *  The values can be stored through a wrapper W of a V& (e.g. leaving out the parts that are kept
+ *  in their own table, see CBudgetProposal::NoVotes).
+ *  Not thread safe: SetDirty and WriteChanges need the persisted map locked by the caller.
+ */
+template <typename K, typename V, typename W = V>
+class CTierTwoDBTable
+{
+private:
+    const char chTable;
+    const bool fDiffHashes;
+    // Keys marked since the last batch
+    std::set<K> setDirty;
+    // Serialization hash of the entries last written (only with fDiffHashes)
+    std::map<K, uint256> mapWritten;
+    // Changes added to the last batch (no hash for the erased keys, nor without fDiffHashes), cleared once it is written
+    std::vector<std::pair<K, Optional<uint256>>> vPending;
+
+    // The value as it is stored in the db
+    template <typename T = W>
+    static typename std::enable_if<std::is_same<T, V>::value, V&>::type Stored(V& value) { return value; }
+    template <typename T = W>
+    static typename std::enable_if<!std::is_same<T, V>::value, T>::type Stored(V& value) { return T(value); }
+
+    static uint256 GetEntryHash(const V& value) { return SerializeHash(Stored(const_cast<V&>(value)), SER_DISK, CLIENT_VERSION); }
+
+    size_t WriteDiff(CDBBatch& batch, const std::map<K, V>& mapIn)
+    {
+        vPending.clear();
+        auto itWritten = mapWritten.cbegin();
+        auto eraseWritten = [&]() {
+            batch.Erase(std::make_pair(chTable, itWritten->first));
+            vPending.emplace_back(itWritten->first, nullopt);
+            ++itWritten;
+        };
+        for (const auto& p : mapIn) {
+            // both maps are sorted: the written keys lower than the current one were removed
+            while (itWritten != mapWritten.cend() && itWritten->first < p.first) {
+                eraseWritten();
+            }
+            const uint256& hash = GetEntryHash(p.second);
+            const bool fWritten = itWritten != mapWritten.cend() && !(p.first < itWritten->first);
+            if (!fWritten || itWritten->second != hash) {
+                batch.Write(std::make_pair(chTable, p.first), Stored(const_cast<V&>(p.second)));
+                vPending.emplace_back(p.first, hash);
+            }
+            if (fWritten) {
+                ++itWritten;
+            }
+        }
+        while (itWritten != mapWritten.cend()) {
+            eraseWritten();
+        }
+        return vPending.size();
+    }
+
+public:
+    explicit CTierTwoDBTable(char _chTable, bool _fDiffHashes = false) : chTable(_chTable), fDiffHashes(_fDiffHashes) {}
+
+    // Marks a key added, modified or removed, to write with the next batch
+    void SetDirty(const K& key) { setDirty.emplace(key); }
+
+    // Marks all the keys of mapIn (e.g. to initialize the db from the legacy flat files)
+    void SetAllDirty(const std::map<K, V>& mapIn)
+    {
+        for (const auto& p : mapIn) {
+            setDirty.emplace_hint(setDirty.end(), p.first);
+        }
+    }
+
+    // Adds to the batch the changes of mapIn since the last written batch. Returns the number of changed entries.
+    // The changes are not considered written until ChangesWritten is called.
+    size_t WriteChanges(CDBBatch& batch, const std::map<K, V>& mapIn)
+    {
+        if (fDiffHashes) {
+            return WriteDiff(batch, mapIn);
+        }
+        return WriteDirty(batch, [&mapIn](const K& key) -> const V* {
+            const auto it = mapIn.find(key);
+            return it != mapIn.end() ? &it->second : nullptr;
+        });
+    }
+
+    // Adds to the batch the entries of the marked keys, looked up with fnFind (nullptr for the removed ones).
+    // For the entries that are not in a map of their own (e.g. the votes of the budget proposals).
+    template <typename FindFn>
+    size_t WriteDirty(CDBBatch& batch, FindFn fnFind)
+    {
+        // a batch that was not written is written again
+        for (const auto& p : vPending) {
+            setDirty.emplace(p.first);
+        }
+        vPending.clear();
+        for (const K& key : setDirty) {
+            const V* pvalue = fnFind(key);
+            if (pvalue) {
+                batch.Write(std::make_pair(chTable, key), Stored(const_cast<V&>(*pvalue)));
+            } else {
+                batch.Erase(std::make_pair(chTable, key));
+            }
+            vPending.emplace_back(key, nullopt);
+        }
+        setDirty.clear();
+        return vPending.size();
+    }
+
+    // Records the changes of the last WriteChanges call, after its batch was written to the db
+    void ChangesWritten()
+    {
+        if (fDiffHashes) {
+            for (const auto& p : vPending) {
+                if (p.second) {
+                    mapWritten[p.first] = *p.second;
+                } else {
+                    mapWritten.erase(p.first);
+                }
+            }
+        }
+        vPending.clear();
+    }
+
+    // Reads the table and adds to mapTo (guarded by cs) the entries that it doesn't have yet.
+    // The reading is done without holding cs.
+    template <typename MutexType>
+    bool Load(CDBWrapper& db, std::map<K, V>& mapTo, MutexType& cs)
+    {
+        std::map<K, V> mapRead;
+        if (!Read(db, mapRead)) {
+            return false;
+        }
+        LOCK(cs);
+        mapTo.insert(std::make_move_iterator(mapRead.begin()), std::make_move_iterator(mapRead.end()));
+        return true;
+    }
+
+    // Reads all the entries of the table in mapOut
+    bool Read(CDBWrapper& db, std::map<K, V>& mapOut)
+    {
+        std::unique_ptr<CDBIterator> it(db.NewIterator());
+        for (it->Seek(chTable); it->Valid(); it->Next()) {
+            std::pair<char, K> key;
+            if (!it->GetKey(key) || key.first != chTable) {
+                break;
+            }
+            V value;
+            auto&& stored = Stored(value);
+            if (!it->GetValue(stored)) {
+                return error("%s : failed to read entry %d of table '%c'", __func__, mapOut.size(), chTable);
+            }
+            if (fDiffHashes) {
+                mapWritten.emplace_hint(mapWritten.end(), key.second, GetEntryHash(value));
+            }
+            mapOut.emplace_hint(mapOut.end(), key.second, std::move(value));
+        }
+        return true;
+    }
+
+    // Erases all the entries of the table (e.g. after a read failure).
+    // The entries kept in memory must be marked again (see SetAllDirty).
+    void Wipe(CDBWrapper& db)
+    {
+        CDBBatch batch;
+        std::unique_ptr<CDBIterator> it(db.NewIterator());
+        for (it->Seek(chTable); it->Valid(); it->Next()) {
+            CDataStream ssKey = it->GetKey();
+            if (ssKey.empty() || ssKey[0] != chTable) {
+                break;
+            }
+            batch.Erase(ssKey);
+        }
+        db.WriteBatch(batch);
+        mapWritten.clear();
+        vPending.clear();
+    }
+};
+
+extern std::unique_ptr<CTierTwoCacheDB> g_tiertwo_cachedb;
+
+/** Import the legacy flat files (mncache.dat, budget.dat, mnpayments.dat) in an empty db.
+ *  Must be called before the network is started. */
+void ImportLegacyTierTwoCaches(int nChainHeight);
+/** Load the content of the tier two caches db, merging it with the data received meanwhile */
+void LoadTierTwoCaches();
+/** Write the changes of the tier two caches since the last flush */
+void FlushTierTwoCaches();
+
+#endif // PIVX_TIERTWO_CACHEDB_H
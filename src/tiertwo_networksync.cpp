@@ -4,6 +4,7 @@
 
 #include "masternode-sync.h"
 
+#include "budget/budgetmanager.h"  // for g_budgetman
 #include "masternodeman.h"          // for mnodeman
 #include "netmessagemaker.h"
 #include "net_processing.h"         // for Misbehaving
@@ -92,6 +93,7 @@ bool CMasternodeSync::MessageDispatcher(CNode* pfrom, std::string& strCommand, C
         int nItemID;
         int nCount;
         vRecv >> nItemID >> nCount;
+        ProcessSyncStatusCount(pfrom->GetId(), nItemID, nCount);
 
         // this means we will receive no further communication on the first sync
         switch (nItemID) {
@@ -185,7 +187,7 @@ void CMasternodeSync::SyncRegtest(CNode* pnode)
         RequestDataTo(pnode, NetMsgType::GETMNWINNERS, false, mnodeman.CountEnabled());
     } else if (RequestedMasternodeAssets == MASTERNODE_SYNC_BUDGET) {
         // sync masternode votes
-        RequestDataTo(pnode, NetMsgType::BUDGETVOTESYNC, false, uint256());
+        RequestDataTo(pnode, NetMsgType::BUDGETVOTESYNC, false, uint256(), g_budgetman.GetVotesDigests());
     } else if (RequestedMasternodeAssets == MASTERNODE_SYNC_FINISHED) {
         LogPrintf("REGTEST SYNC FINISHED!\n");
     }
@@ -0,0 +1,99 @@
+// Copyright (c) 2019 The Dash Core developers
+// Copyright (c) 2021 The PIVX developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef PIVX_UNORDERED_LRU_CACHE_H
+#define PIVX_UNORDERED_LRU_CACHE_H
+
+#include <list>
+#include <unordered_map>
+
+/*
+ * Map that evicts its least recently used entries once the total cost of
+ * the entries exceeds the configured maximum. The cost of each entry is
+ * given by the caller (e.g. an estimate of its memory usage).
+ * The most recently inserted entry is never evicted.
+ * Not thread safe, the caller must provide the locking.
+ */
+template <typename Key, typename Value, typename Hasher = std::hash<Key>>
+class unordered_lru_cache
+{
+private:
+    typedef std::list<Key> OrderList;
+    struct Entry {
+        Value value;
+        size_t cost;
+        typename OrderList::iterator orderIt;
+    };
+
+    std::unordered_map<Key, Entry, Hasher> cacheMap;
+    // keys of cacheMap, most recently used first
+    OrderList order;
+    size_t maxCost;
+    size_t totalCost{0};
+
+public:
+    explicit unordered_lru_cache(size_t _maxCost) : maxCost(_maxCost) {}
+
+    void insert(const Key& key, const Value& value, size_t cost)
+    {
+        erase(key);
+        order.emplace_front(key);
+        cacheMap.emplace(key, Entry{value, cost, order.begin()});
+        totalCost += cost;
+        truncate_if_needed();
+    }
+
+    // Copies the value of key in value, and marks it as the most recently used
+    bool get(const Key& key, Value& value)
+    {
+        auto it = cacheMap.find(key);
+        if (it == cacheMap.end()) {
+            return false;
+        }
+        order.splice(order.begin(), order, it->second.orderIt);
+        value = it->second.value;
+        return true;
+    }
+
+    bool exists(const Key& key) const
+    {
+        return cacheMap.count(key) != 0;
+    }
+
+    void erase(const Key& key)
+    {
+        auto it = cacheMap.find(key);
+        if (it == cacheMap.end()) {
+            return;
+        }
+        totalCost -= it->second.cost;
+        order.erase(it->second.orderIt);
+        cacheMap.erase(it);
+    }
+
+    void clear()
+    {
+        cacheMap.clear();
+        order.clear();
+        totalCost = 0;
+    }
+
+    size_t size() const { return cacheMap.size(); }
+    size_t cost() const { return totalCost; }
+    size_t max_cost() const { return maxCost; }
+
+private:
+    void truncate_if_needed()
+    {
+        while (totalCost > maxCost && order.size() > 1) {
+            auto it = cacheMap.find(order.back());
+            totalCost -= it->second.cost;
+            cacheMap.erase(it);
+            order.pop_back();
+        }
+    }
+};
+
+#endif // PIVX_UNORDERED_LRU_CACHE_H
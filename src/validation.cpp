@@ -27,6 +27,7 @@
 #include "flatfile.h"
 #include "fs.h"
 #include "guiinterface.h"
+#include "index/txindex.h"
 #include "init.h"
 #include "invalid.h"
 #include "interfaces/handler.h"
@@ -38,6 +39,7 @@
 #include "policy/policy.h"
 #include "pow.h"
 #include "reverse_iterate.h"
+#include "sapling/sapling_validation.h"
 #include "script/sigcache.h"
 #include "spork.h"
 #include "sporkdb.h"
@@ -95,7 +97,6 @@ int64_t g_best_block_time = 0;
 int nScriptCheckThreads = 0;
 std::atomic<bool> fImporting{false};
 std::atomic<bool> fReindex{false};
-bool fTxIndex = true;
 bool fRequireStandard = true;
 bool fCheckBlockIndex = false;
 size_t nCoinCacheUsage = 5000 * 300;
@@ -716,6 +717,35 @@ bool GetOutput(const uint256& hash, unsigned int index, CValidationState& state,
     return true;
 }
 
+/** Maximum number of blocks read by GetTransaction, when the txindex lags behind the tip */
+static const int MAX_INDEX_LAG_BLOCKS = 10;
+
+/**
+ * Look up a transaction in the blocks of the active chain that the index has not
+ * processed yet, as long as it is synced and at most MAX_INDEX_LAG_BLOCKS behind.
+ */
+static bool FindTxNotIndexedYet(const BaseIndex& index, const uint256& hash, CTransactionRef& txOut, uint256& hashBlock)
+{
+    AssertLockHeld(cs_main);
+    const CBlockIndex* pindexBest = index.GetSyncedBestBlock();
+    if (!pindexBest) return false;
+    const CBlockIndex* pindexFork = chainActive.FindFork(pindexBest);
+    if (!pindexFork || chainActive.Height() - pindexFork->nHeight > MAX_INDEX_LAG_BLOCKS) return false;
+
+    for (const CBlockIndex* pindex = chainActive.Tip(); pindex != pindexFork; pindex = pindex->pprev) {
+        CBlock block;
+        if (!ReadBlockFromDisk(block, pindex)) continue;
+        for (const auto& tx : block.vtx) {
+            if (tx->GetHash() == hash) {
+                txOut = tx;
+                hashBlock = pindex->GetBlockHash();
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
 /** Return transaction in tx, and if it was found inside a block, its hash is placed in hashBlock */
 bool GetTransaction(const uint256& hash, CTransactionRef& txOut, uint256& hashBlock, bool fAllowSlow, CBlockIndex* blockIndex)
 {
@@ -731,28 +761,12 @@ bool GetTransaction(const uint256& hash, CTransactionRef& txOut, uint256& hashBl
             return true;
         }
 
-        if (fTxIndex) {
-            CDiskTxPos postx;
-            if (pblocktree->ReadTxIndex(hash, postx)) {
-                CAutoFile file(OpenBlockFile(postx, true), SER_DISK, CLIENT_VERSION);
-                if (file.IsNull())
-                    return error("%s: OpenBlockFile failed", __func__);
-                CBlockHeader header;
-                try {
-                    file >> header;
-                    fseek(file.Get(), postx.nTxOffset, SEEK_CUR);
-                    file >> txOut;
-                } catch (const std::exception& e) {
-                    return error("%s : Deserialize or I/O error - %s", __func__, e.what());
-                }
-                hashBlock = header.GetHash();
-                if (txOut->GetHash() != hash)
-                    return error("%s : txid mismatch", __func__);
-                return true;
-            }
-
-            // transaction not found in the index, nothing more can be done
-            return false;
+        // The txindex is synced in the background, and can miss the last
+        // blocks connected: these are read directly.
+        std::shared_ptr<TxIndex> txindex = GetTxIndex();
+        if (txindex && (txindex->FindTx(hash, hashBlock, txOut) ||
+                        FindTxNotIndexedYet(*txindex, hash, txOut, hashBlock))) {
+            return true;
         }
 
         if (fAllowSlow) { // use coin database to locate block that contains transaction, and scan it
@@ -842,6 +856,46 @@ bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex)
     return true;
 }
 
+bool ReadRawBlockFromDisk(std::vector<unsigned char>& block, const CBlockIndex* pindex)
+{
+    const FlatFilePos blockPos = WITH_LOCK(cs_main, return pindex->GetBlockPos(); );
+    if (blockPos.nPos < MESSAGE_START_SIZE + sizeof(unsigned int))
+        return error("%s : invalid block position %s", __func__, blockPos.ToString());
+
+    // Open history file at the index header (message start and block size, see WriteBlockToDisk)
+    const FlatFilePos hpos(blockPos.nFile, blockPos.nPos - MESSAGE_START_SIZE - sizeof(unsigned int));
+    CAutoFile filein(OpenBlockFile(hpos, true), SER_DISK, CLIENT_VERSION);
+    if (filein.IsNull())
+        return error("%s : OpenBlockFile failed for %s", __func__, hpos.ToString());
+
+    try {
+        unsigned char buf[MESSAGE_START_SIZE];
+        unsigned int nSize;
+        filein >> buf >> nSize;
+        if (memcmp(buf, Params().MessageStart(), MESSAGE_START_SIZE))
+            return error("%s : block magic mismatch for %s", __func__, hpos.ToString());
+        if (nSize > MAX_BLOCK_SIZE_CURRENT)
+            return error("%s : block data larger than maximum deserialization size for %s", __func__, hpos.ToString());
+        block.resize(nSize);
+        filein.read((char*)block.data(), nSize);
+    } catch (const std::exception& e) {
+        return error("%s : Read from block file failed: %s for %s", __func__, e.what(), hpos.ToString());
+    }
+
+    // Check the header only, the transactions are not deserialized
+    CBlockHeader header;
+    try {
+        VectorReader(SER_DISK, CLIENT_VERSION, block, 0) >> header;
+    } catch (const std::exception& e) {
+        return error("%s : Deserialize error - %s", __func__, e.what());
+    }
+    if (header.GetHash() != pindex->GetBlockHash()) {
+        LogPrintf("%s : block=%s index=%s\n", __func__, header.GetHash().GetHex(), pindex->GetBlockHash().GetHex());
+        return error("%s : GetHash() doesn't match index", __func__);
+    }
+    return true;
+}
+
 
 double ConvertBitsToDouble(unsigned int nBits)
 {
@@ -1452,6 +1506,15 @@ void ThreadScriptCheck()
     scriptcheckqueue.Thread();
 }
 
+// Each job verifies all the proofs of one transaction, so keep the batches small
+static CCheckQueue<CSaplingProofCheck> saplingcheckqueue(8);
+
+void ThreadSaplingProofCheck()
+{
+    util::ThreadRename("pivx-saplingch");
+    saplingcheckqueue.Thread();
+}
+
 static int64_t nTimeVerify = 0;
 static int64_t nTimeProcessSpecial = 0;
 static int64_t nTimeConnect = 0;
@@ -1546,10 +1609,7 @@ static bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockInd
     CAmount nFees = 0;
     int nInputs = 0;
     unsigned int nSigOps = 0;
-    CDiskTxPos pos(pindex->GetBlockPos(), GetSizeOfCompactSize(block.vtx.size()));
-    std::vector<std::pair<uint256, CDiskTxPos> > vPos;
     std::vector<std::pair<libzerocoin::CoinSpend, uint256> > vSpends;
-    vPos.reserve(block.vtx.size());
     CBlockUndo blockundo;
     blockundo.vtxundo.reserve(block.vtx.size() - 1);
     CAmount nValueOut = 0;
@@ -1677,9 +1737,6 @@ static bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockInd
                 sapling_tree.append(outputDescription.cmu);
             }
         }
-
-        vPos.emplace_back(tx.GetHash(), pos);
-        pos.nTxOffset += ::GetSerializeSize(tx, SER_DISK, CLIENT_VERSION);
     }
 
     // Push new tree anchor
@@ -1770,10 +1827,6 @@ static bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockInd
     if (!vSpends.empty() && !zerocoinDB->WriteCoinSpendBatch(vSpends))
         return AbortNode(state, "Failed to record coin serials to database");
 
-    if (fTxIndex)
-        if (!pblocktree->WriteTxIndex(vPos))
-            return AbortNode(state, "Failed to write transaction index");
-
     // add this block to the view's block chain
     view.SetBestBlock(pindex->GetBlockHash());
     evoDb->WriteBestBlock(pindex->GetBlockHash());
@@ -1860,7 +1913,9 @@ bool static FlushStateToDisk(CValidationState& state, FlushStateMode mode)
                 std::vector<const CBlockIndex*> vBlocks;
                 vBlocks.reserve(setDirtyBlockIndex.size());
                 for (std::set<CBlockIndex*>::iterator it = setDirtyBlockIndex.begin(); it != setDirtyBlockIndex.end(); ) {
-                    vBlocks.push_back(*it);
+                    // (the unverified headers are written with their block)
+                    if (!IsUnverifiedHeader(*it))
+                        vBlocks.push_back(*it);
                     setDirtyBlockIndex.erase(it++);
                 }
                 if (!pblocktree->WriteBatchSync(vFiles, nLastBlockFile, vBlocks)) {
@@ -2502,6 +2557,41 @@ bool ReconsiderBlock(CValidationState& state, CBlockIndex* pindex)
     return true;
 }
 
+static void SetBlockStakeModifier(CBlockIndex* pindex, const CBlock& block)
+{
+    if (!Params().GetConsensus().NetworkUpgradeActive(pindex->nHeight, Consensus::UPGRADE_V3_4)) {
+        // compute and set new V1 stake modifier (entropy bits)
+        pindex->SetNewStakeModifier();
+
+    } else {
+        // compute and set new V2 stake modifier (hash of prevout and prevModifier)
+        pindex->SetNewStakeModifier(block.vtx[1]->vin[0].prevout.hash);
+    }
+}
+
+bool IsUnverifiedHeader(const CBlockIndex* pindex)
+{
+    return !(pindex->nStatus & BLOCK_HAVE_DATA) &&
+           Params().GetConsensus().NetworkUpgradeActive(pindex->nHeight, Consensus::UPGRADE_POS);
+}
+
+void EraseUnverifiedHeaders(const std::vector<CBlockIndex*>& vErase)
+{
+    AssertLockHeld(cs_main);
+    for (CBlockIndex* pindex : vErase) {
+        assert(IsUnverifiedHeader(pindex) && pindex != pindexBestHeader);
+        setDirtyBlockIndex.erase(pindex);
+        mapBlocksUnlinked.erase(pindex);
+        if (pindexBestInvalid == pindex)
+            pindexBestInvalid = nullptr;
+        if (pindexBestForkTip == pindex || pindexBestForkBase == pindex)
+            pindexBestForkTip = pindexBestForkBase = nullptr;
+        const uint256 hash = pindex->GetBlockHash();
+        mapBlockIndex.erase(hash);
+        delete pindex;
+    }
+}
+
 CBlockIndex* AddToBlockIndex(const CBlock& block)
 {
     // Check for duplicate
@@ -2526,19 +2616,17 @@ CBlockIndex* AddToBlockIndex(const CBlock& block)
         pindexNew->nHeight = pindexNew->pprev->nHeight + 1;
         pindexNew->BuildSkip();
 
-        const Consensus::Params& consensus = Params().GetConsensus();
-        if (!consensus.NetworkUpgradeActive(pindexNew->nHeight, Consensus::UPGRADE_V3_4)) {
-            // compute and set new V1 stake modifier (entropy bits)
-            pindexNew->SetNewStakeModifier();
-
-        } else {
-            // compute and set new V2 stake modifier (hash of prevout and prevModifier)
-            pindexNew->SetNewStakeModifier(block.vtx[1]->vin[0].prevout.hash);
-        }
+        // Headers-first sync: the stake modifier of a header is set when the block is received (see AcceptBlock)
+        if (!block.vtx.empty())
+            SetBlockStakeModifier(pindexNew, block);
     }
     pindexNew->nTimeMax = (pindexNew->pprev ? std::max(pindexNew->pprev->nTimeMax, pindexNew->nTime) : pindexNew->nTime);
     pindexNew->nChainWork = (pindexNew->pprev ? pindexNew->pprev->nChainWork : 0) + GetBlockProof(*pindexNew);
     pindexNew->RaiseValidity(BLOCK_VALID_TREE);
+    // The proof of stake of a header-only entry is checked with its block: until then it doesn't move the best header,
+    // and it isn't written to disk (see ReceivedBlockTransactions)
+    if (block.vtx.empty() && IsUnverifiedHeader(pindexNew))
+        return pindexNew;
     if (pindexBestHeader == NULL || pindexBestHeader->nChainWork < pindexNew->nChainWork)
         pindexBestHeader = pindexNew;
 
@@ -3022,20 +3110,36 @@ bool ContextualCheckBlock(const CBlock& block, CValidationState& state, CBlockIn
 {
     const int nHeight = pindexPrev == nullptr ? 0 : pindexPrev->nHeight + 1;
     const CChainParams& chainparams = Params();
+    const bool fInitialBlockDownload = IsInitialBlockDownload();
+
+    // Sapling proofs are verified by the check queue workers while the rest of the block is validated
+    CCheckQueueControl<CSaplingProofCheck> control(nScriptCheckThreads ? &saplingcheckqueue : nullptr);
 
     // Check that all transactions are finalized
     for (const auto& tx : block.vtx) {
 
         // Check transaction contextually against consensus rules at block height
-        if (!ContextualCheckTransaction(tx, state, chainparams, nHeight, true /* isMined */, IsInitialBlockDownload())) {
+        std::vector<CSaplingProofCheck> vChecks;
+        if (!ContextualCheckTransaction(tx, state, chainparams, nHeight, true /* isMined */, fInitialBlockDownload, nScriptCheckThreads ? &vChecks : nullptr)) {
             return false;
         }
+        control.Add(vChecks);
 
         if (!IsFinalTx(tx, nHeight, block.GetBlockTime())) {
             return state.DoS(10, false, REJECT_INVALID, "bad-txns-nonfinal", false, "non-final transaction");
         }
     }
 
+    if (!control.Wait()) {
+        // Re-run the shielded txs checks serially, to report the proper rejection reason
+        for (const auto& tx : block.vtx) {
+            if (tx->IsShieldedTx() && !ContextualCheckTransaction(tx, state, chainparams, nHeight, true /* isMined */, fInitialBlockDownload)) {
+                return false;
+            }
+        }
+        return state.DoS(100, error("%s: Sapling CheckQueue failed", __func__), REJECT_INVALID, "block-validation-failed");
+    }
+
     // Enforce block.nVersion=2 rule that the coinbase starts with serialized block height
     if (pindexPrev) { // pindexPrev is only null on the first block which is a version 1 block.
         CScript expect = CScript() << nHeight;
@@ -3116,6 +3220,18 @@ bool AcceptBlockHeader(const CBlock& block, CValidationState& state, CBlockIndex
     return true;
 }
 
+/** The block of a header-only entry (headers-first sync) failed the context-free checks. As in InvalidateBlock,
+ *  only the entry is marked: the download window stops at it, and its descendants are refused (bad-prevblk).
+ *  The best header moves back to the tip if it was building on it. */
+static void InvalidBlockHeaderFound(CBlockIndex* pindexInvalid)
+{
+    AssertLockHeld(cs_main);
+    setBlockIndexCandidates.erase(pindexInvalid);
+    if (pindexBestHeader && pindexBestHeader->GetAncestor(pindexInvalid->nHeight) == pindexInvalid)
+        pindexBestHeader = chainActive.Tip();
+    InvalidChainFound(pindexInvalid);
+}
+
 static bool AcceptBlock(const CBlock& block, CValidationState& state, CBlockIndex** ppindex, const FlatFilePos* dbp)
 {
     AssertLockHeld(cs_main);
@@ -3130,6 +3246,17 @@ static bool AcceptBlock(const CBlock& block, CValidationState& state, CBlockInde
     if (!GetPrevIndex(block, &pindexPrev, state))
         return false;
 
+    // With headers-first sync, the parent may be known by its header only.
+    // The proof of stake needs the parent (and its stake modifier), so the blocks are accepted in order.
+    if (pindexPrev && !(pindexPrev->nStatus & BLOCK_HAVE_DATA))
+        return state.DoS(0, error("%s : prev block %s not received yet", __func__, block.hashPrevBlock.GetHex()), 0,
+                         "prevblk-not-received");
+
+    // Header already in the block index (headers-first sync), waiting for the block data
+    BlockMap::iterator miSelf = mapBlockIndex.find(block.GetHash());
+    const bool fHeaderOnly = miSelf != mapBlockIndex.end() && !(miSelf->second->nStatus & BLOCK_HAVE_DATA);
+
+    // The work and the proof of stake depend on the parent: a failure doesn't mark the (header-only) entry invalid
     if (block.GetHash() != consensus.hashGenesisBlock && !CheckWork(block, pindexPrev))
         return state.DoS(100, false, REJECT_INVALID);
 
@@ -3154,10 +3281,19 @@ static bool AcceptBlock(const CBlock& block, CValidationState& state, CBlockInde
         if (state.IsInvalid() && !state.CorruptionPossible()) {
             pindex->nStatus |= BLOCK_FAILED_VALID;
             setDirtyBlockIndex.insert(pindex);
+            if (fHeaderOnly) InvalidBlockHeaderFound(pindex);
         }
         return error("%s: %s", __func__, FormatStateMessage(state));
     }
 
+    if (fHeaderOnly) {
+        if (isPoS) pindex->SetProofOfStake();
+        SetBlockStakeModifier(pindex, block);
+        // verified now, it can be the best header
+        if (pindexBestHeader == nullptr || pindexBestHeader->nChainWork < pindex->nChainWork)
+            pindexBestHeader = pindex;
+    }
+
     int nHeight = pindex->nHeight;
     int splitHeight = -1;
 
@@ -3406,6 +3542,63 @@ bool ProcessNewBlock(CValidationState& state, const std::shared_ptr<const CBlock
     return true;
 }
 
+/** Whether the chain ending at pindex extends the active chain, forks from it within the max reorganization depth,
+ *  or goes through the last checkpoint. */
+static bool BuildsOnRecentChain(const CBlockIndex* pindex)
+{
+    AssertLockHeld(cs_main);
+    const CBlockIndex* pindexFork = chainActive.FindFork(pindex);
+    if (pindexFork == chainActive.Tip())
+        return true;
+    const int nMaxReorgDepth = gArgs.GetArg("-maxreorg", DEFAULT_MAX_REORG_DEPTH);
+    if (pindexFork && pindexFork->nHeight >= chainActive.Height() - nMaxReorgDepth)
+        return true;
+    const CBlockIndex* pcheckpoint = Checkpoints::GetLastCheckpoint();
+    return pcheckpoint && pcheckpoint->nHeight > chainActive.Height() && pindex->GetAncestor(pcheckpoint->nHeight) == pcheckpoint;
+}
+
+bool ProcessNewBlockHeaders(const std::vector<CBlockHeader>& headers, CValidationState& state, CBlockIndex** ppindex)
+{
+    AssertLockNotHeld(cs_main);
+    LOCK(cs_main);
+
+    const Consensus::Params& consensus = Params().GetConsensus();
+    for (const CBlockHeader& header : headers) {
+        // Block without transactions: only the header is stored in the block index
+        const CBlock block(header);
+        const uint256& hash = block.GetHash();
+        CBlockIndex* pindex = nullptr;
+        CBlockIndex* pindexPrev = nullptr;
+        if (!mapBlockIndex.count(hash)) {
+            if (!GetPrevIndex(block, &pindexPrev, state))
+                return false;
+            if (pindexPrev == nullptr || !CheckWork(block, pindexPrev))
+                return state.DoS(100, error("%s : incorrect work for header %s", __func__, hash.GetHex()),
+                                 REJECT_INVALID, "bad-diffbits");
+            const int nHeight = pindexPrev->nHeight + 1;
+            if (!consensus.NetworkUpgradeActive(nHeight, Consensus::UPGRADE_POS)) {
+                if (!CheckProofOfWork(hash, block.nBits))
+                    return state.DoS(50, error("%s : proof of work failed for header %s", __func__, hash.GetHex()),
+                                     REJECT_INVALID, "high-hash");
+            } else {
+                // The PoS blocks are checked when received, their kernel needs the parent connected.
+                // Until then, only the headers building on our chain, and not too far ahead of it, are stored.
+                if (nHeight > chainActive.Height() + MAX_HEADERS_AHEAD_OF_TIP)
+                    return state.DoS(0, false, 0, "headers-too-far-ahead");
+                if (!BuildsOnRecentChain(pindexPrev))
+                    return state.DoS(1, error("%s : header %s forks from an old block", __func__, hash.GetHex()),
+                                     REJECT_INVALID, "bad-fork-point");
+            }
+        }
+        if (!AcceptBlockHeader(block, state, &pindex, pindexPrev))
+            return false;
+        if (ppindex)
+            *ppindex = pindex;
+    }
+
+    return true;
+}
+
 bool TestBlockValidity(CValidationState& state, const CBlock& block, CBlockIndex* const pindexPrev, bool fCheckPOW, bool fCheckMerkleRoot, bool fCheckBlockSig)
 {
     AssertLockHeld(cs_main);
@@ -3532,7 +3725,8 @@ bool static LoadBlockIndexDB(std::string& strError)
             pindexBestInvalid = pindex;
         if (pindex->pprev)
             pindex->BuildSkip();
-        if (pindex->IsValid(BLOCK_VALID_TREE) && (pindexBestHeader == NULL || CBlockIndexWorkComparator()(pindexBestHeader, pindex)))
+        // (not the header-only entries of PoS blocks, verified with their block)
+        if (pindex->IsValid(BLOCK_VALID_TREE) && !IsUnverifiedHeader(pindex) && (pindexBestHeader == NULL || CBlockIndexWorkComparator()(pindexBestHeader, pindex)))
             pindexBestHeader = pindex;
     }
 
@@ -3579,10 +3773,6 @@ bool static LoadBlockIndexDB(std::string& strError)
     pblocktree->ReadReindexing(fReindexing);
     if (fReindexing) fReindex = true;
 
-    // Check whether we have a transaction index
-    pblocktree->ReadFlag("txindex", fTxIndex);
-    LogPrintf("LoadBlockIndexDB(): transaction index %s\n", fTxIndex ? "enabled" : "disabled");
-
     // If this is written true before the next client init, then we know the shutdown process failed
     pblocktree->WriteFlag("shutdown", false);
 
@@ -3868,9 +4058,6 @@ bool LoadBlockIndex(std::string& strError)
         // needs_init.
 
         LogPrintf("Initializing databases...\n");
-        // Use the provided setting for -txindex in the new database
-        fTxIndex = gArgs.GetBoolArg("-txindex", DEFAULT_TXINDEX);
-        pblocktree->WriteFlag("txindex", fTxIndex);
     }
     return true;
 }
@@ -3955,7 +4142,9 @@ bool LoadExternalBlockFile(FILE* fileIn, FlatFilePos* dbp)
 
                 // detect out of order blocks, and store them for later
                 uint256 hash = block.GetHash();
-                if (hash != Params().GetConsensus().hashGenesisBlock && mapBlockIndex.find(block.hashPrevBlock) == mapBlockIndex.end()) {
+                BlockMap::iterator miPrev = mapBlockIndex.find(block.hashPrevBlock);
+                if (hash != Params().GetConsensus().hashGenesisBlock &&
+                        (miPrev == mapBlockIndex.end() || !(miPrev->second->nStatus & BLOCK_HAVE_DATA))) {
                     LogPrint(BCLog::REINDEX, "%s: Out of order block %s, parent %s not known\n", __func__,
                             hash.GetHex(), block.hashPrevBlock.GetHex());
                     if (dbp)
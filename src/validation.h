@@ -101,6 +101,9 @@ static const unsigned int MAX_HEADERS_RESULTS = 2000;
  *  degree of disordering of blocks on disk (which make reindexing and in the future perhaps pruning
  *  harder). We'll probably want to make this a per-peer adaptive value at some point. */
 static const unsigned int BLOCK_DOWNLOAD_WINDOW = 1024;
+/** Maximum height above the active tip of the PoS headers stored before their block (headers-first sync).
+ *  Their proof of stake can't be checked until the blocks in between are connected. */
+static const int MAX_HEADERS_AHEAD_OF_TIP = 2 * MAX_HEADERS_RESULTS;
 /** Time to wait (in seconds) between writing blocks/block index to disk. */
 static const unsigned int DATABASE_WRITE_INTERVAL = 60 * 60;
 /** Time to wait (in seconds) between flushing chainstate to disk. */
@@ -142,7 +145,6 @@ extern int64_t g_best_block_time;
 extern std::atomic<bool> fImporting;
 extern std::atomic<bool> fReindex;
 extern int nScriptCheckThreads;
-extern bool fTxIndex;
 extern bool fRequireStandard;
 extern bool fCheckBlockIndex;
 extern size_t nCoinCacheUsage;
@@ -173,6 +175,28 @@ extern CBlockIndex* pindexBestHeader;
  */
 bool ProcessNewBlock(CValidationState& state, const std::shared_ptr<const CBlock> pblock, const FlatFilePos* dbp, bool* fAccepted = nullptr);
 
+/**
+ * Process incoming block headers (headers-first sync). The headers are checked for
+ * continuity and work, and added to the block index without their block data.
+ * The proof of stake is verified later, with the block, once its parent is connected: until then the
+ * PoS headers don't move pindexBestHeader, and they are only stored on a chain building on the active one,
+ * up to MAX_HEADERS_AHEAD_OF_TIP above its tip (further ones are refused with "headers-too-far-ahead").
+ *
+ * @param[in]   headers    The block headers themselves, in chain order
+ * @param[out]  state      This may be set to an Error state if any error occurred processing them
+ * @param[out]  ppindex    If set, the pointer will be set to point to the last block index object accepted
+ * @return True if the headers were accepted
+ */
+bool ProcessNewBlockHeaders(const std::vector<CBlockHeader>& headers, CValidationState& state, CBlockIndex** ppindex = nullptr);
+
+/** Whether the entry is the header of a PoS block stored without its block (headers-first sync): its
+ *  proof of stake is not checked yet, and it is not written to disk. Requires cs_main. */
+bool IsUnverifiedHeader(const CBlockIndex* pindex);
+
+/** Remove unverified headers from the block index (see IsUnverifiedHeader), and delete them. Their
+ *  descendants must be in vErase too. Requires cs_main. */
+void EraseUnverifiedHeaders(const std::vector<CBlockIndex*>& vErase);
+
 /** Open a block file (blk?????.dat) */
 FILE* OpenBlockFile(const FlatFilePos& pos, bool fReadOnly = false);
 /** Open an undo file (rev?????.dat) */
@@ -194,6 +218,8 @@ void UnloadBlockIndex();
 int ActiveProtocol();
 /** Run an instance of the script checking thread */
 void ThreadScriptCheck();
+/** Run an instance of the Sapling proofs checking thread */
+void ThreadSaplingProofCheck();
 
 /** Check whether we are doing an initial block download (synchronizing from disk or network) */
 bool IsInitialBlockDownload();
@@ -321,6 +347,9 @@ public:
 bool WriteBlockToDisk(const CBlock& block, FlatFilePos& pos);
 bool ReadBlockFromDisk(CBlock& block, const FlatFilePos& pos);
 bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex);
+/** Reads the serialized block, as stored on disk (and sent on the network), without deserializing
+ *  its transactions. The header is checked against the block index hash. */
+bool ReadRawBlockFromDisk(std::vector<unsigned char>& block, const CBlockIndex* pindex);
 
 
 /** Functions for validating blocks and updating the block tree */
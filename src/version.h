@@ -11,7 +11,7 @@
  * network protocol versioning
  */
 
-static const int PROTOCOL_VERSION = 70922;
+static const int PROTOCOL_VERSION = 70923;
 
 //! initial proto version, to be increased after version/verack negotiation
 static const int INIT_PROTO_VERSION = 209;
@@ -19,6 +19,12 @@ static const int INIT_PROTO_VERSION = 209;
 //! In this version, 'getheaders' was introduced.
 static const int GETHEADERS_VERSION = 70077;
 
+//! In this version, 'getheaders' is answered with 'headers' (headers-first sync)
+static const int HEADERS_FIRST_VERSION = 70923;
+
+//! "feefilter" tells peers to filter invs to you by fee starting with this version (BIP133)
+static const int FEEFILTER_VERSION = 70923;
+
 //! disconnect from peers older than this proto version
 static const int MIN_PEER_PROTO_VERSION_BEFORE_ENFORCEMENT = 70921;
 static const int MIN_PEER_PROTO_VERSION_AFTER_ENFORCEMENT = 70922;
@@ -6,9 +6,11 @@
 #include "wallet/test/wallet_test_fixture.h"
 
 #include "consensus/merkle.h"
+#include "index/blockfilterindex.h"
 #include "rpc/server.h"
 #include "txmempool.h"
 #include "validation.h"
+#include "validationinterface.h"
 #include "wallet/wallet.h"
 
 #include <set>
@@ -456,6 +458,233 @@ BOOST_FIXTURE_TEST_CASE(importwallet_rescan, TestChain100Setup)
     vpwallets.erase(vpwallets.begin());
 }
 
+// Stakeable outputs found walking the whole wallet, as StakeableCoins did before the index
+static std::set<COutPoint> ScanStakeableCoins(CWallet& wallet)
+{
+    LOCK2(cs_main, wallet.cs_wallet);
+    const Consensus::Params& consensus = Params().GetConsensus();
+    std::set<COutPoint> ret;
+    for (const auto& it : wallet.mapWallet) {
+        const CWalletTx& wtx = it.second;
+        if (wtx.GetDepthInMainChain() < consensus.nStakeMinDepth || wtx.GetBlocksToMaturity() > 0) continue;
+        for (unsigned int i = 0; i < wtx.tx->vout.size(); i++) {
+            const CTxOut& out = wtx.tx->vout[i];
+            if (out.nValue <= 0 || wallet.IsSpent(wtx.GetHash(), i)) continue;
+            if ((wallet.IsMine(out) & ISMINE_SPENDABLE) == ISMINE_NO) continue;
+            ret.emplace(wtx.GetHash(), i);
+        }
+    }
+    return ret;
+}
+
+// Stakeable outputs returned by the index
+static std::set<COutPoint> IndexedStakeableCoins(CWallet& wallet)
+{
+    std::vector<CStakeableOutput> vCoins;
+    wallet.StakeableCoins(&vCoins);
+    std::set<COutPoint> ret;
+    for (const CStakeableOutput& coin : vCoins) {
+        BOOST_CHECK(coin.pindex && coin.pindex->GetBlockHash() == coin.tx->m_confirm.hashBlock);
+        BOOST_CHECK_EQUAL(coin.nDepth, coin.tx->GetDepthInMainChain());
+        ret.emplace(coin.tx->GetHash(), coin.i);
+    }
+    return ret;
+}
+
+static void CheckStakeableCoins(CWallet& wallet, size_t nExpected)
+{
+    SyncWithValidationInterfaceQueue();
+    const std::set<COutPoint> setScanned = ScanStakeableCoins(wallet);
+    BOOST_CHECK_EQUAL(setScanned.size(), nExpected);
+    BOOST_CHECK(IndexedStakeableCoins(wallet) == setScanned);
+    // and the index built from scratch is the same
+    {
+        LOCK2(cs_main, wallet.cs_wallet);
+        wallet.RebuildStakeableCoins();
+    }
+    BOOST_CHECK(IndexedStakeableCoins(wallet) == setScanned);
+}
+
+BOOST_FIXTURE_TEST_CASE(stakeable_coins_index, TestChain100Setup)
+{
+    const Consensus::Params& consensus = Params().GetConsensus();
+    const CScript scriptCoinbase = GetScriptForRawPubKey(coinbaseKey.GetPubKey());
+
+    CWallet wallet;
+    WITH_LOCK(wallet.cs_wallet, wallet.SetLastBlockProcessed(chainActive.Tip()); );
+    AddKey(wallet, coinbaseKey);
+    RegisterValidationInterface(&wallet);
+    {
+        WalletRescanReserver reserver(&wallet);
+        BOOST_CHECK(reserver.reserve());
+        BOOST_CHECK(wallet.ScanForWalletTransactions(chainActive.Genesis(), nullptr, reserver) == nullptr);
+    }
+    // No coinbase is mature yet
+    BOOST_CHECK_EQUAL(consensus.nCoinbaseMaturity, 100);
+    CheckStakeableCoins(wallet, 0);
+
+    // Receive: the first 10 coinbase outputs mature
+    for (int i = 0; i < 10; i++) {
+        CreateAndProcessBlock({}, scriptCoinbase);
+    }
+    CheckStakeableCoins(wallet, 10);
+
+    // Spend: the spent output is removed, one more coinbase matures
+    CKey keyOther;
+    keyOther.MakeNewKey(true);
+    CMutableTransaction spend;
+    spend.vin.emplace_back(COutPoint(coinbaseTxns[0].GetHash(), 0));
+    spend.vout.emplace_back(coinbaseTxns[0].vout[0].nValue - CENT, GetScriptForDestination(keyOther.GetPubKey().GetID()));
+    std::vector<unsigned char> vchSig;
+    uint256 hash = SignatureHash(scriptCoinbase, spend, 0, SIGHASH_ALL, 0, SIGVERSION_BASE);
+    BOOST_CHECK(coinbaseKey.Sign(hash, vchSig));
+    vchSig.push_back((unsigned char)SIGHASH_ALL);
+    spend.vin[0].scriptSig << vchSig;
+    CreateAndProcessBlock({spend}, scriptCoinbase);
+    BOOST_CHECK(chainActive.Tip()->nHeight == 111);
+    CheckStakeableCoins(wallet, 10);
+    BOOST_CHECK(!IndexedStakeableCoins(wallet).count(COutPoint(coinbaseTxns[0].GetHash(), 0)));
+
+    // Reorg: disconnecting the last block makes the coinbase of height 11 immature again.
+    // The spend goes back to the mempool, so its input is still spent.
+    CBlockIndex* pindexTip = WITH_LOCK(cs_main, return chainActive.Tip(); );
+    {
+        CValidationState state;
+        BOOST_CHECK(WITH_LOCK(cs_main, return InvalidateBlock(state, Params(), pindexTip); ));
+        BOOST_CHECK(ActivateBestChain(state));
+    }
+    BOOST_CHECK(WITH_LOCK(cs_main, return chainActive.Height(); ) == 110);
+    CheckStakeableCoins(wallet, 9);
+
+    // and reconnecting it restores the previous state
+    {
+        CValidationState state;
+        BOOST_CHECK(WITH_LOCK(cs_main, return ReconsiderBlock(state, pindexTip); ));
+        BOOST_CHECK(ActivateBestChain(state));
+    }
+    BOOST_CHECK(WITH_LOCK(cs_main, return chainActive.Tip() == pindexTip; ));
+    CheckStakeableCoins(wallet, 10);
+
+    UnregisterValidationInterface(&wallet);
+}
+
+// Sign the only input of tx, spending an output with the given script and key
+static void SignSpend(CMutableTransaction& tx, const CScript& scriptPubKey, const CKey& key, bool fPushPubKey)
+{
+    std::vector<unsigned char> vchSig;
+    uint256 hash = SignatureHash(scriptPubKey, tx, 0, SIGHASH_ALL, 0, SIGVERSION_BASE);
+    BOOST_CHECK(key.Sign(hash, vchSig));
+    vchSig.push_back((unsigned char)SIGHASH_ALL);
+    tx.vin[0].scriptSig << vchSig;
+    if (fPushPubKey) tx.vin[0].scriptSig << ToByteVector(key.GetPubKey());
+}
+
+// Transactions of the active chain paying to or spending from the wallet keys,
+// found by reading every block in order
+static std::set<uint256> SerialScanWalletTxes(const CWallet& wallet)
+{
+    std::set<uint256> setTxes;
+    std::set<COutPoint> setOurs;
+    for (CBlockIndex* pindex = WITH_LOCK(cs_main, return chainActive.Genesis(); ); pindex;
+         pindex = WITH_LOCK(cs_main, return chainActive.Next(pindex); )) {
+        CBlock block;
+        BOOST_CHECK(ReadBlockFromDisk(block, pindex));
+        for (const CTransactionRef& tx : block.vtx) {
+            bool fInvolved = std::any_of(tx->vin.begin(), tx->vin.end(), [&](const CTxIn& txin) {
+                return setOurs.count(txin.prevout) > 0;
+            });
+            for (uint32_t i = 0; i < tx->vout.size(); i++) {
+                if (wallet.IsMine(tx->vout[i]) != ISMINE_NO) {
+                    setOurs.emplace(tx->GetHash(), i);
+                    fInvolved = true;
+                }
+            }
+            if (fInvolved) setTxes.emplace(tx->GetHash());
+        }
+    }
+    return setTxes;
+}
+
+// Transactions added to a new wallet with the given keys by a rescan from genesis
+static std::set<uint256> RescanWalletTxes(const std::vector<CKey>& keys)
+{
+    CWallet wallet;
+    WITH_LOCK(wallet.cs_wallet, wallet.SetLastBlockProcessed(WITH_LOCK(cs_main, return chainActive.Tip(); )); );
+    for (const CKey& key : keys) AddKey(wallet, key);
+    {
+        WalletRescanReserver reserver(&wallet);
+        BOOST_CHECK(reserver.reserve());
+        BOOST_CHECK(wallet.ScanForWalletTransactions(WITH_LOCK(cs_main, return chainActive.Genesis(); ), nullptr, reserver) == nullptr);
+    }
+    std::set<uint256> setTxes;
+    LOCK(wallet.cs_wallet);
+    for (const auto& it : wallet.mapWallet) setTxes.emplace(it.first);
+    return setTxes;
+}
+
+BOOST_FIXTURE_TEST_CASE(rescan_matches_serial_scan, TestChain100Setup)
+{
+    const CScript scriptCoinbase = GetScriptForRawPubKey(coinbaseKey.GetPubKey());
+    CKey keyOurs, keyOther;
+    keyOurs.MakeNewKey(true);
+    keyOther.MakeNewKey(true);
+    const CScript scriptOurs = GetScriptForDestination(keyOurs.GetPubKey().GetID());
+    const CScript scriptOther = GetScriptForDestination(keyOther.GetPubKey().GetID());
+
+    // Blocks not involving the wallet, spread over several rescan batches
+    auto mineOther = [&](int nBlocks) {
+        for (int i = 0; i < nBlocks; i++) CreateAndProcessBlock({}, scriptOther);
+    };
+    mineOther(10);
+
+    // A spend with no output of ours, and a receive from a coinbase to another key of ours
+    CMutableTransaction spendOnly;
+    spendOnly.vin.emplace_back(COutPoint(coinbaseTxns[0].GetHash(), 0));
+    spendOnly.vout.emplace_back(coinbaseTxns[0].vout[0].nValue - CENT, scriptOther);
+    SignSpend(spendOnly, scriptCoinbase, coinbaseKey, false);
+    CMutableTransaction receive;
+    receive.vin.emplace_back(COutPoint(coinbaseTxns[1].GetHash(), 0));
+    receive.vout.emplace_back(coinbaseTxns[1].vout[0].nValue - CENT, scriptOurs);
+    SignSpend(receive, scriptCoinbase, coinbaseKey, false);
+    CreateAndProcessBlock({spendOnly, receive}, scriptOther);
+    mineOther(40);
+
+    // The output received above is spent in a later batch
+    CMutableTransaction spendReceived;
+    spendReceived.vin.emplace_back(COutPoint(receive.GetHash(), 0));
+    spendReceived.vout.emplace_back(receive.vout[0].nValue - CENT, scriptOther);
+    SignSpend(spendReceived, scriptOurs, keyOurs, true);
+    CreateAndProcessBlock({spendReceived}, scriptOther);
+    mineOther(20);
+    BOOST_CHECK_EQUAL(WITH_LOCK(cs_main, return chainActive.Height(); ), 172);
+
+    const std::vector<CKey> keys = {coinbaseKey, keyOurs};
+    CWallet walletRef;
+    for (const CKey& key : keys) AddKey(walletRef, key);
+    const std::set<uint256> setExpected = SerialScanWalletTxes(walletRef);
+    // The 100 coinbase outputs, and the three transactions above
+    BOOST_CHECK_EQUAL(setExpected.size(), 103);
+    BOOST_CHECK(setExpected.count(spendOnly.GetHash()));
+    BOOST_CHECK(setExpected.count(spendReceived.GetHash()));
+
+    // Without block filters, every block is read
+    BOOST_CHECK(RescanWalletTxes(keys) == setExpected);
+
+    // With block filters, the blocks not involving the wallet are skipped
+    BOOST_CHECK(InitBlockFilterIndex(BlockFilterType::BASIC, 1 << 20, true));
+    BlockFilterIndex* filterIndex = GetBlockFilterIndex(BlockFilterType::BASIC);
+    BOOST_REQUIRE(filterIndex);
+    filterIndex->Start();
+    int64_t nTimeStart = GetTimeMillis();
+    while (!filterIndex->BlockUntilSyncedToCurrentChain()) {
+        BOOST_REQUIRE(GetTimeMillis() - nTimeStart < 120 * 1000);
+        MilliSleep(100);
+    }
+    BOOST_CHECK(RescanWalletTxes(keys) == setExpected);
+    filterIndex->Stop();
+    DestroyAllBlockFilterIndexes();
+}
+
 void removeTxFromMempool(CWalletTx& wtx)
 {
     LOCK(mempool.cs);
@@ -11,6 +11,7 @@
 #include "coincontrol.h"
 #include "evo/deterministicmns.h"
 #include "guiinterfaceutil.h"
+#include "index/blockfilterindex.h"
 #include "masternode.h"
 #include "masternode-payments.h"
 #include "policy/policy.h"
@@ -506,7 +507,7 @@ bool CWallet::ChangeWalletPassphrase(const SecureString& strOldWalletPassphrase,
 
 void CWallet::ChainTipAdded(const CBlockIndex *pindex,
                             const CBlock *pblock,
-                            SaplingMerkleTree saplingTree)
+                            SaplingMerkleTree& saplingTree)
 {
     IncrementNoteWitnesses(pindex, pblock, saplingTree);
     m_sspk_man->UpdateSaplingNullifierNoteMapForBlock(pblock);
@@ -745,6 +746,7 @@ void CWallet::AddToSpends(const COutPoint& outpoint, const uint256& wtxid)
 {
     mapTxSpends.emplace(outpoint, wtxid);
     setLockedCoins.erase(outpoint);
+    mapStakeableCoins.erase(outpoint);
 
     std::pair<TxSpends::iterator, TxSpends::iterator> range;
     range = mapTxSpends.equal_range(outpoint);
@@ -768,6 +770,58 @@ void CWallet::AddToSpends(const uint256& wtxid)
     }
 }
 
+void CWallet::UpdateStakeableCoins(const CWalletTx& wtx, const CBlockIndex* pindex)
+{
+    AssertLockHeld(cs_wallet);
+    // Not tracked while the wallet is loading (the index is rebuilt afterwards)
+    if (m_last_block_processed_height < 0) return;
+
+    const uint256& wtxid = wtx.GetHash();
+    for (unsigned int i = 0; i < wtx.tx->vout.size(); i++) {
+        const COutPoint outpoint(wtxid, i);
+        const CTxOut& out = wtx.tx->vout[i];
+        const isminetype mine = (wtx.isConfirmed() && out.nValue > 0 && !IsSpent(outpoint)) ? IsMine(out) : ISMINE_NO;
+        if ((mine & (ISMINE_SPENDABLE | ISMINE_COLD)) == ISMINE_NO) {
+            mapStakeableCoins.erase(outpoint);
+            continue;
+        }
+        StakeableCoin& coin = mapStakeableCoins[outpoint];
+        coin.wtx = &wtx;
+        coin.fCold = (mine == ISMINE_COLD);
+        if (pindex) {
+            coin.pindex = pindex;
+        } else if (coin.pindex && coin.pindex->GetBlockHash() != wtx.m_confirm.hashBlock) {
+            coin.pindex = nullptr;
+        }
+    }
+}
+
+void CWallet::UpdateStakeableCoinsSpentBy(const CWalletTx& wtx)
+{
+    AssertLockHeld(cs_wallet);
+    // A change in the state of wtx can make the outputs it spends available again
+    for (const CTxIn& txin : wtx.tx->vin) {
+        auto it = mapWallet.find(txin.prevout.hash);
+        if (it != mapWallet.end()) {
+            UpdateStakeableCoins(it->second);
+        }
+    }
+}
+
+void CWallet::RebuildStakeableCoins()
+{
+    AssertLockHeld(cs_main);
+    AssertLockHeld(cs_wallet);
+    mapStakeableCoins.clear();
+    for (const auto& it : mapWallet) {
+        const CWalletTx& wtx = it.second;
+        if (!wtx.isConfirmed()) continue;
+        auto mi = mapBlockIndex.find(wtx.m_confirm.hashBlock);
+        UpdateStakeableCoins(wtx, mi != mapBlockIndex.end() ? mi->second : nullptr);
+    }
+    LogPrintf("%s: %d stakeable outputs\n", __func__, mapStakeableCoins.size());
+}
+
 bool CWallet::GetVinAndKeysFromOutput(COutput out, CTxIn& txinRet, CPubKey& pubKeyRet, CKey& keyRet, bool fColdStake)
 {
     // wait for reindex and/or import to finish
@@ -963,6 +1017,9 @@ bool CWallet::AddToWallet(const CWalletTx& wtxIn, bool fFlushOnClose)
         }
     }
 
+    // Sapling: track the witnesses of our notes
+    m_sspk_man->AddToWitnessedNotes(wtx);
+
     //// debug print
     LogPrintf("AddToWallet %s  %s%s\n", wtxIn.GetHash().ToString(), (fInsertedNew ? "new" : ""), (fUpdated ? "update" : ""));
 
@@ -975,6 +1032,10 @@ bool CWallet::AddToWallet(const CWalletTx& wtxIn, bool fFlushOnClose)
     // Break debit/credit balance caches:
     wtx.MarkDirty();
 
+    // Update the stakeable outputs index
+    UpdateStakeableCoins(wtx);
+    if (fUpdated) UpdateStakeableCoinsSpentBy(wtx);
+
     // Notify UI of new or updated transaction
     NotifyTransactionChanged(this, hash, fInsertedNew ? CT_NEW : CT_UPDATED);
 
@@ -1029,6 +1090,7 @@ bool CWallet::LoadToWallet(CWalletTx& wtxIn)
     wtx.BindWallet(this);
     // Sapling
     m_sspk_man->UpdateNullifierNoteMapWithTx(wtx);
+    m_sspk_man->AddToWitnessedNotes(wtx);
     wtxOrdered.emplace(wtx.nOrderPos, &wtx);
     AddToSpends(hash);
     for (const CTxIn& txin : wtx.tx->vin) {
@@ -1043,11 +1105,12 @@ bool CWallet::LoadToWallet(CWalletTx& wtxIn)
     return true;
 }
 
-bool CWallet::FindNotesDataAndAddMissingIVKToKeystore(const CTransaction& tx, Optional<mapSaplingNoteData_t>& saplingNoteData)
+bool CWallet::FindNotesDataAndAddMissingIVKToKeystore(const CTransaction& tx, Optional<mapSaplingNoteData_t>& saplingNoteData,
+                                                      const SaplingNotesFound* pSaplingNotes)
 {
-    auto saplingNoteDataAndAddressesToAdd = m_sspk_man->FindMySaplingNotes(tx);
+    const SaplingNotesFound saplingNoteDataAndAddressesToAdd = pSaplingNotes ? *pSaplingNotes : m_sspk_man->FindMySaplingNotes(tx);
     saplingNoteData = saplingNoteDataAndAddressesToAdd.first;
-    auto addressesToAdd = saplingNoteDataAndAddressesToAdd.second;
+    const auto& addressesToAdd = saplingNoteDataAndAddressesToAdd.second;
     // Add my addresses
     for (const auto& addressToAdd : addressesToAdd) {
         if (!m_sspk_man->AddSaplingIncomingViewingKey(addressToAdd.second, addressToAdd.first)) {
@@ -1057,6 +1120,17 @@ bool CWallet::FindNotesDataAndAddMissingIVKToKeystore(const CTransaction& tx, Op
     return true;
 }
 
+std::vector<SaplingNotesFound> CWallet::TrialDecryptSaplingNotes(const std::vector<CTransactionRef>& vtx) const
+{
+    std::vector<SaplingNotesFound> vNotes;
+    if (!HasSaplingSPKM()) return vNotes;
+    vNotes.reserve(vtx.size());
+    for (const CTransactionRef& ptx : vtx) {
+        vNotes.emplace_back(m_sspk_man->FindMySaplingNotes(*ptx));
+    }
+    return vNotes;
+}
+
 void CWallet::AddExternalNotesDataToTx(CWalletTx& wtx) const
 {
     if (HasSaplingSPKM() && wtx.tx->IsShieldedTx()) {
@@ -1094,7 +1168,8 @@ void CWallet::AddExternalNotesDataToTx(CWalletTx& wtx) const
  * Abandoned state should probably be more carefully tracked via different
  * posInBlock signals or by checking mempool presence when necessary.
  */
-bool CWallet::AddToWalletIfInvolvingMe(const CTransactionRef& ptx, const CWalletTx::Confirmation& confirm, bool fUpdate)
+bool CWallet::AddToWalletIfInvolvingMe(const CTransactionRef& ptx, const CWalletTx::Confirmation& confirm, bool fUpdate,
+                                       const SaplingNotesFound* pSaplingNotes)
 {
     const CTransaction& tx = *ptx;
     {
@@ -1119,7 +1194,7 @@ bool CWallet::AddToWalletIfInvolvingMe(const CTransactionRef& ptx, const CWallet
         // Check tx for Sapling notes
         Optional<mapSaplingNoteData_t> saplingNoteData {nullopt};
         if (HasSaplingSPKM()) {
-            if (!FindNotesDataAndAddMissingIVKToKeystore(tx, saplingNoteData)) {
+            if (!FindNotesDataAndAddMissingIVKToKeystore(tx, saplingNoteData, pSaplingNotes)) {
                 return false; // error adding incoming viewing key.
             }
         }
@@ -1197,6 +1272,7 @@ bool CWallet::AbandonTransaction(const uint256& hashTx)
             wtx.setAbandoned();
             wtx.MarkDirty();
             walletdb.WriteTx(wtx);
+            UpdateStakeableCoinsSpentBy(wtx);
             NotifyTransactionChanged(this, wtx.GetHash(), CT_UPDATED);
             // Iterate over all its outputs, and mark transactions in the wallet that spend them abandoned too
             TxSpends::const_iterator iter = mapTxSpends.lower_bound(COutPoint(now, 0));
@@ -1257,6 +1333,8 @@ void CWallet::MarkConflicted(const uint256& hashBlock, int conflicting_height, c
             wtx.setConflicted();
             wtx.MarkDirty();
             walletdb.WriteTx(wtx);
+            UpdateStakeableCoins(wtx);
+            UpdateStakeableCoinsSpentBy(wtx);
             // Iterate over all its outputs, and mark transactions in the wallet that spend them conflicted too
             TxSpends::const_iterator iter = mapTxSpends.lower_bound(COutPoint(now, 0));
             while (iter != mapTxSpends.end() && iter->first.hash == now) {
@@ -1277,9 +1355,9 @@ void CWallet::MarkConflicted(const uint256& hashBlock, int conflicting_height, c
     }
 }
 
-void CWallet::SyncTransaction(const CTransactionRef& ptx, const CWalletTx::Confirmation& confirm)
+void CWallet::SyncTransaction(const CTransactionRef& ptx, const CWalletTx::Confirmation& confirm, const SaplingNotesFound* pSaplingNotes)
 {
-    if (!AddToWalletIfInvolvingMe(ptx, confirm, true)) {
+    if (!AddToWalletIfInvolvingMe(ptx, confirm, true, pSaplingNotes)) {
         return; // Not one of ours
     }
 
@@ -1288,9 +1366,11 @@ void CWallet::SyncTransaction(const CTransactionRef& ptx, const CWalletTx::Confi
 
 void CWallet::TransactionAddedToMempool(const CTransactionRef& ptx)
 {
+    // Trial decryption without the wallet lock, it's taken only to record the notes found
+    const std::vector<SaplingNotesFound> vSaplingNotes = TrialDecryptSaplingNotes({ptx});
     LOCK(cs_wallet);
     CWalletTx::Confirmation confirm(CWalletTx::Status::UNCONFIRMED, /* block_height */ 0, {}, /* nIndex */ 0);
-    SyncTransaction(ptx, confirm);
+    SyncTransaction(ptx, confirm, vSaplingNotes.empty() ? nullptr : &vSaplingNotes[0]);
 
     auto it = mapWallet.find(ptx->GetHash());
     if (it != mapWallet.end()) {
@@ -1299,6 +1379,8 @@ void CWallet::TransactionAddedToMempool(const CTransactionRef& ptx)
 }
 
 void CWallet::TransactionRemovedFromMempool(const CTransactionRef &ptx, MemPoolRemovalReason reason) {
+    const std::vector<SaplingNotesFound> vSaplingNotes = reason == MemPoolRemovalReason::CONFLICT ?
+            TrialDecryptSaplingNotes({ptx}) : std::vector<SaplingNotesFound>();
     LOCK(cs_wallet);
     auto it = mapWallet.find(ptx->GetHash());
     if (it != mapWallet.end()) {
@@ -1332,12 +1414,15 @@ void CWallet::TransactionRemovedFromMempool(const CTransactionRef &ptx, MemPoolR
         // distinguishing between conflicted and unconfirmed transactions are
         // imperfect, and could be improved in general, see
         // https://github.com/bitcoin-core/bitcoin-devwiki/wiki/Wallet-Transaction-Conflict-Tracking
-        SyncTransaction(ptx, {CWalletTx::Status::UNCONFIRMED, /* block height  */ 0, /* block hash */ {}, /* index */ 0});
+        SyncTransaction(ptx, {CWalletTx::Status::UNCONFIRMED, /* block height  */ 0, /* block hash */ {}, /* index */ 0},
+                        vSaplingNotes.empty() ? nullptr : &vSaplingNotes[0]);
     }
 }
 
 void CWallet::BlockConnected(const std::shared_ptr<const CBlock>& pblock, const CBlockIndex *pindex)
 {
+    // Trial decryption without the wallet lock, it's taken only to record the notes found
+    const std::vector<SaplingNotesFound> vSaplingNotes = TrialDecryptSaplingNotes(pblock->vtx);
     {
         LOCK(cs_wallet);
 
@@ -1347,8 +1432,13 @@ void CWallet::BlockConnected(const std::shared_ptr<const CBlock>& pblock, const
         for (size_t index = 0; index < pblock->vtx.size(); index++) {
             CWalletTx::Confirmation confirm(CWalletTx::Status::CONFIRMED, m_last_block_processed_height,
                                             m_last_block_processed, index);
-            SyncTransaction(pblock->vtx[index], confirm);
+            SyncTransaction(pblock->vtx[index], confirm, vSaplingNotes.empty() ? nullptr : &vSaplingNotes[index]);
             TransactionRemovedFromMempool(pblock->vtx[index], MemPoolRemovalReason::BLOCK);
+            // Set the block of the (new) stakeable outputs
+            auto it = mapWallet.find(pblock->vtx[index]->GetHash());
+            if (it != mapWallet.end()) {
+                UpdateStakeableCoins(it->second, pindex);
+            }
         }
 
         // Sapling: notify about the connected block
@@ -1379,6 +1469,7 @@ void CWallet::BlockConnected(const std::shared_ptr<const CBlock>& pblock, const
 
 void CWallet::BlockDisconnected(const std::shared_ptr<const CBlock>& pblock, const uint256& blockHash, int nBlockHeight, int64_t blockTime)
 {
+    const std::vector<SaplingNotesFound> vSaplingNotes = TrialDecryptSaplingNotes(pblock->vtx);
     LOCK(cs_wallet);
 
     // At block disconnection, this will change an abandoned transaction to
@@ -1388,9 +1479,9 @@ void CWallet::BlockDisconnected(const std::shared_ptr<const CBlock>& pblock, con
     m_last_block_processed_height = nBlockHeight - 1;
     m_last_block_processed_time = blockTime;
     m_last_block_processed = blockHash;
-    for (const CTransactionRef& ptx : pblock->vtx) {
+    for (size_t index = 0; index < pblock->vtx.size(); index++) {
         CWalletTx::Confirmation confirm(CWalletTx::Status::UNCONFIRMED, /* block_height */ 0, {}, /* nIndex */ 0);
-        SyncTransaction(ptx, confirm);
+        SyncTransaction(pblock->vtx[index], confirm, vSaplingNotes.empty() ? nullptr : &vSaplingNotes[index]);
     }
 
     if (Params().GetConsensus().NetworkUpgradeActive(nBlockHeight, Consensus::UPGRADE_V5_0)) {
@@ -1458,6 +1549,8 @@ void CWallet::EraseFromWallet(const uint256& hash)
 {
     {
         LOCK(cs_wallet);
+        mapStakeableCoins.erase(mapStakeableCoins.lower_bound(COutPoint(hash, 0)),
+                                mapStakeableCoins.upper_bound(COutPoint(hash, std::numeric_limits<uint32_t>::max())));
         if (mapWallet.erase(hash))
             CWalletDB(*dbw).EraseTx(hash);
         LogPrintf("%s: Erased wtx %s from wallet\n", __func__, hash.GetHex());
@@ -1880,11 +1973,106 @@ int64_t CWallet::RescanFromTime(int64_t startTime, const WalletRescanReserver& r
     return startTime;
 }
 
+/** Number of blocks read ahead during a rescan */
+static const int RESCAN_BATCH_SIZE = 50;
+/** Maximum number of threads reading and deserializing blocks during a rescan */
+static const int RESCAN_PREFETCH_THREADS = 4;
+
+namespace {
+
+/** A block read ahead by the rescan, and whether it may involve the wallet */
+struct RescanBlock
+{
+    CBlockIndex* pindex{nullptr};
+    CBlock block;
+    bool fRead{false};
+    // False only if no output is ours, and no transaction can carry shielded
+    // or special payloads. Spends of wallet coins are checked when committing.
+    bool fCandidate{true};
+    // The block filter excluded the block: it was not read, and has no shielded outputs.
+    bool fSkipped{false};
+};
+
+} // anon namespace
+
+/**
+ * Whether the basic block filter of pindex proves that the block has nothing for the wallet.
+ * Blocks adding Sapling commitments are never excluded, as our notes can only be found by
+ * trial decryption, and the commitments are needed to update the witnesses.
+ */
+static bool IsExcludedByBlockFilter(const CBlockIndex* pindex, const GCSFilter::ElementSet* pFilterElements)
+{
+    const BlockFilterIndex* filterIndex = GetBlockFilterIndex(BlockFilterType::BASIC);
+    if (!pFilterElements || !filterIndex || !pindex->pprev ||
+            pindex->hashFinalSaplingRoot != pindex->pprev->hashFinalSaplingRoot) {
+        return false;
+    }
+    BlockFilter filter;
+    return filterIndex->LookupFilter(pindex, filter) && !filter.GetFilter().MatchAny(*pFilterElements);
+}
+
+/**
+ * Read and deserialize the blocks of a rescan batch in parallel, flagging the
+ * ones that can be skipped by the commit stage (needs only the keystore lock).
+ * If the block filter index is available, the blocks it excludes are not read at all.
+ */
+static std::vector<RescanBlock> PrefetchRescanBatch(const CWallet* pwallet, const std::vector<CBlockIndex*>& vIndex,
+                                                    std::shared_ptr<const GCSFilter::ElementSet> filterElements)
+{
+    std::vector<RescanBlock> vBlocks(vIndex.size());
+    const int nThreads = std::max(1, std::min({RESCAN_PREFETCH_THREADS, GetNumCores(), (int) vIndex.size()}));
+    auto readBlocks = [&](int nStart) {
+        for (size_t i = nStart; i < vIndex.size(); i += nThreads) {
+            RescanBlock& rb = vBlocks[i];
+            rb.pindex = vIndex[i];
+            if (IsExcludedByBlockFilter(rb.pindex, filterElements.get())) {
+                rb.fRead = rb.fSkipped = true;
+                rb.fCandidate = false;
+                continue;
+            }
+            rb.fRead = ReadBlockFromDisk(rb.block, rb.pindex);
+            if (!rb.fRead) continue;
+            rb.fCandidate = std::any_of(rb.block.vtx.begin(), rb.block.vtx.end(), [&](const CTransactionRef& tx) {
+                return tx->IsShieldedTx() || tx->IsSpecialTx() || tx->HasZerocoinSpendInputs() || pwallet->IsMine(tx);
+            });
+        }
+    };
+    std::vector<std::future<void>> vTasks;
+    for (int i = 1; i < nThreads; i++) {
+        vTasks.emplace_back(std::async(std::launch::async, readBlocks, i));
+    }
+    readBlocks(0);
+    for (auto& task : vTasks) task.get();
+    return vBlocks;
+}
+
+/**
+ * Collect up to RESCAN_BATCH_SIZE blocks of the active chain, starting from pindex
+ * (included) and ending at pindexStop (included), if set.
+ */
+static std::vector<CBlockIndex*> GetRescanBatch(CBlockIndex* pindex, const CBlockIndex* pindexStop)
+{
+    std::vector<CBlockIndex*> vIndex;
+    LOCK(cs_main);
+    while (pindex && (int) vIndex.size() < RESCAN_BATCH_SIZE) {
+        vIndex.emplace_back(pindex);
+        if (pindex == pindexStop) break;
+        pindex = chainActive.Next(pindex);
+    }
+    return vIndex;
+}
+
 /**
  * Scan the block chain (starting in pindexStart) for transactions
  * from or to us. If fUpdate is true, found transactions that already
  * exist in the wallet will be updated.
  *
+ * The scan is pipelined: while a batch of blocks is committed to the wallet
+ * (taking cs_main and cs_wallet once for the batch, after the trial decryption
+ * of its shielded outputs), the next one is read from disk and filtered in
+ * parallel. Blocks that cannot involve the wallet only advance the Sapling
+ * note witnesses.
+ *
  * Returns null if scan was successful. Otherwise, if a complete rescan was not
  * possible (due to pruning or corruption), returns pointer to the most recent
  * block that could not be scanned.
@@ -1899,6 +2087,7 @@ int64_t CWallet::RescanFromTime(int64_t startTime, const WalletRescanReserver& r
 CBlockIndex* CWallet::ScanForWalletTransactions(CBlockIndex* pindexStart, CBlockIndex* pindexStop, const WalletRescanReserver& reserver, bool fUpdate, bool fromStartup)
 {
     int64_t nNow = GetTime();
+    const int64_t nStartTimeMillis = GetTimeMillis();
 
     assert(reserver.isReserved());
     if (pindexStop) {
@@ -1920,57 +2109,127 @@ CBlockIndex* CWallet::ScanForWalletTransactions(CBlockIndex* pindexStart, CBlock
         }
 
         std::vector<uint256> myTxHashes;
-        while (pindex && !fAbortRescan) {
+        // Sapling tree after the last committed block, carried forward instead
+        // of being reloaded from the coins view at every block.
+        SaplingMerkleTree saplingTree;
+        const CBlockIndex* pindexSaplingTree = nullptr;
+        // Committing a transaction can top up the keypool (see MarkUnusedAddresses),
+        // while the next batch is already being filtered against the previous keys.
+        bool fAddedInPrevBatch = false;
+        int64_t nBlocksScanned = 0;
+
+        // Wallet elements matched against the block filters, rebuilt when the wallet changes
+        std::shared_ptr<const GCSFilter::ElementSet> filterElements;
+        const bool fUseBlockFilters = GetBlockFilterIndex(BlockFilterType::BASIC) != nullptr;
+        if (fUseBlockFilters) {
+            filterElements = std::make_shared<const GCSFilter::ElementSet>(WITH_LOCK(cs_wallet, return GetBlockFilterElements(); ));
+        }
+
+        std::vector<CBlockIndex*> vIndex = GetRescanBatch(pindex, pindexStop);
+        std::future<std::vector<RescanBlock>> nextBatch = std::async(std::launch::async, PrefetchRescanBatch, this, vIndex, filterElements);
+        while (!vIndex.empty() && !fAbortRescan) {
+            if (fromStartup && ShutdownRequested()) {
+                break;
+            }
+            std::vector<RescanBlock> vBlocks = nextBatch.get();
+            const bool fLastBatch = vIndex.back() == pindexStop;
+
+            // Start reading the next batch while this one is committed
+            CBlockIndex* pindexNext = fLastBatch ? nullptr : WITH_LOCK(cs_main, return chainActive.Next(vBlocks.back().pindex); );
+            vIndex = GetRescanBatch(pindexNext, pindexStop);
+            if (!vIndex.empty()) {
+                if (fUseBlockFilters && fAddedInPrevBatch) {
+                    filterElements = std::make_shared<const GCSFilter::ElementSet>(WITH_LOCK(cs_wallet, return GetBlockFilterElements(); ));
+                }
+                nextBatch = std::async(std::launch::async, PrefetchRescanBatch, this, vIndex, filterElements);
+            }
+
             double gvp = 0;
-            if (pindex->nHeight % 100 == 0 && dProgressTip - dProgressStart > 0.0) {
-                gvp = WITH_LOCK(cs_main, return Checkpoints::GuessVerificationProgress(pindex, false); );
-                ShowProgress(_("Rescanning..."), std::max(1, std::min(99, (int)((gvp - dProgressStart) / (dProgressTip - dProgressStart) * 100))));
+            if (dProgressTip - dProgressStart > 0.0) {
+                gvp = WITH_LOCK(cs_main, return Checkpoints::GuessVerificationProgress(vBlocks.front().pindex, false); );
+                const int64_t nElapsed = std::max<int64_t>(1, GetTimeMillis() - nStartTimeMillis);
+                ShowProgress(strprintf("%s (%d %s)", _("Rescanning..."), nBlocksScanned * 1000 / nElapsed, _("blocks/s")),
+                             std::max(1, std::min(99, (int)((gvp - dProgressStart) / (dProgressTip - dProgressStart) * 100))));
             }
             if (GetTime() >= nNow + 60) {
                 nNow = GetTime();
-                LogPrintf("Still rescanning. At block %d. Progress=%f\n", pindex->nHeight, gvp);
+                const int64_t nElapsed = std::max<int64_t>(1, GetTimeMillis() - nStartTimeMillis);
+                LogPrintf("Still rescanning. At block %d. Progress=%f (%d blocks/s)\n", vBlocks.front().pindex->nHeight, gvp, nBlocksScanned * 1000 / nElapsed);
             }
-            if (fromStartup && ShutdownRequested()) {
-                break;
+
+            // Trial decryption of the batch without the wallet lock, it's taken only to record the notes found
+            std::vector<std::vector<SaplingNotesFound>> vSaplingNotes(vBlocks.size());
+            for (size_t i = 0; i < vBlocks.size(); i++) {
+                if (vBlocks[i].fRead && vBlocks[i].fCandidate) {
+                    vSaplingNotes[i] = TrialDecryptSaplingNotes(vBlocks[i].block.vtx);
+                }
             }
 
-            CBlock block;
-            if (ReadBlockFromDisk(block, pindex)) {
+            bool fTrustFilter = !fAddedInPrevBatch;
+            fAddedInPrevBatch = false;
+            {
+                // Commit the batch under a single lock
                 LOCK2(cs_main, cs_wallet);
-                if (pindex && !chainActive.Contains(pindex)) {
-                     // Abort scan if current block is no longer active, to prevent
-                     // marking transactions as coming from the wrong block.
-                     ret = pindex;
-                     break;
-                 }
-                for (int posInBlock = 0; posInBlock < (int) block.vtx.size(); posInBlock++) {
-                    const auto& tx = block.vtx[posInBlock];
-                    CWalletTx::Confirmation confirm(CWalletTx::Status::CONFIRMED, pindex->nHeight, pindex->GetBlockHash(), posInBlock);
-                    if (AddToWalletIfInvolvingMe(tx, confirm, fUpdate)) {
-                        myTxHashes.push_back(tx->GetHash());
+                for (size_t i = 0; i < vBlocks.size(); i++) {
+                    RescanBlock& rb = vBlocks[i];
+                    pindex = rb.pindex;
+                    if (fAbortRescan || (fromStartup && ShutdownRequested())) {
+                        break;
+                    }
+                    if (!rb.fRead) {
+                        ret = pindex;
+                        continue;
+                    }
+                    if (!chainActive.Contains(pindex)) {
+                        // Abort scan if current block is no longer active, to prevent
+                        // marking transactions as coming from the wrong block.
+                        ret = pindex;
+                        vIndex.clear();
+                        break;
+                    }
+                    nBlocksScanned++;
+
+                    if (rb.fSkipped && !fTrustFilter) {
+                        // The block filter was matched against elements that may be outdated (rare: a
+                        // transaction was added in this batch or the previous one), read it now
+                        if (!ReadBlockFromDisk(rb.block, pindex)) {
+                            ret = pindex;
+                            continue;
+                        }
+                        rb.fSkipped = false;
+                    }
+
+                    const CBlock& block = rb.block;
+                    if (rb.fCandidate || !fTrustFilter || IsBlockTouchingWallet(block)) {
+                        for (int posInBlock = 0; posInBlock < (int) block.vtx.size(); posInBlock++) {
+                            const auto& tx = block.vtx[posInBlock];
+                            CWalletTx::Confirmation confirm(CWalletTx::Status::CONFIRMED, pindex->nHeight, pindex->GetBlockHash(), posInBlock);
+                            const SaplingNotesFound* pSaplingNotes = vSaplingNotes[i].empty() ? nullptr : &vSaplingNotes[i][posInBlock];
+                            if (AddToWalletIfInvolvingMe(tx, confirm, fUpdate, pSaplingNotes)) {
+                                myTxHashes.push_back(tx->GetHash());
+                                fTrustFilter = false;
+                                fAddedInPrevBatch = true;
+                            }
+                        }
                     }
-                }
 
-                // Sapling
-                // This should never fail: we should always be able to get the tree
-                // state on the path to the tip of our chain
-                if (pindex->pprev) {
-                    if (Params().GetConsensus().NetworkUpgradeActive(pindex->pprev->nHeight, Consensus::UPGRADE_V5_0)) {
-                        SaplingMerkleTree saplingTree;
-                        assert(pcoinsTip->GetSaplingAnchorAt(pindex->pprev->hashFinalSaplingRoot, saplingTree));
-                        // Increment note witness caches
-                        ChainTipAdded(pindex, &block, saplingTree);
+                    // Sapling
+                    // This should never fail: we should always be able to get the tree
+                    // state on the path to the tip of our chain
+                    if (pindex->pprev) {
+                        if (Params().GetConsensus().NetworkUpgradeActive(pindex->pprev->nHeight, Consensus::UPGRADE_V5_0)) {
+                            if (pindexSaplingTree != pindex->pprev) {
+                                assert(pcoinsTip->GetSaplingAnchorAt(pindex->pprev->hashFinalSaplingRoot, saplingTree));
+                            }
+                            // Increment note witness caches (and append the block commitments to the tree)
+                            ChainTipAdded(pindex, &block, saplingTree);
+                            pindexSaplingTree = pindex;
+                        }
                     }
                 }
-            } else {
-                ret = pindex;
-            }
-            if (pindex == pindexStop) {
-                break;
             }
             {
                 LOCK(cs_main);
-                pindex = chainActive.Next(pindex);
                 if (tip != chainActive.Tip()) {
                     tip = chainActive.Tip();
                     // in case the tip has changed, update progress max
@@ -1992,14 +2251,65 @@ CBlockIndex* CWallet::ScanForWalletTransactions(CBlockIndex* pindexStart, CBlock
             }
         }
 
+        const int64_t nElapsed = std::max<int64_t>(1, GetTimeMillis() - nStartTimeMillis);
         if (pindex && fAbortRescan) {
             LogPrintf("Rescan aborted at block %d. Progress=%f\n", pindex->nHeight, Checkpoints::GuessVerificationProgress(pindex, false));
         }
+        LogPrintf("Rescan scanned %d blocks in %dms (%d blocks/s)\n", nBlocksScanned, nElapsed, nBlocksScanned * 1000 / nElapsed);
         ShowProgress(_("Rescanning..."), 100); // hide progress dialog in GUI
     }
     return ret;
 }
 
+GCSFilter::ElementSet CWallet::GetBlockFilterElements() const
+{
+    AssertLockHeld(cs_wallet);
+    GCSFilter::ElementSet elements;
+    auto addScript = [&elements](const CScript& script) { elements.emplace(script.begin(), script.end()); };
+    {
+        LOCK(cs_KeyStore);
+        std::set<CKeyID> setKeyIds;
+        GetKeys(setKeyIds);
+        for (const CKeyID& keyId : setKeyIds) {
+            addScript(GetScriptForDestination(keyId));
+            CPubKey pubKey;
+            if (GetPubKey(keyId, pubKey)) {
+                addScript(GetScriptForRawPubKey(pubKey));
+            }
+        }
+        for (const auto& it : mapScripts) {
+            addScript(GetScriptForDestination(CScriptID(it.second)));
+        }
+        for (const CScript& script : setWatchOnly) {
+            addScript(script);
+        }
+    }
+    for (const auto& it : mapWallet) {
+        const CWalletTx& wtx = it.second;
+        for (unsigned int i = 0; i < wtx.tx->vout.size(); i++) {
+            if (IsMine(wtx.tx->vout[i]) != ISMINE_NO) {
+                elements.emplace(BasicFilterOutPointElement(COutPoint(wtx.GetHash(), i)));
+            }
+        }
+    }
+    for (const auto& it : m_sspk_man->mapSaplingNullifiersToNotes) {
+        elements.emplace(it.first.begin(), it.first.end());
+    }
+    return elements;
+}
+
+bool CWallet::IsBlockTouchingWallet(const CBlock& block) const
+{
+    AssertLockHeld(cs_wallet);
+    for (const auto& tx : block.vtx) {
+        if (mapWallet.count(tx->GetHash())) return true;
+        for (const CTxIn& txin : tx->vin) {
+            if (mapWallet.count(txin.prevout.hash) || mapTxSpends.count(txin.prevout)) return true;
+        }
+    }
+    return false;
+}
+
 void CWallet::ReacceptWalletTransactions(bool fFirstLoad)
 {
     LOCK2(cs_main, cs_wallet);
@@ -2695,42 +3005,51 @@ bool CWallet::StakeableCoins(std::vector<CStakeableOutput>* pCoins)
 {
     const bool fIncludeColdStaking = !sporkManager.IsSporkActive(SPORK_19_COLDSTAKING_MAINTENANCE) &&
                                      gArgs.GetBoolArg("-coldstaking", DEFAULT_COLDSTAKING);
+    const Consensus::Params& consensus = Params().GetConsensus();
 
     if (pCoins) pCoins->clear();
 
-    LOCK2(cs_main, cs_wallet);
-    for (const auto& it : mapWallet) {
-        const uint256& wtxid = it.first;
-        const CWalletTx* pcoin = &(it).second;
-
-        // Check if the tx is selectable
-        int nDepth = 0;
-        bool safeTx = false;
-        if (!CheckTXAvailability(pcoin, true, nDepth, safeTx))
-            continue;
-
-        // Check min depth requirement for stake inputs
-        if (nDepth < Params().GetConsensus().nStakeMinDepth) continue;
-
-        const CBlockIndex* pindex = nullptr;
-        for (unsigned int index = 0; index < pcoin->tx->vout.size(); index++) {
+    bool fUnresolved = false;
+    {
+        LOCK(cs_wallet);
+        if (m_last_block_processed_height < 0) return false;
+        for (const auto& it : mapStakeableCoins) {
+            const COutPoint& outpoint = it.first;
+            const StakeableCoin& coin = it.second;
+            const CWalletTx* pcoin = coin.wtx;
 
-            auto res = CheckOutputAvailability(
-                    pcoin->tx->vout[index],
-                    index,
-                    wtxid,
-                    nullptr, // coin control
-                    false,   // fIncludeDelegated
-                    fIncludeColdStaking,
-                    false,
-                    false);   // fIncludeLocked
+            // Check min depth requirement for stake inputs (and maturity of coinbase/coinstake outputs)
+            const int nDepth = m_last_block_processed_height - pcoin->m_confirm.block_height + 1;
+            if (nDepth < consensus.nStakeMinDepth) continue;
+            if ((pcoin->IsCoinBase() || pcoin->IsCoinStake()) && nDepth <= consensus.nCoinbaseMaturity) continue;
 
-            if (!res.available || !res.spendable) continue;
+            // Skip locked utxo, and cold coins without delegator
+            if (IsLockedCoin(outpoint.hash, outpoint.n)) continue;
+            if (coin.fCold && (!fIncludeColdStaking || !HasDelegator(pcoin->tx->vout[outpoint.n]))) continue;
 
             // found valid coin
             if (!pCoins) return true;
-            if (!pindex) pindex = mapBlockIndex.at(pcoin->m_confirm.hashBlock);
-            pCoins->emplace_back(pcoin, (int) index, nDepth, pindex);
+            const CBlockIndex* pindex = coin.pindex;
+            pCoins->emplace_back(pcoin, (int) outpoint.n, nDepth, pindex);
+            fUnresolved |= (pindex == nullptr);
+        }
+    }
+
+    if (fUnresolved) {
+        // Look up (once) the blocks of the outputs added without a block index (e.g. during a rescan)
+        LOCK2(cs_main, cs_wallet);
+        for (auto it = pCoins->begin(); it != pCoins->end();) {
+            if (!it->pindex) {
+                auto mi = mapBlockIndex.find(it->tx->m_confirm.hashBlock);
+                if (mi == mapBlockIndex.end() || !chainActive.Contains(mi->second)) {
+                    it = pCoins->erase(it);
+                    continue;
+                }
+                it->pindex = mi->second;
+                auto sc = mapStakeableCoins.find(COutPoint(it->tx->GetHash(), it->i));
+                if (sc != mapStakeableCoins.end()) sc->second.pindex = it->pindex;
+            }
+            it++;
         }
     }
     return (pCoins && !pCoins->empty());
@@ -3253,6 +3572,17 @@ bool CWallet::CreateTransaction(CScript scriptPubKey, const CAmount& nValue, CTr
     return CreateTransaction(vecSend, wtxNew, reservekey, nFeeRet, nChangePosInOut, strFailReason, coinControl, true, nFeePay, fIncludeDelegated);
 }
 
+// Whether the kernel search engine was prepared for the same coins (and in the same order)
+static bool IsSameStakeSet(const CStakeKernelSearch& search, const std::vector<CStakeableOutput>& coins)
+{
+    if (search.Size() != coins.size()) return false;
+    for (size_t i = 0; i < coins.size(); i++) {
+        const COutPoint& outpoint = search.GetOutPoint(i);
+        if (outpoint.n != (uint32_t) coins[i].i || outpoint.hash != coins[i].tx->GetHash()) return false;
+    }
+    return true;
+}
+
 bool CWallet::CreateCoinStake(
         const CBlockIndex* pindexPrev,
         unsigned int nBits,
@@ -3269,84 +3599,109 @@ bool CWallet::CreateCoinStake(
     pStakerStatus->SetLastTip(pindexPrev);
     pStakerStatus->SetLastCoins((int) availableCoins->size());
 
+    {
+        LOCK(cs_wallet);
+        // New block came in, move on
+        if (m_last_block_processed_height != pindexPrev->nHeight) return false;
+
+        // Remove the stake inputs spent since last check
+        availableCoins->erase(std::remove_if(availableCoins->begin(), availableCoins->end(),
+                [this](const CStakeableOutput& out) { return IsSpent(COutPoint(out.tx->GetHash(), out.i)); }),
+                availableCoins->end());
+    }
+
+    // Prepare the kernel search engine (once per tip and set of coins)
+    std::shared_ptr<CStakeKernelSearch> search;
+    if (CStakeKernelSearch::IsSupported(pindexPrev)) {
+        search = pStakerStatus->GetKernelSearch();
+        if (!search || !search->IsPreparedFor(pindexPrev, nBits) || !IsSameStakeSet(*search, *availableCoins)) {
+            search = std::make_shared<CStakeKernelSearch>(pindexPrev, nBits);
+            for (const CStakeableOutput& out : *availableCoins) {
+                search->AddCandidate(COutPoint(out.tx->GetHash(), out.i), out.pindex, out.tx->tx->vout[out.i].nValue);
+            }
+            pStakerStatus->SetKernelSearch(search);
+        }
+    }
+    nTxNewTime = (Params().IsRegTestNet() ? GetAdjustedTime() : GetCurrentTimeSlot());
+
     // Kernel Search
     CAmount nCredit;
-    CScript scriptPubKeyKernel;
     bool fKernelFound = false;
     int nAttempts = 0;
-    for (auto it = availableCoins->begin(); it != availableCoins->end();) {
-        COutPoint outPoint = COutPoint(it->tx->GetHash(), it->i);
-        CPivStake stakeInput(it->tx->tx->vout[it->i],
-                             outPoint,
-                             it->pindex);
-
+    const size_t nCoins = availableCoins->size();
+    size_t nPos = 0;
+    while (nPos < nCoins && !fKernelFound) {
         // New block came in, move on
         if (WITH_LOCK(cs_wallet, return m_last_block_processed_height) != pindexPrev->nHeight) return false;
 
         // Make sure the wallet is unlocked and shutdown hasn't been requested
         if (IsLocked() || ShutdownRequested()) return false;
 
-        // Make sure the stake input hasn't been spent since last check
-        if (WITH_LOCK(cs_wallet, return IsSpent(outPoint))) {
-            // remove it from the available coins
-            it = availableCoins->erase(it);
-            continue;
-        }
-
-        nCredit = 0;
-
-        nAttempts++;
-        fKernelFound = Stake(pindexPrev, &stakeInput, nBits, nTxNewTime);
+        const size_t nEnd = std::min(nPos + STAKE_SEARCH_BATCH_SIZE, nCoins);
+        while (nPos < nEnd) {
+            if (search) {
+                // Hash the batch, and only send the winner down the full Stake() path
+                const size_t nFound = search->FindKernel(nTxNewTime, nPos, nEnd);
+                nAttempts += nFound - nPos;
+                nPos = nFound;
+                if (nPos == nEnd) break;
+            }
 
-        // update staker status (time, attempts)
-        pStakerStatus->SetLastTime(nTxNewTime);
-        pStakerStatus->SetLastTries(nAttempts);
+            const CStakeableOutput& out = (*availableCoins)[nPos++];
+            CPivStake stakeInput(out.tx->tx->vout[out.i],
+                                 COutPoint(out.tx->GetHash(), out.i),
+                                 out.pindex);
+            nCredit = 0;
 
-        if (!fKernelFound) {
-            it++;
-            continue;
-        }
+            nAttempts++;
+            fKernelFound = Stake(pindexPrev, &stakeInput, nBits, nTxNewTime);
+            if (!fKernelFound) continue;
 
-        // Found a kernel
-        LogPrintf("CreateCoinStake : kernel found\n");
-        nCredit += stakeInput.GetValue();
+            // Found a kernel
+            LogPrintf("CreateCoinStake : kernel found\n");
+            nCredit += stakeInput.GetValue();
 
-        // Add block reward to the credit
-        nCredit += GetBlockValue(pindexPrev->nHeight + 1);
+            // Add block reward to the credit
+            nCredit += GetBlockValue(pindexPrev->nHeight + 1);
 
-        // Create the output transaction(s)
-        std::vector<CTxOut> vout;
-        if (!stakeInput.CreateTxOuts(this, vout, nCredit)) {
-            LogPrintf("%s : failed to create output\n", __func__);
-            it++;
-            continue;
-        }
-        txNew.vout.insert(txNew.vout.end(), vout.begin(), vout.end());
-
-        // Set output amount
-        int outputs = (int) txNew.vout.size() - 1;
-        CAmount nRemaining = nCredit;
-        if (outputs > 1) {
-            // Split the stake across the outputs
-            CAmount nShare = nRemaining / outputs;
-            for (int i = 1; i < outputs; i++) {
-                // loop through all but the last one.
-                txNew.vout[i].nValue = nShare;
-                nRemaining -= nShare;
+            // Create the output transaction(s)
+            std::vector<CTxOut> vout;
+            if (!stakeInput.CreateTxOuts(this, vout, nCredit)) {
+                LogPrintf("%s : failed to create output\n", __func__);
+                fKernelFound = false;
+                continue;
             }
-        }
-        // put the remaining on the last output (which all into the first if only one output)
-        txNew.vout[outputs].nValue += nRemaining;
+            txNew.vout.insert(txNew.vout.end(), vout.begin(), vout.end());
+
+            // Set output amount
+            int outputs = (int) txNew.vout.size() - 1;
+            CAmount nRemaining = nCredit;
+            if (outputs > 1) {
+                // Split the stake across the outputs
+                CAmount nShare = nRemaining / outputs;
+                for (int i = 1; i < outputs; i++) {
+                    // loop through all but the last one.
+                    txNew.vout[i].nValue = nShare;
+                    nRemaining -= nShare;
+                }
+            }
+            // put the remaining on the last output (which all into the first if only one output)
+            txNew.vout[outputs].nValue += nRemaining;
 
-        // Set coinstake input
-        txNew.vin.emplace_back(stakeInput.GetTxIn());
+            // Set coinstake input
+            txNew.vin.emplace_back(stakeInput.GetTxIn());
 
-        // Limit size
-        unsigned int nBytes = ::GetSerializeSize(txNew, SER_NETWORK, PROTOCOL_VERSION);
-        if (nBytes >= DEFAULT_BLOCK_MAX_SIZE / 5)
-            return error("%s : exceeded coinstake size limit", __func__);
+            // Limit size
+            unsigned int nBytes = ::GetSerializeSize(txNew, SER_NETWORK, PROTOCOL_VERSION);
+            if (nBytes >= DEFAULT_BLOCK_MAX_SIZE / 5)
+                return error("%s : exceeded coinstake size limit", __func__);
+
+            break;
+        }
 
-        break;
+        // update staker status (time, attempts)
+        pStakerStatus->SetLastTime(nTxNewTime);
+        pStakerStatus->SetLastTries(nAttempts);
     }
     LogPrint(BCLog::STAKING, "%s: attempted staking %d times\n", __func__, nAttempts);
 
@@ -4239,6 +4594,7 @@ CWallet* CWallet::CreateWalletFromFile(const std::string walletFile)
             walletInstance->m_last_block_processed = tip->GetBlockHash();
             walletInstance->m_last_block_processed_height = tip->nHeight;
             walletInstance->m_last_block_processed_time = tip->GetBlockTime();
+            walletInstance->RebuildStakeableCoins();
         }
     }
     RegisterValidationInterface(walletInstance);
@@ -10,6 +10,7 @@
 
 #include "addressbook.h"
 #include "amount.h"
+#include "blockfilter.h"
 #include "consensus/tx_verify.h"
 #include "consensus/validation.h"
 #include "crypter.h"
@@ -71,6 +72,8 @@ static const unsigned int MAX_FREE_TRANSACTION_CREATE_SIZE = 1000;
 static const int DEFAULT_CUSTOMBACKUPTHRESHOLD = 1;
 //! -minstakesplit default
 static const CAmount DEFAULT_MIN_STAKE_SPLIT_THRESHOLD = 100 * COIN;
+//! Number of stake candidates hashed between two checks of the staker state
+static const size_t STAKE_SEARCH_BATCH_SIZE = 1000;
 //! Default for -spendzeroconfchange
 static const bool DEFAULT_SPEND_ZEROCONF_CHANGE = true;
 //! Default for -staking
@@ -181,6 +184,8 @@ private:
     int64_t nTime{0};
     int nTries{0};
     int nCoins{0};
+    // kernel search engine prepared for the last tip
+    std::shared_ptr<CStakeKernelSearch> kernelSearch{nullptr};
 
 public:
     // Get
@@ -190,13 +195,16 @@ public:
     int GetLastCoins() const { return nCoins; }
     int GetLastTries() const { return nTries; }
     int64_t GetLastTime() const { return nTime; }
+    std::shared_ptr<CStakeKernelSearch> GetKernelSearch() const { return kernelSearch; }
     // Set
     void SetLastCoins(const int coins) { nCoins = coins; }
     void SetLastTries(const int tries) { nTries = tries; }
     void SetLastTip(const CBlockIndex* lastTip) { tipBlock = lastTip; }
     void SetLastTime(const uint64_t lastTime) { nTime = lastTime; }
+    void SetKernelSearch(std::shared_ptr<CStakeKernelSearch> search) { kernelSearch = std::move(search); }
     void SetNull()
     {
+        SetKernelSearch(nullptr);
         SetLastCoins(0);
         SetLastTries(0);
         SetLastTip(nullptr);
@@ -262,6 +270,7 @@ private:
 template <class T>
 using TxSpendMap = std::multimap<T, uint256>;
 typedef std::map<SaplingOutPoint, SaplingNoteData> mapSaplingNoteData_t;
+typedef std::pair<mapSaplingNoteData_t, SaplingIncomingViewingKeyMap> SaplingNotesFound;
 
 typedef std::map<std::string, std::string> mapValue_t;
 
@@ -624,15 +633,34 @@ private:
     void AddToSpends(const COutPoint& outpoint, const uint256& wtxid);
     void AddToSpends(const uint256& wtxid);
 
+    /**
+     * Stakeable outputs index: confirmed and unspent outputs that the wallet can stake
+     * (spendable or P2CS with the staking key). Kept up to date from AddToWallet, the spend
+     * tracking and the block notifications, so the staker doesn't need to walk mapWallet.
+     * Depth and maturity are derived from the confirmation height when read.
+     */
+    struct StakeableCoin {
+        const CWalletTx* wtx{nullptr};
+        const CBlockIndex* pindex{nullptr};     // block of the tx (resolved lazily when unknown)
+        bool fCold{false};                      // P2CS output, staked on behalf of a delegator
+    };
+    std::map<COutPoint, StakeableCoin> mapStakeableCoins GUARDED_BY(cs_wallet);
+    void UpdateStakeableCoins(const CWalletTx& wtx, const CBlockIndex* pindex = nullptr);
+    void UpdateStakeableCoinsSpentBy(const CWalletTx& wtx);
+
     /* Mark a transaction (and its in-wallet descendants) as conflicting with a particular block. */
     void MarkConflicted(const uint256& hashBlock, int conflicting_height, const uint256& hashTx);
 
     template <class T>
     void SyncMetaData(std::pair<typename TxSpendMap<T>::iterator, typename TxSpendMap<T>::iterator> range);
-    void ChainTipAdded(const CBlockIndex *pindex, const CBlock *pblock, SaplingMerkleTree saplingTree);
+    void ChainTipAdded(const CBlockIndex *pindex, const CBlock *pblock, SaplingMerkleTree& saplingTree);
+    /* Whether the block has a wallet transaction, or spends an output of one. Requires cs_wallet. */
+    bool IsBlockTouchingWallet(const CBlock& block) const;
+    /* Elements to match against the basic block filters: our scripts, outpoints and nullifiers. Requires cs_wallet. */
+    GCSFilter::ElementSet GetBlockFilterElements() const;
 
     /* Used by TransactionAddedToMemorypool/BlockConnected/Disconnected */
-    void SyncTransaction(const CTransactionRef& tx, const CWalletTx::Confirmation& confirm);
+    void SyncTransaction(const CTransactionRef& tx, const CWalletTx::Confirmation& confirm, const SaplingNotesFound* pSaplingNotes = nullptr);
 
     bool IsKeyUsed(const CPubKey& vchPubKey);
 
@@ -894,8 +922,12 @@ public:
 
     //////////// Sapling //////////////////
 
-    // Search for notes and addresses from this wallet in the tx, and add the addresses --> IVK mapping to the keystore if missing.
-    bool FindNotesDataAndAddMissingIVKToKeystore(const CTransaction& tx, Optional<mapSaplingNoteData_t>& saplingNoteData);
+    // Search for notes and addresses from this wallet in the tx (unless already found, see TrialDecryptSaplingNotes),
+    // and add the addresses --> IVK mapping to the keystore if missing.
+    bool FindNotesDataAndAddMissingIVKToKeystore(const CTransaction& tx, Optional<mapSaplingNoteData_t>& saplingNoteData,
+                                                 const SaplingNotesFound* pSaplingNotes = nullptr);
+    // Trial-decrypt the shielded outputs of the transactions, before taking cs_wallet (nothing if the wallet has no Sapling keys)
+    std::vector<SaplingNotesFound> TrialDecryptSaplingNotes(const std::vector<CTransactionRef>& vtx) const;
     // Decrypt sapling output notes with the inputs ovk and updates saplingNoteDataMap
     void AddExternalNotesDataToTx(CWalletTx& wtx) const;
 
@@ -992,10 +1024,13 @@ public:
     void MarkDirty();
     bool AddToWallet(const CWalletTx& wtxIn, bool fFlushOnClose = true);
     bool LoadToWallet(CWalletTx& wtxIn);
+    //! Rebuild the stakeable outputs index once the wallet is loaded (requires cs_main)
+    void RebuildStakeableCoins();
     void TransactionAddedToMempool(const CTransactionRef& tx) override;
     void BlockConnected(const std::shared_ptr<const CBlock>& pblock, const CBlockIndex *pindex) override;
     void BlockDisconnected(const std::shared_ptr<const CBlock>& pblock, const uint256& blockHash, int nBlockHeight, int64_t blockTime) override;
-    bool AddToWalletIfInvolvingMe(const CTransactionRef& tx, const CWalletTx::Confirmation& confirm, bool fUpdate);
+    bool AddToWalletIfInvolvingMe(const CTransactionRef& tx, const CWalletTx::Confirmation& confirm, bool fUpdate,
+                                  const SaplingNotesFound* pSaplingNotes = nullptr);
     void EraseFromWallet(const uint256& hash);
 
     /**